@@ -1,8 +1,14 @@
 #include "argument_parsing.h"
+#include "bandwidth_governor.h"
 #include "directory_management.h"
+#include "download_jobs.h"
 #include "help_display.h"
+#include "playlist.h"
+#include "range_download.h"
 
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
 #include <limits.h>
 #include <stdint.h>
@@ -10,6 +16,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Upper bounds for the per-command limit options
+#define MAX_LIMIT_SECONDS (7UL * 24 * 60 * 60)
+#define MAX_LIMIT_MEMORY_MB (1024UL * 1024)
+
 /**
  * Secure string duplication with overflow protection and length validation.
  * @param s Source string to duplicate
@@ -52,6 +62,71 @@ secure_strdup (const char *s, size_t max_len)
   return new_str;
 }
 
+/**
+ * Parse a positive decimal limit given on the command line.
+ * @param name Option name (for error messages)
+ * @param text Option argument
+ * @param max Largest accepted value
+ * @param value Receives the parsed value
+ * @return 0 on success, -1 on error
+ */
+static int
+parse_limit (const char *name, const char *text, unsigned long max,
+             unsigned long *value)
+{
+  char *end = NULL;
+  errno = 0;
+  unsigned long parsed = strtoul (text, &end, 10);
+  if (errno != 0 || end == text || *end != '\0' || text[0] == '-'
+      || parsed == 0 || parsed > max)
+    {
+      fprintf (stderr, "Error: Invalid value for --%s: %s (1-%lu)\n", name,
+               text, max);
+      return -1;
+    }
+  *value = parsed;
+  return 0;
+}
+
+/**
+ * Validate a format selector given on the command line. yt-dlp's selector
+ * syntax (e.g. "bestvideo[height<=720]+bestaudio/best") is passed through
+ * as one argument, so only blanks and control characters are refused.
+ * @param selector Option argument
+ * @return 0 if valid, -1 if invalid
+ */
+static int
+validate_format_selector (const char *selector)
+{
+  size_t len = strlen (selector);
+  if (len == 0 || len >= FORMAT_SELECTOR_LENGTH)
+    {
+      fprintf (stderr, "Error: Invalid format length (1-%d characters)\n",
+               FORMAT_SELECTOR_LENGTH - 1);
+      return -1;
+    }
+
+  // A leading dash would be read by yt-dlp as another option
+  if (selector[0] == '-')
+    {
+      fprintf (stderr, "Error: Format must not start with '-'\n");
+      return -1;
+    }
+
+  for (size_t i = 0; i < len; i++)
+    {
+      unsigned char c = (unsigned char)selector[i];
+      if (!isgraph (c))
+        {
+          fprintf (stderr, "Error: Format contains invalid character 0x%02x\n",
+                   c);
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
 /**
  * Parse command line arguments and populate configuration structure.
  * @param argc Argument count
@@ -68,14 +143,50 @@ parse_arguments (int argc, char *argv[], Config *config)
       return EXIT_FAILURE;
     }
 
-  struct option long_options[] = { { "help", no_argument, 0, 'h' },
-                                   { "output", required_argument, 0, 'o' },
-                                   { 0, 0, 0, 0 } };
+  enum
+  {
+    OPT_MAX_MEMORY = 256,
+    OPT_MAX_CPU,
+    OPT_ZYGOTE,
+    OPT_STATS,
+    OPT_LEAN,
+    OPT_CACHE_TTL,
+    OPT_NO_CACHE,
+    OPT_ARCHIVE,
+    OPT_PLAYLIST,
+    OPT_LIST_SHARDS,
+    OPT_JOURNAL,
+    OPT_CONNECTIONS
+  };
+  struct option long_options[]
+      = { { "help", no_argument, 0, 'h' },
+          { "output", required_argument, 0, 'o' },
+          { "format", required_argument, 0, 'f' },
+          { "timeout", required_argument, 0, 't' },
+          { "max-memory", required_argument, 0, OPT_MAX_MEMORY },
+          { "max-cpu", required_argument, 0, OPT_MAX_CPU },
+          { "zygote", no_argument, 0, OPT_ZYGOTE },
+          { "stats", no_argument, 0, OPT_STATS },
+          { "lean", no_argument, 0, OPT_LEAN },
+          { "cache-ttl", required_argument, 0, OPT_CACHE_TTL },
+          { "no-cache", no_argument, 0, OPT_NO_CACHE },
+          { "archive", required_argument, 0, OPT_ARCHIVE },
+          { "playlist", no_argument, 0, OPT_PLAYLIST },
+          { "list-shards", required_argument, 0, OPT_LIST_SHARDS },
+          { "jobs", required_argument, 0, 'j' },
+          { "batch-file", required_argument, 0, 'a' },
+          { "limit-rate", required_argument, 0, 'r' },
+          { "journal", required_argument, 0, OPT_JOURNAL },
+          { "connections", required_argument, 0, OPT_CONNECTIONS },
+          { 0, 0, 0, 0 } };
 
   int opt;
+  unsigned long limit;
   opterr = 0; // Suppress getopt error messages for cleaner output
 
-  while ((opt = getopt_long (argc, argv, "ho:", long_options, NULL)) != -1)
+  while ((opt = getopt_long (argc, argv, "ho:f:t:j:a:r:", long_options,
+                             NULL))
+         != -1)
     {
       switch (opt)
         {
@@ -89,6 +200,139 @@ parse_arguments (int argc, char *argv[], Config *config)
               return EXIT_FAILURE;
             }
           break;
+        case 'f':
+          if (validate_format_selector (optarg) == -1)
+            {
+              return EXIT_FAILURE;
+            }
+          free (config->format_selector);
+          config->format_selector
+              = secure_strdup (optarg, FORMAT_SELECTOR_LENGTH);
+          if (config->format_selector == NULL)
+            {
+              return EXIT_FAILURE;
+            }
+          break;
+        case 't':
+          if (parse_limit ("timeout", optarg, MAX_LIMIT_SECONDS, &limit) == -1)
+            {
+              return EXIT_FAILURE;
+            }
+          config->timeout_seconds = (long)limit;
+          break;
+        case OPT_MAX_MEMORY:
+          if (parse_limit ("max-memory", optarg, MAX_LIMIT_MEMORY_MB,
+                           &config->max_memory_mb)
+              == -1)
+            {
+              return EXIT_FAILURE;
+            }
+          break;
+        case OPT_MAX_CPU:
+          if (parse_limit ("max-cpu", optarg, MAX_LIMIT_SECONDS,
+                           &config->max_cpu_seconds)
+              == -1)
+            {
+              return EXIT_FAILURE;
+            }
+          break;
+        case OPT_ZYGOTE:
+          config->use_zygote = 1;
+          break;
+        case OPT_STATS:
+          config->show_stats = 1;
+          break;
+        case OPT_LEAN:
+          config->lean_metadata = 1;
+          break;
+        case OPT_CACHE_TTL:
+          if (parse_limit ("cache-ttl", optarg, MAX_LIMIT_SECONDS, &limit)
+              == -1)
+            {
+              return EXIT_FAILURE;
+            }
+          config->cache_ttl_seconds = (long)limit;
+          break;
+        case OPT_NO_CACHE:
+          config->cache_ttl_seconds = 0;
+          break;
+        case OPT_PLAYLIST:
+          config->force_playlist = 1;
+          break;
+        case OPT_LIST_SHARDS:
+          if (parse_limit ("list-shards", optarg, PLAYLIST_MAX_SHARDS,
+                           &config->list_shards)
+              == -1)
+            {
+              return EXIT_FAILURE;
+            }
+          break;
+        case 'j':
+          if (parse_limit ("jobs", optarg, MAX_DOWNLOAD_JOBS, &config->jobs)
+              == -1)
+            {
+              return EXIT_FAILURE;
+            }
+          break;
+        case 'a':
+          free (config->batch_file);
+          config->batch_file = secure_strdup (optarg, MAX_PATH_LENGTH);
+          if (config->batch_file == NULL)
+            {
+              return EXIT_FAILURE;
+            }
+          break;
+        case 'r':
+          {
+            RateSchedule schedule;
+            if (parse_rate_schedule (optarg, &schedule) != 0)
+              {
+                return EXIT_FAILURE;
+              }
+            free (config->rate_limit);
+            config->rate_limit = secure_strdup (optarg, BUFFER_SIZE);
+            if (config->rate_limit == NULL)
+              {
+                return EXIT_FAILURE;
+              }
+            break;
+          }
+        case OPT_JOURNAL:
+          free (config->journal_path);
+          config->journal_path = secure_strdup (optarg, MAX_PATH_LENGTH);
+          if (config->journal_path == NULL)
+            {
+              return EXIT_FAILURE;
+            }
+          break;
+        case OPT_ARCHIVE:
+#if USE_ZSTD
+          free (config->archive_path);
+          config->archive_path = secure_strdup (optarg, MAX_PATH_LENGTH);
+          if (config->archive_path == NULL)
+            {
+              return EXIT_FAILURE;
+            }
+          break;
+#else
+          fprintf (stderr, "Error: --archive needs a build with zstd "
+                           "(make USE_ZSTD=1)\n");
+          return EXIT_FAILURE;
+#endif
+        case OPT_CONNECTIONS:
+#if USE_CURL
+          if (parse_limit ("connections", optarg, RANGE_MAX_CONNECTIONS,
+                           &config->connections)
+              == -1)
+            {
+              return EXIT_FAILURE;
+            }
+          break;
+#else
+          fprintf (stderr, "Error: --connections needs a build with libcurl "
+                           "(make USE_CURL=1)\n");
+          return EXIT_FAILURE;
+#endif
         case '?':
           fprintf (stderr, "Error: Unknown option or missing argument\n");
           display_help ();
@@ -99,19 +343,24 @@ parse_arguments (int argc, char *argv[], Config *config)
         }
     }
 
-  // Validate URL argument
+  // Validate URL arguments; several are fetched as one batch
   if (optind < argc)
     {
-      size_t url_len = strlen (argv[optind]);
-      if (url_len >= MAX_URL_LENGTH)
+      for (int i = optind; i < argc; i++)
         {
-          fprintf (stderr, "Error: URL too long (max %d characters)\n",
-                   MAX_URL_LENGTH - 1);
-          return EXIT_FAILURE;
+          size_t url_len = strlen (argv[i]);
+          if (url_len >= MAX_URL_LENGTH)
+            {
+              fprintf (stderr, "Error: URL too long (max %d characters)\n",
+                       MAX_URL_LENGTH - 1);
+              return EXIT_FAILURE;
+            }
         }
       config->url = argv[optind];
+      config->urls = &argv[optind];
+      config->url_count = (size_t)(argc - optind);
     }
-  else
+  else if (config->batch_file == NULL && config->journal_path == NULL)
     {
       fprintf (stderr, "Error: URL is required\n");
       display_help ();
@@ -0,0 +1,590 @@
+#define _GNU_SOURCE
+#include "bandwidth_governor.h"
+#include "util.h"
+
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Longest burst a child may take at once, in milliseconds of its share
+#define GOVERNOR_BURST_MS 250
+// Room a child that is not using its whole share gets to speed up
+#define GOVERNOR_HEADROOM 1.25
+// Share no running child is pushed below, in bytes per second
+#define GOVERNOR_MIN_SHARE (64 * 1024)
+// Largest rate accepted, in bytes per second
+#define RATE_MAX (1LL << 40)
+// Longest "HH:MM=RATE" item of a schedule
+#define RATE_ITEM_MAX 64
+
+// One yt-dlp run under the governor. The run leads its own process group,
+// so pausing the group pauses ffmpeg and friends with it.
+typedef struct
+{
+  pid_t pid;                // 0 for a free slot
+  long long share;          // bytes per second allotted
+  double tokens;            // bytes it may still take; negative means owed
+  long long position;       // bytes of the current stream reported so far
+  long long interval_bytes; // bytes since the last rebalance
+  double rate;              // smoothed observed rate, -1 until measured
+  int fresh;                // joined since the last rebalance
+  int throttled;            // ran out of tokens since the last rebalance
+  int stopped;              // paused with SIGSTOP
+} GovernedChild;
+
+struct BandwidthGovernor
+{
+  RateSchedule schedule;
+  long long budget; // rate in effect, 0 for unlimited
+  GovernedChild *children;
+  size_t capacity;
+  double *demand; // scratch for rebalance(), capacity entries
+  size_t *order;  // scratch for rebalance(), capacity entries
+  double last_tick_ms;
+  double last_rebalance_ms;
+  int rebalance_pending; // a child joined or left
+};
+
+/**
+ * Parse a rate such as "50M", "1.5G" or "800Mbit". K, M and G count 1024s
+ * of bytes per second, as in yt-dlp's --limit-rate; with "bit" appended
+ * they count 1000s of bits, as network links are rated. The number is
+ * parsed by hand so that the user's LC_NUMERIC does not matter.
+ * @param text Rate text
+ * @param rate Receives the rate in bytes per second (0 is accepted)
+ * @return 0 on success, -1 if the text is not a rate
+ */
+int
+parse_rate (const char *text, long long *rate)
+{
+  double value = 0.0;
+  const char *p = text;
+  while (*p >= '0' && *p <= '9')
+    {
+      value = value * 10.0 + (*p++ - '0');
+    }
+  if (p == text)
+    {
+      return -1;
+    }
+  if (*p == '.')
+    {
+      double scale = 0.1;
+      for (p++; *p >= '0' && *p <= '9'; p++)
+        {
+          value += (*p - '0') * scale;
+          scale /= 10.0;
+        }
+    }
+
+  int power = 0;
+  const char *prefix = strchr ("KMG", toupper ((unsigned char)*p));
+  if (*p != '\0' && prefix != NULL)
+    {
+      power = (int)(prefix - "KMG") + 1;
+      p++;
+    }
+  int bits = strcasecmp (p, "bit") == 0;
+  if (!bits && *p != '\0')
+    {
+      return -1;
+    }
+
+  for (int i = 0; i < power; i++)
+    {
+      value *= bits ? 1000.0 : 1024.0;
+    }
+  if (bits)
+    {
+      value /= 8.0;
+    }
+  if (value > (double)RATE_MAX)
+    {
+      return -1;
+    }
+  *rate = (long long)value;
+  return 0;
+}
+
+/**
+ * Sort profiles by start time (insertion sort; there are at most
+ * RATE_MAX_PROFILES).
+ * @param schedule Schedule to sort
+ */
+static void
+sort_profiles (RateSchedule *schedule)
+{
+  for (size_t i = 1; i < schedule->profile_count; i++)
+    {
+      RateProfile profile = schedule->profiles[i];
+      size_t j = i;
+      while (j > 0 && schedule->profiles[j - 1].start_minute
+                          > profile.start_minute)
+        {
+          schedule->profiles[j] = schedule->profiles[j - 1];
+          j--;
+        }
+      schedule->profiles[j] = profile;
+    }
+}
+
+/**
+ * Parse one "HH:MM=RATE" schedule item.
+ * @param item Item text (NUL-terminated)
+ * @param profile Receives the profile
+ * @return 0 on success, -1 if malformed
+ */
+static int
+parse_profile (const char *item, RateProfile *profile)
+{
+  const char *p = item;
+  if (!isdigit ((unsigned char)p[0]) || !isdigit ((unsigned char)p[1])
+      || p[2] != ':' || !isdigit ((unsigned char)p[3])
+      || !isdigit ((unsigned char)p[4]) || p[5] != '=')
+    {
+      return -1;
+    }
+  int hours = (p[0] - '0') * 10 + (p[1] - '0');
+  int minutes = (p[3] - '0') * 10 + (p[4] - '0');
+  if (hours > 23 || minutes > 59)
+    {
+      return -1;
+    }
+  profile->start_minute = hours * 60 + minutes;
+  return parse_rate (p + 6, &profile->rate);
+}
+
+/**
+ * Parse a --limit-rate argument: one rate, or comma-separated
+ * "HH:MM=RATE" profiles that each hold from their local time of day until
+ * the next one's (the last one wraps past midnight). A rate of 0 lifts
+ * the cap for that part of the day.
+ * @param text Argument text
+ * @param schedule Receives the schedule
+ * @return 0 on success, -1 on error
+ */
+int
+parse_rate_schedule (const char *text, RateSchedule *schedule)
+{
+  memset (schedule, 0, sizeof (RateSchedule));
+  if (strchr (text, '=') == NULL)
+    {
+      schedule->profile_count = 1;
+      if (parse_rate (text, &schedule->profiles[0].rate) != 0
+          || schedule->profiles[0].rate == 0)
+        {
+          fprintf (stderr, "Error: Invalid rate: %s (e.g. 50M or 800Mbit)\n",
+                   text);
+          return -1;
+        }
+      return 0;
+    }
+
+  const char *item = text;
+  for (;;)
+    {
+      size_t length = strcspn (item, ",");
+      char buffer[RATE_ITEM_MAX];
+      if (schedule->profile_count == RATE_MAX_PROFILES
+          || length >= sizeof (buffer))
+        {
+          fprintf (stderr, "Error: Rate schedule has too many or too long "
+                           "items (at most %d)\n",
+                   RATE_MAX_PROFILES);
+          return -1;
+        }
+      memcpy (buffer, item, length);
+      buffer[length] = '\0';
+
+      RateProfile *profile = &schedule->profiles[schedule->profile_count];
+      if (parse_profile (buffer, profile) != 0)
+        {
+          fprintf (stderr, "Error: Invalid rate schedule item: %s "
+                           "(e.g. 08:00=200Mbit)\n",
+                   buffer);
+          return -1;
+        }
+      for (size_t i = 0; i < schedule->profile_count; i++)
+        {
+          if (schedule->profiles[i].start_minute == profile->start_minute)
+            {
+              fprintf (stderr, "Error: Rate schedule repeats %s\n", buffer);
+              return -1;
+            }
+        }
+      schedule->profile_count++;
+
+      if (item[length] == '\0')
+        {
+          break;
+        }
+      item += length + 1;
+    }
+
+  sort_profiles (schedule);
+  return 0;
+}
+
+/**
+ * Rate in effect at a given time.
+ * @param schedule Schedule
+ * @param now Wall-clock time
+ * @return Bytes per second, 0 for unlimited
+ */
+long long
+rate_schedule_current (const RateSchedule *schedule, time_t now)
+{
+  if (schedule->profile_count == 0)
+    {
+      return 0;
+    }
+  if (schedule->profile_count == 1)
+    {
+      return schedule->profiles[0].rate;
+    }
+
+  struct tm local;
+  localtime_r (&now, &local);
+  int minute = local.tm_hour * 60 + local.tm_min;
+
+  // Before the first profile of the day, yesterday's last one still holds
+  const RateProfile *current
+      = &schedule->profiles[schedule->profile_count - 1];
+  for (size_t i = 0; i < schedule->profile_count; i++)
+    {
+      if (schedule->profiles[i].start_minute <= minute)
+        {
+          current = &schedule->profiles[i];
+        }
+    }
+  return current->rate;
+}
+
+/**
+ * Create a governor for up to max_children concurrent runs.
+ * @param schedule Combined rate to enforce (copied)
+ * @param max_children Most runs governed at once
+ * @return Governor, NULL on error
+ */
+BandwidthGovernor *
+governor_create (const RateSchedule *schedule, size_t max_children)
+{
+  BandwidthGovernor *governor = calloc (1, sizeof (BandwidthGovernor));
+  if (governor == NULL)
+    {
+      perror ("calloc");
+      return NULL;
+    }
+  governor->children = calloc (max_children, sizeof (GovernedChild));
+  governor->demand = calloc (max_children, sizeof (double));
+  governor->order = calloc (max_children, sizeof (size_t));
+  if (governor->children == NULL || governor->demand == NULL
+      || governor->order == NULL)
+    {
+      perror ("calloc");
+      governor_destroy (governor);
+      return NULL;
+    }
+  governor->schedule = *schedule;
+  governor->capacity = max_children;
+  governor->budget = rate_schedule_current (schedule, time (NULL));
+  governor->last_tick_ms = monotonic_ms ();
+  governor->last_rebalance_ms = governor->last_tick_ms;
+  return governor;
+}
+
+/**
+ * Destroy a governor, resuming whatever it paused.
+ * @param governor Governor to destroy (can be NULL)
+ */
+void
+governor_destroy (BandwidthGovernor *governor)
+{
+  if (governor == NULL)
+    {
+      return;
+    }
+  if (governor->children != NULL)
+    {
+      governor_resume_all (governor);
+    }
+  free (governor->order);
+  free (governor->demand);
+  free (governor->children);
+  free (governor);
+}
+
+/**
+ * Rate currently enforced, which also serves as each run's own
+ * --limit-rate: no single run can outpace the whole budget between ticks.
+ * @param governor Governor
+ * @return Bytes per second, 0 for unlimited
+ */
+long long
+governor_budget (const BandwidthGovernor *governor)
+{
+  return governor->budget;
+}
+
+/**
+ * Pause a child's process group.
+ * @param child Running child
+ */
+static void
+pause_child (GovernedChild *child)
+{
+  child->throttled = 1;
+  if (!child->stopped && kill (-child->pid, SIGSTOP) == 0)
+    {
+      child->stopped = 1;
+    }
+}
+
+/**
+ * Resume a paused child's process group.
+ * @param child Child
+ */
+static void
+resume_child (GovernedChild *child)
+{
+  if (child->stopped)
+    {
+      kill (-child->pid, SIGCONT);
+      child->stopped = 0;
+    }
+}
+
+/**
+ * Record a run's progress, taking the bytes from its bucket. A run that
+ * has overdrawn its bucket is paused until governor_tick() has refilled
+ * it. A run not seen before joins the governed set.
+ * @param governor Governor
+ * @param pid Process (group) of the run
+ * @param stream_bytes Bytes of the stream being downloaded, as in its
+ *                     latest progress line; counting restarts with each
+ *                     stream (video, then audio)
+ */
+void
+governor_report (BandwidthGovernor *governor, pid_t pid,
+                 long long stream_bytes)
+{
+  if (pid <= 0 || stream_bytes < 0)
+    {
+      return;
+    }
+
+  GovernedChild *child = NULL;
+  GovernedChild *free_slot = NULL;
+  for (size_t i = 0; i < governor->capacity && child == NULL; i++)
+    {
+      if (governor->children[i].pid == pid)
+        {
+          child = &governor->children[i];
+        }
+      else if (governor->children[i].pid == 0 && free_slot == NULL)
+        {
+          free_slot = &governor->children[i];
+        }
+    }
+  if (child == NULL)
+    {
+      if (free_slot == NULL)
+        {
+          return;
+        }
+      child = free_slot;
+      memset (child, 0, sizeof (GovernedChild));
+      child->pid = pid;
+      child->rate = -1.0;
+      child->fresh = 1;
+      governor->rebalance_pending = 1;
+    }
+
+  if (stream_bytes < child->position)
+    {
+      child->position = 0;
+    }
+  long long delta = stream_bytes - child->position;
+  child->position = stream_bytes;
+  child->interval_bytes += delta;
+
+  if (governor->budget > 0 && !child->fresh)
+    {
+      child->tokens -= (double)delta;
+      if (child->tokens < 0)
+        {
+          pause_child (child);
+        }
+    }
+}
+
+/**
+ * Drop a run that has finished.
+ * @param governor Governor
+ * @param pid Process (group) of the run
+ */
+void
+governor_forget (BandwidthGovernor *governor, pid_t pid)
+{
+  for (size_t i = 0; i < governor->capacity; i++)
+    {
+      GovernedChild *child = &governor->children[i];
+      if (pid > 0 && child->pid == pid)
+        {
+          resume_child (child);
+          child->pid = 0;
+          governor->rebalance_pending = 1;
+        }
+    }
+}
+
+/**
+ * Recompute the shares by water-filling: runs that used less than an even
+ * split last interval (and were never held back) get what they used plus
+ * headroom, and the rest of the budget is split evenly among the runs that
+ * hit their limit. Whatever is still left over is spread over everyone.
+ * @param governor Governor
+ * @param now Monotonic time in milliseconds
+ */
+static void
+rebalance (BandwidthGovernor *governor, double now)
+{
+  double elapsed = now - governor->last_rebalance_ms;
+  governor->last_rebalance_ms = now;
+  governor->rebalance_pending = 0;
+  governor->budget = rate_schedule_current (&governor->schedule, time (NULL));
+
+  size_t count = 0;
+  for (size_t i = 0; i < governor->capacity; i++)
+    {
+      GovernedChild *child = &governor->children[i];
+      if (child->pid == 0)
+        {
+          continue;
+        }
+      if (child->fresh)
+        {
+          // Not measured over a whole interval yet
+          child->fresh = 0;
+        }
+      else if (elapsed > 0)
+        {
+          double observed = (double)child->interval_bytes * 1e3 / elapsed;
+          child->rate
+              = child->rate < 0 ? observed : (child->rate + observed) / 2.0;
+        }
+      child->interval_bytes = 0;
+
+      double demand = -1.0; // unbounded
+      if (child->rate >= 0 && !child->throttled)
+        {
+          demand = child->rate * GOVERNOR_HEADROOM;
+          if (demand < GOVERNOR_MIN_SHARE)
+            {
+              demand = GOVERNOR_MIN_SHARE;
+            }
+        }
+      child->throttled = 0;
+
+      // Insert in order of demand, unbounded last
+      size_t j = count++;
+      while (j > 0)
+        {
+          double previous = governor->demand[governor->order[j - 1]];
+          if (previous < 0 || (demand >= 0 && previous > demand))
+            {
+              governor->order[j] = governor->order[j - 1];
+              j--;
+            }
+          else
+            {
+              break;
+            }
+        }
+      governor->order[j] = i;
+      governor->demand[i] = demand;
+    }
+  if (count == 0 || governor->budget == 0)
+    {
+      return;
+    }
+
+  double remaining = (double)governor->budget;
+  for (size_t k = 0; k < count; k++)
+    {
+      size_t i = governor->order[k];
+      double fair = remaining / (double)(count - k);
+      double demand = governor->demand[i];
+      double share = demand >= 0 && demand < fair ? demand : fair;
+      governor->children[i].share = (long long)share;
+      remaining -= share;
+    }
+  for (size_t k = 0; k < count; k++)
+    {
+      governor->children[governor->order[k]].share
+          += (long long)(remaining / (double)count);
+    }
+}
+
+/**
+ * Refill every bucket for the time since the last tick, resume runs that
+ * are out of debt and rebalance when due. Call at least every
+ * GOVERNOR_TICK_MS while runs are active.
+ * @param governor Governor
+ */
+void
+governor_tick (BandwidthGovernor *governor)
+{
+  double now = monotonic_ms ();
+  double elapsed = now - governor->last_tick_ms;
+  governor->last_tick_ms = now;
+  if (governor->rebalance_pending
+      || now - governor->last_rebalance_ms >= GOVERNOR_REBALANCE_MS)
+    {
+      rebalance (governor, now);
+    }
+
+  for (size_t i = 0; i < governor->capacity; i++)
+    {
+      GovernedChild *child = &governor->children[i];
+      if (child->pid == 0)
+        {
+          continue;
+        }
+      if (governor->budget == 0)
+        {
+          resume_child (child);
+          continue;
+        }
+
+      double burst = (double)child->share * GOVERNOR_BURST_MS / 1e3;
+      child->tokens += (double)child->share * elapsed / 1e3;
+      if (child->tokens > burst)
+        {
+          child->tokens = burst;
+        }
+      if (child->stopped && child->tokens >= 0)
+        {
+          resume_child (child);
+        }
+    }
+}
+
+/**
+ * Resume every paused run, e.g. so that they can act on SIGTERM.
+ * @param governor Governor
+ */
+void
+governor_resume_all (BandwidthGovernor *governor)
+{
+  for (size_t i = 0; i < governor->capacity; i++)
+    {
+      if (governor->children[i].pid != 0)
+        {
+          resume_child (&governor->children[i]);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef BANDWIDTH_GOVERNOR_H
+#define BANDWIDTH_GOVERNOR_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+// Most time-of-day profiles in a rate schedule
+#define RATE_MAX_PROFILES 8
+// How often the governor refills buckets and pauses or resumes children
+#define GOVERNOR_TICK_MS 50
+// How often shares are recomputed from the observed rates
+#define GOVERNOR_REBALANCE_MS 500
+
+// A rate in effect from a local time of day until the next profile's
+typedef struct
+{
+  int start_minute; // minutes after midnight
+  long long rate;   // bytes per second, 0 for unlimited
+} RateProfile;
+
+// Combined download rate: one flat rate, or profiles by time of day
+typedef struct
+{
+  RateProfile profiles[RATE_MAX_PROFILES]; // sorted by start_minute
+  size_t profile_count;
+} RateSchedule;
+
+// Token-bucket governor sharing one rate among concurrent yt-dlp runs
+typedef struct BandwidthGovernor BandwidthGovernor;
+
+// clang-format off
+int parse_rate(const char *text, long long *rate);
+int parse_rate_schedule(const char *text, RateSchedule *schedule);
+long long rate_schedule_current(const RateSchedule *schedule, time_t now);
+BandwidthGovernor *governor_create(const RateSchedule *schedule, size_t max_children);
+void governor_destroy(BandwidthGovernor *governor);
+long long governor_budget(const BandwidthGovernor *governor);
+void governor_report(BandwidthGovernor *governor, pid_t pid, long long stream_bytes);
+void governor_forget(BandwidthGovernor *governor, pid_t pid);
+void governor_tick(BandwidthGovernor *governor);
+void governor_resume_all(BandwidthGovernor *governor);
+// clang-format on
+
+#endif
@@ -0,0 +1,121 @@
+/**
+ * batch_info_bench.c
+ *
+ * Measures how long ytdl takes to get the format tables of several videos,
+ * running the same yt-dlp commands ytdl does:
+ *
+ *   single  get_video_info() once per URL: one `yt-dlp -j URL` each, so
+ *           interpreter startup and extractor setup are paid per video
+ *   batch   get_video_info_batch(): one `yt-dlp -j URL...`, its output
+ *           split into lines as it arrives and parsed on worker threads
+ *
+ * The metadata cache is disabled so that every sample runs yt-dlp.
+ *
+ * Usage: bench/batch_info_bench ITERATIONS URL...
+ */
+
+#define _GNU_SOURCE
+#include "../metadata_cache.h"
+#include "../video_info.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static double
+now_ms (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/**
+ * Release what one sample fetched.
+ * @return Number of videos that had a table
+ */
+static size_t
+release_entries (VideoInfoEntry *entries, size_t count)
+{
+  size_t found = 0;
+  for (size_t i = 0; i < count; i++)
+    {
+      found += entries[i].table != NULL;
+      free_format_table (entries[i].table);
+      entries[i].table = NULL;
+      if (entries[i].info_json_fd >= 0)
+        {
+          close (entries[i].info_json_fd);
+          entries[i].info_json_fd = -1;
+        }
+    }
+  return found;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 2 ? atoi (argv[1]) : 0;
+  if (iterations <= 0)
+    {
+      fprintf (stderr, "Usage: %s ITERATIONS URL...\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  size_t count = (size_t)(argc - 2);
+  VideoInfoEntry *entries = calloc (count, sizeof (VideoInfoEntry));
+  if (entries == NULL)
+    {
+      perror ("calloc");
+      return EXIT_FAILURE;
+    }
+  for (size_t i = 0; i < count; i++)
+    {
+      entries[i].url = argv[i + 2];
+      entries[i].info_json_fd = -1;
+    }
+
+  MetadataCacheSettings cache = { .ttl_seconds = 0 };
+  configure_metadata_cache (&cache);
+
+  // Progress messages go to stdout; keep the report readable
+  FILE *report = fdopen (dup (STDOUT_FILENO), "w");
+  if (report == NULL || freopen ("/dev/null", "w", stdout) == NULL)
+    {
+      perror ("stdout");
+      return EXIT_FAILURE;
+    }
+
+  double single_ms = 0, batch_ms = 0;
+  size_t single_found = 0, batch_found = 0;
+  for (int iteration = 0; iteration < iterations; iteration++)
+    {
+      double start = now_ms ();
+      for (size_t i = 0; i < count; i++)
+        {
+          entries[i].table = get_video_info (entries[i].url, 0,
+                                             &entries[i].info_json_fd);
+        }
+      single_ms += now_ms () - start;
+      single_found += release_entries (entries, count);
+
+      start = now_ms ();
+      get_video_info_batch (entries, count, 0);
+      batch_ms += now_ms () - start;
+      batch_found += release_entries (entries, count);
+    }
+
+  fprintf (report, "%zu URLs, %d iterations\n", count, iterations);
+  fprintf (report, "%-7s %10s %10s %8s\n", "mode", "ms/run", "ms/video",
+           "found");
+  fprintf (report, "%-7s %10.1f %10.1f %8zu\n", "single",
+           single_ms / iterations, single_ms / iterations / count,
+           single_found / (size_t)iterations);
+  fprintf (report, "%-7s %10.1f %10.1f %8zu\n", "batch",
+           batch_ms / iterations, batch_ms / iterations / count,
+           batch_found / (size_t)iterations);
+  fclose (report);
+  free (entries);
+  return EXIT_SUCCESS;
+}
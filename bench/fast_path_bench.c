@@ -0,0 +1,205 @@
+/**
+ * fast_path_bench.c
+ *
+ * Measures end-to-end latency of the three ways ytdl can get a known format
+ * onto disk, issuing the same yt-dlp commands ytdl does:
+ *
+ *   legacy   `yt-dlp -j URL`, parse, then `yt-dlp -f FORMAT URL` (the
+ *            original two-phase flow: extraction happens twice)
+ *   reuse    `yt-dlp -j URL`, parse, keep the JSON in a memfd, then
+ *            `yt-dlp -f FORMAT --load-info-json` (the interactive flow)
+ *   direct   `yt-dlp -f FORMAT --print-to-file ... URL` (ytdl -f: no
+ *            metadata round trip, title and path reported by the download)
+ *
+ * Every sample downloads into a fresh temporary directory, so yt-dlp never
+ * short-circuits on an existing file. Prompt time is not part of any flow.
+ *
+ * Usage: bench/fast_path_bench ITERATIONS URL [FORMAT]
+ */
+
+#define _GNU_SOURCE
+#include "../command_execution.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_FORMAT "18"
+#define REPORT_TEMPLATE                                                       \
+  "after_move:%(.{title,filepath,filesize,filesize_approx})j"
+
+typedef enum
+{
+  FLOW_LEGACY,
+  FLOW_REUSE,
+  FLOW_DIRECT
+} Flow;
+
+static const char *const flow_names[] = { "legacy", "reuse", "direct" };
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int
+compare_double (const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static int
+remove_entry (const char *path, const struct stat *sb, int type,
+              struct FTW *ftw)
+{
+  (void)sb;
+  (void)type;
+  (void)ftw;
+  return remove (path);
+}
+
+/**
+ * Run a command to completion, discarding its output.
+ * @return 0 on success, -1 on failure
+ */
+static int
+run (char *const argv[], json_t **info, int info_fd)
+{
+  CommandResult result;
+  int status = execute_command_capture (argv[0], argv, &result);
+  if (status == 0 && info != NULL)
+    {
+      json_error_t error;
+      *info = json_loadb (result.output, result.output_length, 0, &error);
+      if (*info == NULL)
+        {
+          status = -1;
+        }
+      else if (info_fd != -1
+               && write (info_fd, result.output, result.output_length)
+                      != (ssize_t)result.output_length)
+        {
+          status = -1;
+        }
+    }
+  if (status != 0)
+    {
+      fprintf (stderr, "Error: %s %s failed: %s\n", argv[0], argv[1],
+               result.error_tail.data);
+    }
+  free (result.output);
+  return status;
+}
+
+/**
+ * Run one flow into a fresh directory.
+ * @return Elapsed nanoseconds
+ */
+static double
+run_flow (Flow flow, const char *url, const char *format)
+{
+  char directory[] = "/tmp/ytdl-bench-XXXXXX";
+  if (mkdtemp (directory) == NULL)
+    {
+      perror ("mkdtemp");
+      exit (EXIT_FAILURE);
+    }
+  char output_template[sizeof (directory) + 32];
+  snprintf (output_template, sizeof (output_template), "%s/%%(title)s.%%(ext)s",
+            directory);
+
+  int memfd = memfd_create ("bench", MFD_CLOEXEC);
+  char memfd_path[64];
+  snprintf (memfd_path, sizeof (memfd_path), "/proc/%ld/fd/%d",
+            (long)getpid (), memfd);
+
+  char *info_argv[] = { "yt-dlp", "-j", (char *)url, NULL };
+  char *legacy_argv[] = { "yt-dlp",          "-f", (char *)format, "-o",
+                          output_template,   (char *)url,          NULL };
+  char *reuse_argv[] = { "yt-dlp",          "-f",
+                         (char *)format,    "-o",
+                         output_template,   "--load-info-json",
+                         memfd_path,        NULL };
+  char *direct_argv[]
+      = { "yt-dlp",        "-f",          (char *)format,  "-o",
+          output_template, "--no-simulate", "--print-to-file", REPORT_TEMPLATE,
+          memfd_path,      (char *)url,   NULL };
+
+  double start = now_ns ();
+  json_t *info = NULL;
+  int status = 0;
+  switch (flow)
+    {
+    case FLOW_LEGACY:
+      status = run (info_argv, &info, -1);
+      status = status == 0 ? run (legacy_argv, NULL, -1) : status;
+      break;
+    case FLOW_REUSE:
+      status = run (info_argv, &info, memfd);
+      status = status == 0 ? run (reuse_argv, NULL, -1) : status;
+      break;
+    case FLOW_DIRECT:
+      status = run (direct_argv, NULL, -1);
+      break;
+    }
+  double elapsed = now_ns () - start;
+
+  json_decref (info);
+  close (memfd);
+  nftw (directory, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+  if (status != 0)
+    {
+      exit (EXIT_FAILURE);
+    }
+  return elapsed;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : 0;
+  if (iterations <= 0 || argc < 3)
+    {
+      fprintf (stderr, "Usage: %s ITERATIONS URL [FORMAT]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  const char *url = argv[2];
+  const char *format = argc > 3 ? argv[3] : DEFAULT_FORMAT;
+
+  printf ("url: %s  format: %s  iterations: %d\n", url, format, iterations);
+
+  double medians[3];
+  for (Flow flow = FLOW_LEGACY; flow <= FLOW_DIRECT; flow++)
+    {
+      double *samples = malloc (sizeof (double) * iterations);
+      if (samples == NULL)
+        {
+          perror ("malloc");
+          return EXIT_FAILURE;
+        }
+      for (int i = 0; i < iterations; i++)
+        {
+          samples[i] = run_flow (flow, url, format);
+        }
+      qsort (samples, iterations, sizeof (double), compare_double);
+
+      medians[flow] = samples[iterations / 2];
+      printf ("%-7s p50 %9.1f ms  min %9.1f ms  max %9.1f ms\n",
+              flow_names[flow], medians[flow] / 1e6, samples[0] / 1e6,
+              samples[iterations - 1] / 1e6);
+      free (samples);
+    }
+
+  printf ("direct saves %.1f ms over legacy, %.1f ms over reuse (p50)\n",
+          (medians[FLOW_LEGACY] - medians[FLOW_DIRECT]) / 1e6,
+          (medians[FLOW_REUSE] - medians[FLOW_DIRECT]) / 1e6);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+/**
+ * info_archive_bench.c
+ *
+ * Storage and read throughput for DOCUMENTS near-identical info documents
+ * (one shape, different IDs, titles and URL signatures), kept as:
+ *
+ *   gzip     one .json.gz file per document, at gzip's default level
+ *   archive  one info archive: a zstd frame per document, compressed with
+ *            the dictionary trained after the first documents, and an
+ *            offset index
+ *
+ * and accessed as:
+ *
+ *   write  compress and store every document, in order
+ *   read   look documents up in random order and decompress them whole
+ *   parse  look documents up in random order and stream them into
+ *          parse_formats_stream()
+ *
+ * Throughputs are in MB/s of JSON; "disk" counts allocated blocks, which
+ * is what a library of millions of small files really costs. The files
+ * live in a fresh temporary directory.
+ *
+ * Usage: bench/info_archive_bench [DOCUMENTS]
+ */
+
+#define _GNU_SOURCE
+#include "../info_archive.h"
+#include "info_fixture.h"
+
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <zlib.h>
+
+#define DEFAULT_DOCUMENTS 200
+#define KEY_LENGTH 32
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Bytes stored by the files of one mode
+static unsigned long long stored_bytes;
+static unsigned long long disk_bytes;
+
+static int
+count_entry (const char *path, const struct stat *sb, int type,
+             struct FTW *ftw)
+{
+  (void)path;
+  (void)ftw;
+  if (type == FTW_F)
+    {
+      stored_bytes += (unsigned long long)sb->st_size;
+      disk_bytes += (unsigned long long)sb->st_blocks * 512;
+    }
+  return 0;
+}
+
+static int
+remove_entry (const char *path, const struct stat *sb, int type,
+              struct FTW *ftw)
+{
+  (void)sb;
+  (void)type;
+  (void)ftw;
+  return remove (path);
+}
+
+/**
+ * json_load_callback_t over a gzFile.
+ */
+static size_t
+gzip_read (void *buffer, size_t size, void *file)
+{
+  int read = gzread (file, buffer, size > INT_MAX ? INT_MAX : (unsigned)size);
+  return read < 0 ? (size_t)-1 : (size_t)read;
+}
+
+static void
+fail (const char *what, unsigned variant)
+{
+  fprintf (stderr, "Error: %s failed for document %u\n", what, variant);
+  exit (EXIT_FAILURE);
+}
+
+static void
+print_row (const char *mode, const char *directory, double raw_bytes,
+           double write_ns, double read_ns, double parse_ns)
+{
+  stored_bytes = disk_bytes = 0;
+  nftw (directory, count_entry, 8, FTW_PHYS);
+  printf ("%-8s %9.2f %9.2f %7.1fx %9.1f %9.1f %9.1f\n", mode,
+          stored_bytes / 1e6, disk_bytes / 1e6, raw_bytes / stored_bytes,
+          raw_bytes / write_ns * 1e3, raw_bytes / read_ns * 1e3,
+          raw_bytes / parse_ns * 1e3);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int documents = argc > 1 ? atoi (argv[1]) : DEFAULT_DOCUMENTS;
+  if (documents <= 0)
+    {
+      fprintf (stderr, "Usage: %s [DOCUMENTS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  char directory[] = "/tmp/ytdl-archive-bench-XXXXXX";
+  char gzip_directory[sizeof (directory) + 8];
+  char archive_directory[sizeof (directory) + 8];
+  char archive_path[sizeof (archive_directory) + 16];
+  if (mkdtemp (directory) == NULL)
+    {
+      perror ("mkdtemp");
+      return EXIT_FAILURE;
+    }
+  snprintf (gzip_directory, sizeof (gzip_directory), "%s/gzip", directory);
+  snprintf (archive_directory, sizeof (archive_directory), "%s/zstd",
+            directory);
+  snprintf (archive_path, sizeof (archive_path), "%s/info.archive",
+            archive_directory);
+  if (mkdir (gzip_directory, 0700) != 0 || mkdir (archive_directory, 0700) != 0)
+    {
+      perror ("mkdir");
+      return EXIT_FAILURE;
+    }
+
+  InfoArchive *archive = info_archive_open (archive_path);
+  if (archive == NULL)
+    {
+      return EXIT_FAILURE;
+    }
+
+  // Documents are built one at a time; only the compression is timed
+  FixtureShape shape = { 30, 120, 40, 150, 0 };
+  double raw_bytes = 0, gzip_write_ns = 0, archive_write_ns = 0;
+  char key[KEY_LENGTH];
+  char path[sizeof (gzip_directory) + KEY_LENGTH + 16];
+  size_t longest = 0;
+  for (int i = 0; i < documents; i++)
+    {
+      Text document = { 0 };
+      shape.variant = (unsigned)i + 1;
+      build_info_fixture (&shape, &document, NULL);
+      raw_bytes += (double)document.length;
+      longest = document.length > longest ? document.length : longest;
+      snprintf (key, sizeof (key), "youtube:v%010u", shape.variant);
+      snprintf (path, sizeof (path), "%s/%s.json.gz", gzip_directory, key);
+
+      double start = now_ns ();
+      gzFile file = gzopen (path, "wb6");
+      if (file == NULL
+          || gzwrite (file, document.data, (unsigned)document.length)
+                 != (int)document.length
+          || gzclose (file) != Z_OK)
+        {
+          fail ("gzip write", shape.variant);
+        }
+      gzip_write_ns += now_ns () - start;
+
+      start = now_ns ();
+      if (info_archive_append (archive, key, document.data, document.length)
+          != 0)
+        {
+          fail ("archive append", shape.variant);
+        }
+      archive_write_ns += now_ns () - start;
+      free (document.data);
+    }
+
+  // Random access: the same shuffled order for both
+  unsigned *order = malloc ((size_t)documents * sizeof (unsigned));
+  char *buffer = malloc (longest + 1);
+  if (order == NULL || buffer == NULL)
+    {
+      perror ("malloc");
+      return EXIT_FAILURE;
+    }
+  for (int i = 0; i < documents; i++)
+    {
+      order[i] = (unsigned)i + 1;
+    }
+  srand (1);
+  for (int i = documents - 1; i > 0; i--)
+    {
+      int j = rand () % (i + 1);
+      unsigned swap = order[i];
+      order[i] = order[j];
+      order[j] = swap;
+    }
+
+  double gzip_read_ns = 0, gzip_parse_ns = 0;
+  double archive_read_ns = 0, archive_parse_ns = 0;
+  for (int i = 0; i < documents; i++)
+    {
+      snprintf (key, sizeof (key), "youtube:v%010u", order[i]);
+      snprintf (path, sizeof (path), "%s/%s.json.gz", gzip_directory, key);
+
+      double start = now_ns ();
+      gzFile file = gzopen (path, "rb");
+      int length = file ? gzread (file, buffer, (unsigned)longest) : -1;
+      if (length <= 0 || gzclose (file) != Z_OK)
+        {
+          fail ("gzip read", order[i]);
+        }
+      gzip_read_ns += now_ns () - start;
+
+      start = now_ns ();
+      size_t archived_length;
+      char *json = info_archive_read (archive, key, &archived_length);
+      if (json == NULL || archived_length != (size_t)length
+          || memcmp (json, buffer, archived_length) != 0)
+        {
+          fail ("archive read", order[i]);
+        }
+      free (json);
+      archive_read_ns += now_ns () - start;
+
+      start = now_ns ();
+      file = gzopen (path, "rb");
+      json_t *formats = file ? parse_formats_stream (gzip_read, file) : NULL;
+      if (formats == NULL)
+        {
+          fail ("gzip parse", order[i]);
+        }
+      json_decref (formats);
+      gzclose (file);
+      gzip_parse_ns += now_ns () - start;
+
+      start = now_ns ();
+      InfoArchiveReader *reader = info_archive_open_reader (archive, key);
+      formats = reader ? parse_formats_stream (info_archive_reader_read,
+                                               reader)
+                       : NULL;
+      if (formats == NULL)
+        {
+          fail ("archive parse", order[i]);
+        }
+      json_decref (formats);
+      info_archive_close_reader (reader);
+      archive_parse_ns += now_ns () - start;
+    }
+  info_archive_close (archive);
+
+  printf ("%d documents, %.2f MB of JSON\n", documents, raw_bytes / 1e6);
+  printf ("%-8s %9s %9s %8s %9s %9s %9s\n", "mode", "MB", "disk MB",
+          "ratio", "write", "read", "parse");
+  print_row ("gzip", gzip_directory, raw_bytes, gzip_write_ns, gzip_read_ns,
+             gzip_parse_ns);
+  print_row ("archive", archive_directory, raw_bytes, archive_write_ns,
+             archive_read_ns, archive_parse_ns);
+
+  nftw (directory, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+  free (order);
+  free (buffer);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/**
+ * info_fixture.h
+ *
+ * Synthesized `yt-dlp -j` documents for the parser benchmarks, with the
+ * shape of a YouTube extraction: formats carrying HTTP headers and a DASH
+ * fragment list, thumbnails, and automatic captions in many languages. The
+ * matching lean record stream (`-f all -O LEAN_*_TEMPLATE`) can be built
+ * alongside.
+ */
+
+#ifndef INFO_FIXTURE_H
+#define INFO_FIXTURE_H
+
+#include "../format_parsing.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Size of a synthesized document
+typedef struct
+{
+  int formats;
+  int fragments_per_format;
+  int thumbnails;
+  int caption_languages;
+  unsigned variant; // 0 for video abc123XYZ_0, else another ID and URLs
+} FixtureShape;
+
+typedef struct
+{
+  char *data;
+  size_t length;
+  size_t capacity;
+} Text;
+
+static void
+append (Text *text, const char *format, ...)
+{
+  va_list args;
+  for (;;)
+    {
+      va_start (args, format);
+      int written = vsnprintf (text->data + text->length,
+                               text->capacity - text->length, format, args);
+      va_end (args);
+      if (written < 0)
+        {
+          abort ();
+        }
+      if ((size_t)written < text->capacity - text->length)
+        {
+          text->length += (size_t)written;
+          return;
+        }
+      text->capacity = text->capacity * 2 + (size_t)written;
+      text->data = realloc (text->data, text->capacity);
+      if (text->data == NULL)
+        {
+          perror ("realloc");
+          exit (EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * Pseudo-random hex digits standing in for a URL signature, different for
+ * every (variant, index) pair as real signatures are.
+ */
+static void
+fixture_signature (unsigned variant, int index, char *digits, size_t count)
+{
+  unsigned long long state
+      = 0x9e3779b97f4a7c15ULL * (variant + 1) ^ (unsigned long long)index;
+  for (size_t i = 0; i < count; i++)
+    {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      digits[i] = "0123456789abcdef"[state & 15];
+    }
+  digits[count] = '\0';
+}
+
+/**
+ * Build the full -j document and, unless lean is NULL, the equivalent lean
+ * record stream.
+ */
+static void
+build_info_fixture (const FixtureShape *shape, Text *full, Text *lean)
+{
+  char id[16] = "abc123XYZ_0";
+  char signature[65];
+  if (shape->variant != 0)
+    {
+      snprintf (id, sizeof (id), "v%010u", shape->variant);
+    }
+
+  append (full,
+          "{\"id\": \"%s\", \"title\": \"Benchmark \\\"video\\\" %u\", "
+          "\"channel\": \"Chan\", \"duration\": %u, \"formats\": [",
+          id, shape->variant, 212 + shape->variant % 600);
+  if (lean != NULL)
+    {
+      append (lean, "%s\t%u\t\"Chan\"\t\"Benchmark \\\"video\\\" %u\"\n",
+              LEAN_INFO_TAG, 212 + shape->variant % 600, shape->variant);
+    }
+
+  for (int i = 0; i < shape->formats; i++)
+    {
+      int height = 144 << (i % 5);
+      fixture_signature (shape->variant, i, signature, 64);
+      append (full,
+              "%s{\"format_id\": \"%d\", \"resolution\": \"%dx%d\", "
+              "\"ext\": \"mp4\", \"filesize\": %d, \"width\": %d, "
+              "\"height\": %d, \"fps\": 30, \"vcodec\": \"avc1.64001F\", "
+              "\"acodec\": \"none\", \"tbr\": %d.5, "
+              "\"url\": \"https://rr1---sn-example.googlevideo.com/"
+              "videoplayback?expire=%u&itag=%d&sig=%s\", "
+              "\"http_headers\": {\"User-Agent\": \"Mozilla/5.0 (X11; Linux "
+              "x86_64) AppleWebKit/537.36 Chrome/120.0\", \"Accept\": "
+              "\"text/html,application/xhtml+xml\", \"Accept-Language\": "
+              "\"en-us,en;q=0.5\"}, \"fragments\": [",
+              i ? ", " : "", 100 + i, height * 16 / 9, height,
+              1000000 * (i + 1), height * 16 / 9, height, 100 * i,
+              1700000000 + shape->variant, 100 + i, signature);
+      for (int k = 0; k < shape->fragments_per_format; k++)
+        {
+          append (full, "%s{\"url\": \"sq/%d/range/%d-%d\", \"duration\": "
+                        "5.005}",
+                  k ? ", " : "", k, k * 65536, k * 65536 + 65535);
+        }
+      append (full, "]}");
+    }
+  // yt-dlp prints the "-f all" records best first
+  for (int i = shape->formats - 1; lean != NULL && i >= 0; i--)
+    {
+      int height = 144 << (i % 5);
+      append (lean, "%s\t\"%d\"\t\"%dx%d\"\t\"mp4\"\t%d\t%d\t%d\t30\t%d.5\n",
+              LEAN_FORMAT_TAG, 100 + i, height * 16 / 9, height,
+              1000000 * (i + 1), height * 16 / 9, height, 100 * i);
+    }
+
+  append (full, "], \"thumbnails\": [");
+  for (int i = 0; i < shape->thumbnails; i++)
+    {
+      append (full,
+              "%s{\"url\": \"https://i.ytimg.com/vi/%s/%d.jpg\", "
+              "\"preference\": %d, \"id\": \"%d\"}",
+              i ? ", " : "", id, i, -i, i);
+    }
+  append (full, "], \"automatic_captions\": {");
+  for (int i = 0; i < shape->caption_languages; i++)
+    {
+      append (full, "%s\"l%03d\": [", i ? ", " : "", i);
+      for (int k = 0; k < 5; k++)
+        {
+          fixture_signature (shape->variant, i * 5 + k + 1000, signature, 32);
+          append (full,
+                  "%s{\"ext\": \"vtt\", \"url\": \"https://www.youtube.com/"
+                  "api/timedtext?v=%s&lang=l%03d&fmt=%d&sig=%s\"}",
+                  k ? ", " : "", id, i, k, signature);
+        }
+      append (full, "]");
+    }
+  append (full,
+          "}, \"webpage_url\": \"https://www.youtube.com/watch?v=%s\"}\n", id);
+}
+
+#endif
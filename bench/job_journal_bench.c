@@ -0,0 +1,180 @@
+/**
+ * job_journal_bench.c
+ *
+ * Cost of journaling the jobs of a run, by how many updates share one
+ * fdatasync(). Each job goes through the states of a download: claimed
+ * (queued), fetching, downloading with its file, PROGRESS_UPDATES byte
+ * counts, done. journal_sync() is forced after every BATCH updates; the
+ * run loop gets the same effect by syncing once every JOURNAL_SYNC_MS, so
+ * BATCH 1 is what syncing every record would cost.
+ *
+ * For each batch size the time per update, the fdatasync() calls and the
+ * compactions (rename() calls, both counted through the linker's --wrap)
+ * and the final size of the journal are reported, then the time to open
+ * and replay the journal of the last run.
+ *
+ * fdatasync() is nearly free on tmpfs, so the journal goes to a temporary
+ * directory under DIRECTORY (/var/tmp by default), which should be on the
+ * disk downloads go to.
+ *
+ * Usage: bench/job_journal_bench [JOBS] [DIRECTORY]
+ */
+
+#define _GNU_SOURCE
+#include "../job_journal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_JOBS 1000
+#define DEFAULT_DIRECTORY "/var/tmp"
+// Byte counts journaled per job between its downloading and done records
+#define PROGRESS_UPDATES 8
+
+static unsigned long sync_count = 0;
+static unsigned long rename_count = 0;
+
+int __real_fdatasync (int fd);
+int __real_rename (const char *from, const char *to);
+
+int
+__wrap_fdatasync (int fd)
+{
+  sync_count++;
+  return __real_fdatasync (fd);
+}
+
+int
+__wrap_rename (const char *from, const char *to)
+{
+  rename_count++;
+  return __real_rename (from, to);
+}
+
+static double
+now_ms (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/**
+ * Journal a run of jobs, forcing a sync every batch updates.
+ * @return Updates made
+ */
+static size_t
+journal_jobs (JobJournal *journal, int jobs, int batch)
+{
+  size_t updates = 0;
+  char url[128];
+  char path[128];
+  for (int j = 0; j < jobs; j++)
+    {
+      snprintf (url, sizeof (url),
+                "https://www.youtube.com/watch?v=bench%06d", j);
+      snprintf (path, sizeof (path), "/srv/videos/Bench video %06d.mp4",
+                j);
+      long long size = 50000000LL + j;
+      for (int step = 0; step < PROGRESS_UPDATES + 4; step++)
+        {
+          if (step == 0)
+            {
+              journal_claim (journal, url);
+            }
+          else if (step == 1)
+            {
+              journal_update (journal, url, JOURNAL_FETCHING, -1, NULL);
+            }
+          else if (step == 2)
+            {
+              journal_update (journal, url, JOURNAL_DOWNLOADING, 0, path);
+            }
+          else if (step < PROGRESS_UPDATES + 3)
+            {
+              journal_update (journal, url, JOURNAL_DOWNLOADING,
+                              size * (step - 2) / (PROGRESS_UPDATES + 1),
+                              NULL);
+            }
+          else
+            {
+              journal_update (journal, url, JOURNAL_DONE, size, path);
+            }
+          if (++updates % (size_t)batch == 0)
+            {
+              journal_sync (journal, 1);
+            }
+        }
+    }
+  return updates;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int jobs = argc > 1 ? atoi (argv[1]) : DEFAULT_JOBS;
+  const char *parent = argc > 2 ? argv[2] : DEFAULT_DIRECTORY;
+  if (jobs < 1)
+    {
+      fprintf (stderr, "Usage: %s [JOBS] [DIRECTORY]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  char directory[4096];
+  snprintf (directory, sizeof (directory), "%s/ytdl-journal-bench-XXXXXX",
+            parent);
+  if (mkdtemp (directory) == NULL)
+    {
+      perror ("mkdtemp");
+      return EXIT_FAILURE;
+    }
+  char path[4200];
+  snprintf (path, sizeof (path), "%s/bench.journal", directory);
+
+  printf ("%d jobs, %d updates each, in %s\n", jobs, PROGRESS_UPDATES + 4,
+          directory);
+  int batches[] = { 1, 16, 256 };
+  for (size_t b = 0; b < sizeof (batches) / sizeof (batches[0]); b++)
+    {
+      unlink (path);
+      JobJournal *journal = journal_open (path, NULL);
+      if (journal == NULL)
+        {
+          return EXIT_FAILURE;
+        }
+      unsigned long syncs_before = sync_count;
+      unsigned long renames_before = rename_count;
+      double start = now_ms ();
+      size_t updates = journal_jobs (journal, jobs, batches[b]);
+      journal_close (journal);
+      double elapsed = now_ms () - start;
+
+      struct stat st;
+      stat (path, &st);
+      printf ("batch %4d: %8.2f us per update  %6lu fdatasync  %3lu "
+              "compactions  %8.1f KB\n",
+              batches[b], elapsed * 1e3 / updates,
+              sync_count - syncs_before, rename_count - renames_before,
+              st.st_size / 1024.0);
+    }
+
+  JournalTotals totals;
+  double start = now_ms ();
+  JobJournal *journal = journal_open (path, &totals);
+  double elapsed = now_ms () - start;
+  if (journal == NULL || totals.done != (size_t)jobs)
+    {
+      fprintf (stderr, "Error: replayed %zu done jobs, expected %d\n",
+               journal != NULL ? totals.done : 0, jobs);
+      return EXIT_FAILURE;
+    }
+  journal_close (journal);
+  printf ("replay:     %8.2f ms for %d jobs\n", elapsed, jobs);
+
+  unlink (path);
+  rmdir (directory);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+/**
+ * json_arena_bench.c
+ *
+ * Parses DOCUMENTS info documents with jansson the way a long-running
+ * ytdl process would (json_loadb(), build_format_table(), keep the table,
+ * drop the tree), once per allocator:
+ *
+ *   heap    jansson on malloc/free, each node freed by json_decref()
+ *   arena   each document parsed inside a JsonArena, released by one reset
+ *
+ * Each mode runs in its own child process so that peak RSS, the RSS left
+ * at the end (heap fragmentation pins freed tree memory between the kept
+ * tables) and the malloc calls made are measured in isolation.
+ *
+ * Usage: bench/json_arena_bench [DOCUMENTS]
+ */
+
+#define _GNU_SOURCE
+#include "../json_arena.h"
+#include "info_fixture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_DOCUMENTS 200
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Resident set size right now, in kilobytes.
+ */
+static long
+current_rss_kb (void)
+{
+  long pages = 0, resident = 0;
+  FILE *statm = fopen ("/proc/self/statm", "r");
+  if (statm != NULL)
+    {
+      if (fscanf (statm, "%ld %ld", &pages, &resident) != 2)
+        {
+          resident = 0;
+        }
+      fclose (statm);
+    }
+  return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Run one mode and print its line.
+ */
+static void
+run_mode (int use_arena, const Text *document, int documents)
+{
+  // An empty arena installs the counting hooks for the heap mode too
+  JsonArena arena = JSON_ARENA_INIT;
+  json_arena_begin (&arena);
+  if (!use_arena)
+    {
+      json_arena_end (&arena);
+    }
+
+  FormatTable **tables = calloc ((size_t)documents, sizeof (FormatTable *));
+  if (tables == NULL)
+    {
+      perror ("calloc");
+      exit (EXIT_FAILURE);
+    }
+
+  double start = now_ns ();
+  for (int i = 0; i < documents; i++)
+    {
+      json_error_t error;
+      json_t *root = json_loadb (document->data, document->length, 0, &error);
+      tables[i] = root ? build_format_table (root) : NULL;
+      json_decref (root);
+      if (use_arena)
+        {
+          json_arena_reset (&arena);
+        }
+      if (tables[i] == NULL)
+        {
+          fprintf (stderr, "Error: document %d rejected\n", i);
+          exit (EXIT_FAILURE);
+        }
+    }
+  double elapsed = now_ns () - start;
+  if (use_arena)
+    {
+      json_arena_end (&arena);
+    }
+  long end_rss = current_rss_kb ();
+
+  JsonArenaStats stats;
+  json_arena_get_stats (&stats);
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  printf ("%-6s %9.1f %10lu %12.1f %10.1f %10.1f\n",
+          use_arena ? "arena" : "heap", elapsed / 1e3 / documents,
+          stats.heap_allocations + stats.blocks,
+          (double)(stats.arena_allocations + stats.heap_allocations)
+              / documents,
+          usage.ru_maxrss / 1024.0, end_rss / 1024.0);
+
+  for (int i = 0; i < documents; i++)
+    {
+      free_format_table (tables[i]);
+    }
+  free (tables);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int documents = argc > 1 ? atoi (argv[1]) : DEFAULT_DOCUMENTS;
+  if (documents <= 0)
+    {
+      fprintf (stderr, "Usage: %s [DOCUMENTS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  const FixtureShape shape = { 30, 120, 40, 150, 0 };
+  Text document = { 0 };
+  build_info_fixture (&shape, &document, NULL);
+
+  printf ("%d documents of %zu bytes\n", documents, document.length);
+  printf ("%-6s %9s %10s %12s %10s %10s\n", "mode", "us/doc", "mallocs",
+          "json/doc", "peak MB", "end MB");
+  fflush (stdout);
+
+  for (int use_arena = 0; use_arena <= 1; use_arena++)
+    {
+      pid_t pid = fork ();
+      if (pid == -1)
+        {
+          perror ("fork");
+          return EXIT_FAILURE;
+        }
+      if (pid == 0)
+        {
+          run_mode (use_arena, &document, documents);
+          fflush (stdout);
+          _exit (EXIT_SUCCESS);
+        }
+      int status;
+      if (waitpid (pid, &status, 0) == -1 || !WIFEXITED (status)
+          || WEXITSTATUS (status) != 0)
+        {
+          return EXIT_FAILURE;
+        }
+    }
+
+  free (document.data);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,214 @@
+/**
+ * json_scan_bench.c
+ *
+ * Compares the two ways ytdl turns a `yt-dlp -j` document into its format
+ * table:
+ *
+ *   loads   json_loadb() of the whole document, then build_format_table()
+ *   scan    scan_format_table(): whitelisted paths only, other subtrees
+ *           skipped by bracket matching, no tree built
+ *
+ * The corpus is three synthesized documents (see info_fixture.h) spanning
+ * a short clip to a long video with many DASH formats, plus any files named
+ * on the command line (e.g. saved `yt-dlp -j` output). For each document
+ * the throughput over the input and the heap allocations per parse are
+ * reported. Allocations are counted both inside jansson (through
+ * json_set_alloc_funcs) and in ytdl's own code (through the linker's
+ * --wrap); the table itself accounts for a handful on either path.
+ *
+ * Usage: bench/json_scan_bench [ITERATIONS] [FILE...]
+ */
+
+#define _GNU_SOURCE
+#include "info_fixture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 20
+
+typedef struct
+{
+  const char *name;
+  Text text;
+} Document;
+
+typedef struct
+{
+  double mb_per_s;
+  unsigned long allocations;
+  size_t formats;
+} Measurement;
+
+static unsigned long allocation_count = 0;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t count, size_t size);
+void *__real_realloc (void *pointer, size_t size);
+
+void *
+__wrap_malloc (size_t size)
+{
+  allocation_count++;
+  return __real_malloc (size);
+}
+
+void *
+__wrap_calloc (size_t count, size_t size)
+{
+  allocation_count++;
+  return __real_calloc (count, size);
+}
+
+void *
+__wrap_realloc (void *pointer, size_t size)
+{
+  allocation_count++;
+  return __real_realloc (pointer, size);
+}
+
+// jansson is linked as a library, which --wrap does not reach
+static void *
+counting_json_malloc (size_t size)
+{
+  return __wrap_malloc (size);
+}
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static FormatTable *
+parse_loads (const Text *text)
+{
+  json_error_t error;
+  json_t *root = json_loadb (text->data, text->length, 0, &error);
+  FormatTable *table = root ? build_format_table (root) : NULL;
+  json_decref (root);
+  return table;
+}
+
+static FormatTable *
+parse_scan (const Text *text)
+{
+  return scan_format_table (text->data, text->length);
+}
+
+/**
+ * Time a parser over one document.
+ */
+static Measurement
+measure (FormatTable *(*parse) (const Text *), const Text *text,
+         int iterations)
+{
+  Measurement result = { 0 };
+  double total = 0;
+  for (int i = 0; i < iterations; i++)
+    {
+      unsigned long before = allocation_count;
+      double start = now_ns ();
+      FormatTable *table = parse (text);
+      total += now_ns () - start;
+      result.allocations = allocation_count - before;
+      if (table == NULL)
+        {
+          fprintf (stderr, "Error: parser rejected the document\n");
+          exit (EXIT_FAILURE);
+        }
+      result.formats = table->count;
+      free_format_table (table);
+    }
+  result.mb_per_s = (double)text->length * iterations / (total / 1e9) / 1e6;
+  return result;
+}
+
+/**
+ * Read a whole file into memory.
+ * @return 0 on success, -1 on error
+ */
+static int
+load_file (const char *path, Text *text)
+{
+  FILE *file = fopen (path, "rb");
+  if (file == NULL)
+    {
+      perror (path);
+      return -1;
+    }
+  char chunk[64 * 1024];
+  size_t bytes_read;
+  while ((bytes_read = fread (chunk, 1, sizeof (chunk), file)) > 0)
+    {
+      append (text, "%.*s", (int)bytes_read, chunk);
+    }
+  int failed = ferror (file);
+  fclose (file);
+  return failed ? -1 : 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+    {
+      fprintf (stderr, "Usage: %s [ITERATIONS] [FILE...]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  json_set_alloc_funcs (counting_json_malloc, free);
+
+  static const FixtureShape shapes[] = {
+    { 8, 0, 4, 10, 0 },      // short clip, progressive formats only
+    { 30, 120, 40, 150, 0 }, // typical YouTube video
+    { 120, 600, 80, 300, 0 } // long video, many DASH formats
+  };
+  static const char *const shape_names[] = { "small", "typical", "large" };
+  size_t count = 3 + (size_t)(argc > 2 ? argc - 2 : 0);
+  Document *corpus = calloc (count, sizeof (Document));
+  if (corpus == NULL)
+    {
+      perror ("calloc");
+      return EXIT_FAILURE;
+    }
+  for (size_t i = 0; i < 3; i++)
+    {
+      corpus[i].name = shape_names[i];
+      build_info_fixture (&shapes[i], &corpus[i].text, NULL);
+    }
+  for (size_t i = 3; i < count; i++)
+    {
+      corpus[i].name = argv[i - 1];
+      if (load_file (corpus[i].name, &corpus[i].text) != 0)
+        {
+          return EXIT_FAILURE;
+        }
+    }
+
+  printf ("%-12s %10s %8s %12s %10s %12s %10s\n", "document", "bytes",
+          "formats", "loads MB/s", "allocs", "scan MB/s", "allocs");
+  for (size_t i = 0; i < count; i++)
+    {
+      Measurement loads = measure (parse_loads, &corpus[i].text, iterations);
+      Measurement scan = measure (parse_scan, &corpus[i].text, iterations);
+      if (loads.formats != scan.formats)
+        {
+          fprintf (stderr, "Error: %s: %zu formats loaded, %zu scanned\n",
+                   corpus[i].name, loads.formats, scan.formats);
+          return EXIT_FAILURE;
+        }
+      printf ("%-12.12s %10zu %8zu %12.1f %10lu %12.1f %10lu\n",
+              corpus[i].name, corpus[i].text.length, scan.formats,
+              loads.mb_per_s, loads.allocations, scan.mb_per_s,
+              scan.allocations);
+      free (corpus[i].text.data);
+    }
+
+  free (corpus);
+  return EXIT_SUCCESS;
+}
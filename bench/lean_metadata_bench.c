@@ -0,0 +1,102 @@
+/**
+ * lean_metadata_bench.c
+ *
+ * Compares the bytes and parse cost of the full `yt-dlp -j` document with
+ * the lean record stream (`-f all -O LEAN_*_TEMPLATE`) for the same video.
+ *
+ *   full    json_loadb() of the whole document, then build_format_table()
+ *   lean    parse_lean_metadata() of the records, then build_format_table()
+ *
+ * Both inputs are synthesized in memory (see info_fixture.h) for FORMATS
+ * formats. Only the parser is timed; no process is started.
+ *
+ * Usage: bench/lean_metadata_bench [ITERATIONS]
+ */
+
+#define _GNU_SOURCE
+#include "info_fixture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 50
+#define FORMATS 30
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static FormatTable *
+parse_full (const Text *full)
+{
+  json_error_t error;
+  json_t *root = json_loadb (full->data, full->length, 0, &error);
+  FormatTable *table = root ? build_format_table (root) : NULL;
+  json_decref (root);
+  return table;
+}
+
+static FormatTable *
+parse_lean (const Text *lean)
+{
+  json_t *root = parse_lean_metadata (lean->data, lean->length);
+  FormatTable *table = root ? build_format_table (root) : NULL;
+  json_decref (root);
+  return table;
+}
+
+/**
+ * Time a parser and return the mean in nanoseconds.
+ */
+static double
+time_parser (FormatTable *(*parse) (const Text *), const Text *input,
+             int iterations)
+{
+  double total = 0;
+  for (int i = 0; i < iterations; i++)
+    {
+      double start = now_ns ();
+      FormatTable *table = parse (input);
+      double elapsed = now_ns () - start;
+      if (table == NULL || table->count != FORMATS)
+        {
+          fprintf (stderr, "Error: parser returned the wrong formats\n");
+          exit (EXIT_FAILURE);
+        }
+      free_format_table (table);
+      total += elapsed;
+    }
+  return total / iterations;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+    {
+      fprintf (stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  const FixtureShape shape = { FORMATS, 120, 40, 150, 0 };
+  Text full = { 0 }, lean = { 0 };
+  build_info_fixture (&shape, &full, &lean);
+
+  double full_ns = time_parser (parse_full, &full, iterations);
+  double lean_ns = time_parser (parse_lean, &lean, iterations);
+
+  printf ("full  %9zu bytes  %9.1f us/parse\n", full.length, full_ns / 1e3);
+  printf ("lean  %9zu bytes  %9.1f us/parse\n", lean.length, lean_ns / 1e3);
+  printf ("ratio %9.1fx bytes %8.1fx parse time\n",
+          (double)full.length / (double)lean.length, full_ns / lean_ns);
+
+  free (full.data);
+  free (lean.data);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+/**
+ * metadata_cache_bench.c
+ *
+ * Latency of a metadata cache hit, against the parse work a miss repeats
+ * (the yt-dlp run a miss also pays, typically seconds, is not included):
+ *
+ *   scan    scan_format_table() of a typical `yt-dlp -j` document
+ *   disk    metadata_cache_lookup() from the mmap'ed cache file
+ *   memory  metadata_cache_lookup() from the in-memory LRU tier
+ *
+ * The cache lives in a fresh temporary directory.
+ *
+ * Usage: bench/metadata_cache_bench [ITERATIONS]
+ */
+
+#define _GNU_SOURCE
+#include "../metadata_cache.h"
+#include "info_fixture.h"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 10000
+#define BENCH_URL "https://www.youtube.com/watch?v=abc123XYZ_0"
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int
+remove_entry (const char *path, const struct stat *sb, int type,
+              struct FTW *ftw)
+{
+  (void)sb;
+  (void)type;
+  (void)ftw;
+  return remove (path);
+}
+
+/**
+ * Mean cost of a lookup with the cache configured as given.
+ * @return Nanoseconds per lookup
+ */
+static double
+time_lookups (const MetadataCacheSettings *settings, int iterations)
+{
+  configure_metadata_cache (settings);
+  double start = now_ns ();
+  for (int i = 0; i < iterations; i++)
+    {
+      FormatTable *table = metadata_cache_lookup (BENCH_URL);
+      if (table == NULL)
+        {
+          fprintf (stderr, "Error: cache miss\n");
+          exit (EXIT_FAILURE);
+        }
+      free_format_table (table);
+    }
+  return (now_ns () - start) / iterations;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+    {
+      fprintf (stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  char directory[] = "/tmp/ytdl-cache-bench-XXXXXX";
+  if (mkdtemp (directory) == NULL)
+    {
+      perror ("mkdtemp");
+      return EXIT_FAILURE;
+    }
+
+  const FixtureShape shape = { 30, 120, 40, 150, 0 };
+  Text document = { 0 };
+  build_info_fixture (&shape, &document, NULL);
+
+  double start = now_ns ();
+  for (int i = 0; i < iterations / 100 + 1; i++)
+    {
+      free_format_table (scan_format_table (document.data, document.length));
+    }
+  double scan_ns = (now_ns () - start) / (iterations / 100 + 1);
+
+  MetadataCacheSettings settings
+      = { .ttl_seconds = 3600, .directory = directory, .memory_entries = 0 };
+  configure_metadata_cache (&settings);
+  FormatTable *table = scan_format_table (document.data, document.length);
+  metadata_cache_store (BENCH_URL, table);
+  free_format_table (table);
+
+  double disk_ns = time_lookups (&settings, iterations);
+  settings.memory_entries = DEFAULT_CACHE_MEMORY_ENTRIES;
+  double memory_ns = time_lookups (&settings, iterations);
+  metadata_cache_shutdown ();
+
+  printf ("scan   %10.2f us\n", scan_ns / 1e3);
+  printf ("disk   %10.2f us\n", disk_ns / 1e3);
+  printf ("memory %10.2f us\n", memory_ns / 1e3);
+
+  nftw (directory, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+  free (document.data);
+  return EXIT_SUCCESS;
+}
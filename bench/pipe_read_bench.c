@@ -0,0 +1,262 @@
+/**
+ * pipe_read_bench.c
+ *
+ * Compares ways of collecting a child's stdout of the size a `yt-dlp -j`
+ * document reaches (64 KiB .. 16 MiB):
+ *
+ *   legacy  the original read_from_pipe loop: 1023-byte reads into a stack
+ *           buffer, memcpy into a realloc-doubled heap buffer
+ *   pipe    read_from_pipe(): F_SETPIPE_SZ plus reads straight into the
+ *           spare capacity of the output buffer
+ *   memfd   the execute_command_to_memfd() strategy: the child writes into
+ *           a memfd that the parent maps (and faults in) after exit
+ *
+ * The writer child is identical in every case (64 KiB write() calls from a
+ * pre-filled buffer), so differences come from the reading side. read()
+ * calls are counted by linking with -Wl,--wrap=read.
+ *
+ * Usage: bench/pipe_read_bench [ITERATIONS]
+ */
+
+#define _GNU_SOURCE
+#include "../command_execution.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERATIONS 20
+#define WRITE_CHUNK (64 * 1024)
+
+static const size_t payload_sizes[]
+    = { 64 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024 };
+
+// JSON-ish, NUL-free filler for the payload
+static const char filler[] = "{\"format_id\": \"137\", \"ext\": \"mp4\"},\n";
+
+static char *payload;
+static size_t payload_size;
+static unsigned long read_calls;
+
+ssize_t __real_read (int fd, void *buf, size_t count);
+
+ssize_t
+__wrap_read (int fd, void *buf, size_t count)
+{
+  read_calls++;
+  return __real_read (fd, buf, count);
+}
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Fork a child that writes the payload to fd and exits.
+ */
+static pid_t
+start_writer (int fd)
+{
+  pid_t pid = fork ();
+  if (pid == 0)
+    {
+      for (size_t off = 0; off < payload_size;)
+        {
+          size_t len = payload_size - off;
+          if (len > WRITE_CHUNK)
+            {
+              len = WRITE_CHUNK;
+            }
+          ssize_t written = write (fd, payload + off, len);
+          if (written <= 0)
+            {
+              _exit (1);
+            }
+          off += (size_t)written;
+        }
+      _exit (0);
+    }
+  return pid;
+}
+
+/**
+ * The read loop ytdl shipped before the large-pipe reader, kept verbatim
+ * in behaviour for comparison.
+ */
+static char *
+legacy_read_from_pipe (int pipefd)
+{
+  char buffer[BUFFER_SIZE];
+  ssize_t bytes_read;
+  size_t output_size = 0;
+  size_t output_capacity = BUFFER_SIZE;
+  char *output = malloc (output_capacity);
+  if (output == NULL)
+    {
+      return NULL;
+    }
+  output[0] = '\0';
+
+  while ((bytes_read = read (pipefd, buffer, BUFFER_SIZE - 1)) > 0)
+    {
+      buffer[bytes_read] = '\0';
+      size_t new_size = output_size + bytes_read + 1;
+      if (new_size > output_capacity)
+        {
+          size_t new_capacity = output_capacity * 2;
+          if (new_capacity < new_size)
+            {
+              new_capacity = new_size;
+            }
+          char *new_output = realloc (output, new_capacity);
+          if (new_output == NULL)
+            {
+              free (output);
+              return NULL;
+            }
+          output = new_output;
+          output_capacity = new_capacity;
+        }
+      memcpy (output + output_size, buffer, bytes_read + 1);
+      output_size += bytes_read;
+    }
+
+  return output;
+}
+
+static double
+run_pipe_reader (char *(*reader) (int))
+{
+  int pipefd[2];
+  if (pipe (pipefd) == -1)
+    {
+      perror ("pipe");
+      exit (EXIT_FAILURE);
+    }
+
+  double start = now_ns ();
+  pid_t pid = start_writer (pipefd[WRITE_END]);
+  close (pipefd[WRITE_END]);
+  char *output = reader (pipefd[READ_END]);
+  double elapsed = now_ns () - start;
+
+  close (pipefd[READ_END]);
+  waitpid (pid, NULL, 0);
+  if (output == NULL || strlen (output) != payload_size)
+    {
+      fprintf (stderr, "Error: short read\n");
+      exit (EXIT_FAILURE);
+    }
+  free (output);
+  return elapsed;
+}
+
+static double
+run_memfd_reader (void)
+{
+  int memfd = memfd_create ("bench", MFD_CLOEXEC);
+  if (memfd == -1)
+    {
+      perror ("memfd_create");
+      exit (EXIT_FAILURE);
+    }
+
+  double start = now_ns ();
+  pid_t pid = start_writer (memfd);
+  waitpid (pid, NULL, 0);
+  struct stat st;
+  fstat (memfd, &st);
+  const char *data
+      = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, memfd, 0);
+  // Touch every page so the comparison includes making the data resident
+  volatile char sink = 0;
+  for (off_t off = 0; off < st.st_size; off += 4096)
+    {
+      sink ^= data[off];
+    }
+  double elapsed = now_ns () - start;
+  (void)sink;
+
+  if ((size_t)st.st_size != payload_size)
+    {
+      fprintf (stderr, "Error: short memfd capture\n");
+      exit (EXIT_FAILURE);
+    }
+  munmap ((void *)data, (size_t)st.st_size);
+  close (memfd);
+  return elapsed;
+}
+
+static void
+report (const char *label, double total_ns, unsigned long calls,
+        int iterations)
+{
+  printf ("%-7s %8zu KiB  %8.2f ms  %7.3f ns/byte  %8.1f read()s\n", label,
+          payload_size / 1024, total_ns / iterations / 1e6,
+          total_ns / iterations / (double)payload_size,
+          (double)calls / iterations);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+    {
+      fprintf (stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  for (size_t i = 0; i < sizeof (payload_sizes) / sizeof (payload_sizes[0]);
+       i++)
+    {
+      payload_size = payload_sizes[i];
+      payload = malloc (payload_size);
+      if (payload == NULL)
+        {
+          perror ("malloc");
+          return EXIT_FAILURE;
+        }
+      for (size_t j = 0; j < payload_size; j++)
+        {
+          payload[j] = filler[j % (sizeof (filler) - 1)];
+        }
+
+      double total = 0;
+      read_calls = 0;
+      for (int it = 0; it < iterations; it++)
+        {
+          total += run_pipe_reader (legacy_read_from_pipe);
+        }
+      report ("legacy", total, read_calls, iterations);
+
+      total = 0;
+      read_calls = 0;
+      for (int it = 0; it < iterations; it++)
+        {
+          total += run_pipe_reader (read_from_pipe);
+        }
+      report ("pipe", total, read_calls, iterations);
+
+      total = 0;
+      read_calls = 0;
+      for (int it = 0; it < iterations; it++)
+        {
+          total += run_memfd_reader ();
+        }
+      report ("memfd", total, read_calls, iterations);
+
+      free (payload);
+    }
+
+  return EXIT_SUCCESS;
+}
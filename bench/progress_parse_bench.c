@@ -0,0 +1,187 @@
+/**
+ * progress_parse_bench.c
+ *
+ * Measures how fast the parent digests a download's progress output: a
+ * synthesized yt-dlp stdout (PROGRESS_TEMPLATE lines for a video and an
+ * audio stream, with the usual [info]/[download]/[Merger] chatter between
+ * them) is split by progress_line_reader_feed() and each line handed to
+ * parse_progress_line(), the way a curses download does it.
+ *
+ * The output is fed in chunks of several sizes, since pipe reads cut lines
+ * at arbitrary places and cut lines are the ones assembled in the reader's
+ * buffer. For each chunk size the throughput in lines per second and the
+ * heap allocations per line are reported; allocations are counted through
+ * the linker's --wrap and should be zero.
+ *
+ * Usage: bench/progress_parse_bench [ITERATIONS]
+ */
+
+#define _GNU_SOURCE
+#include "../progress_parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 50
+// Progress updates per stream in the synthesized output
+#define UPDATES_PER_STREAM 20000
+
+static unsigned long allocation_count = 0;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t count, size_t size);
+void *__real_realloc (void *pointer, size_t size);
+
+void *
+__wrap_malloc (size_t size)
+{
+  allocation_count++;
+  return __real_malloc (size);
+}
+
+void *
+__wrap_calloc (size_t count, size_t size)
+{
+  allocation_count++;
+  return __real_calloc (count, size);
+}
+
+void *
+__wrap_realloc (void *pointer, size_t size)
+{
+  allocation_count++;
+  return __real_realloc (pointer, size);
+}
+
+typedef struct
+{
+  size_t lines;
+  size_t updates;
+  long long last_downloaded;
+} Tally;
+
+static double
+now_ms (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void
+count_line (const char *line, size_t length, void *user_data)
+{
+  Tally *tally = user_data;
+  ProgressUpdate update;
+  tally->lines++;
+  if (parse_progress_line (line, length, &update))
+    {
+      tally->updates++;
+      tally->last_downloaded = update.downloaded;
+    }
+}
+
+/**
+ * Synthesize the stdout of a two-stream download.
+ * @param length Receives the size of the output
+ * @return Allocated output
+ */
+static char *
+synthesize_output (size_t *length)
+{
+  size_t capacity = (size_t)UPDATES_PER_STREAM * 2 * 160 + 4096;
+  char *text = malloc (capacity);
+  if (text == NULL)
+    {
+      perror ("malloc");
+      exit (EXIT_FAILURE);
+    }
+
+  size_t used = 0;
+  used += (size_t)snprintf (text + used, capacity - used,
+                            "[youtube] Extracting URL: https://www.youtube."
+                            "com/watch?v=example\n"
+                            "[info] example: Downloading 1 format(s): "
+                            "137+140\n");
+  long long sizes[2] = { 187654321, 9876543 };
+  for (int stream = 0; stream < 2; stream++)
+    {
+      used += (size_t)snprintf (text + used, capacity - used,
+                                "[download] Destination: /tmp/Example "
+                                "video.f%s.mp4\n",
+                                stream == 0 ? "137" : "140");
+      for (int i = 1; i <= UPDATES_PER_STREAM; i++)
+        {
+          long long done = sizes[stream] * i / UPDATES_PER_STREAM;
+          double speed = 52428800.0 + i * 0.37;
+          used += (size_t)snprintf (
+              text + used, capacity - used,
+              PROGRESS_LINE_PREFIX " %s %lld %lld NA %.6f %lld\n",
+              i == UPDATES_PER_STREAM ? "finished" : "downloading", done,
+              sizes[stream], speed,
+              (long long)((sizes[stream] - done) / speed));
+        }
+    }
+  used += (size_t)snprintf (text + used, capacity - used,
+                            "[Merger] Merging formats into \"/tmp/Example "
+                            "video.mp4\"\n");
+  *length = used;
+  return text;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations < 1)
+    {
+      fprintf (stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  size_t length;
+  char *text = synthesize_output (&length);
+  printf ("%zu bytes of output, %d updates, %d iterations\n", length,
+          UPDATES_PER_STREAM * 2, iterations);
+
+  size_t chunk_sizes[] = { 61, 512, 4096, 65536 };
+  for (size_t c = 0; c < sizeof (chunk_sizes) / sizeof (chunk_sizes[0]); c++)
+    {
+      size_t chunk = chunk_sizes[c];
+      Tally tally = { 0 };
+      ProgressLineReader reader;
+      unsigned long allocations_before = allocation_count;
+      double start = now_ms ();
+      for (int i = 0; i < iterations; i++)
+        {
+          progress_line_reader_init (&reader);
+          for (size_t offset = 0; offset < length; offset += chunk)
+            {
+              size_t n = length - offset < chunk ? length - offset : chunk;
+              progress_line_reader_feed (&reader, text + offset, n,
+                                         count_line, &tally);
+            }
+          progress_line_reader_finish (&reader, count_line, &tally);
+        }
+      double elapsed = now_ms () - start;
+      unsigned long allocations = allocation_count - allocations_before;
+
+      if (tally.updates != (size_t)UPDATES_PER_STREAM * 2 * iterations)
+        {
+          fprintf (stderr, "Error: parsed %zu updates, expected %zu\n",
+                   tally.updates,
+                   (size_t)UPDATES_PER_STREAM * 2 * iterations);
+          return EXIT_FAILURE;
+        }
+      printf ("chunk %6zu: %7.1f M lines/s  %6.1f MB/s  %.3f allocations "
+              "per line\n",
+              chunk, tally.lines / elapsed / 1e3,
+              (double)length * iterations / elapsed / 1e3,
+              (double)allocations / tally.lines);
+    }
+
+  free (text);
+  return EXIT_SUCCESS;
+}
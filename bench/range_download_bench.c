@@ -0,0 +1,384 @@
+/**
+ * range_download_bench.c
+ *
+ * The native range downloader against a throttling HTTP server run in
+ * this process on 127.0.0.1, so no network is involved. The server sends
+ * every connection at RATE MB/s, as CDNs that throttle per connection do,
+ * except every SLOW_EVERY-th connection from the second on, which gets
+ * RATE / SLOW_FACTOR: those are the ranges the downloader has to split
+ * or restart.
+ *
+ * For each connection count the time, throughput, HTTP requests, splits
+ * and restarts are reported, and the file is checked byte by byte against
+ * the content served. Then two downloads that must fail: one expecting a
+ * size the server does not report, and one from a server ignoring range
+ * requests. Neither may leave a file behind.
+ *
+ * Usage: bench/range_download_bench [SIZE_MB] [RATE_MB] [DIRECTORY]
+ */
+
+#define _GNU_SOURCE
+#include "../range_download.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_SIZE_MB 32
+#define DEFAULT_RATE_MB 8
+#define DEFAULT_DIRECTORY "/var/tmp"
+#define SLOW_EVERY 4
+#define SLOW_FACTOR 20
+#define CHUNK (16 * 1024)
+
+// How the fixture answers range requests
+typedef enum
+{
+  SERVE_RANGES,
+  SERVE_WHOLE // ignores Range and sends 200 with the whole file
+} ServeMode;
+
+typedef struct
+{
+  int listener;
+  long long size;
+  double rate; // bytes per second per connection
+  ServeMode mode;
+  pthread_mutex_t lock;
+  unsigned long connections;
+} Fixture;
+
+typedef struct
+{
+  Fixture *fixture;
+  int fd;
+  double rate;
+} Connection;
+
+static double
+now_ms (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/**
+ * Byte at an offset of the file served: position dependent, so a range
+ * written at the wrong offset shows.
+ */
+static unsigned char
+content_byte (long long offset)
+{
+  uint64_t x = (uint64_t)offset;
+  return (unsigned char)((x * 31) ^ (x >> 11) ^ (x >> 19));
+}
+
+/**
+ * Answer one request on a connection, throttled to its rate.
+ */
+static void *
+serve_connection (void *data)
+{
+  Connection *connection = data;
+  Fixture *fixture = connection->fixture;
+  char request[8192];
+  size_t length = 0;
+  while (length < sizeof (request) - 1)
+    {
+      ssize_t n = recv (connection->fd, request + length,
+                        sizeof (request) - 1 - length, 0);
+      if (n <= 0)
+        {
+          break;
+        }
+      length += (size_t)n;
+      request[length] = '\0';
+      if (strstr (request, "\r\n\r\n") != NULL)
+        {
+          break;
+        }
+    }
+  request[length] = '\0';
+
+  long long first = 0, last = fixture->size - 1;
+  int ranged = 0;
+  for (char *line = strstr (request, "\r\n"); line != NULL;
+       line = strstr (line + 2, "\r\n"))
+    {
+      if (strncasecmp (line + 2, "Range: bytes=", 13) == 0
+          && sscanf (line + 15, "%lld-%lld", &first, &last) >= 1)
+        {
+          ranged = fixture->mode == SERVE_RANGES;
+        }
+    }
+  if (!ranged)
+    {
+      first = 0;
+      last = fixture->size - 1;
+    }
+  if (last >= fixture->size)
+    {
+      last = fixture->size - 1;
+    }
+
+  char header[512];
+  int header_length;
+  if (ranged)
+    {
+      header_length = snprintf (
+          header, sizeof (header),
+          "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes "
+          "%lld-%lld/%lld\r\nContent-Length: %lld\r\nConnection: "
+          "close\r\n\r\n",
+          first, last, fixture->size, last - first + 1);
+    }
+  else
+    {
+      header_length = snprintf (header, sizeof (header),
+                                "HTTP/1.1 200 OK\r\nContent-Length: %lld\r\n"
+                                "Connection: close\r\n\r\n",
+                                fixture->size);
+    }
+  send (connection->fd, header, (size_t)header_length, MSG_NOSIGNAL);
+
+  unsigned char chunk[CHUNK];
+  double start = now_ms ();
+  long long sent = 0;
+  for (long long offset = first; offset <= last;)
+    {
+      size_t n = last - offset + 1 < CHUNK ? (size_t)(last - offset + 1)
+                                           : CHUNK;
+      for (size_t i = 0; i < n; i++)
+        {
+          chunk[i] = content_byte (offset + (long long)i);
+        }
+      if (send (connection->fd, chunk, n, MSG_NOSIGNAL) != (ssize_t)n)
+        {
+          break; // the downloader cut this range short
+        }
+      offset += (long long)n;
+      sent += (long long)n;
+      double due = start + (double)sent * 1e3 / connection->rate;
+      double wait = due - now_ms ();
+      if (wait > 0)
+        {
+          struct timespec ts = { (time_t)(wait / 1e3),
+                                 (long)(wait * 1e6) % 1000000000L };
+          nanosleep (&ts, NULL);
+        }
+    }
+  close (connection->fd);
+  free (connection);
+  return NULL;
+}
+
+/**
+ * Accept connections until the listener is shut down.
+ */
+static void *
+accept_connections (void *data)
+{
+  Fixture *fixture = data;
+  for (;;)
+    {
+      int fd = accept (fixture->listener, NULL, NULL);
+      if (fd < 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          return NULL;
+        }
+      Connection *connection = malloc (sizeof (*connection));
+      if (connection == NULL)
+        {
+          close (fd);
+          continue;
+        }
+      pthread_mutex_lock (&fixture->lock);
+      unsigned long number = fixture->connections++;
+      pthread_mutex_unlock (&fixture->lock);
+      connection->fixture = fixture;
+      connection->fd = fd;
+      connection->rate = number % SLOW_EVERY == 1 ? fixture->rate / SLOW_FACTOR
+                                                  : fixture->rate;
+      pthread_t thread;
+      if (pthread_create (&thread, NULL, serve_connection, connection) != 0)
+        {
+          close (fd);
+          free (connection);
+          continue;
+        }
+      pthread_detach (thread);
+    }
+}
+
+/**
+ * Compare a downloaded file with the content served.
+ * @return 0 if identical, -1 if not
+ */
+static int
+verify_file (const char *path, long long size)
+{
+  int fd = open (path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat (fd, &st) != 0 || st.st_size != size)
+    {
+      if (fd >= 0)
+        {
+          close (fd);
+        }
+      return -1;
+    }
+  unsigned char *data = mmap (NULL, (size_t)size, PROT_READ, MAP_PRIVATE,
+                              fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      return -1;
+    }
+  long long offset = 0;
+  while (offset < size && data[offset] == content_byte (offset))
+    {
+      offset++;
+    }
+  munmap (data, (size_t)size);
+  return offset == size ? 0 : -1;
+}
+
+/**
+ * Run a download that must fail, and check it left nothing behind.
+ * @return 0 if it failed cleanly, -1 if not
+ */
+static int
+expect_failure (const char *what, const RangeRequest *request)
+{
+  char partial[4200];
+  snprintf (partial, sizeof (partial), "%s.part", request->path);
+  int result = range_download (request, NULL, NULL, NULL);
+  if (result == 0 || access (request->path, F_OK) == 0
+      || access (partial, F_OK) == 0)
+    {
+      fprintf (stderr, "Error: %s was not refused cleanly\n", what);
+      unlink (request->path);
+      unlink (partial);
+      return -1;
+    }
+  printf ("%-24s refused, nothing left behind\n", what);
+  return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  long long size_mb = argc > 1 ? atoll (argv[1]) : DEFAULT_SIZE_MB;
+  double rate_mb = argc > 2 ? atof (argv[2]) : DEFAULT_RATE_MB;
+  const char *parent = argc > 3 ? argv[3] : DEFAULT_DIRECTORY;
+  if (size_mb < 1 || rate_mb <= 0)
+    {
+      fprintf (stderr, "Usage: %s [SIZE_MB] [RATE_MB] [DIRECTORY]\n",
+               argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  Fixture fixture = { .size = size_mb * 1024 * 1024,
+                      .rate = rate_mb * 1e6,
+                      .mode = SERVE_RANGES };
+  pthread_mutex_init (&fixture.lock, NULL);
+  struct sockaddr_in address = { .sin_family = AF_INET };
+  address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  socklen_t address_length = sizeof (address);
+  fixture.listener = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fixture.listener < 0
+      || bind (fixture.listener, (struct sockaddr *)&address,
+               sizeof (address))
+             != 0
+      || listen (fixture.listener, 64) != 0
+      || getsockname (fixture.listener, (struct sockaddr *)&address,
+                      &address_length)
+             != 0)
+    {
+      perror ("listen");
+      return EXIT_FAILURE;
+    }
+  pthread_t acceptor;
+  pthread_create (&acceptor, NULL, accept_connections, &fixture);
+
+  char directory[4096];
+  snprintf (directory, sizeof (directory), "%s/ytdl-range-bench-XXXXXX",
+            parent);
+  if (mkdtemp (directory) == NULL)
+    {
+      perror ("mkdtemp");
+      return EXIT_FAILURE;
+    }
+  char url[64];
+  snprintf (url, sizeof (url), "http://127.0.0.1:%d/video.mp4",
+            ntohs (address.sin_port));
+  char path[4200];
+  snprintf (path, sizeof (path), "%s/video.mp4", directory);
+  const char *const headers[] = { "User-Agent: range_download_bench", NULL };
+
+  printf ("%lld MB at %.1f MB/s per connection, every %d. connection "
+          "%d times slower\n",
+          size_mb, rate_mb, SLOW_EVERY, SLOW_FACTOR);
+  int status = EXIT_SUCCESS;
+  int counts[] = { 1, 2, 4, 8, 16 };
+  for (size_t c = 0; c < sizeof (counts) / sizeof (counts[0]); c++)
+    {
+      pthread_mutex_lock (&fixture.lock);
+      fixture.connections = 0;
+      pthread_mutex_unlock (&fixture.lock);
+      RangeRequest request = { url, headers, fixture.size, path, counts[c],
+                               0 };
+      RangeStats stats;
+      if (range_download (&request, NULL, NULL, &stats) != 0
+          || verify_file (path, fixture.size) != 0)
+        {
+          fprintf (stderr, "Error: download with %d connections is wrong\n",
+                   counts[c]);
+          status = EXIT_FAILURE;
+        }
+      else
+        {
+          printf ("%2d connections: %7.2f s  %7.1f MB/s  %3zu requests  "
+                  "%3zu splits  %2zu restarts\n",
+                  counts[c], stats.elapsed_ms / 1e3,
+                  stats.bytes / 1e3 / stats.elapsed_ms, stats.requests,
+                  stats.splits, stats.restarts);
+        }
+      unlink (path);
+    }
+
+  RangeRequest wrong_size = { url, headers, fixture.size + 1, path, 4, 0 };
+  if (expect_failure ("wrong size", &wrong_size) != 0)
+    {
+      status = EXIT_FAILURE;
+    }
+  fixture.mode = SERVE_WHOLE;
+  RangeRequest ignored = { url, headers, fixture.size, path, 4, 0 };
+  if (expect_failure ("ranges ignored", &ignored) != 0)
+    {
+      status = EXIT_FAILURE;
+    }
+
+  shutdown (fixture.listener, SHUT_RDWR);
+  pthread_join (acceptor, NULL);
+  close (fixture.listener);
+  rmdir (directory);
+  return status;
+}
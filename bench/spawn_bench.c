@@ -0,0 +1,167 @@
+/**
+ * spawn_bench.c
+ *
+ * Measures spawn-to-exec latency of the legacy fork()+execvp() launcher
+ * against spawn_process() while the parent holds an increasingly large,
+ * fully touched heap (standing in for the ncurses screen, jansson trees and
+ * metadata buffers ytdl carries when it launches yt-dlp).
+ *
+ * Latency is the time from the launch call until the exec has happened,
+ * observed as EOF on a close-on-exec pipe whose write end only the child
+ * holds. The child runs /bin/true and is reaped outside the timed region.
+ *
+ * Usage: bench/spawn_bench [ITERATIONS]
+ */
+
+#define _GNU_SOURCE
+#include "../command_execution.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERATIONS 200
+#define BENCH_COMMAND "true"
+
+static const size_t rss_sizes_mb[] = { 0, 64, 256, 1024 };
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/**
+ * Launch via the original fork()+execvp() path.
+ */
+static pid_t
+launch_fork (char *const argv[], int marker_fd)
+{
+  pid_t pid = fork_process ();
+  if (pid == 0)
+    {
+      (void)marker_fd; // inherited, closed by exec (O_CLOEXEC)
+      execvp (BENCH_COMMAND, argv);
+      _exit (127);
+    }
+  return pid;
+}
+
+/**
+ * Launch via posix_spawn with the cached executable path.
+ */
+static pid_t
+launch_spawn (char *const argv[], int marker_fd)
+{
+  (void)marker_fd;
+  return spawn_process (BENCH_COMMAND, argv, -1, -1);
+}
+
+/**
+ * Time a single launch until exec, in nanoseconds.
+ */
+static double
+time_launch (pid_t (*launch) (char *const[], int), char *const argv[])
+{
+  int marker[2];
+  if (pipe2 (marker, O_CLOEXEC) == -1)
+    {
+      perror ("pipe2");
+      exit (EXIT_FAILURE);
+    }
+
+  double start = now_ns ();
+  pid_t pid = launch (argv, marker[WRITE_END]);
+  close (marker[WRITE_END]);
+
+  char byte;
+  while (read (marker[READ_END], &byte, 1) > 0)
+    ;
+  double elapsed = now_ns () - start;
+  close (marker[READ_END]);
+
+  if (pid <= 0)
+    {
+      fprintf (stderr, "Error: launch failed\n");
+      exit (EXIT_FAILURE);
+    }
+  waitpid (pid, NULL, 0);
+  return elapsed;
+}
+
+static int
+compare_double (const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void
+run_series (const char *label, size_t rss_mb,
+            pid_t (*launch) (char *const[], int), char *const argv[],
+            int iterations)
+{
+  double *samples = malloc (sizeof (double) * iterations);
+  if (samples == NULL)
+    {
+      perror ("malloc");
+      exit (EXIT_FAILURE);
+    }
+
+  for (int i = 0; i < iterations; i++)
+    {
+      samples[i] = time_launch (launch, argv);
+    }
+  qsort (samples, iterations, sizeof (double), compare_double);
+
+  printf ("%-6s %6zu MB  p50 %9.1f us  p99 %9.1f us\n", label, rss_mb,
+          samples[iterations / 2] / 1e3,
+          samples[(iterations * 99) / 100] / 1e3);
+  free (samples);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+    {
+      fprintf (stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  char *const child_argv[] = { BENCH_COMMAND, NULL };
+  char *ballast = NULL;
+
+  printf ("launcher  parent RSS   latency (spawn call -> exec)\n");
+  for (size_t i = 0; i < sizeof (rss_sizes_mb) / sizeof (rss_sizes_mb[0]);
+       i++)
+    {
+      size_t bytes = rss_sizes_mb[i] * 1024 * 1024;
+      free (ballast);
+      ballast = NULL;
+      if (bytes > 0)
+        {
+          ballast = malloc (bytes);
+          if (ballast == NULL)
+            {
+              perror ("malloc");
+              return EXIT_FAILURE;
+            }
+          memset (ballast, 0xA5, bytes); // fault every page in
+        }
+
+      run_series ("fork", rss_sizes_mb[i], launch_fork, child_argv,
+                  iterations);
+      run_series ("spawn", rss_sizes_mb[i], launch_spawn, child_argv,
+                  iterations);
+    }
+
+  free (ballast);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+/**
+ * structural_scan_bench.c
+ *
+ * Bulk-ingestion throughput of the format table builders over a corpus of
+ * info documents, in GB/s of JSON consumed:
+ *
+ *   jansson  json_loadb() of the whole document, then build_format_table()
+ *   scalar   scan_format_table(), containers skipped a byte at a time
+ *   sse2     scan_format_table(), containers skipped 64 bytes at a time
+ *   avx2     (with SSE2 and AVX2 block classifiers respectively)
+ *
+ * The corpus is CORPUS_DOCUMENTS synthesized documents (see info_fixture.h)
+ * cycling through short, typical and long videos, or the files named on
+ * the command line (e.g. a directory of saved `yt-dlp -j` output).
+ * Instruction sets the CPU lacks are reported as unsupported.
+ *
+ * Usage: bench/structural_scan_bench [ITERATIONS] [FILE...]
+ */
+
+#define _GNU_SOURCE
+#include "../json_scan.h"
+#include "info_fixture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 5
+#define CORPUS_DOCUMENTS 48
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static FormatTable *
+parse_jansson (const Text *text)
+{
+  json_error_t error;
+  json_t *root = json_loadb (text->data, text->length, 0, &error);
+  FormatTable *table = root ? build_format_table (root) : NULL;
+  json_decref (root);
+  return table;
+}
+
+static FormatTable *
+parse_scan (const Text *text)
+{
+  return scan_format_table (text->data, text->length);
+}
+
+/**
+ * Parse the whole corpus ITERATIONS times.
+ * @param formats Receives the formats found in one pass over the corpus
+ * @return GB/s
+ */
+static double
+ingest (FormatTable *(*parse) (const Text *), const Text *corpus,
+        size_t count, int iterations, size_t *formats)
+{
+  size_t bytes = 0;
+  double start = now_ns ();
+  for (int i = 0; i < iterations; i++)
+    {
+      *formats = 0;
+      for (size_t k = 0; k < count; k++)
+        {
+          FormatTable *table = parse (&corpus[k]);
+          if (table == NULL)
+            {
+              fprintf (stderr, "Error: document %zu rejected\n", k);
+              exit (EXIT_FAILURE);
+            }
+          *formats += table->count;
+          bytes += corpus[k].length;
+          free_format_table (table);
+        }
+    }
+  return (double)bytes / (now_ns () - start);
+}
+
+/**
+ * Read a whole file into memory.
+ * @return 0 on success, -1 on error
+ */
+static int
+load_file (const char *path, Text *text)
+{
+  FILE *file = fopen (path, "rb");
+  if (file == NULL)
+    {
+      perror (path);
+      return -1;
+    }
+  char chunk[64 * 1024];
+  size_t bytes_read;
+  while ((bytes_read = fread (chunk, 1, sizeof (chunk), file)) > 0)
+    {
+      append (text, "%.*s", (int)bytes_read, chunk);
+    }
+  int failed = ferror (file);
+  fclose (file);
+  return failed ? -1 : 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+    {
+      fprintf (stderr, "Usage: %s [ITERATIONS] [FILE...]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  static const FixtureShape shapes[] = {
+    { 8, 0, 4, 10, 0 },      // short clip, progressive formats only
+    { 30, 120, 40, 150, 0 }, // typical YouTube video
+    { 120, 600, 80, 300, 0 } // long video, many DASH formats
+  };
+  size_t count = argc > 2 ? (size_t)(argc - 2) : CORPUS_DOCUMENTS;
+  Text *corpus = calloc (count, sizeof (Text));
+  if (corpus == NULL)
+    {
+      perror ("calloc");
+      return EXIT_FAILURE;
+    }
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++)
+    {
+      if (argc > 2)
+        {
+          if (load_file (argv[i + 2], &corpus[i]) != 0)
+            {
+              return EXIT_FAILURE;
+            }
+        }
+      else
+        {
+          build_info_fixture (&shapes[i % 3], &corpus[i], NULL);
+        }
+      total += corpus[i].length;
+    }
+
+  printf ("corpus: %zu documents, %.1f MB, %d iterations\n", count,
+          (double)total / 1e6, iterations);
+
+  size_t reference;
+  double jansson
+      = ingest (parse_jansson, corpus, count, iterations, &reference);
+  printf ("%-8s %8.3f GB/s\n", "jansson", jansson);
+
+  for (JsonScanIsa isa = JSON_SCAN_ISA_SCALAR; isa <= JSON_SCAN_ISA_AVX2;
+       isa++)
+    {
+      if (json_scan_set_isa (isa) != 0)
+        {
+          printf ("%-8s unsupported\n", json_scan_isa_name (isa));
+          continue;
+        }
+      size_t formats;
+      double rate = ingest (parse_scan, corpus, count, iterations, &formats);
+      if (formats != reference)
+        {
+          fprintf (stderr, "Error: %s found %zu formats, jansson %zu\n",
+                   json_scan_isa_name (isa), formats, reference);
+          return EXIT_FAILURE;
+        }
+      printf ("%-8s %8.3f GB/s  %6.1fx jansson\n", json_scan_isa_name (isa),
+              rate, rate / jansson);
+    }
+
+  for (size_t i = 0; i < count; i++)
+    {
+      free (corpus[i].data);
+    }
+  free (corpus);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+/**
+ * zygote_bench.c
+ *
+ * Measures per-invocation latency of yt-dlp launched directly (a fresh
+ * interpreter that imports yt_dlp every time) against runs forked from the
+ * zygote (imported once, up front). Each sample is a complete
+ * execute_command_capture() call: launch, stdout/stderr capture and reap.
+ *
+ * With no URL the command is `yt-dlp --version`, which isolates startup
+ * cost. With a URL it is `yt-dlp -j URL`, closer to get_video_info() but
+ * dominated by network time.
+ *
+ * The zygote's own startup (one interpreter plus one import) is reported
+ * separately; it is paid once per ytdl run.
+ *
+ * Usage: bench/zygote_bench [ITERATIONS] [URL]
+ */
+
+#define _GNU_SOURCE
+#include "../command_execution.h"
+#include "../zygote.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 20
+
+static double
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int
+compare_double (const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Run the command repeatedly and print latency percentiles.
+ * @return Median latency in nanoseconds
+ */
+static double
+run_series (const char *label, char *const argv[], int iterations)
+{
+  double *samples = malloc (sizeof (double) * iterations);
+  if (samples == NULL)
+    {
+      perror ("malloc");
+      exit (EXIT_FAILURE);
+    }
+
+  for (int i = 0; i < iterations; i++)
+    {
+      CommandResult result;
+      double start = now_ns ();
+      if (execute_command_capture (ZYGOTE_COMMAND, argv, &result) == -1)
+        {
+          fprintf (stderr, "Error: %s run %d failed\n", label, i);
+          exit (EXIT_FAILURE);
+        }
+      samples[i] = now_ns () - start;
+      free (result.output);
+    }
+  qsort (samples, iterations, sizeof (double), compare_double);
+
+  double median = samples[iterations / 2];
+  printf ("%-7s p50 %8.1f ms  p99 %8.1f ms  min %8.1f ms\n", label,
+          median / 1e6, samples[(iterations * 99) / 100] / 1e6,
+          samples[0] / 1e6);
+  free (samples);
+  return median;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int iterations = argc > 1 ? atoi (argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0)
+    {
+      fprintf (stderr, "Usage: %s [ITERATIONS] [URL]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  char *version_argv[] = { ZYGOTE_COMMAND, "--version", NULL };
+  char *info_argv[] = { ZYGOTE_COMMAND, "-j", argc > 2 ? argv[2] : NULL,
+                        NULL };
+  char **child_argv = argc > 2 ? info_argv : version_argv;
+
+  printf ("command: %s %s%s%s\n", ZYGOTE_COMMAND, child_argv[1],
+          argc > 2 ? " " : "", argc > 2 ? argv[2] : "");
+
+  double direct = run_series ("direct", child_argv, iterations);
+
+  double start = now_ns ();
+  if (zygote_start (NULL) != 0)
+    {
+      return EXIT_FAILURE;
+    }
+  printf ("zygote startup %.1f ms (once per ytdl run)\n",
+          (now_ns () - start) / 1e6);
+
+  double forked = run_series ("zygote", child_argv, iterations);
+  zygote_stop ();
+
+  printf ("speedup %.1fx at the median\n", direct / forked);
+  return EXIT_SUCCESS;
+}
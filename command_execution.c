@@ -1,16 +1,70 @@
+#define _GNU_SOURCE
 #include "command_execution.h"
+#include "zygote.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+extern char **environ;
+
+// posix_spawn can close every inherited descriptor above stderr (glibc 2.34+)
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 34)
+#define HAVE_SPAWN_CLOSEFROM 1
+#endif
+#endif
+
+// Pipe capacity requested for command output (Linux caps unprivileged
+// requests at /proc/sys/fs/pipe-max-size, 1 MiB by default)
+#define PIPE_CAPTURE_SIZE (1024 * 1024)
+// Minimum spare buffer capacity offered to each read() of command output
+#define PIPE_READ_CHUNK (256 * 1024)
+
+// Number of distinct commands whose resolved executable path is cached
+#define COMMAND_PATH_CACHE_SIZE 8
+// Search path used when PATH is unset (matches execvp's default)
+#define DEFAULT_SEARCH_PATH "/bin:/usr/bin"
+// Seconds between the RLIMIT_CPU soft limit (SIGXCPU) and the hard one
+#define CPU_LIMIT_HARD_GRACE 5
+
+typedef struct
+{
+  char name[64];
+  char path[MAX_PATH_LENGTH];
+} CommandPathEntry;
+
+static CommandPathEntry command_path_cache[COMMAND_PATH_CACHE_SIZE];
+static size_t command_path_cache_count = 0;
+static size_t command_path_cache_next = 0;
+
+static CommandLimits command_limits = { 0 };
+static volatile sig_atomic_t cancel_requested = 0;
+// Children spawned but not yet reaped; the cancel handler only intercepts
+// SIGINT/SIGTERM while there is something to cancel. Atomic because the
+// playlist reader thread spawns and reaps too (lock-free, so still safe to
+// read from the handler).
+static atomic_int running_children = 0;
+// Serialises the zygote registry and the command path cache between
+// threads; held across a spawn since the resolved path lives in the cache
+static pthread_mutex_t process_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Safely close a file descriptor with error checking.
  * @param fd File descriptor to close
@@ -24,248 +78,1588 @@ safe_close (int fd)
       perror ("close");
       return -1;
     }
-  return 0;
+  return 0;
+}
+
+/**
+ * Print the most relevant part of a child's stderr tail: the last line
+ * yt-dlp tagged with "ERROR:", or failing that the last non-empty line.
+ * @param tail Captured stderr tail (can be NULL)
+ */
+static void
+report_stderr_tail (const StderrTail *tail)
+{
+  if (tail == NULL || tail->length == 0)
+    {
+      return;
+    }
+
+  char text[STDERR_TAIL_SIZE + 1];
+  stderr_tail_read (tail, text, sizeof (text));
+
+  const char *report = NULL;
+  for (char *line = strtok (text, "\r\n"); line != NULL;
+       line = strtok (NULL, "\r\n"))
+    {
+      if (strncmp (line, "ERROR:", 6) == 0)
+        {
+          report = line;
+        }
+      else if (line[strspn (line, " \t")] != '\0'
+               && (report == NULL || strncmp (report, "ERROR:", 6) != 0))
+        {
+          report = line;
+        }
+    }
+
+  if (report != NULL)
+    {
+      fprintf (stderr, "  %s\n", report);
+    }
+}
+
+/**
+ * Validate child process exit status and handle errors.
+ * @param command Command that was run (for error messages)
+ * @param status Process status from waitpid
+ * @param termination Limit or cancellation that stopped the child
+ * @param tail Captured stderr tail to report on failure (can be NULL)
+ * @param output Output buffer to free on error (can be NULL)
+ * @return exit status on success, -1 on error (frees output if provided)
+ */
+static int
+validate_child_status (const char *command, int status,
+                       CommandTermination termination,
+                       const StderrTail *tail, char **output)
+{
+  if (termination == COMMAND_TERMINATION_NONE && WIFEXITED (status)
+      && WEXITSTATUS (status) == 0)
+    {
+      return 0;
+    }
+
+  if (termination == COMMAND_TERMINATION_TIMEOUT)
+    {
+      fprintf (stderr, "Error: %s timed out after %.1f seconds\n", command,
+               command_limits.timeout_ms / 1000.0);
+    }
+  else if (termination != COMMAND_TERMINATION_NONE)
+    {
+      fprintf (stderr, "Error: %s %s\n", command,
+               command_termination_description (termination));
+    }
+  else if (WIFEXITED (status))
+    {
+      CommandErrorKind kind
+          = tail ? classify_command_error (tail) : COMMAND_ERROR_UNKNOWN;
+      fprintf (stderr, "Error: %s exited with status %d (%s)\n", command,
+               WEXITSTATUS (status), command_error_description (kind));
+    }
+  else if (WIFSIGNALED (status))
+    {
+      fprintf (stderr, "Error: %s was terminated by signal %d\n", command,
+               WTERMSIG (status));
+    }
+  else
+    {
+      fprintf (stderr, "Error: Child process did not exit normally\n");
+    }
+  if (termination != COMMAND_TERMINATION_CANCELLED)
+    {
+      report_stderr_tail (tail);
+    }
+
+  if (output && *output)
+    {
+      free (*output);
+      *output = NULL;
+    }
+  return -1;
+}
+
+/**
+ * Search PATH for an executable, the same way execvp() does.
+ * @param command Bare command name (no '/')
+ * @param resolved Output buffer of MAX_PATH_LENGTH bytes
+ * @return 0 if found, -1 otherwise
+ */
+static int
+search_path (const char *command, char *resolved)
+{
+  const char *search = getenv ("PATH");
+  if (search == NULL || *search == '\0')
+    {
+      search = DEFAULT_SEARCH_PATH;
+    }
+
+  const char *dir = search;
+  while (dir != NULL)
+    {
+      const char *sep = strchr (dir, ':');
+      size_t dir_len = sep ? (size_t)(sep - dir) : strlen (dir);
+
+      // An empty PATH element means the current directory
+      int written = snprintf (resolved, MAX_PATH_LENGTH, "%.*s%s%s",
+                              (int)dir_len, dir, dir_len ? "/" : "./",
+                              command);
+      if (written > 0 && written < MAX_PATH_LENGTH)
+        {
+          struct stat st;
+          if (stat (resolved, &st) == 0 && S_ISREG (st.st_mode)
+              && access (resolved, X_OK) == 0)
+            {
+              return 0;
+            }
+        }
+
+      dir = sep ? sep + 1 : NULL;
+    }
+
+  return -1;
+}
+
+/**
+ * Resolve a command to an executable path, caching the result so PATH is
+ * only walked once per command for the lifetime of the process.
+ * @param command Command name or path
+ * @return Executable path (owned by the cache), NULL if not found
+ */
+static const char *
+resolve_command_path (const char *command)
+{
+  // Explicit paths are used as given, like execvp()
+  if (strchr (command, '/') != NULL)
+    {
+      return command;
+    }
+
+  for (size_t i = 0; i < command_path_cache_count; i++)
+    {
+      if (strcmp (command_path_cache[i].name, command) == 0)
+        {
+          return command_path_cache[i].path;
+        }
+    }
+
+  if (strlen (command) >= sizeof (command_path_cache[0].name))
+    {
+      fprintf (stderr, "Error: Command name too long: %s\n", command);
+      return NULL;
+    }
+
+  // Search outside the cache: a failed lookup must not clobber the slot
+  // it would have taken
+  char resolved[MAX_PATH_LENGTH];
+  if (search_path (command, resolved) == -1)
+    {
+      fprintf (stderr, "Error: Command not found in PATH: %s\n", command);
+      return NULL;
+    }
+
+  // Reuse slots round-robin once the cache is full
+  CommandPathEntry *entry = &command_path_cache[command_path_cache_next];
+  snprintf (entry->path, sizeof (entry->path), "%s", resolved);
+  snprintf (entry->name, sizeof (entry->name), "%s", command);
+
+  command_path_cache_next
+      = (command_path_cache_next + 1) % COMMAND_PATH_CACHE_SIZE;
+  if (command_path_cache_count < COMMAND_PATH_CACHE_SIZE)
+    {
+      command_path_cache_count++;
+    }
+
+  return entry->path;
+}
+
+/**
+ * Forget all cached command paths (e.g. after PATH has been changed).
+ */
+void
+reset_command_path_cache (void)
+{
+  pthread_mutex_lock (&process_lock);
+  command_path_cache_count = 0;
+  command_path_cache_next = 0;
+  pthread_mutex_unlock (&process_lock);
+}
+
+/**
+ * Open a pidfd for a child so its exit can be waited on with poll/epoll.
+ * @param pid Child process id
+ * @return pidfd on success, -1 on error (errno set)
+ */
+static int
+open_pidfd (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+  return (int)syscall (SYS_pidfd_open, pid, 0);
+#else
+  (void)pid;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+/**
+ * Open a descriptor that becomes readable when a spawned command exits:
+ * a pidfd for our own children, the status socket for zygote runners.
+ * @param pid Process id returned by spawn_process()
+ * @return Descriptor (caller closes), -1 if none is available
+ */
+int
+open_child_exit_fd (pid_t pid)
+{
+  pthread_mutex_lock (&process_lock);
+  int status_fd = zygote_exit_fd (pid);
+  if (status_fd >= 0)
+    {
+      status_fd = fcntl (status_fd, F_DUPFD_CLOEXEC, 0);
+      pthread_mutex_unlock (&process_lock);
+      return status_fd;
+    }
+  pthread_mutex_unlock (&process_lock);
+  return open_pidfd (pid);
+}
+
+/**
+ * Collect a spawned command's exit status without blocking. Zygote
+ * runners are not our children, so their status arrives over a socket
+ * instead of from wait4().
+ * @param pid Process id returned by spawn_process()
+ * @param status Receives the wait status
+ * @param usage Receives resource usage (can be NULL)
+ * @return pid once collected, 0 while still running, -1 on error
+ */
+pid_t
+reap_child (pid_t pid, int *status, struct rusage *usage)
+{
+  pthread_mutex_lock (&process_lock);
+  if (zygote_owns (pid))
+    {
+      pid_t reaped = zygote_reap (pid, status, usage);
+      pthread_mutex_unlock (&process_lock);
+      return reaped;
+    }
+  pthread_mutex_unlock (&process_lock);
+
+  pid_t waited;
+  do
+    {
+      waited = wait4 (pid, status, WNOHANG, usage);
+    }
+  while (waited == -1 && errno == EINTR);
+  return waited;
+}
+
+/**
+ * Set the limits applied to commands spawned from now on.
+ * @param limits New limits (NULL removes all limits)
+ */
+void
+set_command_limits (const CommandLimits *limits)
+{
+  if (limits == NULL)
+    {
+      memset (&command_limits, 0, sizeof (command_limits));
+      return;
+    }
+  command_limits = *limits;
+}
+
+/**
+ * Limits currently applied to spawned commands.
+ * @return Current limits
+ */
+const CommandLimits *
+get_command_limits (void)
+{
+  return &command_limits;
+}
+
+/**
+ * Ask every running and future command to stop. Async-signal-safe, so it
+ * can be called straight from a SIGINT handler.
+ */
+void
+command_request_cancel (void)
+{
+  cancel_requested = 1;
+}
+
+/**
+ * Whether cancellation has been requested.
+ * @return Non-zero once command_request_cancel() has been called
+ */
+int
+command_cancel_requested (void)
+{
+  return cancel_requested;
+}
+
+/**
+ * SIGINT/SIGTERM handler for the text interface. Children run in their own
+ * process groups and never see the terminal's SIGINT, so the signal is
+ * turned into a cancellation request while one is running; otherwise the
+ * default action (terminate) is restored and the signal re-raised.
+ * @param sig Signal number
+ */
+static void
+cancel_signal_handler (int sig)
+{
+  if (running_children > 0)
+    {
+      cancel_requested = 1;
+      return;
+    }
+
+  struct sigaction sa;
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = SIG_DFL;
+  sigemptyset (&sa.sa_mask);
+  sigaction (sig, &sa, NULL);
+  raise (sig);
+}
+
+/**
+ * Route SIGINT and SIGTERM to command cancellation.
+ */
+void
+install_cancel_handler (void)
+{
+  struct sigaction sa;
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = cancel_signal_handler;
+  sigemptyset (&sa.sa_mask);
+  sa.sa_flags = 0; // interrupt poll() so cancellation is noticed at once
+
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGTERM, &sa, NULL);
+}
+
+/**
+ * Current CLOCK_MONOTONIC time.
+ * @return Seconds
+ */
+static double
+monotonic_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Apply the configured RLIMIT_AS/RLIMIT_CPU caps to a freshly spawned
+ * child. posix_spawn has no rlimit attribute, so prlimit() sets them from
+ * the parent; anything the child forks later inherits them.
+ * @param pid Child process id
+ */
+static void
+apply_resource_limits (pid_t pid)
+{
+  struct rlimit limit;
+
+  if (command_limits.memory_mb > 0)
+    {
+      limit.rlim_cur = (rlim_t)command_limits.memory_mb * 1024 * 1024;
+      limit.rlim_max = limit.rlim_cur;
+      if (prlimit (pid, RLIMIT_AS, &limit, NULL) == -1)
+        {
+          perror ("prlimit");
+        }
+    }
+
+  if (command_limits.cpu_seconds > 0)
+    {
+      limit.rlim_cur = (rlim_t)command_limits.cpu_seconds;
+      limit.rlim_max = limit.rlim_cur + CPU_LIMIT_HARD_GRACE;
+      if (prlimit (pid, RLIMIT_CPU, &limit, NULL) == -1)
+        {
+          perror ("prlimit");
+        }
+    }
+}
+
+/**
+ * Start tracking a spawned child's deadline.
+ * @param watch Watch to initialize
+ * @param pid Child process id (also its process group id)
+ */
+void
+child_watch_start (ChildWatch *watch, pid_t pid)
+{
+  memset (watch, 0, sizeof (ChildWatch));
+  watch->pid = pid;
+  if (command_limits.timeout_ms > 0)
+    {
+      watch->deadline
+          = monotonic_seconds () + command_limits.timeout_ms / 1000.0;
+    }
+}
+
+/**
+ * Signal a child's whole process group and note why.
+ * @param watch Watch of the child
+ * @param reason Termination reason to record
+ * @param now Current monotonic time
+ */
+static void
+terminate_child_group (ChildWatch *watch, CommandTermination reason,
+                       double now)
+{
+  watch->termination = reason;
+  watch->stage = 1;
+  watch->kill_deadline = now + COMMAND_KILL_GRACE_MS / 1000.0;
+  killpg (watch->pid, SIGTERM);
+}
+
+/**
+ * Enforce a child's deadline and any pending cancellation: SIGTERM to the
+ * process group first, SIGKILL once the grace period has passed. Call this
+ * whenever a wait wakes up.
+ * @param watch Watch of a running child
+ * @return Milliseconds until the next call is due (for poll timeouts)
+ */
+int
+child_watch_check (ChildWatch *watch)
+{
+  double now = monotonic_seconds ();
+
+  if (watch->stage == 0)
+    {
+      if (cancel_requested)
+        {
+          terminate_child_group (watch, COMMAND_TERMINATION_CANCELLED, now);
+        }
+      else if (watch->deadline > 0 && now >= watch->deadline)
+        {
+          terminate_child_group (watch, COMMAND_TERMINATION_TIMEOUT, now);
+        }
+    }
+  else if (watch->stage == 1 && now >= watch->kill_deadline)
+    {
+      killpg (watch->pid, SIGKILL);
+      watch->stage = 2;
+      watch->kill_deadline = 0;
+    }
+
+  // Wake regularly anyway: a signal can land just before poll() sleeps
+  double next = now + COMMAND_WATCH_INTERVAL_MS / 1000.0;
+  if (watch->stage == 0 && watch->deadline > 0 && watch->deadline < next)
+    {
+      next = watch->deadline;
+    }
+  if (watch->stage == 1 && watch->kill_deadline < next)
+    {
+      next = watch->kill_deadline;
+    }
+  return (int)((next - now) * 1000.0) + 1;
+}
+
+/**
+ * Settle why a reaped child stopped. Timeouts and cancellation are known
+ * directly; CPU and memory caps are recognised from the way the child died.
+ * @param watch Watch of the reaped child
+ * @param status Status from wait4()
+ * @param usage Resource usage from wait4() (can be NULL)
+ * @param tail Captured stderr tail (can be NULL)
+ * @return Termination reason
+ */
+CommandTermination
+child_watch_finish (ChildWatch *watch, int status, const struct rusage *usage,
+                    const StderrTail *tail)
+{
+  // Several threads reap children: only decrement a count above zero
+  int running = atomic_load (&running_children);
+  while (running > 0
+         && !atomic_compare_exchange_weak (&running_children, &running,
+                                           running - 1))
+    {
+    }
+  if (watch->termination != COMMAND_TERMINATION_NONE)
+    {
+      return watch->termination;
+    }
+
+  int sig = WIFSIGNALED (status) ? WTERMSIG (status) : 0;
+
+  if (command_limits.cpu_seconds > 0 && usage != NULL
+      && (sig == SIGXCPU || sig == SIGKILL))
+    {
+      double cpu = (double)usage->ru_utime.tv_sec + usage->ru_stime.tv_sec
+                   + (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1e6;
+      if (cpu + 1.0 >= (double)command_limits.cpu_seconds)
+        {
+          watch->termination = COMMAND_TERMINATION_CPU_LIMIT;
+        }
+    }
+
+  // Allocation failures surface as MemoryError or as a crash
+  if (watch->termination == COMMAND_TERMINATION_NONE
+      && command_limits.memory_mb > 0
+      && (sig == SIGSEGV || sig == SIGABRT || sig == SIGBUS
+          || (WIFEXITED (status) && WEXITSTATUS (status) != 0 && tail
+              && classify_command_error (tail)
+                     == COMMAND_ERROR_OUT_OF_MEMORY)))
+    {
+      watch->termination = COMMAND_TERMINATION_MEMORY_LIMIT;
+    }
+
+  return watch->termination;
+}
+
+/**
+ * Human-readable description of a termination reason.
+ * @param termination Termination reason
+ * @return Static description string
+ */
+const char *
+command_termination_description (CommandTermination termination)
+{
+  switch (termination)
+    {
+    case COMMAND_TERMINATION_TIMEOUT:
+      return "timed out";
+    case COMMAND_TERMINATION_CANCELLED:
+      return "was cancelled";
+    case COMMAND_TERMINATION_CPU_LIMIT:
+      return "exceeded its CPU time limit";
+    case COMMAND_TERMINATION_MEMORY_LIMIT:
+      return "exceeded its memory limit";
+    case COMMAND_TERMINATION_NONE:
+    default:
+      return "finished";
+    }
+}
+
+/**
+ * Wait for a child to exit while enforcing its deadline and cancellation.
+ * Sleeps on the child's exit descriptor when there is one, otherwise
+ * re-polls every
+ * COMMAND_WATCH_INTERVAL_MS.
+ * @param watch Watch of the child
+ * @param status Receives the exit status
+ * @param usage Receives the child's resource usage
+ * @return 0 on success, -1 on error (the watch is then already finished)
+ */
+static int
+wait_for_child (ChildWatch *watch, int *status, struct rusage *usage)
+{
+  int exit_fd = open_child_exit_fd (watch->pid);
+
+  for (;;)
+    {
+      pid_t waited = reap_child (watch->pid, status, usage);
+      if (waited == watch->pid)
+        {
+          break;
+        }
+      if (waited == -1)
+        {
+          // The exit will never be collected: release the watch as for a
+          // killed child, or running_children stays raised and SIGINT only
+          // ever requests a cancel from then on
+          perror ("wait4");
+          safe_close (exit_fd);
+          child_watch_finish (watch, SIGKILL, NULL, NULL);
+          return -1;
+        }
+
+      int timeout_ms = child_watch_check (watch);
+      struct pollfd pfd = { .fd = exit_fd, .events = POLLIN };
+      poll (&pfd, exit_fd >= 0 ? 1 : 0, timeout_ms);
+    }
+
+  safe_close (exit_fd);
+  return 0;
+}
+
+/**
+ * Body of spawn_process(), called with process_lock held.
+ */
+static pid_t
+spawn_process_locked (const char *command, char *const argv[], int stdout_fd,
+                      int stderr_fd)
+{
+  pid_t pid = -1;
+  if (zygote_handles (command))
+    {
+      // A fork of the warm helper skips interpreter startup and imports;
+      // if the helper has died this falls through to a normal launch
+      pid = zygote_spawn (argv, stdout_fd, stderr_fd);
+      if (pid != -1)
+        {
+          apply_resource_limits (pid);
+          running_children++;
+          return pid;
+        }
+    }
+
+  const char *path = resolve_command_path (command);
+  if (path == NULL)
+    {
+      return -1;
+    }
+
+  posix_spawn_file_actions_t actions;
+  int err = posix_spawn_file_actions_init (&actions);
+  if (err != 0)
+    {
+      fprintf (stderr, "Error: posix_spawn_file_actions_init: %s\n",
+               strerror (err));
+      return -1;
+    }
+
+  // A background process group must not touch the terminal's input
+  err = posix_spawn_file_actions_addopen (&actions, STDIN_FILENO,
+                                          "/dev/null", O_RDONLY, 0);
+  if (err == 0 && stdout_fd >= 0)
+    {
+      err = posix_spawn_file_actions_adddup2 (&actions, stdout_fd,
+                                              STDOUT_FILENO);
+    }
+  if (err == 0 && stderr_fd >= 0)
+    {
+      err = posix_spawn_file_actions_adddup2 (&actions, stderr_fd,
+                                              STDERR_FILENO);
+    }
+#ifdef HAVE_SPAWN_CLOSEFROM
+  // Don't leak pipe ends or other descriptors into the child
+  if (err == 0)
+    {
+      err = posix_spawn_file_actions_addclosefrom_np (&actions,
+                                                      STDERR_FILENO + 1);
+    }
+#endif
+
+  posix_spawnattr_t attr;
+  int attr_err = posix_spawnattr_init (&attr);
+  if (attr_err != 0)
+    {
+      posix_spawn_file_actions_destroy (&actions);
+      fprintf (stderr, "Error: posix_spawnattr_init: %s\n",
+               strerror (attr_err));
+      return -1;
+    }
+
+  sigset_t defaults, empty;
+  sigemptyset (&defaults);
+  sigaddset (&defaults, SIGINT);
+  sigaddset (&defaults, SIGTERM);
+  sigaddset (&defaults, SIGPIPE);
+  sigemptyset (&empty);
+  if (err == 0)
+    {
+      err = posix_spawnattr_setpgroup (&attr, 0);
+    }
+  if (err == 0)
+    {
+      err = posix_spawnattr_setsigdefault (&attr, &defaults);
+    }
+  if (err == 0)
+    {
+      err = posix_spawnattr_setsigmask (&attr, &empty);
+    }
+  if (err == 0)
+    {
+      err = posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETPGROUP
+                                                 | POSIX_SPAWN_SETSIGDEF
+                                                 | POSIX_SPAWN_SETSIGMASK);
+    }
+
+  if (err == 0)
+    {
+      err = posix_spawn (&pid, path, &actions, &attr, argv, environ);
+    }
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+
+  if (err != 0)
+    {
+      fprintf (stderr, "Error: Failed to launch %s: %s\n", command,
+               strerror (err));
+      return -1;
+    }
+
+  apply_resource_limits (pid);
+  running_children++;
+  return pid;
+}
+
+/**
+ * Launch a command with posix_spawn, optionally wiring its stdout/stderr.
+ *
+ * glibc implements posix_spawn with CLONE_VM|CLONE_VFORK, so no page tables
+ * are copied regardless of how large the parent has grown (ncurses screen,
+ * JSON trees, metadata buffers), and the executable path comes from the
+ * resolve cache rather than a fresh PATH walk. The child leads a new process
+ * group (so it can be signalled with everything it starts), gets default
+ * signal dispositions, reads stdin from /dev/null and runs under the
+ * configured resource limits. yt-dlp is forked from the zygote instead
+ * when one is running.
+ * @param command Command to execute
+ * @param argv Argument vector (NULL-terminated)
+ * @param stdout_fd Descriptor to install as the child's stdout, -1 to inherit
+ * @param stderr_fd Descriptor to install as the child's stderr, -1 to inherit
+ * @return pid of child process, -1 on error
+ */
+pid_t
+spawn_process (const char *command, char *const argv[], int stdout_fd,
+               int stderr_fd)
+{
+  pthread_mutex_lock (&process_lock);
+  pid_t pid = spawn_process_locked (command, argv, stdout_fd, stderr_fd);
+  pthread_mutex_unlock (&process_lock);
+  return pid;
+}
+
+/**
+ * Fork a new process with error handling.
+ * @return pid of child process, -1 on error
+ */
+pid_t
+fork_process (void)
+{
+  pid_t pid = fork ();
+  if (pid == -1)
+    {
+      perror ("fork");
+    }
+  return pid;
+}
+
+/**
+ * Create a pipe with bounds checking and error handling.
+ * @param pipefd Array to store pipe file descriptors
+ * @return 0 on success, -1 on error
+ */
+int
+setup_pipes (int pipefd[2])
+{
+  if (pipefd == NULL)
+    {
+      fprintf (stderr, "Error: Invalid pipefd parameter\n");
+      return -1;
+    }
+
+  // Close-on-exec keeps these ends out of unrelated children; dup2 onto a
+  // standard descriptor clears the flag for the child that needs it
+  if (pipe2 (pipefd, O_CLOEXEC) == -1)
+    {
+      perror ("pipe2");
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * Redirect stdout to pipe with error handling.
+ * @param pipefd Write end of pipe
+ * @return 0 on success, -1 on error
+ */
+int
+redirect_stdout (int pipefd)
+{
+  if (dup2 (pipefd, STDOUT_FILENO) == -1)
+    {
+      perror ("dup2");
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * Perform one read() from a pipe straight into the spare capacity of a
+ * growing, NUL-terminated output buffer, with overflow protection.
+ * @param pipefd Read end of pipe
+ * @param output Output buffer (reallocated as needed)
+ * @param output_size Bytes currently stored in the buffer
+ * @param output_capacity Allocated size of the buffer
+ * @return Bytes appended, 0 on EOF, -1 on error
+ */
+static ssize_t
+append_pipe_chunk (int pipefd, char **output, size_t *output_size,
+                   size_t *output_capacity)
+{
+  // Keep at least one chunk (plus the terminator) free for the kernel
+  if (*output_capacity - *output_size < PIPE_READ_CHUNK + 1)
+    {
+      // Check for potential size overflow
+      if (*output_size > SIZE_MAX / 2 - PIPE_READ_CHUNK - 1)
+        {
+          fprintf (stderr, "Error: Output size would overflow\n");
+          return -1;
+        }
+
+      // Grow exponentially so large documents cost few reallocations
+      size_t new_capacity = *output_capacity * 2;
+      if (new_capacity < *output_size + PIPE_READ_CHUNK + 1)
+        {
+          new_capacity = *output_size + PIPE_READ_CHUNK + 1;
+        }
+
+      char *new_output = realloc (*output, new_capacity);
+      if (new_output == NULL)
+        {
+          perror ("realloc");
+          return -1;
+        }
+      *output = new_output;
+      *output_capacity = new_capacity;
+    }
+
+  ssize_t bytes_read;
+  do
+    {
+      bytes_read = read (pipefd, *output + *output_size,
+                         *output_capacity - *output_size - 1);
+    }
+  while (bytes_read == -1 && errno == EINTR);
+
+  if (bytes_read <= 0)
+    {
+      if (bytes_read == -1)
+        {
+          perror ("read");
+        }
+      return bytes_read;
+    }
+
+  *output_size += bytes_read;
+  (*output)[*output_size] = '\0';
+  return bytes_read;
+}
+
+/**
+ * Raise a pipe's capacity so a chatty child needs fewer wakeups and each
+ * read() returns more data. Failure (old kernel, per-user pipe quota) is
+ * harmless and leaves the default 64 KiB pipe in place.
+ * @param pipefd Either end of the pipe
+ */
+void
+enlarge_pipe (int pipefd)
+{
+#ifdef F_SETPIPE_SZ
+  (void)fcntl (pipefd, F_SETPIPE_SZ, PIPE_CAPTURE_SIZE);
+#else
+  (void)pipefd;
+#endif
+}
+
+/**
+ * Read data from pipe with secure buffer management and overflow protection.
+ * @param pipefd Read end of pipe
+ * @return Allocated string containing pipe output, NULL on error
+ */
+char *
+read_from_pipe (int pipefd)
+{
+  size_t output_size = 0;
+  size_t output_capacity = BUFFER_SIZE; // Start with reasonable capacity
+  char *output = malloc (output_capacity);
+
+  if (output == NULL)
+    {
+      perror ("malloc");
+      return NULL;
+    }
+  output[0] = '\0';
+
+  enlarge_pipe (pipefd);
+
+  ssize_t bytes_read;
+  while ((bytes_read = append_pipe_chunk (pipefd, &output, &output_size,
+                                          &output_capacity))
+         > 0)
+    ;
+
+  if (bytes_read == -1)
+    {
+      free (output);
+      return NULL;
+    }
+
+  return output;
+}
+
+/**
+ * Append bytes to a stderr tail, discarding the oldest data once the ring
+ * is full.
+ * @param tail Ring buffer
+ * @param data Bytes to append
+ * @param length Number of bytes
+ */
+void
+stderr_tail_append (StderrTail *tail, const char *data, size_t length)
+{
+  tail->total += length;
+
+  if (length >= STDERR_TAIL_SIZE)
+    {
+      memcpy (tail->data, data + length - STDERR_TAIL_SIZE, STDERR_TAIL_SIZE);
+      tail->start = 0;
+      tail->length = STDERR_TAIL_SIZE;
+      return;
+    }
+
+  size_t end = (tail->start + tail->length) % STDERR_TAIL_SIZE;
+  size_t first = STDERR_TAIL_SIZE - end;
+  if (first > length)
+    {
+      first = length;
+    }
+  memcpy (tail->data + end, data, first);
+  memcpy (tail->data, data + first, length - first);
+
+  tail->length += length;
+  if (tail->length > STDERR_TAIL_SIZE)
+    {
+      tail->start = (tail->start + tail->length - STDERR_TAIL_SIZE)
+                    % STDERR_TAIL_SIZE;
+      tail->length = STDERR_TAIL_SIZE;
+    }
+}
+
+/**
+ * Copy the contents of a stderr tail into a linear, NUL-terminated buffer.
+ * If the buffer is smaller than the tail, the newest bytes are kept.
+ * @param tail Ring buffer
+ * @param buffer Output buffer
+ * @param size Size of output buffer
+ * @return Number of bytes copied (excluding terminator)
+ */
+size_t
+stderr_tail_read (const StderrTail *tail, char *buffer, size_t size)
+{
+  if (buffer == NULL || size == 0)
+    {
+      return 0;
+    }
+
+  size_t count = tail->length < size - 1 ? tail->length : size - 1;
+  size_t skip = tail->length - count;
+  for (size_t i = 0; i < count; i++)
+    {
+      buffer[i] = tail->data[(tail->start + skip + i) % STDERR_TAIL_SIZE];
+    }
+  buffer[count] = '\0';
+  return count;
 }
 
 /**
- * Validate child process exit status and handle errors.
- * @param status Process status from waitpid
- * @param output Output buffer to free on error (can be NULL)
- * @return exit status on success, -1 on error (frees output if provided)
+ * Classify a failed yt-dlp run from the text of its stderr tail.
+ * @param tail Captured stderr tail
+ * @return Error category
  */
-static int
-validate_child_status (int status, char **output)
+CommandErrorKind
+classify_command_error (const StderrTail *tail)
 {
-  if (WIFEXITED (status))
+  static const struct
+  {
+    const char *pattern;
+    CommandErrorKind kind;
+  } patterns[] = {
+    { "HTTP Error 429", COMMAND_ERROR_RATE_LIMITED },
+    { "Too Many Requests", COMMAND_ERROR_RATE_LIMITED },
+    { "Sign in to confirm", COMMAND_ERROR_AUTH_REQUIRED },
+    { "login required", COMMAND_ERROR_AUTH_REQUIRED },
+    { "members-only", COMMAND_ERROR_AUTH_REQUIRED },
+    { "Private video", COMMAND_ERROR_UNAVAILABLE },
+    { "Video unavailable", COMMAND_ERROR_UNAVAILABLE },
+    { "This video is private", COMMAND_ERROR_UNAVAILABLE },
+    { "has been removed", COMMAND_ERROR_UNAVAILABLE },
+    { "Unsupported URL", COMMAND_ERROR_UNSUPPORTED_URL },
+    { "Requested format is not available",
+      COMMAND_ERROR_FORMAT_UNAVAILABLE },
+    { "Unable to download", COMMAND_ERROR_NETWORK },
+    { "timed out", COMMAND_ERROR_NETWORK },
+    { "Connection reset", COMMAND_ERROR_NETWORK },
+    { "Temporary failure in name resolution", COMMAND_ERROR_NETWORK },
+    { "Name or service not known", COMMAND_ERROR_NETWORK },
+    { "MemoryError", COMMAND_ERROR_OUT_OF_MEMORY },
+  };
+
+  if (tail == NULL || tail->length == 0)
     {
-      int exit_status = WEXITSTATUS (status);
-      if (exit_status != 0)
-        {
-          fprintf (stderr, "Error: Command exited with status %d\n",
-                   exit_status);
-          if (output && *output)
-            {
-              free (*output);
-              *output = NULL;
-            }
-          return -1;
-        }
-      return exit_status;
+      return COMMAND_ERROR_UNKNOWN;
     }
-  else
+
+  char text[STDERR_TAIL_SIZE + 1];
+  stderr_tail_read (tail, text, sizeof (text));
+
+  for (size_t i = 0; i < sizeof (patterns) / sizeof (patterns[0]); i++)
     {
-      fprintf (stderr, "Error: Child process did not exit normally\n");
-      if (output && *output)
+      if (strstr (text, patterns[i].pattern) != NULL)
         {
-          free (*output);
-          *output = NULL;
+          return patterns[i].kind;
         }
-      return -1;
     }
+  return COMMAND_ERROR_UNKNOWN;
 }
 
 /**
- * Fork a new process with error handling.
- * @return pid of child process, -1 on error
+ * Human-readable description of an error category.
+ * @param kind Error category
+ * @return Static description string
  */
-pid_t
-fork_process (void)
+const char *
+command_error_description (CommandErrorKind kind)
 {
-  pid_t pid = fork ();
-  if (pid == -1)
+  switch (kind)
     {
-      perror ("fork");
+    case COMMAND_ERROR_NONE:
+      return "no error";
+    case COMMAND_ERROR_UNAVAILABLE:
+      return "video unavailable";
+    case COMMAND_ERROR_UNSUPPORTED_URL:
+      return "unsupported URL";
+    case COMMAND_ERROR_AUTH_REQUIRED:
+      return "sign-in required";
+    case COMMAND_ERROR_RATE_LIMITED:
+      return "rate limited";
+    case COMMAND_ERROR_NETWORK:
+      return "network error";
+    case COMMAND_ERROR_FORMAT_UNAVAILABLE:
+      return "format not available";
+    case COMMAND_ERROR_OUT_OF_MEMORY:
+      return "out of memory";
+    case COMMAND_ERROR_UNKNOWN:
+    default:
+      return "unknown error";
     }
-  return pid;
 }
 
 /**
- * Create a pipe with bounds checking and error handling.
- * @param pipefd Array to store pipe file descriptors
- * @return 0 on success, -1 on error
+ * Execute command, capturing stdout in full and the tail of stderr.
+ * Both pipes are serviced from one poll loop, so a child blocked writing
+ * to a full stderr pipe can never stall the stdout read (or vice versa).
+ * @param command Command to execute
+ * @param argv Argument vector (NULL-terminated)
+ * @param result Result structure to fill (output must be freed by caller)
+ * @return 0 if the command ran and exited with status 0, -1 otherwise
  */
 int
-setup_pipes (int pipefd[2])
+execute_command_capture (const char *command, char *const argv[],
+                         CommandResult *result)
 {
-  if (pipefd == NULL)
+  if (command == NULL || argv == NULL || result == NULL)
     {
-      fprintf (stderr, "Error: Invalid pipefd parameter\n");
+      fprintf (stderr,
+               "Error: Invalid parameters to execute_command_capture\n");
+      return -1;
+    }
+
+  memset (result, 0, sizeof (CommandResult));
+  result->pid = -1;
+  result->exit_status = -1;
+
+  size_t output_capacity = BUFFER_SIZE;
+  result->output = malloc (output_capacity);
+  if (result->output == NULL)
+    {
+      perror ("malloc");
+      return -1;
+    }
+  result->output[0] = '\0';
+
+  int out_pipe[2], err_pipe[2];
+  if (setup_pipes (out_pipe) == -1)
+    {
+      free (result->output);
+      result->output = NULL;
+      return -1;
+    }
+  if (setup_pipes (err_pipe) == -1)
+    {
+      safe_close (out_pipe[READ_END]);
+      safe_close (out_pipe[WRITE_END]);
+      free (result->output);
+      result->output = NULL;
+      return -1;
+    }
+
+  enlarge_pipe (out_pipe[READ_END]);
+
+  result->pid = spawn_process (command, argv, out_pipe[WRITE_END],
+                               err_pipe[WRITE_END]);
+  safe_close (out_pipe[WRITE_END]);
+  safe_close (err_pipe[WRITE_END]);
+  if (result->pid == -1)
+    {
+      safe_close (out_pipe[READ_END]);
+      safe_close (err_pipe[READ_END]);
+      free (result->output);
+      result->output = NULL;
+      return -1;
+    }
+
+  ChildWatch watch;
+  child_watch_start (&watch, result->pid);
+
+  struct pollfd fds[2] = { { .fd = out_pipe[READ_END], .events = POLLIN },
+                           { .fd = err_pipe[READ_END], .events = POLLIN } };
+  int read_failed = 0;
+
+  while (fds[0].fd >= 0 || fds[1].fd >= 0)
+    {
+      int ready = poll (fds, 2, child_watch_check (&watch));
+      if (ready == 0)
+        {
+          continue;
+        }
+      if (ready == -1)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          perror ("poll");
+          read_failed = 1;
+          break;
+        }
+
+      if (fds[0].revents != 0)
+        {
+          ssize_t bytes_read
+              = append_pipe_chunk (fds[0].fd, &result->output,
+                                   &result->output_length, &output_capacity);
+          if (bytes_read <= 0)
+            {
+              read_failed |= (bytes_read == -1);
+              safe_close (fds[0].fd);
+              fds[0].fd = -1;
+            }
+        }
+
+      if (fds[1].revents != 0)
+        {
+          char chunk[BUFFER_SIZE * 4];
+          ssize_t bytes_read = read (fds[1].fd, chunk, sizeof (chunk));
+          if (bytes_read > 0)
+            {
+              stderr_tail_append (&result->error_tail, chunk,
+                                  (size_t)bytes_read);
+            }
+          else if (bytes_read == 0 || errno != EINTR)
+            {
+              safe_close (fds[1].fd);
+              fds[1].fd = -1;
+            }
+        }
+    }
+
+  // Unblock a child still writing into a pipe we gave up on
+  safe_close (fds[0].fd);
+  safe_close (fds[1].fd);
+
+  int status;
+  struct rusage usage;
+  if (wait_for_child (&watch, &status, &usage) == -1)
+    {
+      free (result->output);
+      result->output = NULL;
       return -1;
     }
+  result->termination
+      = child_watch_finish (&watch, status, &usage, &result->error_tail);
+
+  if (WIFEXITED (status))
+    {
+      result->exit_status = WEXITSTATUS (status);
+    }
+  else if (WIFSIGNALED (status))
+    {
+      result->term_signal = WTERMSIG (status);
+    }
 
-  if (pipe (pipefd) == -1)
+  if (validate_child_status (command, status, result->termination,
+                             &result->error_tail, &result->output)
+          == -1
+      || read_failed)
     {
-      perror ("pipe");
+      free (result->output);
+      result->output = NULL;
+      result->output_length = 0;
       return -1;
     }
+
   return 0;
 }
 
 /**
- * Redirect stdout to pipe with error handling.
- * @param pipefd Write end of pipe
+ * Start a command whose stdout is consumed incrementally with
+ * command_stream_read() while it is still running. stderr is collected
+ * into the stream's tail as a side effect of reading.
+ * @param stream Stream to initialize
+ * @param command Command to execute
+ * @param argv Argument vector (NULL-terminated)
  * @return 0 on success, -1 on error
  */
 int
-redirect_stdout (int pipefd)
+command_stream_open (CommandStream *stream, const char *command,
+                     char *const argv[])
 {
-  if (dup2 (pipefd, STDOUT_FILENO) == -1)
+  if (stream == NULL || command == NULL || argv == NULL)
     {
-      perror ("dup2");
+      fprintf (stderr, "Error: Invalid parameters to command_stream_open\n");
       return -1;
     }
+
+  memset (stream, 0, sizeof (CommandStream));
+  stream->command = command;
+  stream->pid = -1;
+  stream->stdout_fd = -1;
+  stream->stderr_fd = -1;
+
+  int out_pipe[2], err_pipe[2];
+  if (setup_pipes (out_pipe) == -1)
+    {
+      return -1;
+    }
+  if (setup_pipes (err_pipe) == -1)
+    {
+      safe_close (out_pipe[READ_END]);
+      safe_close (out_pipe[WRITE_END]);
+      return -1;
+    }
+
+  enlarge_pipe (out_pipe[READ_END]);
+
+  stream->pid = spawn_process (command, argv, out_pipe[WRITE_END],
+                               err_pipe[WRITE_END]);
+  safe_close (out_pipe[WRITE_END]);
+  safe_close (err_pipe[WRITE_END]);
+  if (stream->pid == -1)
+    {
+      safe_close (out_pipe[READ_END]);
+      safe_close (err_pipe[READ_END]);
+      return -1;
+    }
+
+  child_watch_start (&stream->watch, stream->pid);
+  stream->stdout_fd = out_pipe[READ_END];
+  stream->stderr_fd = err_pipe[READ_END];
   return 0;
 }
 
 /**
- * Read data from pipe with secure buffer management and overflow protection.
- * @param pipefd Read end of pipe
- * @return Allocated string containing pipe output, NULL on error
+ * Move whatever stderr has pending into the stream's tail.
+ * @param stream Open stream
  */
-char *
-read_from_pipe (int pipefd)
+static void
+stream_drain_stderr (CommandStream *stream)
 {
-  char buffer[BUFFER_SIZE];
-  ssize_t bytes_read;
-  size_t output_size = 0;
-  size_t output_capacity = BUFFER_SIZE; // Start with reasonable capacity
-  char *output = malloc (output_capacity);
-
-  if (output == NULL)
+  char chunk[BUFFER_SIZE * 4];
+  ssize_t bytes_read = read (stream->stderr_fd, chunk, sizeof (chunk));
+  if (bytes_read > 0)
     {
-      perror ("malloc");
-      return NULL;
+      stderr_tail_append (&stream->error_tail, chunk, (size_t)bytes_read);
     }
-  output[0] = '\0';
+  else if (bytes_read == 0 || errno != EINTR)
+    {
+      safe_close (stream->stderr_fd);
+      stream->stderr_fd = -1;
+    }
+}
 
-  while ((bytes_read = read (pipefd, buffer, BUFFER_SIZE - 1)) > 0)
+/**
+ * Read the next chunk of a streaming command's stdout, servicing stderr in
+ * the same poll loop so neither pipe can fill up and stall the child.
+ * @param stream Open stream
+ * @param buffer Destination buffer
+ * @param size Size of destination buffer
+ * @return Bytes read, 0 at end of output, -1 on error
+ */
+ssize_t
+command_stream_read (CommandStream *stream, char *buffer, size_t size)
+{
+  if (stream == NULL || buffer == NULL)
+    {
+      return -1;
+    }
+  if (stream->stdout_fd < 0)
     {
-      buffer[bytes_read] = '\0';
+      return 0;
+    }
 
-      // Check for potential size overflow
-      if (output_size > SIZE_MAX - bytes_read - 1)
+  for (;;)
+    {
+      struct pollfd fds[2] = { { .fd = stream->stdout_fd, .events = POLLIN },
+                               { .fd = stream->stderr_fd, .events = POLLIN } };
+      int ready = poll (fds, 2, child_watch_check (&stream->watch));
+      if (ready == 0)
         {
-          fprintf (stderr, "Error: Output size would overflow\n");
-          free (output);
-          return NULL;
+          continue;
+        }
+      if (ready == -1)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          perror ("poll");
+          stream->failed = 1;
+          return -1;
         }
 
-      size_t new_size = output_size + bytes_read + 1;
+      if (fds[1].revents != 0)
+        {
+          stream_drain_stderr (stream);
+        }
 
-      // Grow buffer if needed (use exponential growth for efficiency)
-      if (new_size > output_capacity)
+      if (fds[0].revents != 0)
         {
-          size_t new_capacity = output_capacity * 2;
-          if (new_capacity < new_size)
+          ssize_t bytes_read = read (stream->stdout_fd, buffer, size);
+          if (bytes_read == -1 && errno == EINTR)
             {
-              new_capacity = new_size;
+              continue;
             }
-
-          // Prevent capacity overflow
-          if (new_capacity > SIZE_MAX / 2)
+          if (bytes_read == -1)
             {
-              new_capacity = SIZE_MAX / 2;
-              if (new_capacity < new_size)
-                {
-                  fprintf (stderr, "Error: Required buffer size too large\n");
-                  free (output);
-                  return NULL;
-                }
+              perror ("read");
+              stream->failed = 1;
             }
-
-          char *new_output = realloc (output, new_capacity);
-          if (new_output == NULL)
+          if (bytes_read <= 0)
             {
-              perror ("realloc");
-              free (output);
-              return NULL;
+              safe_close (stream->stdout_fd);
+              stream->stdout_fd = -1;
             }
-          output = new_output;
-          output_capacity = new_capacity;
+          return bytes_read;
         }
+    }
+}
 
-      memcpy (output + output_size, buffer, bytes_read + 1);
-      output_size += bytes_read;
+/**
+ * Finish a streaming command: stop reading stdout (a child still writing
+ * gets EPIPE), collect the rest of stderr, reap the child and validate its
+ * exit status.
+ * @param stream Stream to close
+ * @return 0 if the command exited with status 0, -1 otherwise
+ */
+int
+command_stream_close (CommandStream *stream)
+{
+  if (stream == NULL || stream->pid == -1)
+    {
+      return -1;
     }
 
-  if (bytes_read == -1)
+  safe_close (stream->stdout_fd);
+  stream->stdout_fd = -1;
+  while (stream->stderr_fd >= 0)
     {
-      perror ("read");
-      free (output);
-      return NULL;
+      struct pollfd pfd = { .fd = stream->stderr_fd, .events = POLLIN };
+      if (poll (&pfd, 1, child_watch_check (&stream->watch)) > 0)
+        {
+          stream_drain_stderr (stream);
+        }
     }
 
-  return output;
+  int status;
+  struct rusage usage;
+  int waited = wait_for_child (&stream->watch, &status, &usage);
+  stream->pid = -1;
+  if (waited == -1)
+    {
+      return -1;
+    }
+
+  CommandTermination termination = child_watch_finish (
+      &stream->watch, status, &usage, &stream->error_tail);
+  if (validate_child_status (stream->command, status, termination,
+                             &stream->error_tail, NULL)
+          == -1
+      || stream->failed)
+    {
+      return -1;
+    }
+
+  return 0;
 }
 
 /**
- * Execute command and capture its output.
+ * Execute command with its stdout written straight into an anonymous
+ * memory file (memfd), then map the result read-only. The parent never
+ * copies or even reads the output: the child's writes land in page-cache
+ * pages that become the mapping. stderr is still collected into a tail.
  * @param command Command to execute
  * @param argv Argument vector (NULL-terminated)
- * @return Allocated string containing command output, NULL on error
+ * @param captured Receives the memfd and its mapping; release with
+ *                 release_captured_output(). The data is not NUL-terminated.
+ * @param tail Receives the stderr tail (can be NULL)
+ * @return 0 if the command exited with status 0, -1 otherwise
  */
-char *
-execute_command_with_output (const char *command, char *const argv[])
+int
+execute_command_to_memfd (const char *command, char *const argv[],
+                          CapturedOutput *captured, StderrTail *tail)
 {
-  if (command == NULL || argv == NULL)
+  if (command == NULL || argv == NULL || captured == NULL)
     {
       fprintf (stderr,
-               "Error: Invalid parameters to execute_command_with_output\n");
-      return NULL;
+               "Error: Invalid parameters to execute_command_to_memfd\n");
+      return -1;
     }
 
-  int pipefd[2];
-  if (setup_pipes (pipefd) == -1)
+  captured->fd = -1;
+  captured->data = NULL;
+  captured->length = 0;
+
+  StderrTail local_tail;
+  if (tail == NULL)
     {
-      return NULL;
+      tail = &local_tail;
+    }
+  memset (tail, 0, sizeof (StderrTail));
+
+  int memfd = memfd_create ("ytdl-output", MFD_CLOEXEC);
+  if (memfd == -1)
+    {
+      perror ("memfd_create");
+      return -1;
     }
 
-  pid_t pid = fork_process ();
+  int err_pipe[2];
+  if (setup_pipes (err_pipe) == -1)
+    {
+      safe_close (memfd);
+      return -1;
+    }
+
+  pid_t pid = spawn_process (command, argv, memfd, err_pipe[WRITE_END]);
+  safe_close (err_pipe[WRITE_END]);
   if (pid == -1)
     {
-      safe_close (pipefd[READ_END]);
-      safe_close (pipefd[WRITE_END]);
-      return NULL;
+      safe_close (err_pipe[READ_END]);
+      safe_close (memfd);
+      return -1;
     }
-  else if (pid == 0)
+
+  ChildWatch watch;
+  child_watch_start (&watch, pid);
+
+  // stdout goes to a file, so draining stderr alone cannot deadlock
+  char chunk[BUFFER_SIZE * 4];
+  for (;;)
     {
-      // Child process
-      safe_close (pipefd[READ_END]);
+      struct pollfd pfd = { .fd = err_pipe[READ_END], .events = POLLIN };
+      int ready = poll (&pfd, 1, child_watch_check (&watch));
+      if (ready == 0)
+        {
+          continue;
+        }
+      if (ready == -1)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          perror ("poll");
+          break;
+        }
 
-      if (redirect_stdout (pipefd[WRITE_END]) == -1)
+      ssize_t bytes_read = read (err_pipe[READ_END], chunk, sizeof (chunk));
+      if (bytes_read > 0)
+        {
+          stderr_tail_append (tail, chunk, (size_t)bytes_read);
+        }
+      else if (bytes_read == 0)
         {
-          safe_close (pipefd[WRITE_END]);
-          exit (EXIT_FAILURE);
+          break;
         }
-      safe_close (pipefd[WRITE_END]);
+      else if (errno != EINTR)
+        {
+          perror ("read");
+          break;
+        }
+    }
+  safe_close (err_pipe[READ_END]);
 
-      execvp (command, argv);
-      perror ("execvp");
-      exit (EXIT_FAILURE);
+  int status;
+  struct rusage usage;
+  if (wait_for_child (&watch, &status, &usage) == -1)
+    {
+      safe_close (memfd);
+      return -1;
     }
-  else
+
+  CommandTermination termination
+      = child_watch_finish (&watch, status, &usage, tail);
+  if (validate_child_status (command, status, termination, tail, NULL) == -1)
     {
-      // Parent process
-      safe_close (pipefd[WRITE_END]);
+      safe_close (memfd);
+      return -1;
+    }
 
-      char *output = read_from_pipe (pipefd[READ_END]);
-      safe_close (pipefd[READ_END]);
+  struct stat st;
+  if (fstat (memfd, &st) == -1)
+    {
+      perror ("fstat");
+      safe_close (memfd);
+      return -1;
+    }
 
-      int status;
-      if (waitpid (pid, &status, 0) == -1)
+  captured->fd = memfd;
+  captured->length = (size_t)st.st_size;
+  if (captured->length > 0)
+    {
+      void *mapping
+          = mmap (NULL, captured->length, PROT_READ, MAP_PRIVATE, memfd, 0);
+      if (mapping == MAP_FAILED)
         {
-          perror ("waitpid");
-          free (output);
-          return NULL;
+          perror ("mmap");
+          release_captured_output (captured);
+          return -1;
         }
+      captured->data = mapping;
+    }
 
-      if (validate_child_status (status, &output) == -1)
-        {
-          return NULL;
-        }
+  return 0;
+}
+
+/**
+ * Unmap and close output captured by execute_command_to_memfd().
+ * @param captured Captured output (can be NULL)
+ */
+void
+release_captured_output (CapturedOutput *captured)
+{
+  if (captured == NULL)
+    {
+      return;
+    }
+  if (captured->data != NULL)
+    {
+      munmap ((void *)captured->data, captured->length);
+      captured->data = NULL;
+    }
+  safe_close (captured->fd);
+  captured->fd = -1;
+  captured->length = 0;
+}
+
+/**
+ * Execute command and capture its output.
+ * @param command Command to execute
+ * @param argv Argument vector (NULL-terminated)
+ * @return Allocated string containing command output, NULL on error
+ */
+char *
+execute_command_with_output (const char *command, char *const argv[])
+{
+  if (command == NULL || argv == NULL)
+    {
+      fprintf (stderr,
+               "Error: Invalid parameters to execute_command_with_output\n");
+      return NULL;
+    }
 
-      return output;
+  CommandResult result;
+  if (execute_command_capture (command, argv, &result) == -1)
+    {
+      return NULL;
     }
+
+  return result.output;
 }
 
 /**
@@ -285,28 +1679,23 @@ execute_command_without_output (const char *command, char *const argv[])
       return -1;
     }
 
-  pid_t pid = fork_process ();
+  pid_t pid = spawn_process (command, argv, -1, -1);
   if (pid == -1)
     {
       return -1;
     }
-  else if (pid == 0)
+
+  ChildWatch watch;
+  child_watch_start (&watch, pid);
+
+  int status;
+  struct rusage usage;
+  if (wait_for_child (&watch, &status, &usage) == -1)
     {
-      // Child process
-      execvp (command, argv);
-      perror ("execvp");
-      exit (EXIT_FAILURE);
+      return -1;
     }
-  else
-    {
-      // Parent process
-      int status;
-      if (waitpid (pid, &status, 0) == -1)
-        {
-          perror ("waitpid");
-          return -1;
-        }
 
-      return validate_child_status (status, NULL);
-    }
+  CommandTermination termination
+      = child_watch_finish (&watch, status, &usage, NULL);
+  return validate_child_status (command, status, termination, NULL, NULL);
 }
\ No newline at end of file
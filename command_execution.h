@@ -3,11 +3,131 @@
 
 #include "ytdl.h"
 
+#include <signal.h>
+#include <sys/resource.h>
+
+// Bytes of a child's stderr kept for error reporting (newest data wins)
+#define STDERR_TAIL_SIZE (16 * 1024)
+
+// Bounded ring holding the last STDERR_TAIL_SIZE bytes of a child's stderr
+typedef struct
+{
+  char data[STDERR_TAIL_SIZE];
+  size_t start;  // index of the oldest byte
+  size_t length; // bytes currently held
+  size_t total;  // bytes seen overall, including discarded ones
+} StderrTail;
+
+// Failure categories recognised in yt-dlp's stderr
+typedef enum
+{
+  COMMAND_ERROR_NONE,
+  COMMAND_ERROR_UNAVAILABLE,
+  COMMAND_ERROR_UNSUPPORTED_URL,
+  COMMAND_ERROR_AUTH_REQUIRED,
+  COMMAND_ERROR_RATE_LIMITED,
+  COMMAND_ERROR_NETWORK,
+  COMMAND_ERROR_FORMAT_UNAVAILABLE,
+  COMMAND_ERROR_OUT_OF_MEMORY,
+  COMMAND_ERROR_UNKNOWN
+} CommandErrorKind;
+
+// Milliseconds a process group gets between SIGTERM and SIGKILL
+#define COMMAND_KILL_GRACE_MS 3000
+// Longest a wait sleeps before re-checking deadlines and cancellation
+#define COMMAND_WATCH_INTERVAL_MS 250
+
+// Limits applied to every spawned command (0 disables a limit)
+typedef struct
+{
+  long timeout_ms;           // wall-clock deadline
+  unsigned long memory_mb;   // RLIMIT_AS
+  unsigned long cpu_seconds; // RLIMIT_CPU soft limit (SIGXCPU)
+} CommandLimits;
+
+// Why a child stopped, when it was not simply its own decision
+typedef enum
+{
+  COMMAND_TERMINATION_NONE,
+  COMMAND_TERMINATION_TIMEOUT,
+  COMMAND_TERMINATION_CANCELLED,
+  COMMAND_TERMINATION_CPU_LIMIT,
+  COMMAND_TERMINATION_MEMORY_LIMIT
+} CommandTermination;
+
+// Deadline and termination state of one running child. The child leads
+// its own process group, so the whole group (ffmpeg and friends) is
+// signalled together.
+typedef struct
+{
+  pid_t pid;
+  double deadline;      // CLOCK_MONOTONIC seconds, 0 for none
+  double kill_deadline; // when SIGKILL follows SIGTERM, 0 if not pending
+  int stage;            // 0 running, 1 SIGTERM sent, 2 SIGKILL sent
+  CommandTermination termination;
+} ChildWatch;
+
+// Outcome of a finished child process
+typedef struct
+{
+  pid_t pid;
+  int exit_status;      // exit code if the child exited normally, -1 otherwise
+  int term_signal;      // signal that terminated the child, 0 if it exited
+  CommandTermination termination; // limit or cancellation that stopped it
+  char *output;         // captured stdout (NUL-terminated), NULL if none
+  size_t output_length;
+  StderrTail error_tail; // last STDERR_TAIL_SIZE bytes of stderr
+} CommandResult;
+
+// Running command whose stdout is consumed while it is produced
+typedef struct
+{
+  const char *command;
+  pid_t pid;
+  int stdout_fd;
+  int stderr_fd;
+  int failed;
+  ChildWatch watch;
+  StderrTail error_tail;
+} CommandStream;
+
+// Command stdout captured in an anonymous memory file
+typedef struct
+{
+  int fd;           // memfd holding the output, -1 if none
+  const char *data; // read-only mapping, NULL if the output was empty
+  size_t length;
+} CapturedOutput;
+
 // clang-format off
 pid_t fork_process(void);
+pid_t spawn_process(const char *command, char *const argv[], int stdout_fd, int stderr_fd);
+void reset_command_path_cache(void);
+int open_child_exit_fd(pid_t pid);
+pid_t reap_child(pid_t pid, int *status, struct rusage *usage);
+void set_command_limits(const CommandLimits *limits);
+const CommandLimits *get_command_limits(void);
+void command_request_cancel(void);
+int command_cancel_requested(void);
+void install_cancel_handler(void);
+void child_watch_start(ChildWatch *watch, pid_t pid);
+int child_watch_check(ChildWatch *watch);
+CommandTermination child_watch_finish(ChildWatch *watch, int status, const struct rusage *usage, const StderrTail *tail);
+const char *command_termination_description(CommandTermination termination);
 int setup_pipes(int pipefd[2]);
 int redirect_stdout(int pipefd);
 char *read_from_pipe(int pipefd);
+void enlarge_pipe(int pipefd);
+void stderr_tail_append(StderrTail *tail, const char *data, size_t length);
+size_t stderr_tail_read(const StderrTail *tail, char *buffer, size_t size);
+CommandErrorKind classify_command_error(const StderrTail *tail);
+const char *command_error_description(CommandErrorKind kind);
+int execute_command_capture(const char *command, char *const argv[], CommandResult *result);
+int command_stream_open(CommandStream *stream, const char *command, char *const argv[]);
+ssize_t command_stream_read(CommandStream *stream, char *buffer, size_t size);
+int command_stream_close(CommandStream *stream);
+int execute_command_to_memfd(const char *command, char *const argv[], CapturedOutput *captured, StderrTail *tail);
+void release_captured_output(CapturedOutput *captured);
 char *execute_command_with_output(const char *command, char *const argv[]);
 int execute_command_without_output(const char *command, char *const argv[]);
 // clang-format on
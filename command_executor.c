@@ -0,0 +1,800 @@
+#define _GNU_SOURCE
+#include "command_executor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Bytes requested from a child pipe per read() call
+#define EXECUTOR_READ_CHUNK (256 * 1024)
+// Maximum number of epoll events handled per wakeup
+#define EXECUTOR_MAX_EVENTS 64
+// Reap interval used when pidfd_open is unavailable (kernels before 5.3)
+#define EXECUTOR_REAP_INTERVAL_MS 50
+
+// Event sources multiplexed for each child, encoded into epoll data as
+// slot * SOURCE_COUNT + source
+enum
+{
+  SOURCE_STDOUT,
+  SOURCE_STDERR,
+  SOURCE_EXIT,
+  SOURCE_COUNT
+};
+
+typedef struct
+{
+  char *data;
+  size_t length;
+  size_t capacity;
+} CaptureBuffer;
+
+typedef struct ExecutorJob
+{
+  char *command;
+  char **argv; // deep copy, strings stored after the pointer array
+  CommandOutputCallback on_output; // NULL to capture stdout instead
+  CommandCompletionCallback on_complete;
+  void *user_data;
+  pid_t pid;
+  int fds[SOURCE_COUNT]; // -1 once closed
+  bool exited;
+  int status;
+  struct rusage usage;
+  ChildWatch watch; // deadline and termination of the child's group
+  CaptureBuffer output;
+  StderrTail error_tail;
+  struct ExecutorJob *next;
+} ExecutorJob;
+
+struct CommandExecutor
+{
+  int epoll_fd;
+  int max_children;
+  bool have_pidfd;
+  ExecutorJob **slots; // running jobs, indexed by slot
+  size_t active;
+  ExecutorJob *pending_head;
+  ExecutorJob *pending_tail;
+  size_t pending;
+};
+
+/**
+ * Copy a NULL-terminated argument vector into a single allocation.
+ * @param argv Argument vector to copy
+ * @return Allocated copy, NULL on error
+ */
+static char **
+copy_argv (char *const argv[])
+{
+  size_t count = 0;
+  size_t bytes = 0;
+  while (argv[count] != NULL)
+    {
+      bytes += strlen (argv[count]) + 1;
+      count++;
+    }
+
+  size_t table_size = sizeof (char *) * (count + 1);
+  char **copy = malloc (table_size + bytes);
+  if (copy == NULL)
+    {
+      perror ("malloc");
+      return NULL;
+    }
+
+  char *strings = (char *)copy + table_size;
+  for (size_t i = 0; i < count; i++)
+    {
+      size_t len = strlen (argv[i]) + 1;
+      memcpy (strings, argv[i], len);
+      copy[i] = strings;
+      strings += len;
+    }
+  copy[count] = NULL;
+
+  return copy;
+}
+
+/**
+ * Read everything currently available on a non-blocking descriptor.
+ * @param fd Read end of a child pipe
+ * @param buffer Capture buffer to append to
+ * @return 1 if data may follow, 0 on EOF, -1 on error
+ */
+static int
+drain_pipe (int fd, CaptureBuffer *buffer)
+{
+  for (;;)
+    {
+      if (buffer->capacity - buffer->length < EXECUTOR_READ_CHUNK + 1)
+        {
+          size_t new_capacity = buffer->capacity ? buffer->capacity * 2
+                                                 : EXECUTOR_READ_CHUNK * 2;
+          char *new_data = realloc (buffer->data, new_capacity);
+          if (new_data == NULL)
+            {
+              perror ("realloc");
+              return -1;
+            }
+          buffer->data = new_data;
+          buffer->capacity = new_capacity;
+          buffer->data[buffer->length] = '\0';
+        }
+
+      ssize_t bytes_read
+          = read (fd, buffer->data + buffer->length, EXECUTOR_READ_CHUNK);
+      if (bytes_read > 0)
+        {
+          buffer->length += (size_t)bytes_read;
+          buffer->data[buffer->length] = '\0';
+          continue;
+        }
+      if (bytes_read == 0)
+        {
+          return 0;
+        }
+      if (errno == EINTR)
+        {
+          continue;
+        }
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+          return 1;
+        }
+      perror ("read");
+      return -1;
+    }
+}
+
+/**
+ * Pass everything currently available on a streaming child's stdout to
+ * its output callback.
+ * @param fd Read end of the stdout pipe
+ * @param job Job with an output callback
+ * @return 1 if data may follow, 0 on EOF, -1 on error
+ */
+static int
+stream_pipe (int fd, ExecutorJob *job)
+{
+  char chunk[BUFFER_SIZE * 16];
+  for (;;)
+    {
+      ssize_t bytes_read = read (fd, chunk, sizeof (chunk));
+      if (bytes_read > 0)
+        {
+          job->on_output (job->pid, chunk, (size_t)bytes_read,
+                          job->user_data);
+          continue;
+        }
+      if (bytes_read == 0)
+        {
+          return 0;
+        }
+      if (errno == EINTR)
+        {
+          continue;
+        }
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+          return 1;
+        }
+      perror ("read");
+      return -1;
+    }
+}
+
+/**
+ * Read everything currently available on a child's non-blocking stderr
+ * pipe into its bounded tail.
+ * @param fd Read end of the stderr pipe
+ * @param tail Ring buffer receiving the data
+ * @return 1 if data may follow, 0 on EOF, -1 on error
+ */
+static int
+drain_stderr (int fd, StderrTail *tail)
+{
+  char chunk[BUFFER_SIZE * 4];
+  for (;;)
+    {
+      ssize_t bytes_read = read (fd, chunk, sizeof (chunk));
+      if (bytes_read > 0)
+        {
+          stderr_tail_append (tail, chunk, (size_t)bytes_read);
+          continue;
+        }
+      if (bytes_read == 0)
+        {
+          return 0;
+        }
+      if (errno == EINTR)
+        {
+          continue;
+        }
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+          return 1;
+        }
+      perror ("read");
+      return -1;
+    }
+}
+
+/**
+ * Stop watching one of a job's descriptors and close it.
+ * @param executor Executor owning the epoll instance
+ * @param job Job whose descriptor is closed
+ * @param source Which descriptor to close
+ */
+static void
+close_source (CommandExecutor *executor, ExecutorJob *job, int source)
+{
+  if (job->fds[source] < 0)
+    {
+      return;
+    }
+  epoll_ctl (executor->epoll_fd, EPOLL_CTL_DEL, job->fds[source], NULL);
+  close (job->fds[source]);
+  job->fds[source] = -1;
+}
+
+/**
+ * Release a job and everything it owns.
+ * @param job Job to free
+ */
+static void
+free_job (ExecutorJob *job)
+{
+  free (job->output.data);
+  free (job->argv);
+  free (job->command);
+  free (job);
+}
+
+/**
+ * Hand a finished job's result to its completion callback.
+ * @param job Finished job
+ */
+static void
+deliver_result (ExecutorJob *job)
+{
+  CommandResult result = { 0 };
+  result.pid = job->pid;
+  result.exit_status = -1;
+  result.termination
+      = job->exited ? child_watch_finish (&job->watch, job->status,
+                                          &job->usage, &job->error_tail)
+                    : job->watch.termination;
+
+  if (job->exited && WIFEXITED (job->status))
+    {
+      result.exit_status = WEXITSTATUS (job->status);
+    }
+  else if (job->exited && WIFSIGNALED (job->status))
+    {
+      result.term_signal = WTERMSIG (job->status);
+    }
+
+  result.output = job->output.data;
+  result.output_length = job->output.length;
+  result.error_tail = job->error_tail;
+
+  if (job->on_complete != NULL)
+    {
+      job->on_complete (&result, job->user_data);
+    }
+
+  // Whatever the callback did not take is released with the job
+  job->output.data = result.output;
+}
+
+/**
+ * Launch a job in a free slot and register its descriptors with epoll.
+ * @param executor Executor
+ * @param slot Free slot index
+ * @param job Job to start
+ * @return 0 on success, -1 if the job could not be started
+ */
+static int
+start_job (CommandExecutor *executor, size_t slot, ExecutorJob *job)
+{
+  int out_pipe[2], err_pipe[2];
+  if (setup_pipes (out_pipe) == -1)
+    {
+      return -1;
+    }
+  if (setup_pipes (err_pipe) == -1)
+    {
+      close (out_pipe[READ_END]);
+      close (out_pipe[WRITE_END]);
+      return -1;
+    }
+
+  enlarge_pipe (out_pipe[READ_END]);
+
+  job->pid = spawn_process (job->command, job->argv, out_pipe[WRITE_END],
+                            err_pipe[WRITE_END]);
+  close (out_pipe[WRITE_END]);
+  close (err_pipe[WRITE_END]);
+  if (job->pid == -1)
+    {
+      close (out_pipe[READ_END]);
+      close (err_pipe[READ_END]);
+      return -1;
+    }
+
+  child_watch_start (&job->watch, job->pid);
+  job->fds[SOURCE_STDOUT] = out_pipe[READ_END];
+  job->fds[SOURCE_STDERR] = err_pipe[READ_END];
+  job->fds[SOURCE_EXIT] = -1;
+
+  if (executor->have_pidfd)
+    {
+      job->fds[SOURCE_EXIT] = open_child_exit_fd (job->pid);
+      if (job->fds[SOURCE_EXIT] == -1)
+        {
+          // Fall back to periodic waitpid() for this and later children
+          executor->have_pidfd = false;
+        }
+    }
+
+  for (int source = 0; source < SOURCE_COUNT; source++)
+    {
+      if (job->fds[source] < 0)
+        {
+          continue;
+        }
+      if (source != SOURCE_EXIT)
+        {
+          fcntl (job->fds[source], F_SETFL,
+                 fcntl (job->fds[source], F_GETFL) | O_NONBLOCK);
+        }
+
+      struct epoll_event event = { 0 };
+      event.events = EPOLLIN;
+      event.data.u64 = (uint64_t)slot * SOURCE_COUNT + (uint64_t)source;
+      if (epoll_ctl (executor->epoll_fd, EPOLL_CTL_ADD, job->fds[source],
+                     &event)
+          == -1)
+        {
+          // An unwatched pipe would fill and block the child, an unwatched
+          // exit would never be seen: give up on the job as a failed launch
+          perror ("epoll_ctl");
+          for (int open_source = 0; open_source < SOURCE_COUNT; open_source++)
+            {
+              close_source (executor, job, open_source);
+            }
+          killpg (job->pid, SIGKILL);
+          while (reap_child (job->pid, &job->status, NULL) == 0)
+            {
+              poll (NULL, 0, EXECUTOR_REAP_INTERVAL_MS);
+            }
+          child_watch_finish (&job->watch, SIGKILL, NULL, NULL);
+          return -1;
+        }
+    }
+
+  executor->slots[slot] = job;
+  executor->active++;
+  return 0;
+}
+
+/**
+ * Move queued jobs into free slots until the concurrency limit is reached.
+ * @param executor Executor
+ */
+static void
+fill_slots (CommandExecutor *executor)
+{
+  for (size_t slot = 0;
+       slot < (size_t)executor->max_children && executor->pending_head;
+       slot++)
+    {
+      if (executor->slots[slot] != NULL)
+        {
+          continue;
+        }
+
+      ExecutorJob *job = executor->pending_head;
+      executor->pending_head = job->next;
+      if (executor->pending_head == NULL)
+        {
+          executor->pending_tail = NULL;
+        }
+      executor->pending--;
+      job->next = NULL;
+
+      if (command_cancel_requested ())
+        {
+          // Cancelled before it started: complete without launching
+          job->watch.termination = COMMAND_TERMINATION_CANCELLED;
+          deliver_result (job);
+          free_job (job);
+        }
+      else if (start_job (executor, slot, job) == -1)
+        {
+          // Report launch failures through the normal completion path
+          job->pid = -1;
+          deliver_result (job);
+          free_job (job);
+        }
+    }
+}
+
+/**
+ * Collect the exit status of a child if it has terminated.
+ * @param job Running job
+ */
+static void
+reap_job (ExecutorJob *job)
+{
+  if (job->exited)
+    {
+      return;
+    }
+
+  pid_t result = reap_child (job->pid, &job->status, &job->usage);
+
+  if (result == job->pid)
+    {
+      job->exited = true;
+    }
+  else if (result == -1)
+    {
+      // The exit was never collected; report the child as killed rather
+      // than as a clean exit, as zygote_reap does when the helper dies
+      perror ("wait4");
+      job->exited = true;
+      job->status = SIGKILL;
+    }
+}
+
+/**
+ * Dispatch a single epoll event to the job and source it belongs to.
+ * @param executor Executor
+ * @param event Event returned by epoll_wait
+ */
+static void
+handle_event (CommandExecutor *executor, const struct epoll_event *event)
+{
+  size_t slot = (size_t)(event->data.u64 / SOURCE_COUNT);
+  int source = (int)(event->data.u64 % SOURCE_COUNT);
+  ExecutorJob *job = executor->slots[slot];
+  if (job == NULL || job->fds[source] < 0)
+    {
+      return;
+    }
+
+  if (source == SOURCE_EXIT)
+    {
+      reap_job (job);
+      if (job->exited)
+        {
+          close_source (executor, job, SOURCE_EXIT);
+        }
+      return;
+    }
+
+  int state;
+  if (source == SOURCE_STDERR)
+    {
+      state = drain_stderr (job->fds[source], &job->error_tail);
+    }
+  else if (job->on_output != NULL)
+    {
+      state = stream_pipe (job->fds[source], job);
+    }
+  else
+    {
+      state = drain_pipe (job->fds[source], &job->output);
+    }
+  if (state <= 0)
+    {
+      close_source (executor, job, source);
+    }
+}
+
+/**
+ * Create an executor that runs at most max_children commands at once.
+ * @param max_children Concurrency limit (at least 1)
+ * @return Executor, NULL on error
+ */
+CommandExecutor *
+executor_create (int max_children)
+{
+  if (max_children < 1)
+    {
+      fprintf (stderr, "Error: Invalid executor concurrency (%d)\n",
+               max_children);
+      return NULL;
+    }
+
+  CommandExecutor *executor = calloc (1, sizeof (CommandExecutor));
+  if (executor == NULL)
+    {
+      perror ("calloc");
+      return NULL;
+    }
+
+  executor->slots = calloc ((size_t)max_children, sizeof (ExecutorJob *));
+  if (executor->slots == NULL)
+    {
+      perror ("calloc");
+      free (executor);
+      return NULL;
+    }
+
+  executor->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  if (executor->epoll_fd == -1)
+    {
+      perror ("epoll_create1");
+      free (executor->slots);
+      free (executor);
+      return NULL;
+    }
+
+  executor->max_children = max_children;
+  executor->have_pidfd = true;
+  return executor;
+}
+
+/**
+ * Destroy an executor. Children still running are killed and reaped;
+ * their completion callbacks are not invoked.
+ * @param executor Executor to destroy (can be NULL)
+ */
+void
+executor_destroy (CommandExecutor *executor)
+{
+  if (executor == NULL)
+    {
+      return;
+    }
+
+  for (size_t slot = 0; slot < (size_t)executor->max_children; slot++)
+    {
+      ExecutorJob *job = executor->slots[slot];
+      if (job == NULL)
+        {
+          continue;
+        }
+      for (int source = 0; source < SOURCE_COUNT; source++)
+        {
+          close_source (executor, job, source);
+        }
+      if (!job->exited)
+        {
+          killpg (job->pid, SIGKILL);
+          while (reap_child (job->pid, &job->status, NULL) == 0)
+            {
+              poll (NULL, 0, EXECUTOR_REAP_INTERVAL_MS);
+            }
+        }
+      child_watch_finish (&job->watch, job->status, NULL, NULL);
+      free_job (job);
+    }
+
+  while (executor->pending_head != NULL)
+    {
+      ExecutorJob *next = executor->pending_head->next;
+      free_job (executor->pending_head);
+      executor->pending_head = next;
+    }
+
+  close (executor->epoll_fd);
+  free (executor->slots);
+  free (executor);
+}
+
+/**
+ * Queue a command. It starts as soon as a slot is free; the callback runs
+ * from executor_run_once()/executor_run() once the child has exited and both
+ * of its output streams have been drained. Safe to call from a callback.
+ * @param executor Executor
+ * @param command Command to execute
+ * @param argv Argument vector (NULL-terminated, copied)
+ * @param on_complete Completion callback (can be NULL)
+ * @param user_data Passed through to the callback
+ * @return 0 on success, -1 on error
+ */
+int
+executor_submit (CommandExecutor *executor, const char *command,
+                 char *const argv[], CommandCompletionCallback on_complete,
+                 void *user_data)
+{
+  return executor_submit_streaming (executor, command, argv, NULL,
+                                    on_complete, user_data);
+}
+
+/**
+ * Queue a command whose stdout is handed to on_output chunk by chunk while
+ * it runs rather than captured; the result's output is then NULL. Suits
+ * long-running children whose output is only of interest as it comes.
+ * @param executor Executor
+ * @param command Command to execute
+ * @param argv Argument vector (NULL-terminated, copied)
+ * @param on_output Output callback (NULL captures stdout as usual)
+ * @param on_complete Completion callback (can be NULL)
+ * @param user_data Passed through to both callbacks
+ * @return 0 on success, -1 on error
+ */
+int
+executor_submit_streaming (CommandExecutor *executor, const char *command,
+                           char *const argv[], CommandOutputCallback on_output,
+                           CommandCompletionCallback on_complete,
+                           void *user_data)
+{
+  if (executor == NULL || command == NULL || argv == NULL)
+    {
+      fprintf (stderr, "Error: Invalid parameters to executor_submit\n");
+      return -1;
+    }
+
+  ExecutorJob *job = calloc (1, sizeof (ExecutorJob));
+  if (job == NULL)
+    {
+      perror ("calloc");
+      return -1;
+    }
+
+  job->command = strdup (command);
+  job->argv = copy_argv (argv);
+  if (job->command == NULL || job->argv == NULL)
+    {
+      free_job (job);
+      return -1;
+    }
+
+  job->on_output = on_output;
+  job->on_complete = on_complete;
+  job->user_data = user_data;
+  job->pid = -1;
+  for (int source = 0; source < SOURCE_COUNT; source++)
+    {
+      job->fds[source] = -1;
+    }
+
+  if (executor->pending_tail != NULL)
+    {
+      executor->pending_tail->next = job;
+    }
+  else
+    {
+      executor->pending_head = job;
+    }
+  executor->pending_tail = job;
+  executor->pending++;
+
+  return 0;
+}
+
+/**
+ * Start queued jobs, wait for activity and deliver completions once.
+ * @param executor Executor
+ * @param timeout_ms Maximum time to wait for activity, -1 for no limit
+ * @return Number of jobs still running or queued, -1 on error
+ */
+int
+executor_run_once (CommandExecutor *executor, int timeout_ms)
+{
+  if (executor == NULL)
+    {
+      return -1;
+    }
+
+  fill_slots (executor);
+  if (executor->active == 0)
+    {
+      return (int)executor->pending;
+    }
+
+  int wait_ms = timeout_ms;
+  if (!executor->have_pidfd
+      && (wait_ms < 0 || wait_ms > EXECUTOR_REAP_INTERVAL_MS))
+    {
+      wait_ms = EXECUTOR_REAP_INTERVAL_MS;
+    }
+
+  // Enforce deadlines and cancellation; this keeps going after the leader
+  // exits, since a grandchild holding the pipes open would otherwise pin
+  // the slot forever
+  for (size_t slot = 0; slot < (size_t)executor->max_children; slot++)
+    {
+      ExecutorJob *job = executor->slots[slot];
+      if (job == NULL)
+        {
+          continue;
+        }
+      int job_ms = child_watch_check (&job->watch);
+      if (wait_ms < 0 || job_ms < wait_ms)
+        {
+          wait_ms = job_ms;
+        }
+    }
+
+  struct epoll_event events[EXECUTOR_MAX_EVENTS];
+  int count = epoll_wait (executor->epoll_fd, events, EXECUTOR_MAX_EVENTS,
+                          wait_ms);
+  if (count == -1 && errno != EINTR)
+    {
+      perror ("epoll_wait");
+      return -1;
+    }
+
+  for (int i = 0; i < count; i++)
+    {
+      handle_event (executor, &events[i]);
+    }
+
+  for (size_t slot = 0; slot < (size_t)executor->max_children; slot++)
+    {
+      ExecutorJob *job = executor->slots[slot];
+      if (job == NULL)
+        {
+          continue;
+        }
+      if (job->fds[SOURCE_EXIT] < 0)
+        {
+          reap_job (job);
+        }
+      if (job->exited && job->fds[SOURCE_STDOUT] < 0
+          && job->fds[SOURCE_STDERR] < 0)
+        {
+          executor->slots[slot] = NULL;
+          executor->active--;
+          deliver_result (job);
+          free_job (job);
+        }
+    }
+
+  fill_slots (executor);
+  return (int)(executor->active + executor->pending);
+}
+
+/**
+ * Run until every submitted job (including ones submitted from callbacks)
+ * has completed.
+ * @param executor Executor
+ * @return 0 on success, -1 on error
+ */
+int
+executor_run (CommandExecutor *executor)
+{
+  int remaining;
+  while ((remaining = executor_run_once (executor, -1)) > 0)
+    ;
+  return remaining;
+}
+
+/**
+ * Number of children currently running.
+ * @param executor Executor
+ * @return Running child count
+ */
+size_t
+executor_active_count (const CommandExecutor *executor)
+{
+  return executor ? executor->active : 0;
+}
+
+/**
+ * Number of jobs waiting for a free slot.
+ * @param executor Executor
+ * @return Queued job count
+ */
+size_t
+executor_pending_count (const CommandExecutor *executor)
+{
+  return executor ? executor->pending : 0;
+}
@@ -0,0 +1,29 @@
+#ifndef COMMAND_EXECUTOR_H
+#define COMMAND_EXECUTOR_H
+
+#include "command_execution.h"
+
+// Called once per finished child. The callback may take ownership of
+// result->output by setting the pointer to NULL.
+typedef void (*CommandCompletionCallback) (CommandResult *result,
+                                           void *user_data);
+
+// Called with each chunk of a streaming child's stdout as it arrives,
+// instead of capturing it. Must not submit or destroy anything.
+typedef void (*CommandOutputCallback) (pid_t pid, const char *data,
+                                       size_t length, void *user_data);
+
+typedef struct CommandExecutor CommandExecutor;
+
+// clang-format off
+CommandExecutor *executor_create(int max_children);
+void executor_destroy(CommandExecutor *executor);
+int executor_submit(CommandExecutor *executor, const char *command, char *const argv[], CommandCompletionCallback on_complete, void *user_data);
+int executor_submit_streaming(CommandExecutor *executor, const char *command, char *const argv[], CommandOutputCallback on_output, CommandCompletionCallback on_complete, void *user_data);
+int executor_run_once(CommandExecutor *executor, int timeout_ms);
+int executor_run(CommandExecutor *executor);
+size_t executor_active_count(const CommandExecutor *executor);
+size_t executor_pending_count(const CommandExecutor *executor);
+// clang-format on
+
+#endif
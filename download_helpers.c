@@ -1,5 +1,12 @@
+#define _GNU_SOURCE
 #include "download_helpers.h"
+#include "bandwidth_governor.h"
 #include "command_execution.h"
+#include "progress_parser.h"
+
+#if USE_CURL
+#include "range_download.h"
+#endif
 
 #if USE_NCURSES
 #include "terminal_ui.h"
@@ -10,6 +17,10 @@ extern DownloadProgress *g_current_progress;
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 // Default format code for best quality video
 #define DEFAULT_FORMAT_CODE "bestvideo[ext=mp4]+bestaudio[ext=m4a]/best[ext=mp4]/best"
@@ -17,6 +28,10 @@ extern DownloadProgress *g_current_progress;
 #define YT_DLP_COMMAND "yt-dlp"
 // Output template format string
 #define OUTPUT_TEMPLATE_FORMAT "%s/%%(title)s.%%(ext)s"
+// yt-dlp option that downloads from a saved info JSON instead of a URL
+#define LOAD_INFO_JSON_FLAG "--load-info-json"
+// Record appended once the final file is in place: one JSON object per line
+#define REPORT_TEMPLATE "after_move:%(.{title,filepath,filesize,filesize_approx})j"
 
 /**
  * Validate input parameters for download command building.
@@ -52,9 +67,9 @@ validate_download_parameters(const char *format_code, const char *output_path, c
 
   if (format_code != NULL) {
     size_t format_len = strlen(format_code);
-    if (format_len >= FORMAT_CODE_LENGTH) {
+    if (format_len >= FORMAT_SELECTOR_LENGTH) {
       fprintf(stderr, "Error: Format code too long (%zu >= %d)\n",
-              format_len, FORMAT_CODE_LENGTH);
+              format_len, FORMAT_SELECTOR_LENGTH);
       return -1;
     }
   }
@@ -94,58 +109,119 @@ create_output_template(const char *output_path)
   return output_template;
 }
 
+/**
+ * Pack an argument list into a single allocation: the pointer table
+ * followed by copies of the strings, so the whole vector is released with
+ * one free() no matter which arguments were built dynamically.
+ * @param argv Argument list (NULL-terminated)
+ * @return Allocated argument array, NULL on error
+ */
+static char **
+pack_command_args(const char *const argv[])
+{
+  size_t count = 0;
+  size_t bytes = 0;
+  while (argv[count] != NULL) {
+    bytes += strlen(argv[count]) + 1;
+    count++;
+  }
+
+  size_t table_size = sizeof(char *) * (count + 1);
+  char **args = malloc(table_size + bytes);
+  if (args == NULL) {
+    fprintf(stderr, "Error: Memory allocation failed for command arguments\n");
+    return NULL;
+  }
+
+  char *strings = (char *)args + table_size;
+  for (size_t i = 0; i < count; i++) {
+    size_t len = strlen(argv[i]) + 1;
+    memcpy(strings, argv[i], len);
+    args[i] = strings;
+    strings += len;
+  }
+  args[count] = NULL;
+
+  return args;
+}
+
 /**
  * Build command line arguments array for yt-dlp download.
  * @param format_code Format code (NULL for default)
  * @param output_path Output directory path
  * @param url Video URL
+ * @param info_json_path Info JSON from an earlier extraction to download
+ *                       from instead of extracting the URL again (can be
+ *                       NULL)
+ * @param report_path File to append the download report to (can be NULL)
+ * @param progress_lines Replace yt-dlp's progress bar with one
+ *                       PROGRESS_TEMPLATE line per update, for
+ *                       parse_progress_line()
+ * @param rate_limit yt-dlp's own --limit-rate in bytes per second (0 for
+ *                   none)
  * @return Allocated NULL-terminated argument array, NULL on error
  */
 char **
-build_download_command_args(const char *format_code, const char *output_path, const char *url)
+build_download_command_args(const char *format_code, const char *output_path, const char *url,
+                            const char *info_json_path, const char *report_path,
+                            int progress_lines, long long rate_limit)
 {
   if (validate_download_parameters(format_code, output_path, url) == -1) {
     return NULL;
   }
 
-  // Determine argument count based on format code presence
   int has_format = (format_code != NULL && strlen(format_code) > 0);
-  int arg_count = has_format ? 6 : 5; // command + args + NULL
 
-  char **args = malloc(sizeof(char *) * (arg_count + 1));
-  if (args == NULL) {
-    fprintf(stderr, "Error: Memory allocation failed for command arguments\n");
+  char *output_template = create_output_template(output_path);
+  if (output_template == NULL) {
     return NULL;
   }
 
-  // Initialize all pointers to NULL for safety
-  memset(args, 0, sizeof(char *) * (arg_count + 1));
-
+  const char *argv[17];
   int idx = 0;
-  args[idx++] = YT_DLP_COMMAND;
+  argv[idx++] = YT_DLP_COMMAND;
 
   // Add format arguments
-  args[idx++] = "-f";
-  if (has_format) {
-    args[idx++] = (char *)format_code;
-  } else {
-    args[idx++] = DEFAULT_FORMAT_CODE;
-  }
+  argv[idx++] = "-f";
+  argv[idx++] = has_format ? format_code : DEFAULT_FORMAT_CODE;
 
   // Add output arguments
-  args[idx++] = "-o";
+  argv[idx++] = "-o";
+  argv[idx++] = output_template;
+
+  // Report title and final path without suppressing the progress output
+  if (report_path != NULL) {
+    argv[idx++] = "--no-simulate";
+    argv[idx++] = "--print-to-file";
+    argv[idx++] = REPORT_TEMPLATE;
+    argv[idx++] = report_path;
+  }
 
-  char *output_template = create_output_template(output_path);
-  if (output_template == NULL) {
-    free(args);
-    return NULL;
+  char rate[32];
+  if (rate_limit > 0) {
+    snprintf(rate, sizeof(rate), "%lld", rate_limit);
+    argv[idx++] = "--limit-rate";
+    argv[idx++] = rate;
   }
-  args[idx++] = output_template;
 
-  // Add URL
-  args[idx++] = (char *)url;
-  args[idx] = NULL; // NULL terminate
+  if (progress_lines) {
+    argv[idx++] = "--newline";
+    argv[idx++] = "--progress-template";
+    argv[idx++] = PROGRESS_TEMPLATE;
+  }
 
+  // Reuse the metadata already fetched; yt-dlp falls back to the page URL
+  // stored in it if the media URLs have expired meanwhile
+  if (info_json_path != NULL) {
+    argv[idx++] = LOAD_INFO_JSON_FLAG;
+    argv[idx++] = info_json_path;
+  } else {
+    argv[idx++] = url;
+  }
+  argv[idx] = NULL; // NULL terminate
+
+  char **args = pack_command_args(argv);
+  free(output_template);
   return args;
 }
 
@@ -156,26 +232,438 @@ build_download_command_args(const char *format_code, const char *output_path, co
 void
 free_command_args(char **args)
 {
+  // Strings live in the same allocation as the pointer table
+  free(args);
+}
+
+/**
+ * Copy a string member of the report record.
+ * @param record Parsed report record
+ * @param key Member name
+ * @return Allocated copy, NULL if absent or not a string
+ */
+static char *
+report_string(json_t *record, const char *key)
+{
+  const char *value = json_string_value(json_object_get(record, key));
+  return value != NULL ? strdup(value) : NULL;
+}
+
+/**
+ * Fill a download report from the record yt-dlp appended to the report file.
+ * The size is taken from the finished file when it can be stat()ed, since
+ * merged formats usually carry no exact filesize.
+ * @param fd Report file
+ * @param report Report to fill
+ * @return 0 on success, -1 if no usable record was written
+ */
+int
+read_download_report(int fd, DownloadReport *report)
+{
+  if (lseek(fd, 0, SEEK_SET) == -1) {
+    return -1;
+  }
+
+  json_error_t error;
+  json_t *record = json_loadfd(fd, JSON_DISABLE_EOF_CHECK, &error);
+  if (record == NULL || !json_is_object(record)) {
+    json_decref(record);
+    return -1;
+  }
+
+  report->title = report_string(record, "title");
+  report->filepath = report_string(record, "filepath");
+
+  struct stat file_stat;
+  json_t *filesize = json_object_get(record, "filesize");
+  if (!json_is_number(filesize)) {
+    filesize = json_object_get(record, "filesize_approx");
+  }
+  if (report->filepath != NULL && stat(report->filepath, &file_stat) == 0) {
+    report->size = (long long)file_stat.st_size;
+  } else if (json_is_number(filesize)) {
+    report->size = (long long)json_number_value(filesize);
+  }
+
+  json_decref(record);
+  return 0;
+}
+
+/**
+ * Release the strings held by a download report.
+ * @param report Report to clear
+ */
+void
+free_download_report(DownloadReport *report)
+{
+  if (report == NULL) {
+    return;
+  }
+  free(report->title);
+  free(report->filepath);
+  report->title = NULL;
+  report->filepath = NULL;
+  report->size = -1;
+}
+
+#if USE_NCURSES || USE_CURL
+/**
+ * Monotonic clock in milliseconds.
+ * @return Milliseconds since an arbitrary point
+ */
+static double
+progress_clock_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+#endif
+
+#if USE_NCURSES
+// Progress of a curses download, fed from yt-dlp's progress lines
+typedef struct {
+  UIState *ui;
+  DownloadProgress *progress;
+  long long finished_bytes; // streams already downloaded (video before audio)
+  int stream;               // stream being downloaded, from 1
+  double last_draw_ms;
+} ProgressFeed;
+
+/**
+ * Apply one line of yt-dlp's output to the progress window, redrawing it
+ * at most every UI_UPDATE_INTERVAL_MS.
+ * @param line Line without its newline
+ * @param length Length of line
+ * @param user_data ProgressFeed
+ */
+static void
+feed_progress_line(const char *line, size_t length, void *user_data)
+{
+  ProgressFeed *feed = user_data;
+  DownloadProgress *progress = feed->progress;
+  ProgressUpdate update;
+  if (!parse_progress_line(line, length, &update)) {
+    // Merging video and audio takes a while without progress lines
+    if (length >= 8 && memcmp(line, "[Merger]", 8) == 0) {
+      snprintf(progress->current_stage, sizeof(progress->current_stage), "Merging formats...");
+      ui_show_progress(feed->ui, progress);
+    }
+    return;
+  }
+  if (update.downloaded < 0) {
+    return;
+  }
+
+  // Byte counts restart with each stream; the window shows the sum
+  long long downloaded = feed->finished_bytes + update.downloaded;
+  long long total = update.total >= 0 ? feed->finished_bytes + update.total : 0;
+  ui_update_progress(progress, downloaded, total);
+  if (progress->download_speed <= 0 && update.speed > 0) {
+    // Too few samples of our own yet
+    progress->download_speed = update.speed;
+    if (update.eta >= 0) {
+      progress->estimated_completion = time(NULL) + update.eta;
+    }
+  }
+  if (feed->stream > 1) {
+    snprintf(progress->current_stage, sizeof(progress->current_stage),
+             "Downloading stream %d...", feed->stream);
+  } else {
+    snprintf(progress->current_stage, sizeof(progress->current_stage), "Downloading...");
+  }
+
+  int finished = update.status == PROGRESS_FINISHED;
+  if (finished) {
+    feed->finished_bytes += update.total >= 0 ? update.total : update.downloaded;
+    feed->stream++;
+  }
+
+  double now = progress_clock_ms();
+  if (finished || now - feed->last_draw_ms >= UI_UPDATE_INTERVAL_MS) {
+    feed->last_draw_ms = now;
+    ui_show_progress(feed->ui, progress);
+  }
+}
+
+/**
+ * Run a download without leaving curses mode: yt-dlp's output comes back
+ * through a pipe instead of onto the terminal, and its progress lines
+ * drive the progress window until it exits.
+ * @param args Download command built with progress_lines set
+ * @param ui UI state
+ * @param progress Progress shown in the window
+ * @return 0 on success, -1 on error
+ */
+static int
+run_download_with_progress(char **args, UIState *ui, DownloadProgress *progress)
+{
+  CommandStream stream;
+  if (command_stream_open(&stream, YT_DLP_COMMAND, args) != 0) {
+    return -1;
+  }
+
+  ProgressFeed feed = { ui, progress, 0, 1, 0.0 };
+  ProgressLineReader reader;
+  progress_line_reader_init(&reader);
+  char buffer[4096];
+  ssize_t bytes_read;
+  while ((bytes_read = command_stream_read(&stream, buffer, sizeof(buffer))) > 0) {
+    progress_line_reader_feed(&reader, buffer, (size_t)bytes_read, feed_progress_line, &feed);
+  }
+  progress_line_reader_finish(&reader, feed_progress_line, &feed);
+
+  return command_stream_close(&stream);
+}
+#endif
+
+#if USE_CURL
+// What a native download needs from yt-dlp for the chosen format
+#define NATIVE_PRINT_TEMPLATE "%(.{url,http_headers,protocol,filesize,title,filename})j"
+
+// Where a native download shows its progress
+typedef struct {
+  double start_ms;
+#if USE_NCURSES
+  DownloadProgress *progress; // NULL in text mode
+#endif
+} NativeProgress;
+
+/**
+ * Have yt-dlp resolve a format selection to what a native download needs:
+ * the media URL and its request headers, the exact size, and the file name
+ * yt-dlp itself would write with the same output template, so a native
+ * download and a yt-dlp one of the same video end up in the same file.
+ * The fetched info JSON is loaded when there is one; without it (-f, a
+ * cached table, --lean) the URL is extracted again.
+ * @param config Configuration with the URL, output path and info JSON
+ * @param format_code Format chosen
+ * @return Resolved fields (release with json_decref), NULL on error
+ */
+static json_t *
+resolve_native_format(const Config *config, const char *format_code)
+{
+  char *output_template = create_output_template(config->output_path);
+  if (output_template == NULL) {
+    return NULL;
+  }
+
+  char info_json_path[64];
+  const char *argv[11];
+  int idx = 0;
+  argv[idx++] = YT_DLP_COMMAND;
+  argv[idx++] = "-f";
+  argv[idx++] = format_code;
+  argv[idx++] = "-o";
+  argv[idx++] = output_template;
+  argv[idx++] = "--no-warnings";
+  argv[idx++] = "-O";
+  argv[idx++] = NATIVE_PRINT_TEMPLATE;
+  if (config->info_json_fd >= 0) {
+    snprintf(info_json_path, sizeof(info_json_path), "/proc/%ld/fd/%d", (long)getpid(),
+             config->info_json_fd);
+    argv[idx++] = LOAD_INFO_JSON_FLAG;
+    argv[idx++] = info_json_path;
+  } else {
+    argv[idx++] = config->url;
+  }
+  argv[idx] = NULL;
+
+  char **args = pack_command_args(argv);
+  free(output_template);
   if (args == NULL) {
+    return NULL;
+  }
+
+  CommandResult result;
+  json_t *resolved = NULL;
+  if (execute_command_capture(YT_DLP_COMMAND, args, &result) == 0 && result.output != NULL) {
+    json_error_t error;
+    resolved = json_loads(result.output, JSON_DISABLE_EOF_CHECK, &error);
+  }
+  free(result.output);
+  free_command_args(args);
+  if (resolved != NULL && !json_is_object(resolved)) {
+    json_decref(resolved);
+    resolved = NULL;
+  }
+  return resolved;
+}
+
+/**
+ * Show how far a native download is, in the progress window or on one
+ * line of the terminal.
+ * @param downloaded Bytes written so far
+ * @param total Size of the file
+ * @param user_data NativeProgress
+ */
+static void
+show_native_progress(long long downloaded, long long total, void *user_data)
+{
+  NativeProgress *native = user_data;
+#if USE_NCURSES
+  if (native->progress != NULL) {
+    ui_update_progress(native->progress, downloaded, total);
+    snprintf(native->progress->current_stage, sizeof(native->progress->current_stage),
+             "Downloading...");
+    ui_show_progress(g_current_ui_state, native->progress);
     return;
   }
+#endif
+  double seconds = (progress_clock_ms() - native->start_ms) / 1e3;
+  printf("\r[download] %5.1f%% of %.1f MB at %.1f MB/s", 100.0 * downloaded / total, total / 1e6,
+         seconds > 0 ? downloaded / 1e6 / seconds : 0.0);
+  if (downloaded >= total) {
+    printf("\n");
+  }
+  fflush(stdout);
+}
 
-  // Free the output template (always at index 4 when present)
-  if (args[4] != NULL) {
-    free(args[4]);
+/**
+ * Download a format with parallel HTTP range requests instead of yt-dlp,
+ * when yt-dlp resolves it to a single file of known size.
+ * @param config Configuration, with connections and the info JSON if any
+ * @param format_code Format chosen
+ * @param rate_limit Combined bytes per second, 0 for none
+ * @param report Receives title, path and size (can be NULL)
+ * @return 0 on success, 1 if the format cannot be downloaded natively,
+ *         -1 if the native download failed
+ */
+static int
+download_native(const Config *config, const char *format_code, long long rate_limit,
+                DownloadReport *report)
+{
+  if (config->connections == 0 || format_code == NULL || format_code[0] == '\0') {
+    return 1;
+  }
+  json_t *format = resolve_native_format(config, format_code);
+  if (format == NULL) {
+    return 1;
   }
 
-  free(args);
+  // One plain HTTP(S) file of known exact size: not fragments, not a merge
+  const char *protocol = json_string_value(json_object_get(format, "protocol"));
+  const char *url = json_string_value(json_object_get(format, "url"));
+  const char *path = json_string_value(json_object_get(format, "filename"));
+  const char *title = json_string_value(json_object_get(format, "title"));
+  json_t *filesize = json_object_get(format, "filesize");
+  if (protocol == NULL || (strcmp(protocol, "https") != 0 && strcmp(protocol, "http") != 0) ||
+      url == NULL || path == NULL || !json_is_integer(filesize) ||
+      json_integer_value(filesize) <= 0) {
+    json_decref(format);
+    return 1;
+  }
+  long long size = (long long)json_integer_value(filesize);
+
+  // The request headers yt-dlp would send for this format
+  json_t *http_headers = json_object_get(format, "http_headers");
+  char **headers = calloc(json_object_size(http_headers) + 1, sizeof(char *));
+  if (headers == NULL) {
+    json_decref(format);
+    return -1;
+  }
+  size_t header_count = 0;
+  const char *key;
+  json_t *value;
+  json_object_foreach(http_headers, key, value) {
+    if (json_is_string(value) &&
+        asprintf(&headers[header_count], "%s: %s", key, json_string_value(value)) != -1) {
+      header_count++;
+    }
+  }
+
+  NativeProgress native;
+  memset(&native, 0, sizeof(native));
+  int text_mode = 1;
+#if USE_NCURSES
+  if (g_current_ui_state != NULL && g_current_ui_state->ncurses_available) {
+    native.progress = g_current_progress;
+    if (native.progress != NULL && native.progress->start_time == 0) {
+      native.progress->start_time = time(NULL);
+    }
+    text_mode = native.progress == NULL;
+  }
+#endif
+
+  int result;
+  struct stat file_stat;
+  if (stat(path, &file_stat) == 0) {
+    // Whatever is there, as yt-dlp would leave it
+    if (text_mode) {
+      printf("[download] %s has already been downloaded\n", path);
+    }
+    size = (long long)file_stat.st_size;
+    result = 0;
+  } else {
+    RangeRequest request = { url,
+                             (const char *const *)headers,
+                             size,
+                             path,
+                             (int)config->connections,
+                             rate_limit };
+    if (text_mode) {
+      printf("[download] Destination: %s (%lu connections)\n", path, config->connections);
+    }
+    native.start_ms = progress_clock_ms();
+    RangeStats stats;
+    result = range_download(&request, show_native_progress, &native, &stats);
+    if (result == 0 && text_mode) {
+      printf("[download] %.1f MB in %.1f s: %zu requests, %zu splits, %zu restarts\n",
+             stats.bytes / 1e6, stats.elapsed_ms / 1e3, stats.requests, stats.splits,
+             stats.restarts);
+    }
+  }
+
+  if (result == 0 && report != NULL) {
+    report->title = title != NULL ? strdup(title) : NULL;
+    report->filepath = strdup(path);
+    report->size = size;
+  }
+  for (size_t i = 0; i < header_count; i++) {
+    free(headers[i]);
+  }
+  free(headers);
+  json_decref(format);
+  return result == 0 ? 0 : -1;
+}
+#endif
+
+/**
+ * Tell the user a download finished, in the progress window or on the
+ * terminal.
+ * @param config Configuration structure containing the output path
+ */
+static void
+show_download_complete(const Config *config)
+{
+#if USE_NCURSES
+  if (g_current_ui_state && g_current_ui_state->ncurses_available) {
+    // UI mode - update progress to complete
+    if (g_current_progress) {
+      g_current_progress->downloaded_bytes = g_current_progress->total_bytes;
+      strcpy(g_current_progress->current_stage, "Download complete!");
+      ui_show_progress(g_current_ui_state, g_current_progress);
+    }
+    return;
+  }
+#endif
+  printf("Download complete! Saved to: %s\n", config->output_path);
 }
 
 /**
  * Download video using yt-dlp with specified configuration.
  * @param config Configuration structure containing URL and output path
  * @param format_code Format code (NULL for default)
+ * @param report Receives title, path and size from yt-dlp's own output
+ *               when no metadata was fetched beforehand (can be NULL)
+ *
+ * With --connections, a format that is one plain HTTP file is fetched
+ * natively with parallel range requests; anything else, or a native
+ * download that fails, goes to yt-dlp.
  * @return 0 on success, -1 on error
  */
 int
-download_video(const Config *config, const char *format_code)
+download_video(const Config *config, const char *format_code, DownloadReport *report)
 {
   if (config == NULL) {
     fprintf(stderr, "Error: Configuration is NULL\n");
@@ -196,24 +684,79 @@ download_video(const Config *config, const char *format_code)
   }
 #endif
 
-  char **args = build_download_command_args(format_code, config->output_path, config->url);
+  // A single download is held to the whole budget by yt-dlp itself
+  long long rate_limit = 0;
+  RateSchedule schedule;
+  if (config->rate_limit != NULL && parse_rate_schedule(config->rate_limit, &schedule) == 0) {
+    rate_limit = rate_schedule_current(&schedule, time(NULL));
+  }
+
+  if (report != NULL) {
+    report->title = NULL;
+    report->filepath = NULL;
+    report->size = -1;
+  }
+
+#if USE_CURL
+  int native = download_native(config, format_code, rate_limit, report);
+  if (native == 0) {
+    show_download_complete(config);
+    return 0;
+  }
+  if (native == -1) {
+    if (command_cancel_requested()) {
+      return -1;
+    }
+    fprintf(stderr, "Warning: Downloading with yt-dlp instead\n");
+  }
+#endif
+
+  // The child opens our memfd through procfs; descriptors above stderr are
+  // not inherited across spawn
+  char info_json_path[64];
+  const char *info_json = NULL;
+  if (config->info_json_fd >= 0) {
+    snprintf(info_json_path, sizeof(info_json_path), "/proc/%ld/fd/%d", (long)getpid(),
+             config->info_json_fd);
+    info_json = info_json_path;
+  }
+
+  // yt-dlp appends the report to a memfd reached the same way
+  char report_path[64];
+  int report_fd = -1;
+  if (report != NULL) {
+    report_fd = memfd_create("ytdl-report", MFD_CLOEXEC);
+    if (report_fd != -1) {
+      snprintf(report_path, sizeof(report_path), "/proc/%ld/fd/%d", (long)getpid(), report_fd);
+    }
+  }
+
+  int live_progress = 0;
+#if USE_NCURSES
+  live_progress = g_current_ui_state != NULL && g_current_ui_state->ncurses_available;
+#endif
+
+  char **args = build_download_command_args(format_code, config->output_path, config->url,
+                                            info_json, report_fd != -1 ? report_path : NULL,
+                                            live_progress, rate_limit);
   if (args == NULL) {
     fprintf(stderr, "Error: Failed to build download command arguments\n");
+    if (report_fd != -1) {
+      close(report_fd);
+    }
     return -1;
   }
 
-  // Execute download command, handling ncurses mode properly
+  // Execute download command; in ncurses mode its progress feeds the window
   int result;
 #if USE_NCURSES
-  if (g_current_ui_state && g_current_ui_state->ncurses_available) {
-    // In ncurses mode, temporarily exit ncurses to prevent UI corruption
-    def_prog_mode();    // Save current ncurses state
-    endwin();           // Exit ncurses mode
-
-    result = execute_command_without_output(YT_DLP_COMMAND, args);
-
-    reset_prog_mode();  // Restore ncurses state
-    refresh();          // Refresh the screen
+  if (live_progress) {
+    DownloadProgress local_progress = { 0 };
+    DownloadProgress *progress = g_current_progress != NULL ? g_current_progress : &local_progress;
+    if (progress->start_time == 0) {
+      progress->start_time = time(NULL);
+    }
+    result = run_download_with_progress(args, g_current_ui_state, progress);
   } else {
     result = execute_command_without_output(YT_DLP_COMMAND, args);
   }
@@ -222,24 +765,18 @@ download_video(const Config *config, const char *format_code)
 #endif
 
   if (result == 0) {
-#if USE_NCURSES
-    if (g_current_ui_state && g_current_ui_state->ncurses_available) {
-      // UI mode - update progress to complete
-      if (g_current_progress) {
-        g_current_progress->downloaded_bytes = g_current_progress->total_bytes;
-        strcpy(g_current_progress->current_stage, "Download complete!");
-        ui_show_progress(g_current_ui_state, g_current_progress);
-      }
-    } else {
-#endif
-      printf("Download complete! Saved to: %s\n", config->output_path);
-#if USE_NCURSES
-    }
-#endif
+    show_download_complete(config);
   } else {
     fprintf(stderr, "Error: Download failed with exit code %d\n", result);
   }
 
+  if (report_fd != -1) {
+    if (result == 0 && read_download_report(report_fd, report) != 0) {
+      fprintf(stderr, "Warning: yt-dlp did not report the downloaded file\n");
+    }
+    close(report_fd);
+  }
+
   free_command_args(args);
   return result;
 }
\ No newline at end of file
@@ -3,10 +3,19 @@
 
 #include "ytdl.h"
 
+// What yt-dlp reported about a finished download
+typedef struct {
+  char *title;    // NULL if not reported
+  char *filepath; // final path after merging, NULL if not reported
+  long long size; // bytes, -1 if unknown
+} DownloadReport;
+
 // clang-format off
-char **build_download_command_args(const char *format_code, const char *output_path, const char *url);
+char **build_download_command_args(const char *format_code, const char *output_path, const char *url, const char *info_json_path, const char *report_path, int progress_lines, long long rate_limit);
 void free_command_args(char **args);
-int download_video(const Config *config, const char *format_code);
+int read_download_report(int fd, DownloadReport *report);
+int download_video(const Config *config, const char *format_code, DownloadReport *report);
+void free_download_report(DownloadReport *report);
 // clang-format on
 
 #endif
\ No newline at end of file
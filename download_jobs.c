@@ -0,0 +1,520 @@
+#define _GNU_SOURCE
+#include "download_jobs.h"
+#include "bandwidth_governor.h"
+#include "command_executor.h"
+#include "progress_parser.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define YT_DLP_COMMAND "yt-dlp"
+// yt-dlp's line naming the file a download writes to
+#define DESTINATION_PREFIX "[download] Destination: "
+// Suffix of the file yt-dlp writes until a download completes
+#define PARTIAL_SUFFIX ".part"
+
+typedef struct DownloadRun DownloadRun;
+
+// One download of a run, in a slot reused once it has finished
+typedef struct
+{
+  DownloadRun *run;
+  size_t number; // order in which the job was taken from the queue, from 1
+  char url[MAX_URL_LENGTH];
+  DownloadJobState state;
+  int report_fd; // memfd yt-dlp reports the finished file to, or -1
+  double started_ms;
+  pid_t pid;                   // yt-dlp run, -1 until its first output
+  ProgressLineReader progress; // splits its stdout into progress lines
+} DownloadJob;
+
+struct DownloadRun
+{
+  const Config *config;
+  CommandExecutor *executor;
+  DownloadJob *jobs; // max_jobs slots
+  int max_jobs;
+  size_t taken; // jobs taken from the queue
+  DownloadSummary *summary;
+  BandwidthGovernor *governor; // NULL without --limit-rate
+  JobJournal *journal;         // NULL without --journal
+};
+
+/**
+ * Remember the URL of a job that did not complete.
+ * @param summary Summary of the run
+ * @param url URL of the job
+ */
+static void
+record_failed_url (DownloadSummary *summary, const char *url)
+{
+  char *copy = strdup (url);
+  char **grown = realloc (summary->failed_urls, (summary->failed_url_count + 1)
+                                                    * sizeof (char *));
+  if (copy == NULL || grown == NULL)
+    {
+      // Only the list suffers; the counts stay right
+      free (copy);
+      if (grown != NULL)
+        {
+          summary->failed_urls = grown;
+        }
+      return;
+    }
+  summary->failed_urls = grown;
+  summary->failed_urls[summary->failed_url_count++] = copy;
+}
+
+/**
+ * Feed one line of a job's stdout to the governor and the journal: the
+ * bytes of progress lines, and the file named by destination lines.
+ * @param line Line without its newline
+ * @param length Length of line
+ * @param user_data DownloadJob
+ */
+static void
+job_progress_line (const char *line, size_t length, void *user_data)
+{
+  DownloadJob *job = user_data;
+  DownloadRun *run = job->run;
+  ProgressUpdate update;
+  if (parse_progress_line (line, length, &update))
+    {
+      if (run->governor != NULL && !command_cancel_requested ())
+        {
+          governor_report (run->governor, job->pid, update.downloaded);
+        }
+      if (run->journal != NULL)
+        {
+          journal_update (run->journal, job->url, JOURNAL_DOWNLOADING,
+                          update.downloaded, NULL);
+        }
+      return;
+    }
+
+  size_t prefix = strlen (DESTINATION_PREFIX);
+  if (run->journal != NULL && length > prefix && length < MAX_PATH_LENGTH
+      && memcmp (line, DESTINATION_PREFIX, prefix) == 0)
+    {
+      char path[MAX_PATH_LENGTH];
+      memcpy (path, line + prefix, length - prefix);
+      path[length - prefix] = '\0';
+      journal_update (run->journal, job->url, JOURNAL_DOWNLOADING, -1, path);
+    }
+}
+
+/**
+ * Output callback of a download: yt-dlp's progress lines as they come.
+ * @param pid yt-dlp run
+ * @param data Chunk of its stdout
+ * @param length Bytes in data
+ * @param user_data DownloadJob
+ */
+static void
+job_output (pid_t pid, const char *data, size_t length, void *user_data)
+{
+  DownloadJob *job = user_data;
+  job->pid = pid;
+  if (job->run->governor != NULL || job->run->journal != NULL)
+    {
+      progress_line_reader_feed (&job->progress, data, length,
+                                 job_progress_line, job);
+    }
+}
+
+/**
+ * Completion callback of a download: settle its state and report it.
+ * @param result Outcome of the yt-dlp run
+ * @param user_data DownloadJob
+ */
+static void
+job_finished (CommandResult *result, void *user_data)
+{
+  DownloadJob *job = user_data;
+  DownloadSummary *summary = job->run->summary;
+  double seconds = (monotonic_ms () - job->started_ms) / 1e3;
+  if (job->run->governor != NULL)
+    {
+      governor_forget (job->run->governor, result->pid);
+    }
+
+  if (result->pid != -1 && result->exit_status == 0
+      && result->termination == COMMAND_TERMINATION_NONE)
+    {
+      DownloadReport report = { NULL, NULL, -1 };
+      if (job->report_fd != -1)
+        {
+          read_download_report (job->report_fd, &report);
+        }
+      const char *name = report.filepath != NULL ? report.filepath
+                         : report.title != NULL  ? report.title
+                                                 : job->url;
+      if (report.size >= 0)
+        {
+          printf ("[%zu] Done: %s (%.1f MB in %.1f s)\n", job->number, name,
+                  (double)report.size / (1024.0 * 1024.0), seconds);
+          summary->bytes += report.size;
+        }
+      else
+        {
+          printf ("[%zu] Done: %s (%.1f s)\n", job->number, name, seconds);
+        }
+      if (job->run->journal != NULL)
+        {
+          journal_update (job->run->journal, job->url, JOURNAL_DONE,
+                          report.size, report.filepath);
+        }
+      free_download_report (&report);
+      job->state = JOB_DONE;
+      summary->done++;
+    }
+  else
+    {
+      const char *reason;
+      if (result->pid == -1)
+        {
+          reason = "could not be started";
+        }
+      else if (result->termination != COMMAND_TERMINATION_NONE)
+        {
+          reason = command_termination_description (result->termination);
+        }
+      else
+        {
+          reason = command_error_description (
+              classify_command_error (&result->error_tail));
+        }
+      // A cancelled job stays unfinished in the journal, for the next run
+      if (result->termination == COMMAND_TERMINATION_CANCELLED)
+        {
+          job->state = JOB_CANCELLED;
+          summary->cancelled++;
+          fprintf (stderr, "[%zu] Cancelled: %s\n", job->number, job->url);
+        }
+      else
+        {
+          if (job->run->journal != NULL)
+            {
+              journal_update (job->run->journal, job->url, JOURNAL_FAILED,
+                              -1, NULL);
+            }
+          job->state = JOB_FAILED;
+          summary->failed++;
+          fprintf (stderr, "[%zu] Failed: %s (%s)\n", job->number, job->url,
+                   reason);
+        }
+      record_failed_url (summary, job->url);
+    }
+  fflush (stdout);
+
+  if (job->report_fd != -1)
+    {
+      close (job->report_fd);
+      job->report_fd = -1;
+    }
+}
+
+/**
+ * Record in the journal that a job is fetching, and find the partial file
+ * an earlier run left for it. yt-dlp continues a partial file under the
+ * same name rather than starting over, so only its size is looked at.
+ * @param job Job just started
+ * @return Bytes already downloaded, -1 if there is no partial file
+ */
+static long long
+record_job_start (DownloadJob *job)
+{
+  char path[MAX_PATH_LENGTH];
+  long long partial = -1;
+  if (journal_lookup (job->run->journal, job->url, NULL, path, sizeof (path))
+          == JOURNAL_DOWNLOADING
+      && path[0] != '\0'
+      && strlen (path) + strlen (PARTIAL_SUFFIX) < sizeof (path))
+    {
+      struct stat st;
+      strcat (path, PARTIAL_SUFFIX);
+      if (stat (path, &st) == 0)
+        {
+          partial = (long long)st.st_size;
+        }
+    }
+  journal_update (job->run->journal, job->url, JOURNAL_FETCHING, -1, NULL);
+  return partial;
+}
+
+/**
+ * Start downloading a video in a free slot.
+ * @param run Run
+ * @param video Video taken from the queue
+ */
+static void
+start_job (DownloadRun *run, const QueuedVideo *video)
+{
+  DownloadJob *job = NULL;
+  for (int i = 0; i < run->max_jobs && job == NULL; i++)
+    {
+      if (run->jobs[i].state != JOB_RUNNING)
+        {
+          job = &run->jobs[i];
+        }
+    }
+
+  job->run = run;
+  job->number = ++run->taken;
+  job->state = JOB_QUEUED;
+  snprintf (job->url, sizeof (job->url), "%s", video->url);
+  job->started_ms = monotonic_ms ();
+  job->pid = -1;
+  progress_line_reader_init (&job->progress);
+
+  // As in download_video: yt-dlp writes its report to our memfd through
+  // procfs
+  char report_path[64];
+  job->report_fd = memfd_create ("ytdl-report", MFD_CLOEXEC);
+  if (job->report_fd != -1)
+    {
+      snprintf (report_path, sizeof (report_path), "/proc/%ld/fd/%d",
+                (long)getpid (), job->report_fd);
+    }
+
+  // Progress lines rather than a progress bar: they feed the governor, and
+  // are dropped as they come instead of piling up for the whole download
+  long long ceiling
+      = run->governor != NULL ? governor_budget (run->governor) : 0;
+  char **args = build_download_command_args (
+      run->config->format_selector, run->config->output_path, job->url, NULL,
+      job->report_fd != -1 ? report_path : NULL, 1, ceiling);
+  if (args == NULL
+      || executor_submit_streaming (run->executor, YT_DLP_COMMAND, args,
+                                    job_output, job_finished, job)
+             != 0)
+    {
+      free_command_args (args);
+      CommandResult result = { 0 };
+      result.pid = -1;
+      result.exit_status = -1;
+      job->state = JOB_RUNNING;
+      job_finished (&result, job);
+      return;
+    }
+  free_command_args (args);
+
+  job->state = JOB_RUNNING;
+  long long partial = run->journal != NULL ? record_job_start (job) : -1;
+  if (partial >= 0)
+    {
+      printf ("[%zu] Resuming %s (%.1f MB downloaded)\n", job->number,
+              job->url, (double)partial / (1024.0 * 1024.0));
+    }
+  else
+    {
+      printf ("[%zu] Downloading %s\n", job->number, job->url);
+    }
+  fflush (stdout);
+}
+
+/**
+ * Download every video of a queue, up to max_jobs at once, until the
+ * producer closes it. Each job is a yt-dlp run of its own, started as soon
+ * as a slot frees up; its progress output is consumed rather than shown,
+ * and one line per job reports the outcome instead. With --limit-rate a
+ * governor shares the rate among the running jobs. With a journal, each
+ * job's state is recorded as it changes and synced in batches. After
+ * Ctrl-C the running jobs are stopped, the queue is abandoned and nothing
+ * more starts.
+ * @param config Configuration (format and output directory)
+ * @param queue Queue fed by a producer thread
+ * @param max_jobs Most downloads at once (1 to MAX_DOWNLOAD_JOBS)
+ * @param journal Journal of the run, or NULL
+ * @param summary Receives the outcome (release with
+ *                free_download_summary())
+ * @return 0 on success, -1 if the run could not be set up (the queue is
+ *         abandoned)
+ */
+int
+run_download_jobs (const Config *config, DownloadQueue *queue, int max_jobs,
+                   JobJournal *journal, DownloadSummary *summary)
+{
+  memset (summary, 0, sizeof (DownloadSummary));
+  if (max_jobs < 1 || max_jobs > MAX_DOWNLOAD_JOBS)
+    {
+      fprintf (stderr, "Error: Invalid number of download jobs\n");
+      download_queue_abandon (queue);
+      return -1;
+    }
+
+  DownloadRun run = { 0 };
+  run.config = config;
+  run.max_jobs = max_jobs;
+  run.summary = summary;
+  run.journal = journal;
+  run.jobs = calloc ((size_t)max_jobs, sizeof (DownloadJob));
+  run.executor = executor_create (max_jobs);
+  RateSchedule schedule;
+  if (config->rate_limit != NULL
+      && parse_rate_schedule (config->rate_limit, &schedule) == 0)
+    {
+      run.governor = governor_create (&schedule, (size_t)max_jobs);
+    }
+  if (run.jobs == NULL || run.executor == NULL
+      || (config->rate_limit != NULL && run.governor == NULL))
+    {
+      free (run.jobs);
+      executor_destroy (run.executor);
+      governor_destroy (run.governor);
+      download_queue_abandon (queue);
+      return -1;
+    }
+  for (int i = 0; i < max_jobs; i++)
+    {
+      run.jobs[i].report_fd = -1;
+    }
+
+  double start_ms = monotonic_ms ();
+  int drained = 0; // the producer closed the queue and it is empty
+  for (;;)
+    {
+      size_t outstanding = executor_active_count (run.executor)
+                           + executor_pending_count (run.executor);
+      while (!drained && !command_cancel_requested ()
+             && outstanding < (size_t)max_jobs)
+        {
+          QueuedVideo video;
+          int taken = download_queue_try_pop (queue, &video);
+          if (taken != 1)
+            {
+              drained = taken == -1;
+              break;
+            }
+          start_job (&run, &video);
+          outstanding = executor_active_count (run.executor)
+                        + executor_pending_count (run.executor);
+        }
+
+      if (outstanding == 0)
+        {
+          if (drained || command_cancel_requested ())
+            {
+              break;
+            }
+          // Nothing to watch: sleep until the producer catches up
+          QueuedVideo video;
+          if (download_queue_pop (queue, &video) == 0)
+            {
+              drained = 1;
+              continue;
+            }
+          start_job (&run, &video);
+          continue;
+        }
+
+      // Short waits while the queue is open, so new videos start promptly;
+      // shorter ones still when the governor has buckets to refill
+      int wait_ms = run.governor != NULL ? GOVERNOR_TICK_MS
+                                         : COMMAND_WATCH_INTERVAL_MS;
+      if (executor_run_once (run.executor, wait_ms) == -1)
+        {
+          break;
+        }
+      if (run.governor != NULL)
+        {
+          // Paused jobs must run again to act on the cancellation
+          if (command_cancel_requested ())
+            {
+              governor_resume_all (run.governor);
+            }
+          else
+            {
+              governor_tick (run.governor);
+            }
+        }
+      if (journal != NULL)
+        {
+          journal_sync (journal, 0);
+        }
+    }
+
+  if (command_cancel_requested ())
+    {
+      download_queue_abandon (queue);
+    }
+  summary->elapsed_ms = monotonic_ms () - start_ms;
+
+  // Only reached with children left if the executor failed
+  governor_destroy (run.governor);
+  executor_destroy (run.executor);
+  for (int i = 0; i < max_jobs; i++)
+    {
+      if (run.jobs[i].report_fd != -1)
+        {
+          close (run.jobs[i].report_fd);
+        }
+    }
+  free (run.jobs);
+  return 0;
+}
+
+/**
+ * Print the totals of a run and the URLs that did not download.
+ * @param summary Summary of the run
+ */
+void
+print_download_summary (const DownloadSummary *summary)
+{
+  double seconds = summary->elapsed_ms / 1e3;
+  printf ("\nDownloads: %zu done, %zu failed", summary->done,
+          summary->failed);
+  if (summary->cancelled > 0)
+    {
+      printf (", %zu cancelled", summary->cancelled);
+    }
+  printf ("\nDownloaded: %.1f MB in %.1f s", summary->bytes / (1024.0 * 1024.0),
+          seconds);
+  if (seconds > 0 && summary->bytes > 0)
+    {
+      printf (" (%.1f MB/s)", summary->bytes / (1024.0 * 1024.0) / seconds);
+    }
+  printf ("\n");
+  for (size_t i = 0; i < summary->failed_url_count; i++)
+    {
+      printf ("Not downloaded: %s\n", summary->failed_urls[i]);
+    }
+}
+
+/**
+ * Process exit status summing up a run: success if every job completed,
+ * EXIT_PARTIAL if only some did, failure if none did.
+ * @param summary Summary of the run
+ * @return EXIT_SUCCESS, EXIT_PARTIAL or EXIT_FAILURE
+ */
+int
+download_summary_exit_status (const DownloadSummary *summary)
+{
+  size_t missed = summary->failed + summary->cancelled;
+  if (missed == 0)
+    {
+      return EXIT_SUCCESS;
+    }
+  return summary->done > 0 ? EXIT_PARTIAL : EXIT_FAILURE;
+}
+
+/**
+ * Release what a summary holds.
+ * @param summary Summary of the run
+ */
+void
+free_download_summary (DownloadSummary *summary)
+{
+  for (size_t i = 0; i < summary->failed_url_count; i++)
+    {
+      free (summary->failed_urls[i]);
+    }
+  free (summary->failed_urls);
+  summary->failed_urls = NULL;
+  summary->failed_url_count = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef DOWNLOAD_JOBS_H
+#define DOWNLOAD_JOBS_H
+
+#include "download_helpers.h"
+#include "download_queue.h"
+#include "job_journal.h"
+
+// Most downloads run at once (-j)
+#define MAX_DOWNLOAD_JOBS 64
+// Exit status when some downloads of a run failed and others succeeded
+#define EXIT_PARTIAL 2
+
+// Lifecycle of one download
+typedef enum
+{
+  JOB_QUEUED,
+  JOB_RUNNING,
+  JOB_DONE,
+  JOB_FAILED,
+  JOB_CANCELLED
+} DownloadJobState;
+
+// Outcome of a run of concurrent downloads
+typedef struct
+{
+  size_t done;
+  size_t failed;
+  size_t cancelled; // stopped by Ctrl-C
+  long long bytes;  // size of the downloaded files, as reported by yt-dlp
+  double elapsed_ms;
+  char **failed_urls; // failed and cancelled jobs, in completion order
+  size_t failed_url_count;
+} DownloadSummary;
+
+// clang-format off
+int run_download_jobs(const Config *config, DownloadQueue *queue, int max_jobs, JobJournal *journal, DownloadSummary *summary);
+void print_download_summary(const DownloadSummary *summary);
+int download_summary_exit_status(const DownloadSummary *summary);
+void free_download_summary(DownloadSummary *summary);
+// clang-format on
+
+#endif
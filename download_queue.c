@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include "download_queue.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct DownloadQueue
+{
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty; // a video was pushed, or the queue was closed
+  pthread_cond_t not_full;  // a video was popped, or the queue abandoned
+  QueuedVideo *slots;       // ring of capacity videos
+  size_t capacity;
+  size_t head; // oldest video
+  size_t count;
+  int closed;    // the producer is done; pops drain what is left
+  int abandoned; // the consumer is done; pushes fail
+  DownloadQueueFilter filter; // NULL to queue every URL
+  void *filter_data;
+};
+
+/**
+ * Create an empty queue.
+ * @param capacity Most videos held at once (at least 1)
+ * @return Queue, NULL on error
+ */
+DownloadQueue *
+download_queue_create (size_t capacity)
+{
+  if (capacity == 0)
+    {
+      fprintf (stderr, "Error: Invalid download queue capacity\n");
+      return NULL;
+    }
+
+  DownloadQueue *queue = calloc (1, sizeof (DownloadQueue));
+  if (queue == NULL)
+    {
+      perror ("calloc");
+      return NULL;
+    }
+  queue->slots = calloc (capacity, sizeof (QueuedVideo));
+  if (queue->slots == NULL)
+    {
+      perror ("calloc");
+      free (queue);
+      return NULL;
+    }
+  queue->capacity = capacity;
+  pthread_mutex_init (&queue->lock, NULL);
+  pthread_cond_init (&queue->not_empty, NULL);
+  pthread_cond_init (&queue->not_full, NULL);
+  return queue;
+}
+
+/**
+ * Destroy a queue. Neither side may be using it any more.
+ * @param queue Queue to destroy (can be NULL)
+ */
+void
+download_queue_destroy (DownloadQueue *queue)
+{
+  if (queue == NULL)
+    {
+      return;
+    }
+  pthread_cond_destroy (&queue->not_full);
+  pthread_cond_destroy (&queue->not_empty);
+  pthread_mutex_destroy (&queue->lock);
+  free (queue->slots);
+  free (queue);
+}
+
+/**
+ * Have every later push consult a filter first. Set it before any producer
+ * starts.
+ * @param queue Queue
+ * @param filter Filter, NULL to queue every URL
+ * @param user_data Passed to the filter
+ */
+void
+download_queue_set_filter (DownloadQueue *queue, DownloadQueueFilter filter,
+                           void *user_data)
+{
+  queue->filter = filter;
+  queue->filter_data = user_data;
+}
+
+/**
+ * Append a video, waiting while the queue is full. A video the filter
+ * drops counts as pushed.
+ * @param queue Queue
+ * @param url Video URL (shorter than MAX_URL_LENGTH)
+ * @param index Position of the video in its playlist
+ * @return 0 on success, -1 if the URL is too long or the consumer has
+ *         abandoned the queue
+ */
+int
+download_queue_push (DownloadQueue *queue, const char *url, size_t index)
+{
+  size_t url_len = strlen (url);
+  if (url_len >= MAX_URL_LENGTH)
+    {
+      fprintf (stderr, "Error: URL too long (max %d characters)\n",
+               MAX_URL_LENGTH - 1);
+      return -1;
+    }
+  if (queue->filter != NULL && !queue->filter (url, queue->filter_data))
+    {
+      return 0;
+    }
+
+  pthread_mutex_lock (&queue->lock);
+  while (queue->count == queue->capacity && !queue->abandoned)
+    {
+      pthread_cond_wait (&queue->not_full, &queue->lock);
+    }
+  if (queue->abandoned)
+    {
+      pthread_mutex_unlock (&queue->lock);
+      return -1;
+    }
+
+  QueuedVideo *video
+      = &queue->slots[(queue->head + queue->count) % queue->capacity];
+  memcpy (video->url, url, url_len + 1);
+  video->index = index;
+  queue->count++;
+  pthread_cond_signal (&queue->not_empty);
+  pthread_mutex_unlock (&queue->lock);
+  return 0;
+}
+
+/**
+ * Take the oldest video, waiting while the queue is empty and open.
+ * @param queue Queue
+ * @param video Receives the video
+ * @return 1 if a video was taken, 0 once the queue is closed and drained
+ */
+int
+download_queue_pop (DownloadQueue *queue, QueuedVideo *video)
+{
+  pthread_mutex_lock (&queue->lock);
+  while (queue->count == 0 && !queue->closed)
+    {
+      pthread_cond_wait (&queue->not_empty, &queue->lock);
+    }
+  if (queue->count == 0)
+    {
+      pthread_mutex_unlock (&queue->lock);
+      return 0;
+    }
+
+  *video = queue->slots[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+  pthread_cond_signal (&queue->not_full);
+  pthread_mutex_unlock (&queue->lock);
+  return 1;
+}
+
+/**
+ * Take the oldest video if there is one, without waiting.
+ * @param queue Queue
+ * @param video Receives the video
+ * @return 1 if a video was taken, 0 if none is queued yet, -1 once the
+ *         queue is closed and drained
+ */
+int
+download_queue_try_pop (DownloadQueue *queue, QueuedVideo *video)
+{
+  pthread_mutex_lock (&queue->lock);
+  if (queue->count == 0)
+    {
+      int closed = queue->closed;
+      pthread_mutex_unlock (&queue->lock);
+      return closed ? -1 : 0;
+    }
+
+  *video = queue->slots[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+  pthread_cond_signal (&queue->not_full);
+  pthread_mutex_unlock (&queue->lock);
+  return 1;
+}
+
+/**
+ * Producer side: no more videos will be pushed.
+ * @param queue Queue
+ */
+void
+download_queue_close (DownloadQueue *queue)
+{
+  pthread_mutex_lock (&queue->lock);
+  queue->closed = 1;
+  pthread_cond_broadcast (&queue->not_empty);
+  pthread_mutex_unlock (&queue->lock);
+}
+
+/**
+ * Consumer side: no more videos will be popped. A producer waiting for
+ * room, and every later push, fails instead.
+ * @param queue Queue
+ */
+void
+download_queue_abandon (DownloadQueue *queue)
+{
+  pthread_mutex_lock (&queue->lock);
+  queue->abandoned = 1;
+  pthread_cond_broadcast (&queue->not_full);
+  pthread_mutex_unlock (&queue->lock);
+}
@@ -0,0 +1,35 @@
+#ifndef DOWNLOAD_QUEUE_H
+#define DOWNLOAD_QUEUE_H
+
+#include "ytdl.h"
+
+// Videos held between a producer and the downloads; a full queue holds
+// the producer back, so memory does not grow with the playlist
+#define DOWNLOAD_QUEUE_CAPACITY 64
+
+// One video waiting to be downloaded
+typedef struct
+{
+  char url[MAX_URL_LENGTH];
+  size_t index; // position in the playlist it came from, from 1
+} QueuedVideo;
+
+// Bounded FIFO handing videos from a producer thread to the downloads
+typedef struct DownloadQueue DownloadQueue;
+
+// Consulted by every push, in the producer's thread: 1 to queue the URL,
+// 0 to drop it
+typedef int (*DownloadQueueFilter) (const char *url, void *user_data);
+
+// clang-format off
+DownloadQueue *download_queue_create(size_t capacity);
+void download_queue_destroy(DownloadQueue *queue);
+void download_queue_set_filter(DownloadQueue *queue, DownloadQueueFilter filter, void *user_data);
+int download_queue_push(DownloadQueue *queue, const char *url, size_t index);
+int download_queue_pop(DownloadQueue *queue, QueuedVideo *video);
+int download_queue_try_pop(DownloadQueue *queue, QueuedVideo *video);
+void download_queue_close(DownloadQueue *queue);
+void download_queue_abandon(DownloadQueue *queue);
+// clang-format on
+
+#endif
@@ -1,4 +1,5 @@
 #include "format_parsing.h"
+#include "json_scan.h"
 
 #include <jansson.h>
 #include <stdint.h>
@@ -12,6 +13,23 @@
 #define JSON_FIELD_RESOLUTION "resolution"
 #define JSON_FIELD_EXTENSION "ext"
 #define JSON_FIELD_FILESIZE "filesize"
+#define JSON_FIELD_TITLE "title"
+#define JSON_FIELD_CHANNEL "channel"
+#define JSON_FIELD_DURATION "duration"
+#define JSON_FIELD_WIDTH "width"
+#define JSON_FIELD_HEIGHT "height"
+#define JSON_FIELD_FPS "fps"
+#define JSON_FIELD_TBR "tbr"
+
+// Fields of each lean record, in template order (after the record tag)
+static const char *const lean_info_fields[]
+    = { JSON_FIELD_DURATION, JSON_FIELD_CHANNEL, JSON_FIELD_TITLE };
+static const char *const lean_format_fields[]
+    = { JSON_FIELD_FORMAT_ID, JSON_FIELD_RESOLUTION, JSON_FIELD_EXTENSION,
+        JSON_FIELD_FILESIZE,  JSON_FIELD_WIDTH,      JSON_FIELD_HEIGHT,
+        JSON_FIELD_FPS,       JSON_FIELD_TBR };
+
+#define LEAN_FIELD_COUNT(fields) (sizeof (fields) / sizeof ((fields)[0]))
 
 // Display format constants
 #define FORMAT_ID_WIDTH 5
@@ -19,8 +37,45 @@
 #define EXTENSION_WIDTH 4
 #define FILESIZE_WIDTH 8
 
-// Maximum reasonable JSON string length to prevent DoS
-#define MAX_JSON_LENGTH (1024 * 1024) // 1MB
+// Labels indexed by FormatQuality
+static const char *const quality_labels[]
+    = { "", "Audio Only", "SD", "HD", "Full HD", "2K QHD", "4K UHD" };
+
+// Interned strings of a format table: one pool sized up front, so the
+// pointers handed out stay valid, and each distinct value stored once
+typedef struct
+{
+  char *pool;
+  size_t used;
+  const char **distinct;
+  size_t distinct_count;
+} StringInterner;
+
+// Field values of one table row, wherever they were read from
+typedef struct
+{
+  const char *format_id;
+  const char *resolution;
+  const char *ext;
+  long long filesize;
+  double width;
+  double height;
+  double fps;
+  double tbr;
+} FormatRow;
+
+// One formats[] entry as found by the scanner, strings still undecoded
+typedef struct
+{
+  JsonSpan format_id;
+  JsonSpan resolution;
+  JsonSpan ext;
+  long long filesize;
+  double width;
+  double height;
+  double fps;
+  double tbr;
+} FormatSpans;
 
 /**
  * Safely retrieve a string value from JSON object with NULL checking.
@@ -82,46 +137,22 @@ safe_json_integer_value (const json_t *obj, const char *key,
 }
 
 /**
- * Parse JSON string and extract formats array with comprehensive validation.
- * @param json_str JSON string to parse
- * @return JSON array of formats, NULL on error
+ * Extract and validate the formats array from a parsed info document.
+ * @param root Parsed yt-dlp info document
+ * @return New reference to the JSON array of formats, NULL on error
  */
 json_t *
-parse_formats (const char *json_str)
+extract_formats (const json_t *root)
 {
-  if (json_str == NULL)
-    {
-      fprintf (stderr, "Error: JSON string parameter is NULL\n");
-      return NULL;
-    }
-
-  size_t json_len = strlen (json_str);
-  if (json_len == 0)
-    {
-      fprintf (stderr, "Error: JSON string is empty\n");
-      return NULL;
-    }
-
-  if (json_len > MAX_JSON_LENGTH)
-    {
-      fprintf (stderr, "Error: JSON string too large (%zu bytes, max %d)\n",
-               json_len, MAX_JSON_LENGTH);
-      return NULL;
-    }
-
-  json_error_t error;
-  json_t *root = json_loads (json_str, 0, &error);
   if (root == NULL)
     {
-      fprintf (stderr, "Error: JSON parsing failed on line %d: %s\n",
-               error.line, error.text);
+      fprintf (stderr, "Error: JSON document parameter is NULL\n");
       return NULL;
     }
 
   if (!json_is_object (root))
     {
       fprintf (stderr, "Error: Root JSON element is not an object\n");
-      json_decref (root);
       return NULL;
     }
 
@@ -130,7 +161,6 @@ parse_formats (const char *json_str)
     {
       fprintf (stderr, "Error: '%s' field not found in JSON data\n",
                JSON_FIELD_FORMATS);
-      json_decref (root);
       return NULL;
     }
 
@@ -138,7 +168,6 @@ parse_formats (const char *json_str)
     {
       fprintf (stderr, "Error: '%s' is not an array in JSON data\n",
                JSON_FIELD_FORMATS);
-      json_decref (root);
       return NULL;
     }
 
@@ -147,36 +176,412 @@ parse_formats (const char *json_str)
   if (array_size == 0)
     {
       fprintf (stderr, "Error: Formats array is empty\n");
-      json_decref (root);
       return NULL;
     }
 
   // Increment reference count to keep formats alive after root is decref'd
-  json_incref (formats);
+  return json_incref (formats);
+}
+
+/**
+ * Parse JSON delivered in pieces (e.g. decompressed from the info archive)
+ * and extract the formats array, without holding the whole text in memory.
+ * @param callback Reader, as for json_load_callback()
+ * @param data Reader state
+ * @return JSON array of formats, NULL on error
+ */
+json_t *
+parse_formats_stream (json_load_callback_t callback, void *data)
+{
+  json_error_t error;
+  json_t *root = json_load_callback (callback, data, 0, &error);
+  if (root == NULL)
+    {
+      fprintf (stderr, "Error: JSON parsing failed on line %d: %s\n",
+               error.line, error.text);
+      return NULL;
+    }
+
+  json_t *formats = extract_formats (root);
   json_decref (root);
   return formats;
 }
 
 /**
- * Display available formats in a formatted table with safe field access.
- * @param formats JSON array of format objects
+ * Parse one lean record into an object: tab-separated JSON scalars, named
+ * by the field list. Null fields are left out, as yt-dlp leaves them out of
+ * the full document.
+ * @param fields Field names in template order
+ * @param field_count Number of fields
+ * @param text Record text after the tag and its tab
+ * @param length Record length
+ * @param target Object to set the fields on
+ * @return 0 on success, -1 on a malformed record
  */
-void
-display_formats (const json_t *formats)
+static int
+parse_lean_fields (const char *const *fields, size_t field_count,
+                   const char *text, size_t length, json_t *target)
 {
-  if (formats == NULL || !json_is_array (formats))
+  const char *end = text + length;
+  for (size_t i = 0; i < field_count; i++)
     {
-      fprintf (stderr, "Error: Invalid formats parameter\n");
-      return;
+      // JSON escapes control characters, so a tab always separates fields
+      const char *separator = memchr (text, '\t', (size_t)(end - text));
+      const char *field_end = separator ? separator : end;
+      if ((separator == NULL) != (i + 1 == field_count))
+        {
+          return -1;
+        }
+
+      json_error_t error;
+      json_t *value = json_loadb (text, (size_t)(field_end - text),
+                                  JSON_DECODE_ANY, &error);
+      if (value == NULL)
+        {
+          return -1;
+        }
+      if (json_is_null (value))
+        {
+          json_decref (value);
+        }
+      else if (json_object_set_new (target, fields[i], value) != 0)
+        {
+          return -1;
+        }
+
+      text = field_end + 1;
     }
+  return 0;
+}
 
-  printf ("Available formats:\n");
+/**
+ * Parse the compact record stream written by `yt-dlp -f all --print` with
+ * the LEAN_*_TEMPLATE templates into an info object with the same shape
+ * (and only the fields) the display code reads from the full -j document.
+ * @param text Record stream
+ * @param length Length of the stream
+ * @return Info object (caller must json_decref), NULL on error
+ */
+json_t *
+parse_lean_metadata (const char *text, size_t length)
+{
+  if (text == NULL)
+    {
+      fprintf (stderr, "Error: Lean metadata parameter is NULL\n");
+      return NULL;
+    }
+
+  json_t *info = json_object ();
+  json_t *formats = json_array ();
+  if (info == NULL || formats == NULL
+      || json_object_set_new (info, JSON_FIELD_FORMATS, formats) != 0)
+    {
+      fprintf (stderr, "Error: Memory allocation failed for lean metadata\n");
+      json_decref (info);
+      return NULL;
+    }
+
+  size_t info_tag_length = strlen (LEAN_INFO_TAG "\t");
+  size_t format_tag_length = strlen (LEAN_FORMAT_TAG "\t");
+  const char *end = text + length;
+  size_t line_number = 0;
+  while (text < end)
+    {
+      const char *newline = memchr (text, '\n', (size_t)(end - text));
+      const char *line_end = newline ? newline : end;
+      size_t line_length = (size_t)(line_end - text);
+      line_number++;
+
+      int failed = 0;
+      if (line_length > info_tag_length
+          && memcmp (text, LEAN_INFO_TAG "\t", info_tag_length) == 0)
+        {
+          failed = parse_lean_fields (
+              lean_info_fields, LEAN_FIELD_COUNT (lean_info_fields),
+              text + info_tag_length, line_length - info_tag_length, info);
+        }
+      else if (line_length > format_tag_length
+               && memcmp (text, LEAN_FORMAT_TAG "\t", format_tag_length) == 0)
+        {
+          json_t *format = json_object ();
+          // "-f all" walks the formats best first; -j lists them worst first
+          failed = format == NULL || json_array_insert_new (formats, 0, format);
+          failed = failed
+                   || parse_lean_fields (lean_format_fields,
+                                         LEAN_FIELD_COUNT (lean_format_fields),
+                                         text + format_tag_length,
+                                         line_length - format_tag_length,
+                                         format);
+        }
+      // Anything else is not ours (e.g. a plugin printing to stdout)
+
+      if (failed)
+        {
+          fprintf (stderr, "Error: Malformed lean metadata on line %zu\n",
+                   line_number);
+          json_decref (info);
+          return NULL;
+        }
+      text = line_end + 1;
+    }
+
+  return info;
+}
+
+/**
+ * Return the interned copy of a string, adding it on first use.
+ * @param interner Interner with room for the string
+ * @param text String to intern (NULL stays NULL)
+ * @return Interned string, NULL if text is NULL
+ */
+static const char *
+intern_string (StringInterner *interner, const char *text)
+{
+  if (text == NULL)
+    {
+      return NULL;
+    }
+
+  // Columns repeat a handful of values ("mp4", "audio only", ...)
+  for (size_t i = 0; i < interner->distinct_count; i++)
+    {
+      if (strcmp (interner->distinct[i], text) == 0)
+        {
+          return interner->distinct[i];
+        }
+    }
+
+  size_t length = strlen (text) + 1;
+  char *copy = interner->pool + interner->used;
+  memcpy (copy, text, length);
+  interner->used += length;
+  interner->distinct[interner->distinct_count++] = copy;
+  return copy;
+}
+
+/**
+ * Bytes needed to intern a string.
+ */
+static size_t
+interned_size (const char *text)
+{
+  return text != NULL ? strlen (text) + 1 : 0;
+}
+
+/**
+ * Read a numeric member as a double.
+ * @return The value, or fallback if absent or not a number
+ */
+static double
+json_number_member (const json_t *object, const char *key, double fallback)
+{
+  json_t *value = json_object_get (object, key);
+  return json_is_number (value) ? json_number_value (value) : fallback;
+}
 
+/**
+ * Classify a format once, from its height (or the "WxH" resolution when
+ * the height is missing) and, for audio, its resolution or extension.
+ * @param resolution Resolution string (can be NULL)
+ * @param ext Extension (can be NULL)
+ * @param height Height in pixels, 0 if unknown
+ * @return Quality tier
+ */
+static FormatQuality
+classify_quality (const char *resolution, const char *ext, int height)
+{
+  if (resolution == NULL || strstr (resolution, "audio") != NULL)
+    {
+      if (resolution != NULL
+          || (ext
+              && (strcmp (ext, "m4a") == 0 || strcmp (ext, "webm") == 0
+                  || strcmp (ext, "opus") == 0)))
+        {
+          return FORMAT_QUALITY_AUDIO;
+        }
+      return FORMAT_QUALITY_NONE;
+    }
+
+  if (height >= 2160)
+    return FORMAT_QUALITY_UHD;
+  if (height >= 1440)
+    return FORMAT_QUALITY_QHD;
+  if (height >= 1080)
+    return FORMAT_QUALITY_FULL_HD;
+  if (height >= 720)
+    return FORMAT_QUALITY_HD;
+  if (height >= 480)
+    return FORMAT_QUALITY_SD;
+  return FORMAT_QUALITY_NONE;
+}
+
+/**
+ * Display label of a quality tier.
+ * @param quality Quality tier
+ * @return Static label, "" for FORMAT_QUALITY_NONE
+ */
+const char *
+format_quality_label (FormatQuality quality)
+{
+  if ((size_t)quality >= sizeof (quality_labels) / sizeof (quality_labels[0]))
+    {
+      return "";
+    }
+  return quality_labels[quality];
+}
+
+/**
+ * Allocate the columns of a table in one block. Columns are laid out by
+ * decreasing alignment, so every column starts suitably aligned.
+ * @param table Table whose count is set
+ * @return 0 on success, -1 on allocation failure
+ */
+static int
+allocate_format_columns (FormatTable *table)
+{
+  size_t count = table->count;
+  size_t row_size = sizeof (long long) + 2 * sizeof (double)
+                    + 3 * sizeof (const char *) + 2 * sizeof (int)
+                    + sizeof (unsigned char);
+  char *block = calloc (count ? count : 1, row_size);
+  if (block == NULL)
+    {
+      return -1;
+    }
+
+  table->filesize = (long long *)block;
+  table->fps = (double *)(table->filesize + count);
+  table->tbr = table->fps + count;
+  table->format_id = (const char **)(table->tbr + count);
+  table->resolution = table->format_id + count;
+  table->ext = table->resolution + count;
+  table->width = (int *)(table->ext + count);
+  table->height = table->width + count;
+  table->quality = (unsigned char *)(table->height + count);
+  return 0;
+}
+
+/**
+ * Allocate an empty table with room for its rows and strings.
+ * @param count Number of formats
+ * @param pool_size Upper bound on the bytes of all interned strings
+ * @param string_count Upper bound on the number of strings
+ * @param interner Receives the interner to fill the table through
+ * @return Table, NULL on allocation failure (reported)
+ */
+static FormatTable *
+create_format_table (size_t count, size_t pool_size, size_t string_count,
+                     StringInterner *interner)
+{
+  FormatTable *table = calloc (1, sizeof (FormatTable));
+  interner->pool = malloc (pool_size ? pool_size : 1);
+  interner->used = 0;
+  interner->distinct = malloc (sizeof (const char *) * string_count);
+  interner->distinct_count = 0;
+  if (table != NULL)
+    {
+      table->count = count;
+      table->duration = -1;
+    }
+
+  if (table == NULL || interner->pool == NULL || interner->distinct == NULL
+      || allocate_format_columns (table) != 0)
+    {
+      fprintf (stderr, "Error: Memory allocation failed for format table\n");
+      free (interner->pool);
+      free (interner->distinct);
+      free (table);
+      return NULL;
+    }
+  table->strings = interner->pool;
+  return table;
+}
+
+/**
+ * Fill one row of a table.
+ * @param table Table
+ * @param row Row index
+ * @param interner Interner of the table
+ * @param source Field values
+ */
+static void
+set_format_row (FormatTable *table, size_t row, StringInterner *interner,
+                const FormatRow *source)
+{
+  table->format_id[row] = intern_string (interner, source->format_id);
+  table->resolution[row] = intern_string (interner, source->resolution);
+  table->ext[row] = intern_string (interner, source->ext);
+  table->filesize[row] = source->filesize;
+  table->width[row] = (int)source->width;
+  table->height[row] = (int)source->height;
+  if (table->height[row] <= 0 && source->resolution != NULL)
+    {
+      // Older extractors only give "WxH"
+      const char *x_pos = strchr (source->resolution, 'x');
+      table->height[row] = x_pos ? atoi (x_pos + 1) : 0;
+    }
+  table->fps[row] = source->fps;
+  table->tbr[row] = source->tbr;
+  table->quality[row] = (unsigned char)classify_quality (
+      source->resolution, source->ext, table->height[row]);
+}
+
+/**
+ * Build the columnar format table from a parsed info document in a single
+ * pass. Nothing in the table refers to the document, so the caller can
+ * release it as soon as this returns.
+ * @param root Parsed yt-dlp info document (full or lean)
+ * @return Format table (free with free_format_table), NULL on error
+ */
+FormatTable *
+build_format_table (const json_t *root)
+{
+  json_t *formats = extract_formats (root);
+  if (formats == NULL)
+    {
+      return NULL;
+    }
+
+  // Size the string pool (and the row count) before copying anything
+  const char *title = safe_json_string_value (root, JSON_FIELD_TITLE);
+  const char *channel = safe_json_string_value (root, JSON_FIELD_CHANNEL);
+  size_t pool_size = interned_size (title) + interned_size (channel);
+  size_t count = 0;
   size_t index;
   json_t *format;
   json_array_foreach (formats, index, format)
   {
-    if (format == NULL || !json_is_object (format))
+    if (json_is_object (format))
+      {
+        pool_size
+            += interned_size (
+                   safe_json_string_value (format, JSON_FIELD_FORMAT_ID))
+               + interned_size (
+                   safe_json_string_value (format, JSON_FIELD_RESOLUTION))
+               + interned_size (
+                   safe_json_string_value (format, JSON_FIELD_EXTENSION));
+        count++;
+      }
+  }
+
+  StringInterner interner;
+  FormatTable *table
+      = create_format_table (count, pool_size, 2 + 3 * count, &interner);
+  if (table == NULL)
+    {
+      json_decref (formats);
+      return NULL;
+    }
+
+  table->title = intern_string (&interner, title);
+  table->channel = intern_string (&interner, channel);
+  double duration = json_number_member (root, JSON_FIELD_DURATION, -1);
+  table->duration = duration >= 0 ? (long)duration : -1;
+
+  size_t row = 0;
+  json_array_foreach (formats, index, format)
+  {
+    if (!json_is_object (format))
       {
         fprintf (stderr,
                  "Warning: Skipping invalid format entry at index %zu\n",
@@ -184,26 +589,402 @@ display_formats (const json_t *formats)
         continue;
       }
 
-    const char *format_id
-        = safe_json_string_value (format, JSON_FIELD_FORMAT_ID);
-    const char *resolution
-        = safe_json_string_value (format, JSON_FIELD_RESOLUTION);
-    const char *ext = safe_json_string_value (format, JSON_FIELD_EXTENSION);
+    json_int_t filesize;
+    FormatRow source = {
+      .format_id = safe_json_string_value (format, JSON_FIELD_FORMAT_ID),
+      .resolution = safe_json_string_value (format, JSON_FIELD_RESOLUTION),
+      .ext = safe_json_string_value (format, JSON_FIELD_EXTENSION),
+      .filesize
+      = safe_json_integer_value (format, JSON_FIELD_FILESIZE, &filesize) == 0
+            ? (long long)filesize
+            : -1,
+      .width = json_number_member (format, JSON_FIELD_WIDTH, 0),
+      .height = json_number_member (format, JSON_FIELD_HEIGHT, 0),
+      .fps = json_number_member (format, JSON_FIELD_FPS, 0),
+      .tbr = json_number_member (format, JSON_FIELD_TBR, 0),
+    };
+    set_format_row (table, row++, &interner, &source);
+  }
 
-    json_int_t filesize = 0;
-    int filesize_valid
-        = safe_json_integer_value (format, JSON_FIELD_FILESIZE, &filesize);
+  free (interner.distinct);
+  json_decref (formats);
+  return table;
+}
+
+/**
+ * Read a number member into a double, leaving the fallback for other types.
+ * @return 0 on success, -1 on a scan error
+ */
+static int
+scan_number_member (JsonScanner *scanner, double *value)
+{
+  int integral;
+  if (json_scan_peek (scanner) == JSON_SCAN_NUMBER)
+    {
+      return json_scan_number (scanner, value, &integral);
+    }
+  return json_scan_skip (scanner);
+}
 
-    printf (
-        "Format code: %-*s Resolution: %-*s Extension: %-*s Filesize: %*s\n",
-        FORMAT_ID_WIDTH, format_id ? format_id : "N/A", RESOLUTION_WIDTH,
-        resolution ? resolution : "N/A", EXTENSION_WIDTH, ext ? ext : "N/A",
-        FILESIZE_WIDTH, filesize_valid == 0 ? "bytes" : "N/A");
+/**
+ * Read a string member as a span, leaving it empty for other types.
+ * @return 0 on success, -1 on a scan error
+ */
+static int
+scan_string_member (JsonScanner *scanner, JsonSpan *span)
+{
+  if (json_scan_peek (scanner) == JSON_SCAN_STRING)
+    {
+      return json_scan_string (scanner, span);
+    }
+  return json_scan_skip (scanner);
+}
 
-    if (filesize_valid == 0)
-      {
-        printf ("%*lld ", FILESIZE_WIDTH, (long long)filesize);
-      }
-    printf ("\n");
-  }
-}
\ No newline at end of file
+/**
+ * Scan one element of the formats array, keeping only whitelisted fields.
+ * @param scanner Scanner at the element
+ * @param spans Receives the fields
+ * @return 1 if the element was an object, 0 if skipped, -1 on error
+ */
+static int
+scan_format_entry (JsonScanner *scanner, FormatSpans *spans)
+{
+  if (json_scan_peek (scanner) != JSON_SCAN_OBJECT)
+    {
+      return json_scan_skip (scanner) == 0 ? 0 : -1;
+    }
+
+  memset (spans, 0, sizeof (FormatSpans));
+  spans->filesize = -1;
+  json_scan_enter (scanner, JSON_SCAN_OBJECT);
+
+  int first = 1;
+  JsonSpan key;
+  int member;
+  while ((member = json_scan_next_member (scanner, &first, &key)) == 1)
+    {
+      int status;
+      if (json_span_equals (&key, JSON_FIELD_FORMAT_ID))
+        status = scan_string_member (scanner, &spans->format_id);
+      else if (json_span_equals (&key, JSON_FIELD_RESOLUTION))
+        status = scan_string_member (scanner, &spans->resolution);
+      else if (json_span_equals (&key, JSON_FIELD_EXTENSION))
+        status = scan_string_member (scanner, &spans->ext);
+      else if (json_span_equals (&key, JSON_FIELD_WIDTH))
+        status = scan_number_member (scanner, &spans->width);
+      else if (json_span_equals (&key, JSON_FIELD_HEIGHT))
+        status = scan_number_member (scanner, &spans->height);
+      else if (json_span_equals (&key, JSON_FIELD_FPS))
+        status = scan_number_member (scanner, &spans->fps);
+      else if (json_span_equals (&key, JSON_FIELD_TBR))
+        status = scan_number_member (scanner, &spans->tbr);
+      else if (json_span_equals (&key, JSON_FIELD_FILESIZE)
+               && json_scan_peek (scanner) == JSON_SCAN_NUMBER)
+        {
+          // Only exact sizes count, as with the jansson reader
+          double value;
+          int integral;
+          status = json_scan_number (scanner, &value, &integral);
+          if (status == 0 && integral && value >= 0
+              && value <= (double)(INT64_MAX / 2))
+            {
+              spans->filesize = (long long)value;
+            }
+        }
+      else
+        // fragments, http_headers, url, ...: skipped without a look inside
+        status = json_scan_skip (scanner);
+
+      if (status != 0)
+        {
+          return -1;
+        }
+    }
+  return member == 0 ? 1 : -1;
+}
+
+/**
+ * Decode a span into the scratch buffer.
+ * @return Decoded string, NULL if the span is empty (member missing)
+ */
+static const char *
+decode_span (const JsonSpan *span, char *scratch)
+{
+  if (span->start == NULL)
+    {
+      return NULL;
+    }
+  json_span_decode (span, scratch);
+  return scratch;
+}
+
+/**
+ * Build the format table straight from the text of a `yt-dlp -j` document,
+ * without building a JSON tree. Only the whitelisted paths are read (title,
+ * channel, duration and the displayed fields of each format); every other
+ * subtree, including thumbnails, captions, fragment lists and headers, is
+ * skipped by bracket matching. Strings are taken as spans of the input and
+ * decoded only when copied into the table.
+ * @param text Document text (need not be NUL-terminated)
+ * @param length Length of the text
+ * @return Format table (free with free_format_table), NULL on error
+ */
+FormatTable *
+scan_format_table (const char *text, size_t length)
+{
+  if (text == NULL)
+    {
+      fprintf (stderr, "Error: JSON document parameter is NULL\n");
+      return NULL;
+    }
+
+  JsonScanner scanner;
+  json_scan_init (&scanner, text, length);
+  if (json_scan_enter (&scanner, JSON_SCAN_OBJECT) != 0)
+    {
+      fprintf (stderr, "Error: Root JSON element is not an object\n");
+      return NULL;
+    }
+
+  JsonSpan title = { 0 }, channel = { 0 };
+  double duration = -1;
+  FormatSpans *rows = NULL;
+  size_t count = 0, capacity = 0;
+  int found_formats = 0;
+
+  int first = 1;
+  JsonSpan key;
+  int member;
+  while ((member = json_scan_next_member (&scanner, &first, &key)) == 1)
+    {
+      int status = 0;
+      if (json_span_equals (&key, JSON_FIELD_TITLE))
+        status = scan_string_member (&scanner, &title);
+      else if (json_span_equals (&key, JSON_FIELD_CHANNEL))
+        status = scan_string_member (&scanner, &channel);
+      else if (json_span_equals (&key, JSON_FIELD_DURATION))
+        status = scan_number_member (&scanner, &duration);
+      else if (json_span_equals (&key, JSON_FIELD_FORMATS)
+               && json_scan_peek (&scanner) == JSON_SCAN_ARRAY)
+        {
+          found_formats = 1;
+          json_scan_enter (&scanner, JSON_SCAN_ARRAY);
+          int first_element = 1;
+          int element;
+          while (status == 0
+                 && (element
+                     = json_scan_next_element (&scanner, &first_element))
+                        == 1)
+            {
+              if (count == capacity)
+                {
+                  capacity = capacity ? capacity * 2 : 32;
+                  FormatSpans *grown
+                      = realloc (rows, sizeof (FormatSpans) * capacity);
+                  if (grown == NULL)
+                    {
+                      fprintf (stderr, "Error: Memory allocation failed for "
+                                       "format table\n");
+                      free (rows);
+                      return NULL;
+                    }
+                  rows = grown;
+                }
+              int entry = scan_format_entry (&scanner, &rows[count]);
+              status = entry < 0 ? -1 : 0;
+              count += entry == 1;
+            }
+          status = status == 0 && element == 0 ? 0 : -1;
+        }
+      else
+        status = json_scan_skip (&scanner);
+
+      if (status != 0)
+        {
+          member = -1;
+          break;
+        }
+    }
+
+  if (member != 0)
+    {
+      fprintf (stderr, "Error: JSON parsing failed at offset %zu\n",
+               (size_t)((scanner.error ? scanner.error : scanner.position)
+                        - text));
+      free (rows);
+      return NULL;
+    }
+  if (!found_formats)
+    {
+      fprintf (stderr, "Error: '%s' field not found in JSON data\n",
+               JSON_FIELD_FORMATS);
+      free (rows);
+      return NULL;
+    }
+  if (count == 0)
+    {
+      fprintf (stderr, "Error: Formats array is empty\n");
+      free (rows);
+      return NULL;
+    }
+
+  // Decoded strings are never longer than their spans
+  size_t pool_size = title.length + channel.length + 2;
+  size_t longest = title.length > channel.length ? title.length
+                                                 : channel.length;
+  for (size_t i = 0; i < count; i++)
+    {
+      const JsonSpan *spans[]
+          = { &rows[i].format_id, &rows[i].resolution, &rows[i].ext };
+      for (size_t k = 0; k < 3; k++)
+        {
+          pool_size += spans[k]->length + 1;
+          longest = spans[k]->length > longest ? spans[k]->length : longest;
+        }
+    }
+
+  // Room to decode the three strings of a row side by side
+  size_t stride = longest + 1;
+  StringInterner interner;
+  char *scratch = malloc (3 * stride);
+  FormatTable *table
+      = scratch ? create_format_table (count, pool_size, 2 + 3 * count,
+                                       &interner)
+                : NULL;
+  if (table == NULL)
+    {
+      free (scratch);
+      free (rows);
+      return NULL;
+    }
+
+  table->title = intern_string (&interner, decode_span (&title, scratch));
+  table->channel = intern_string (&interner, decode_span (&channel, scratch));
+  table->duration = duration >= 0 ? (long)duration : -1;
+
+  for (size_t i = 0; i < count; i++)
+    {
+      FormatRow source = {
+        .format_id = decode_span (&rows[i].format_id, scratch),
+        .resolution = decode_span (&rows[i].resolution, scratch + stride),
+        .ext = decode_span (&rows[i].ext, scratch + 2 * stride),
+        .filesize = rows[i].filesize,
+        .width = rows[i].width,
+        .height = rows[i].height,
+        .fps = rows[i].fps,
+        .tbr = rows[i].tbr,
+      };
+      set_format_row (table, i, &interner, &source);
+    }
+
+  free (scratch);
+  free (interner.distinct);
+  free (rows);
+  return table;
+}
+
+/**
+ * Deep-copy a format table into a single new allocation set.
+ * @param source Table to copy (its strings can live anywhere)
+ * @return Copy (free with free_format_table), NULL on error
+ */
+FormatTable *
+copy_format_table (const FormatTable *source)
+{
+  if (source == NULL)
+    {
+      return NULL;
+    }
+
+  size_t count = source->count;
+  size_t pool_size
+      = interned_size (source->title) + interned_size (source->channel);
+  for (size_t i = 0; i < count; i++)
+    {
+      pool_size += interned_size (source->format_id[i])
+                   + interned_size (source->resolution[i])
+                   + interned_size (source->ext[i]);
+    }
+
+  StringInterner interner;
+  FormatTable *table
+      = create_format_table (count, pool_size, 2 + 3 * count, &interner);
+  if (table == NULL)
+    {
+      return NULL;
+    }
+
+  table->title = intern_string (&interner, source->title);
+  table->channel = intern_string (&interner, source->channel);
+  table->duration = source->duration;
+  for (size_t i = 0; i < count; i++)
+    {
+      table->format_id[i] = intern_string (&interner, source->format_id[i]);
+      table->resolution[i] = intern_string (&interner, source->resolution[i]);
+      table->ext[i] = intern_string (&interner, source->ext[i]);
+    }
+  if (count > 0)
+    {
+      memcpy (table->filesize, source->filesize, count * sizeof (long long));
+      memcpy (table->fps, source->fps, count * sizeof (double));
+      memcpy (table->tbr, source->tbr, count * sizeof (double));
+      memcpy (table->width, source->width, count * sizeof (int));
+      memcpy (table->height, source->height, count * sizeof (int));
+      memcpy (table->quality, source->quality, count);
+    }
+
+  free (interner.distinct);
+  return table;
+}
+
+/**
+ * Release a format table and its strings.
+ * @param table Table to free (can be NULL)
+ */
+void
+free_format_table (FormatTable *table)
+{
+  if (table == NULL)
+    {
+      return;
+    }
+  free (table->filesize); // start of the column block
+  free (table->strings);
+  free (table);
+}
+
+/**
+ * Display available formats in a formatted table.
+ * @param table Format table
+ */
+void
+display_formats (const FormatTable *table)
+{
+  if (table == NULL)
+    {
+      fprintf (stderr, "Error: Invalid formats parameter\n");
+      return;
+    }
+
+  printf ("Available formats:\n");
+
+  for (size_t i = 0; i < table->count; i++)
+    {
+      const char *format_id = table->format_id[i];
+      const char *resolution = table->resolution[i];
+      const char *ext = table->ext[i];
+      int filesize_valid = table->filesize[i] >= 0;
+
+      printf (
+          "Format code: %-*s Resolution: %-*s Extension: %-*s Filesize: %*s\n",
+          FORMAT_ID_WIDTH, format_id ? format_id : "N/A", RESOLUTION_WIDTH,
+          resolution ? resolution : "N/A", EXTENSION_WIDTH, ext ? ext : "N/A",
+          FILESIZE_WIDTH, filesize_valid ? "bytes" : "N/A");
+
+      if (filesize_valid)
+        {
+          printf ("%*lld ", FILESIZE_WIDTH, table->filesize[i]);
+        }
+      printf ("\n");
+    }
+}
@@ -3,9 +3,64 @@
 
 #include "ytdl.h"
 
+// Compact metadata records printed by yt-dlp instead of the full -j
+// document: one info line per video (from the pre_process stage, before
+// format selection) and, with "-f all", one line per format. Each field is
+// a JSON scalar and fields are separated by tabs; the "|null" default
+// replaces yt-dlp's "NA" placeholder for missing fields.
+#define LEAN_INFO_TAG "ytdl-info"
+#define LEAN_FORMAT_TAG "ytdl-format"
+#define LEAN_INFO_TEMPLATE                                                    \
+  "pre_process:" LEAN_INFO_TAG                                                \
+  "\t%(duration|null)j\t%(channel|null)j\t%(title|null)j"
+#define LEAN_FORMAT_TEMPLATE                                                  \
+  LEAN_FORMAT_TAG "\t%(format_id|null)j\t%(resolution|null)j"               \
+                  "\t%(ext|null)j\t%(filesize|null)j\t%(width|null)j"        \
+                  "\t%(height|null)j\t%(fps|null)j\t%(tbr|null)j"
+
+// Quality tier of a format, derived once when the table is built
+typedef enum
+{
+  FORMAT_QUALITY_NONE,
+  FORMAT_QUALITY_AUDIO,
+  FORMAT_QUALITY_SD,
+  FORMAT_QUALITY_HD,
+  FORMAT_QUALITY_FULL_HD,
+  FORMAT_QUALITY_QHD,
+  FORMAT_QUALITY_UHD
+} FormatQuality;
+
+// Formats of one video as columns (index = row, in yt-dlp's worst-to-best
+// order). Strings are interned in one pool owned by the table; missing
+// strings are NULL and missing numbers 0 (filesize: -1).
+typedef struct
+{
+  size_t count;
+  const char **format_id;
+  const char **resolution;
+  const char **ext;
+  int *width;
+  int *height;
+  double *fps;
+  double *tbr;
+  long long *filesize;
+  unsigned char *quality; // FormatQuality
+  const char *title;      // NULL if missing
+  const char *channel;    // NULL if missing
+  long duration;          // seconds, -1 if unknown
+  char *strings;          // interned string pool
+} FormatTable;
+
 // clang-format off
-json_t *parse_formats(const char *json_str);
-void display_formats(const json_t *formats);
+json_t *extract_formats(const json_t *root);
+json_t *parse_formats_stream(json_load_callback_t callback, void *data);
+json_t *parse_lean_metadata(const char *text, size_t length);
+FormatTable *build_format_table(const json_t *root);
+FormatTable *scan_format_table(const char *text, size_t length);
+FormatTable *copy_format_table(const FormatTable *source);
+void free_format_table(FormatTable *table);
+const char *format_quality_label(FormatQuality quality);
+void display_formats(const FormatTable *table);
 // clang-format on
 
 #endif
\ No newline at end of file
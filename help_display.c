@@ -4,15 +4,64 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 // Help text constants for better maintainability
 #define PROGRAM_NAME "ytdl"
-#define USAGE_FORMAT "Usage: %s [OPTION]... URL\n"
-#define DESCRIPTION "Download videos from YouTube using yt-dlp\n\n"
+#define USAGE_FORMAT "Usage: %s [OPTION]... URL...\n"
+#define DESCRIPTION                                                           \
+  "Download videos from YouTube using yt-dlp\n"                              \
+  "The info of several URLs is fetched by one yt-dlp run; playlists and\n"   \
+  "channels are downloaded entry by entry while they are being listed\n"    \
+  "With -j or -a, every URL is downloaded as a job of its own, several at\n" \
+  "once, and the run ends with a summary\n\n"
 #define HELP_OPTION "  -h, --help\t\t\tDisplay this help message\n"
 #define OUTPUT_OPTION                                                         \
   "  -o, --output PATH\t\tSpecify the output directory (default: current "    \
   "directory)\n"
+#define FORMAT_OPTION                                                         \
+  "  -f, --format FORMAT\t\tDownload FORMAT right away, without fetching "   \
+  "metadata\n"
+#define TIMEOUT_OPTION                                                        \
+  "  -t, --timeout SECONDS\t\tStop each yt-dlp run after SECONDS\n"
+#define MAX_MEMORY_OPTION                                                     \
+  "      --max-memory MB\t\tCap each yt-dlp run's address space at MB\n"
+#define MAX_CPU_OPTION                                                        \
+  "      --max-cpu SECONDS\t\tCap each yt-dlp run's CPU time at SECONDS\n"
+#define ZYGOTE_OPTION                                                         \
+  "      --zygote\t\t\tFork yt-dlp from a helper that has already "       \
+  "imported it\n"
+#define LEAN_OPTION                                                           \
+  "      --lean\t\t\tFetch only the metadata shown, not the full "        \
+  "JSON\n"
+#define CACHE_TTL_OPTION                                                      \
+  "      --cache-ttl SECONDS\tReuse video info cached within SECONDS "    \
+  "(default 3600)\n"
+#define NO_CACHE_OPTION                                                       \
+  "      --no-cache\t\tAlways fetch video info\n"
+#define ARCHIVE_OPTION                                                        \
+  "      --archive PATH\t\tAppend the fetched info JSON to a zstd archive\n"
+#define PLAYLIST_OPTION                                                       \
+  "      --playlist\t\tTreat every URL as a playlist or channel\n"
+#define LIST_SHARDS_OPTION                                                    \
+  "      --list-shards N\t\tList playlists with N concurrent yt-dlp runs\n"
+#define JOBS_OPTION                                                           \
+  "  -j, --jobs N\t\t\tRun up to N downloads at once\n"
+#define BATCH_FILE_OPTION                                                     \
+  "  -a, --batch-file FILE\t\tAlso download the URLs in FILE (- for "        \
+  "stdin)\n"
+#define LIMIT_RATE_OPTION                                                     \
+  "  -r, --limit-rate RATE\t\tCap the combined rate of all downloads (50M, "  \
+  "800Mbit,\n\t\t\t\tor HH:MM=RATE,... by time of day)\n"
+#define JOURNAL_OPTION                                                        \
+  "      --journal FILE\t\tRecord the jobs in FILE and resume the "       \
+  "unfinished ones\n"
+#define CONNECTIONS_OPTION                                                    \
+  "      --connections K\t\tDownload single videos with K range requests "  \
+  "when the\n\t\t\t\tformat is one HTTP file (not with -j, -a, "          \
+  "--journal\n\t\t\t\tor playlists)\n"
+#define STATS_OPTION                                                          \
+  "      --stats\t\t\tPrint phase timings and memory use\n"
 
 /**
  * Display help information for the program.
@@ -25,6 +74,23 @@ display_help (void)
   printf ("Options:\n");
   printf (HELP_OPTION);
   printf (OUTPUT_OPTION);
+  printf (FORMAT_OPTION);
+  printf (TIMEOUT_OPTION);
+  printf (MAX_MEMORY_OPTION);
+  printf (MAX_CPU_OPTION);
+  printf (ZYGOTE_OPTION);
+  printf (LEAN_OPTION);
+  printf (CACHE_TTL_OPTION);
+  printf (NO_CACHE_OPTION);
+  printf (ARCHIVE_OPTION);
+  printf (PLAYLIST_OPTION);
+  printf (LIST_SHARDS_OPTION);
+  printf (JOBS_OPTION);
+  printf (BATCH_FILE_OPTION);
+  printf (LIMIT_RATE_OPTION);
+  printf (JOURNAL_OPTION);
+  printf (CONNECTIONS_OPTION);
+  printf (STATS_OPTION);
 }
 
 /**
@@ -57,6 +123,28 @@ cleanup (Config *config)
       config->output_path = NULL;
     }
 
+  free (config->format_selector);
+  config->format_selector = NULL;
+
+  free (config->archive_path);
+  config->archive_path = NULL;
+
+  free (config->batch_file);
+  config->batch_file = NULL;
+
+  free (config->rate_limit);
+  config->rate_limit = NULL;
+
+  free (config->journal_path);
+  config->journal_path = NULL;
+
+  // In-memory copy of the info JSON kept for the download
+  if (config->info_json_fd >= 0)
+    {
+      close (config->info_json_fd);
+      config->info_json_fd = -1;
+    }
+
   // Note: config->url is const and should not be freed here
   // as it's either a string literal or managed elsewhere
 }
\ No newline at end of file
@@ -0,0 +1,1072 @@
+#define _GNU_SOURCE
+#include "info_archive.h"
+#include "metadata_cache.h"
+#include "util.h"
+#include "ytdl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zdict.h>
+#include <zstd.h>
+
+// Identify an archive and its index, and their layout version
+#define ARCHIVE_MAGIC "YTDLAR1\n"
+#define INDEX_MAGIC "YTDLAI1\n"
+#define ARCHIVE_MAGIC_LENGTH (sizeof (ARCHIVE_MAGIC) - 1)
+#define INDEX_SUFFIX ".idx"
+#define DICTIONARY_SUFFIX ".dict"
+// Name of an index or dictionary being written, before it is renamed
+#define ARCHIVE_TEMPLATE ".tmp-XXXXXX"
+// Slots of a new index; it doubles when 70% full
+#define INDEX_FIRST_SLOTS 1024
+// Longest key (canonical ID or URL)
+#define ARCHIVE_KEY_LENGTH MAX_URL_LENGTH
+// zstd's default level: one document per run must not hold up the format
+// prompt, and higher levels gain little over the dictionary on documents
+// this size. Decompression speed does not depend on the level.
+#define ARCHIVE_COMPRESSION_LEVEL 3
+#define ARCHIVE_DICTIONARY_SIZE (112 * 1024)
+// The dictionary is trained once this many documents are archived, from
+// samples spread over each of them
+#define ARCHIVE_TRAINING_DOCUMENTS 64
+#define ARCHIVE_SAMPLE_SIZE (16 * 1024)
+#define ARCHIVE_TRAINING_BYTES (32 * 1024 * 1024)
+// Compressed bytes read at a time by a streaming reader
+#define ARCHIVE_READ_CHUNK (128 * 1024)
+
+/*
+ * Archive file, native byte order (like the metadata cache):
+ *
+ *   char magic[8]
+ *   repeated: RecordHeader, char key[key_length], zstd frame[frame_size]
+ *
+ * Records are only ever appended. A record torn by a crash lies past the
+ * indexed size and is overwritten by the next append.
+ *
+ * Index file: IndexHeader, then IndexSlot[slot_count], an open-addressing
+ * hash table (linear probing) from key hash to record offset. It is
+ * mapped shared, updated in place under the archive's exclusive lock, and
+ * replaced through a rename when it grows; records past indexed_size
+ * (from a crash between the two writes, or a lost index) are indexed by
+ * the next writer.
+ */
+typedef struct
+{
+  uint32_t key_length;
+  uint32_t reserved;
+  uint64_t raw_size;   // bytes of JSON
+  uint64_t frame_size; // bytes of zstd frame
+} RecordHeader;
+
+typedef struct
+{
+  char magic[8];
+  uint64_t slot_count;   // power of two
+  uint64_t used;         // distinct keys
+  uint64_t indexed_size; // archive bytes covered by the slots
+} IndexHeader;
+
+typedef struct
+{
+  uint64_t hash;
+  uint64_t offset; // record offset, 0 for an empty slot
+} IndexSlot;
+
+struct InfoArchive
+{
+  int fd;
+  char path[MAX_PATH_LENGTH];
+  IndexHeader *index; // shared mapping of PATH.idx
+  size_t index_size;
+  ino_t index_inode;
+  ZSTD_CCtx *cctx;
+  ZSTD_DCtx *dctx;
+  ZSTD_CDict *cdict; // NULL until PATH.dict exists
+  ZSTD_DDict *ddict;
+  unsigned dictionary_id;
+};
+
+struct InfoArchiveReader
+{
+  InfoArchive *archive;
+  ZSTD_DCtx *dctx;
+  uint64_t next;      // archive offset of the next compressed bytes
+  uint64_t remaining; // compressed bytes not read yet
+  ZSTD_inBuffer input;
+  int started;        // first chunk read and dictionary chosen
+  size_t last_result; // of ZSTD_decompressStream, 0 at a frame end
+  char buffer[ARCHIVE_READ_CHUNK];
+};
+
+/**
+ * Path of a file kept next to the archive.
+ * @return 0 on success, -1 if the path does not fit
+ */
+static int
+sibling_path (const InfoArchive *archive, const char *suffix, char *path,
+              size_t size)
+{
+  int written = snprintf (path, size, "%s%s", archive->path, suffix);
+  return written > 0 && (size_t)written < size ? 0 : -1;
+}
+
+static IndexSlot *
+index_slots (IndexHeader *index)
+{
+  return (IndexSlot *)(index + 1);
+}
+
+/**
+ * Map PATH.idx, unless it is missing or damaged.
+ * @return 0 on success, -1 if the index has to be rebuilt
+ */
+static int
+map_index (InfoArchive *archive)
+{
+  char path[MAX_PATH_LENGTH];
+  if (sibling_path (archive, INDEX_SUFFIX, path, sizeof (path)) != 0)
+    {
+      return -1;
+    }
+  int fd = open (path, O_RDWR | O_CLOEXEC);
+  if (fd == -1)
+    {
+      return -1;
+    }
+
+  struct stat st;
+  IndexHeader header;
+  if (fstat (fd, &st) != 0 || pread (fd, &header, sizeof (header), 0)
+                                  != (ssize_t)sizeof (header)
+      || memcmp (header.magic, INDEX_MAGIC, sizeof (header.magic)) != 0
+      || header.slot_count == 0
+      || (header.slot_count & (header.slot_count - 1)) != 0
+      || header.slot_count > (SIZE_MAX - sizeof (header)) / sizeof (IndexSlot)
+      || (uint64_t)st.st_size
+             != sizeof (header) + header.slot_count * sizeof (IndexSlot))
+    {
+      close (fd);
+      return -1;
+    }
+
+  void *mapping = mmap (NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+  close (fd);
+  if (mapping == MAP_FAILED)
+    {
+      return -1;
+    }
+  archive->index = mapping;
+  archive->index_size = (size_t)st.st_size;
+  archive->index_inode = st.st_ino;
+  return 0;
+}
+
+static void
+unmap_index (InfoArchive *archive)
+{
+  if (archive->index != NULL)
+    {
+      munmap (archive->index, archive->index_size);
+      archive->index = NULL;
+    }
+}
+
+/**
+ * Place a hash in the first free slot of its probe sequence, without
+ * looking for an existing entry (used when rehashing).
+ */
+static void
+insert_slot (IndexHeader *index, uint64_t hash, uint64_t offset)
+{
+  IndexSlot *slots = index_slots (index);
+  uint64_t mask = index->slot_count - 1;
+  for (uint64_t i = hash & mask;; i = (i + 1) & mask)
+    {
+      if (slots[i].offset == 0)
+        {
+          slots[i].hash = hash;
+          slots[i].offset = offset;
+          return;
+        }
+    }
+}
+
+/**
+ * Write a new index of slot_count slots holding the entries of the
+ * current one (if any), rename it over PATH.idx and map it. Called with
+ * the archive locked exclusively.
+ * @return 0 on success, -1 on error
+ */
+static int
+create_index (InfoArchive *archive, uint64_t slot_count)
+{
+  char path[MAX_PATH_LENGTH];
+  char temp[MAX_PATH_LENGTH];
+  if (sibling_path (archive, INDEX_SUFFIX, path, sizeof (path)) != 0
+      || sibling_path (archive, INDEX_SUFFIX ARCHIVE_TEMPLATE, temp,
+                       sizeof (temp))
+             != 0)
+    {
+      fprintf (stderr, "Error: Archive path too long\n");
+      return -1;
+    }
+
+  size_t size = sizeof (IndexHeader) + slot_count * sizeof (IndexSlot);
+  int fd = mkstemp (temp);
+  if (fd == -1 || ftruncate (fd, (off_t)size) != 0)
+    {
+      fprintf (stderr, "Error: Cannot create archive index: %s\n",
+               strerror (errno));
+      if (fd != -1)
+        {
+          close (fd);
+          unlink (temp);
+        }
+      return -1;
+    }
+  IndexHeader *index
+      = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (index == MAP_FAILED)
+    {
+      fprintf (stderr, "Error: Cannot map archive index: %s\n",
+               strerror (errno));
+      unlink (temp);
+      return -1;
+    }
+
+  memcpy (index->magic, INDEX_MAGIC, sizeof (index->magic));
+  index->slot_count = slot_count;
+  index->used = 0;
+  index->indexed_size = ARCHIVE_MAGIC_LENGTH;
+  if (archive->index != NULL)
+    {
+      IndexSlot *old = index_slots (archive->index);
+      for (uint64_t i = 0; i < archive->index->slot_count; i++)
+        {
+          if (old[i].offset != 0)
+            {
+              insert_slot (index, old[i].hash, old[i].offset);
+            }
+        }
+      index->used = archive->index->used;
+      index->indexed_size = archive->index->indexed_size;
+    }
+  munmap (index, size);
+
+  if (rename (temp, path) != 0)
+    {
+      fprintf (stderr, "Error: Cannot install archive index: %s\n",
+               strerror (errno));
+      unlink (temp);
+      return -1;
+    }
+  unmap_index (archive);
+  if (map_index (archive) != 0)
+    {
+      fprintf (stderr, "Error: Cannot map archive index\n");
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * Read a record's header and key.
+ * @param key Receives the key, ARCHIVE_KEY_LENGTH bytes
+ * @return 0 on success, -1 if no whole record starts at offset
+ */
+static int
+read_record (const InfoArchive *archive, uint64_t offset, RecordHeader *record,
+             char *key)
+{
+  if (pread (archive->fd, record, sizeof (*record), (off_t)offset)
+          != (ssize_t)sizeof (*record)
+      || record->key_length == 0 || record->key_length >= ARCHIVE_KEY_LENGTH
+      || pread (archive->fd, key, record->key_length,
+                (off_t)(offset + sizeof (*record)))
+             != (ssize_t)record->key_length)
+    {
+      return -1;
+    }
+  key[record->key_length] = '\0';
+  return 0;
+}
+
+/**
+ * Probe the index for a key.
+ * @return The key's slot, or the empty slot it would take
+ */
+static IndexSlot *
+find_slot (InfoArchive *archive, const char *key, uint64_t hash)
+{
+  IndexSlot *slots = index_slots (archive->index);
+  uint64_t mask = archive->index->slot_count - 1;
+  char stored[ARCHIVE_KEY_LENGTH];
+  RecordHeader record;
+  for (uint64_t i = hash & mask;; i = (i + 1) & mask)
+    {
+      if (slots[i].offset == 0)
+        {
+          return &slots[i];
+        }
+      if (slots[i].hash == hash
+          && read_record (archive, slots[i].offset, &record, stored) == 0
+          && strcmp (stored, key) == 0)
+        {
+          return &slots[i];
+        }
+    }
+}
+
+/**
+ * Point a key at a record, growing the index first if it is 70% full.
+ * Called with the archive locked exclusively.
+ * @return 0 on success, -1 on error
+ */
+static int
+index_record (InfoArchive *archive, const char *key, uint64_t offset)
+{
+  if ((archive->index->used + 1) * 10 > archive->index->slot_count * 7
+      && create_index (archive, archive->index->slot_count * 2) != 0)
+    {
+      return -1;
+    }
+
+  uint64_t hash = fnv1a_hash (key);
+  IndexSlot *slot = find_slot (archive, key, hash);
+  if (slot->offset == 0)
+    {
+      archive->index->used++;
+    }
+  slot->hash = hash;
+  slot->offset = offset; // a re-archived video points at its newest record
+  return 0;
+}
+
+/**
+ * Index the records past indexed_size and drop a torn record at the end.
+ * Called with the archive locked exclusively.
+ * @return 0 on success, -1 on error
+ */
+static int
+catch_up_index (InfoArchive *archive)
+{
+  struct stat st;
+  if (fstat (archive->fd, &st) != 0)
+    {
+      return -1;
+    }
+  uint64_t size = (uint64_t)st.st_size;
+  uint64_t offset = archive->index->indexed_size;
+  RecordHeader record;
+  char key[ARCHIVE_KEY_LENGTH];
+  while (read_record (archive, offset, &record, key) == 0)
+    {
+      uint64_t end = offset + sizeof (record) + record.key_length;
+      if (record.frame_size > size - end)
+        {
+          break;
+        }
+      end += record.frame_size;
+      if (index_record (archive, key, offset) != 0)
+        {
+          return -1;
+        }
+      offset = end;
+      archive->index->indexed_size = offset;
+    }
+  if (size > offset && ftruncate (archive->fd, (off_t)offset) != 0)
+    {
+      fprintf (stderr, "Error: Cannot truncate torn archive record: %s\n",
+               strerror (errno));
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * Load PATH.dict if it exists and is not loaded yet.
+ * @return 0 on success (with or without a dictionary), -1 on error
+ */
+static int
+load_dictionary (InfoArchive *archive)
+{
+  char path[MAX_PATH_LENGTH];
+  if (archive->cdict != NULL
+      || sibling_path (archive, DICTIONARY_SUFFIX, path, sizeof (path)) != 0)
+    {
+      return 0;
+    }
+  int fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      return errno == ENOENT ? 0 : -1;
+    }
+
+  struct stat st;
+  void *dictionary = MAP_FAILED;
+  if (fstat (fd, &st) == 0 && st.st_size > 0)
+    {
+      dictionary = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                         fd, 0);
+    }
+  close (fd);
+  if (dictionary == MAP_FAILED)
+    {
+      fprintf (stderr, "Error: Cannot read archive dictionary %s\n", path);
+      return -1;
+    }
+
+  // Both copy the dictionary content
+  archive->cdict = ZSTD_createCDict (dictionary, (size_t)st.st_size,
+                                     ARCHIVE_COMPRESSION_LEVEL);
+  archive->ddict = ZSTD_createDDict (dictionary, (size_t)st.st_size);
+  archive->dictionary_id
+      = ZSTD_getDictID_fromDict (dictionary, (size_t)st.st_size);
+  munmap (dictionary, (size_t)st.st_size);
+  if (archive->cdict == NULL || archive->ddict == NULL)
+    {
+      fprintf (stderr, "Error: Invalid archive dictionary %s\n", path);
+      ZSTD_freeCDict (archive->cdict);
+      ZSTD_freeDDict (archive->ddict);
+      archive->cdict = NULL;
+      archive->ddict = NULL;
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * Lock the archive and pick up changes made by other processes: an index
+ * that was grown (renamed over) and a dictionary trained since.
+ * @param operation LOCK_SH to read, LOCK_EX to write
+ * @return 0 on success, -1 on error
+ */
+static int
+lock_archive (InfoArchive *archive, int operation)
+{
+  while (flock (archive->fd, operation) != 0)
+    {
+      if (errno != EINTR)
+        {
+          fprintf (stderr, "Error: Cannot lock archive: %s\n",
+                   strerror (errno));
+          return -1;
+        }
+    }
+
+  char path[MAX_PATH_LENGTH];
+  struct stat st;
+  if (sibling_path (archive, INDEX_SUFFIX, path, sizeof (path)) == 0
+      && stat (path, &st) == 0 && st.st_ino != archive->index_inode)
+    {
+      unmap_index (archive);
+      map_index (archive);
+    }
+  if (archive->index == NULL || load_dictionary (archive) != 0)
+    {
+      flock (archive->fd, LOCK_UN);
+      return -1;
+    }
+  return 0;
+}
+
+static void
+unlock_archive (InfoArchive *archive)
+{
+  flock (archive->fd, LOCK_UN);
+}
+
+/**
+ * Decompress one frame, with the dictionary if it was compressed with one
+ * (frames archived before the dictionary was trained have none).
+ * @return 0 on success, -1 on error
+ */
+static int
+decompress_frame (InfoArchive *archive, const char *frame, size_t frame_size,
+                  char *json, size_t raw_size)
+{
+  if (archive->dctx == NULL)
+    {
+      archive->dctx = ZSTD_createDCtx ();
+      if (archive->dctx == NULL)
+        {
+          return -1;
+        }
+    }
+
+  size_t result;
+  unsigned dictionary_id = ZSTD_getDictID_fromFrame (frame, frame_size);
+  if (dictionary_id == 0)
+    {
+      result = ZSTD_decompressDCtx (archive->dctx, json, raw_size, frame,
+                                    frame_size);
+    }
+  else if (dictionary_id == archive->dictionary_id)
+    {
+      result = ZSTD_decompress_usingDDict (archive->dctx, json, raw_size,
+                                           frame, frame_size, archive->ddict);
+    }
+  else
+    {
+      fprintf (stderr, "Error: Archive frame needs unknown dictionary %u\n",
+               dictionary_id);
+      return -1;
+    }
+  if (ZSTD_isError (result) || result != raw_size)
+    {
+      fprintf (stderr, "Error: Corrupt archive record: %s\n",
+               ZSTD_isError (result) ? ZSTD_getErrorName (result)
+                                     : "size mismatch");
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * Read and decompress the document of a record.
+ * @param length Receives the JSON length
+ * @return NUL-terminated JSON (caller must free), NULL on error
+ */
+static char *
+read_document (InfoArchive *archive, uint64_t offset, size_t *length)
+{
+  RecordHeader record;
+  char key[ARCHIVE_KEY_LENGTH];
+  if (read_record (archive, offset, &record, key) != 0
+      || record.raw_size >= SIZE_MAX || record.frame_size >= SIZE_MAX)
+    {
+      fprintf (stderr, "Error: Corrupt archive record at %llu\n",
+               (unsigned long long)offset);
+      return NULL;
+    }
+
+  char *frame = malloc ((size_t)record.frame_size);
+  char *json = malloc ((size_t)record.raw_size + 1);
+  off_t frame_offset = (off_t)(offset + sizeof (record) + record.key_length);
+  if (frame == NULL || json == NULL
+      || pread (archive->fd, frame, (size_t)record.frame_size, frame_offset)
+             != (ssize_t)record.frame_size
+      || decompress_frame (archive, frame, (size_t)record.frame_size, json,
+                           (size_t)record.raw_size)
+             != 0)
+    {
+      free (frame);
+      free (json);
+      return NULL;
+    }
+  free (frame);
+  json[record.raw_size] = '\0';
+  *length = (size_t)record.raw_size;
+  return json;
+}
+
+/**
+ * Train PATH.dict on samples spread over the archived documents, so that
+ * the shared structure of yt-dlp output (field names, HTTP headers, URL
+ * prefixes, caption lists) is not stored again in every frame. Called
+ * with the archive locked exclusively.
+ * @return 0 on success, -1 on error
+ */
+static int
+train_dictionary (InfoArchive *archive)
+{
+  size_t capacity = ARCHIVE_TRAINING_BYTES;
+  size_t max_samples = ARCHIVE_TRAINING_BYTES / ARCHIVE_SAMPLE_SIZE
+                       + archive->index->used;
+  char *samples = malloc (capacity);
+  size_t *sizes = malloc (max_samples * sizeof (size_t));
+  void *dictionary = malloc (ARCHIVE_DICTIONARY_SIZE);
+  if (samples == NULL || sizes == NULL || dictionary == NULL)
+    {
+      free (samples);
+      free (sizes);
+      free (dictionary);
+      return -1;
+    }
+
+  size_t used = 0;
+  unsigned sample_count = 0;
+  size_t budget = capacity / archive->index->used;
+  IndexSlot *slots = index_slots (archive->index);
+  for (uint64_t i = 0; i < archive->index->slot_count; i++)
+    {
+      size_t length;
+      char *json = slots[i].offset != 0
+                       ? read_document (archive, slots[i].offset, &length)
+                       : NULL;
+      if (json == NULL)
+        {
+          continue;
+        }
+      // Evenly spaced chunks, so the tail of long documents is sampled too
+      size_t chunks = length / ARCHIVE_SAMPLE_SIZE + 1;
+      size_t wanted = budget / ARCHIVE_SAMPLE_SIZE + 1;
+      size_t stride = chunks > wanted ? chunks / wanted : 1;
+      for (size_t chunk = 0; chunk < chunks; chunk += stride)
+        {
+          size_t start = chunk * ARCHIVE_SAMPLE_SIZE;
+          size_t size = length - start < ARCHIVE_SAMPLE_SIZE
+                            ? length - start
+                            : ARCHIVE_SAMPLE_SIZE;
+          if (size == 0 || size > capacity - used
+              || sample_count == max_samples)
+            {
+              break;
+            }
+          memcpy (samples + used, json + start, size);
+          sizes[sample_count++] = size;
+          used += size;
+        }
+      free (json);
+    }
+
+  size_t size = ZDICT_trainFromBuffer (dictionary, ARCHIVE_DICTIONARY_SIZE,
+                                       samples, sizes, sample_count);
+  free (samples);
+  free (sizes);
+  if (ZDICT_isError (size))
+    {
+      fprintf (stderr, "Error: Cannot train archive dictionary: %s\n",
+               ZDICT_getErrorName (size));
+      free (dictionary);
+      return -1;
+    }
+
+  char path[MAX_PATH_LENGTH];
+  char temp[MAX_PATH_LENGTH];
+  int fd = -1;
+  int status = -1;
+  if (sibling_path (archive, DICTIONARY_SUFFIX, path, sizeof (path)) == 0
+      && sibling_path (archive, DICTIONARY_SUFFIX ARCHIVE_TEMPLATE, temp,
+                       sizeof (temp))
+             == 0
+      && (fd = mkstemp (temp)) != -1)
+    {
+      if (write (fd, dictionary, size) == (ssize_t)size
+          && rename (temp, path) == 0)
+        {
+          status = load_dictionary (archive);
+        }
+      else
+        {
+          unlink (temp);
+        }
+      close (fd);
+    }
+  if (status != 0)
+    {
+      fprintf (stderr, "Error: Cannot save archive dictionary: %s\n",
+               strerror (errno));
+    }
+  free (dictionary);
+  return status;
+}
+
+/**
+ * Open an archive, creating it if needed. An index that is missing or
+ * damaged is rebuilt from the records.
+ * @param path Archive path; the index and dictionary are kept next to it
+ * @return Archive (close with info_archive_close), NULL on error
+ */
+InfoArchive *
+info_archive_open (const char *path)
+{
+  InfoArchive *archive = calloc (1, sizeof (InfoArchive));
+  if (archive == NULL)
+    {
+      fprintf (stderr, "Error: Memory allocation failed\n");
+      return NULL;
+    }
+  size_t length = strlen (path);
+  if (length + sizeof (INDEX_SUFFIX ARCHIVE_TEMPLATE) > sizeof (archive->path))
+    {
+      fprintf (stderr, "Error: Archive path too long\n");
+      free (archive);
+      return NULL;
+    }
+  memcpy (archive->path, path, length + 1);
+
+  archive->fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (archive->fd == -1)
+    {
+      fprintf (stderr, "Error: Cannot open archive %s: %s\n", path,
+               strerror (errno));
+      free (archive);
+      return NULL;
+    }
+  while (flock (archive->fd, LOCK_EX) != 0 && errno == EINTR)
+    {
+    }
+
+  char magic[ARCHIVE_MAGIC_LENGTH];
+  struct stat st;
+  int status = fstat (archive->fd, &st);
+  if (status == 0 && st.st_size == 0)
+    {
+      status = pwrite (archive->fd, ARCHIVE_MAGIC, sizeof (magic), 0)
+                       == (ssize_t)sizeof (magic)
+                   ? 0
+                   : -1;
+    }
+  else if (status == 0
+           && (pread (archive->fd, magic, sizeof (magic), 0)
+                   != (ssize_t)sizeof (magic)
+               || memcmp (magic, ARCHIVE_MAGIC, sizeof (magic)) != 0))
+    {
+      fprintf (stderr, "Error: %s is not an info archive\n", path);
+      status = -1;
+    }
+
+  if (status == 0 && map_index (archive) != 0)
+    {
+      status = create_index (archive, INDEX_FIRST_SLOTS);
+    }
+  if (status == 0)
+    {
+      status = catch_up_index (archive);
+    }
+  if (status == 0)
+    {
+      status = load_dictionary (archive);
+    }
+  flock (archive->fd, LOCK_UN);
+
+  if (status != 0)
+    {
+      info_archive_close (archive);
+      return NULL;
+    }
+  return archive;
+}
+
+/**
+ * Close an archive.
+ * @param archive Archive, may be NULL
+ */
+void
+info_archive_close (InfoArchive *archive)
+{
+  if (archive == NULL)
+    {
+      return;
+    }
+  unmap_index (archive);
+  ZSTD_freeCCtx (archive->cctx);
+  ZSTD_freeDCtx (archive->dctx);
+  ZSTD_freeCDict (archive->cdict);
+  ZSTD_freeDDict (archive->ddict);
+  close (archive->fd);
+  free (archive);
+}
+
+/**
+ * Compress a document and append it. A key archived before now resolves
+ * to this copy; the older one stays in the file.
+ * @param archive Archive
+ * @param key Canonical video key
+ * @param json Info JSON
+ * @param length Length of json
+ * @return 0 on success, -1 on error
+ */
+int
+info_archive_append (InfoArchive *archive, const char *key, const char *json,
+                     size_t length)
+{
+  size_t key_length = strlen (key);
+  if (key_length == 0 || key_length >= ARCHIVE_KEY_LENGTH || length == 0)
+    {
+      fprintf (stderr, "Error: Invalid archive key or document\n");
+      return -1;
+    }
+  if (archive->cctx == NULL && (archive->cctx = ZSTD_createCCtx ()) == NULL)
+    {
+      fprintf (stderr, "Error: Memory allocation failed\n");
+      return -1;
+    }
+  size_t bound = ZSTD_compressBound (length);
+  char *frame = malloc (bound);
+  if (frame == NULL)
+    {
+      fprintf (stderr, "Error: Memory allocation failed\n");
+      return -1;
+    }
+  if (lock_archive (archive, LOCK_EX) != 0)
+    {
+      free (frame);
+      return -1;
+    }
+
+  int status = -1;
+  if (catch_up_index (archive) != 0)
+    {
+      goto unlock;
+    }
+
+  // The checksum lets an audit tell a damaged record from a changed one
+  ZSTD_CCtx_reset (archive->cctx, ZSTD_reset_session_and_parameters);
+  ZSTD_CCtx_setParameter (archive->cctx, ZSTD_c_compressionLevel,
+                          ARCHIVE_COMPRESSION_LEVEL);
+  ZSTD_CCtx_setParameter (archive->cctx, ZSTD_c_checksumFlag, 1);
+  ZSTD_CCtx_refCDict (archive->cctx, archive->cdict);
+  size_t frame_size
+      = ZSTD_compress2 (archive->cctx, frame, bound, json, length);
+  if (ZSTD_isError (frame_size))
+    {
+      fprintf (stderr, "Error: Compression failed: %s\n",
+               ZSTD_getErrorName (frame_size));
+      goto unlock;
+    }
+
+  RecordHeader record = { .key_length = (uint32_t)key_length,
+                          .raw_size = length,
+                          .frame_size = frame_size };
+  struct iovec parts[] = { { &record, sizeof (record) },
+                           { (void *)key, key_length },
+                           { frame, frame_size } };
+  uint64_t offset = archive->index->indexed_size;
+  ssize_t expected = (ssize_t)(sizeof (record) + key_length + frame_size);
+  if (pwritev (archive->fd, parts, 3, (off_t)offset) != expected)
+    {
+      fprintf (stderr, "Error: Cannot write archive record: %s\n",
+               strerror (errno));
+      ftruncate (archive->fd, (off_t)offset);
+      goto unlock;
+    }
+  if (index_record (archive, key, offset) != 0)
+    {
+      goto unlock; // indexed by the next writer
+    }
+  archive->index->indexed_size = offset + (uint64_t)expected;
+  status = 0;
+
+  if (archive->cdict == NULL
+      && archive->index->used >= ARCHIVE_TRAINING_DOCUMENTS)
+    {
+      // Failure only costs ratio; the next append tries again
+      train_dictionary (archive);
+    }
+
+unlock:
+  unlock_archive (archive);
+  free (frame);
+  return status;
+}
+
+/**
+ * Look up a key's newest record.
+ * @return Record offset, 0 if the key is not archived
+ */
+static uint64_t
+lookup_record (InfoArchive *archive, const char *key)
+{
+  if (lock_archive (archive, LOCK_SH) != 0)
+    {
+      return 0;
+    }
+  // Records never move once written, so they can be read after unlocking
+  uint64_t offset = find_slot (archive, key, fnv1a_hash (key))->offset;
+  unlock_archive (archive);
+  return offset;
+}
+
+/**
+ * Read a whole archived document, e.g. for scan_format_table().
+ * @param archive Archive
+ * @param key Canonical video key
+ * @param length Receives the JSON length
+ * @return NUL-terminated JSON (caller must free), NULL if the key is not
+ *         archived or on error
+ */
+char *
+info_archive_read (InfoArchive *archive, const char *key, size_t *length)
+{
+  uint64_t offset = lookup_record (archive, key);
+  return offset != 0 ? read_document (archive, offset, length) : NULL;
+}
+
+/**
+ * Start decompressing an archived document piece by piece, for
+ * parse_formats_stream() or anything else taking a json_load_callback_t.
+ * Memory use is bounded by the zstd window, not the document size.
+ * @param archive Archive (must outlive the reader)
+ * @param key Canonical video key
+ * @return Reader (close with info_archive_close_reader), NULL if the key
+ *         is not archived or on error
+ */
+InfoArchiveReader *
+info_archive_open_reader (InfoArchive *archive, const char *key)
+{
+  uint64_t offset = lookup_record (archive, key);
+  RecordHeader record;
+  char stored[ARCHIVE_KEY_LENGTH];
+  if (offset == 0 || read_record (archive, offset, &record, stored) != 0)
+    {
+      return NULL;
+    }
+
+  InfoArchiveReader *reader = malloc (sizeof (InfoArchiveReader));
+  if (reader == NULL)
+    {
+      fprintf (stderr, "Error: Memory allocation failed\n");
+      return NULL;
+    }
+  reader->archive = archive;
+  reader->dctx = ZSTD_createDCtx ();
+  reader->next = offset + sizeof (record) + record.key_length;
+  reader->remaining = record.frame_size;
+  reader->input = (ZSTD_inBuffer){ reader->buffer, 0, 0 };
+  reader->started = 0;
+  reader->last_result = 1;
+  if (reader->dctx == NULL)
+    {
+      free (reader);
+      return NULL;
+    }
+  return reader;
+}
+
+/**
+ * Read the next compressed chunk; the first one also selects the
+ * dictionary from the frame header.
+ * @return 0 on success, -1 on error
+ */
+static int
+refill_reader (InfoArchiveReader *reader)
+{
+  size_t size = reader->remaining < ARCHIVE_READ_CHUNK
+                    ? (size_t)reader->remaining
+                    : ARCHIVE_READ_CHUNK;
+  if (pread (reader->archive->fd, reader->buffer, size, (off_t)reader->next)
+      != (ssize_t)size)
+    {
+      return -1;
+    }
+
+  if (!reader->started)
+    {
+      reader->started = 1;
+      unsigned dictionary_id = ZSTD_getDictID_fromFrame (reader->buffer, size);
+      if (dictionary_id != 0)
+        {
+          if (dictionary_id != reader->archive->dictionary_id)
+            {
+              fprintf (stderr,
+                       "Error: Archive frame needs unknown dictionary %u\n",
+                       dictionary_id);
+              return -1;
+            }
+          ZSTD_DCtx_refDDict (reader->dctx, reader->archive->ddict);
+        }
+    }
+
+  reader->next += size;
+  reader->remaining -= size;
+  reader->input.size = size;
+  reader->input.pos = 0;
+  return 0;
+}
+
+/**
+ * json_load_callback_t over an open reader.
+ * @param buffer Receives JSON text
+ * @param size Size of buffer
+ * @param reader InfoArchiveReader
+ * @return Bytes stored, 0 at the end of the document, (size_t)-1 on error
+ */
+size_t
+info_archive_reader_read (void *buffer, size_t size, void *reader)
+{
+  InfoArchiveReader *state = reader;
+  ZSTD_outBuffer output = { buffer, size, 0 };
+  while (output.pos == 0)
+    {
+      if (state->input.pos == state->input.size)
+        {
+          if (state->remaining == 0)
+            {
+              if (state->last_result != 0)
+                {
+                  fprintf (stderr, "Error: Truncated archive record\n");
+                  return (size_t)-1;
+                }
+              return 0;
+            }
+          if (refill_reader (state) != 0)
+            {
+              return (size_t)-1;
+            }
+        }
+      state->last_result
+          = ZSTD_decompressStream (state->dctx, &output, &state->input);
+      if (ZSTD_isError (state->last_result))
+        {
+          fprintf (stderr, "Error: Corrupt archive record: %s\n",
+                   ZSTD_getErrorName (state->last_result));
+          return (size_t)-1;
+        }
+      if (state->last_result == 0 && output.pos == 0
+          && state->input.pos == state->input.size && state->remaining == 0)
+        {
+          return 0;
+        }
+    }
+  return output.pos;
+}
+
+/**
+ * Close a reader.
+ * @param reader Reader, may be NULL
+ */
+void
+info_archive_close_reader (InfoArchiveReader *reader)
+{
+  if (reader != NULL)
+    {
+      ZSTD_freeDCtx (reader->dctx);
+      free (reader);
+    }
+}
+
+/**
+ * Append the info JSON fetched for a URL to an archive.
+ * @param path Archive path
+ * @param url Video URL (keyed through canonical_video_key())
+ * @param info_json_fd File holding the info JSON
+ * @return 0 on success, -1 on error
+ */
+int
+archive_info_json (const char *path, const char *url, int info_json_fd)
+{
+  char key[ARCHIVE_KEY_LENGTH];
+  struct stat st;
+  if (canonical_video_key (url, key, sizeof (key)) != 0
+      || fstat (info_json_fd, &st) != 0 || st.st_size == 0)
+    {
+      return -1;
+    }
+  void *json = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                     info_json_fd, 0);
+  if (json == MAP_FAILED)
+    {
+      return -1;
+    }
+
+  InfoArchive *archive = info_archive_open (path);
+  int status = archive ? info_archive_append (archive, key, json,
+                                              (size_t)st.st_size)
+                       : -1;
+  info_archive_close (archive);
+  munmap (json, (size_t)st.st_size);
+  return status;
+}
@@ -0,0 +1,27 @@
+#ifndef INFO_ARCHIVE_H
+#define INFO_ARCHIVE_H
+
+#include <stddef.h>
+
+// Append-only archive of raw info JSON documents, keyed by canonical video
+// key (see canonical_video_key()). Each document is its own zstd frame, so
+// any one is read without touching the others; PATH.idx maps keys to frame
+// offsets and PATH.dict holds the dictionary trained on the first
+// documents, which the frames written after it are compressed with.
+typedef struct InfoArchive InfoArchive;
+
+// Streaming decompression of one archived document
+typedef struct InfoArchiveReader InfoArchiveReader;
+
+// clang-format off
+InfoArchive *info_archive_open(const char *path);
+void info_archive_close(InfoArchive *archive);
+int info_archive_append(InfoArchive *archive, const char *key, const char *json, size_t length);
+char *info_archive_read(InfoArchive *archive, const char *key, size_t *length);
+InfoArchiveReader *info_archive_open_reader(InfoArchive *archive, const char *key);
+size_t info_archive_reader_read(void *buffer, size_t size, void *reader);
+void info_archive_close_reader(InfoArchiveReader *reader);
+int archive_info_json(const char *path, const char *url, int info_json_fd);
+// clang-format on
+
+#endif
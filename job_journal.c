@@ -0,0 +1,882 @@
+#define _GNU_SOURCE
+#include "job_journal.h"
+#include "util.h"
+#include "ytdl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// First record of every journal: identifies the file and its format
+#define JOURNAL_HEADER_KEY "ytdl_journal"
+#define JOURNAL_VERSION 1
+// Name of a compacted journal being written, before it is renamed over
+#define JOURNAL_TEMPLATE ".tmp-XXXXXX"
+#define JOURNAL_INITIAL_ENTRIES 256
+
+/*
+ * On-disk format: one JSON object per line, appended as jobs change state.
+ *
+ *   {"ytdl_journal":1}
+ *   {"state":"queued","url":"https://..."}
+ *   {"state":"downloading","url":"https://...","bytes":123,"path":"/x.mp4"}
+ *   {"state":"done","url":"https://...","bytes":456,"path":"/x.mp4"}
+ *
+ * A later record for a URL supersedes the earlier ones, and omitted fields
+ * keep their earlier value. A crash can only tear the last line, which has
+ * no newline then and is ignored. Compaction writes one record per URL to
+ * a new file and renames it over the journal.
+ */
+
+static const char *const state_names[] = {
+  [JOURNAL_QUEUED] = "queued", [JOURNAL_FETCHING] = "fetching",
+  [JOURNAL_DOWNLOADING] = "downloading", [JOURNAL_DONE] = "done",
+  [JOURNAL_FAILED] = "failed", [JOURNAL_LISTED] = "listed",
+};
+
+// Latest state of one URL
+typedef struct
+{
+  char *url;
+  char *path;      // file being written or written, or NULL
+  long long bytes; // bytes of path, -1 if unknown
+  JournalState state;
+  int claimed; // handed to this run's downloads
+  int stale;   // bytes changed since the last record
+  int dirty;   // in the dirty list
+} JournalEntry;
+
+// Growable run of records
+typedef struct
+{
+  char *data;
+  size_t length;
+  size_t capacity;
+} JournalBuffer;
+
+struct JobJournal
+{
+  pthread_mutex_t lock; // the feeder thread claims URLs too
+  char *path;
+  int fd; // O_APPEND, locked with flock() while open
+  JournalEntry *entries;
+  size_t count;
+  size_t capacity;
+  size_t *slots; // open addressing: entry index + 1, 0 for a free slot
+  size_t slot_capacity;
+  size_t *dirty; // entries whose bytes changed since their last record
+  size_t dirty_count;
+  JournalBuffer pending; // records not written yet
+  JournalBuffer writing; // records being written, outside the lock
+  size_t records;        // records in the file and pending
+  size_t pending_records;
+  double synced_ms;
+  double compact_retry_ms; // no compaction before this time
+  int write_failed;        // reported once
+};
+
+/**
+ * Append bytes to a buffer, growing it as needed.
+ * @return 0 on success, -1 if out of memory
+ */
+static int
+buffer_append (JournalBuffer *buffer, const char *data, size_t length)
+{
+  if (buffer->length + length > buffer->capacity)
+    {
+      size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+      while (capacity < buffer->length + length)
+        {
+          capacity *= 2;
+        }
+      char *grown = realloc (buffer->data, capacity);
+      if (grown == NULL)
+        {
+          return -1;
+        }
+      buffer->data = grown;
+      buffer->capacity = capacity;
+    }
+  memcpy (buffer->data + buffer->length, data, length);
+  buffer->length += length;
+  return 0;
+}
+
+/**
+ * Append the record of an entry's current state to a buffer.
+ * @return 0 on success, -1 if it could not be encoded
+ */
+static int
+encode_entry (const JournalEntry *entry, JournalBuffer *buffer)
+{
+  json_t *record = json_object ();
+  json_t *url = json_string (entry->url);
+  if (record == NULL || url == NULL)
+    {
+      json_decref (url);
+      json_decref (record);
+      return -1;
+    }
+  json_object_set_new (record, "state",
+                       json_string (state_names[entry->state]));
+  json_object_set_new (record, "url", url);
+  if (entry->bytes >= 0)
+    {
+      json_object_set_new (record, "bytes", json_integer (entry->bytes));
+    }
+  // A path that is not UTF-8 is left out; the URL is what matters
+  json_t *path = entry->path != NULL ? json_string (entry->path) : NULL;
+  if (path != NULL)
+    {
+      json_object_set_new (record, "path", path);
+    }
+
+  char *text = json_dumps (record, JSON_COMPACT);
+  json_decref (record);
+  int status = -1;
+  if (text != NULL && buffer_append (buffer, text, strlen (text)) == 0
+      && buffer_append (buffer, "\n", 1) == 0)
+    {
+      status = 0;
+    }
+  free (text);
+  return status;
+}
+
+/**
+ * Queue the record of an entry's current state. Called with the lock held.
+ */
+static void
+record_entry (JobJournal *journal, JournalEntry *entry)
+{
+  if (encode_entry (entry, &journal->pending) == 0)
+    {
+      journal->records++;
+      journal->pending_records++;
+    }
+  entry->stale = 0;
+}
+
+/**
+ * Find the entry of a URL.
+ * @return Entry, NULL if the URL is not in the journal
+ */
+static JournalEntry *
+find_entry (const JobJournal *journal, const char *url)
+{
+  if (journal->slot_capacity == 0)
+    {
+      return NULL;
+    }
+  size_t mask = journal->slot_capacity - 1;
+  for (size_t i = fnv1a_hash (url) & mask; journal->slots[i] != 0;
+       i = (i + 1) & mask)
+    {
+      JournalEntry *entry = &journal->entries[journal->slots[i] - 1];
+      if (strcmp (entry->url, url) == 0)
+        {
+          return entry;
+        }
+    }
+  return NULL;
+}
+
+/**
+ * Double the hash index, or create it.
+ * @return 0 on success, -1 if out of memory
+ */
+static int
+grow_slots (JobJournal *journal)
+{
+  size_t capacity
+      = journal->slot_capacity > 0 ? journal->slot_capacity * 2 : 1024;
+  size_t *slots = calloc (capacity, sizeof (size_t));
+  if (slots == NULL)
+    {
+      return -1;
+    }
+  for (size_t e = 0; e < journal->count; e++)
+    {
+      size_t i = fnv1a_hash (journal->entries[e].url) & (capacity - 1);
+      while (slots[i] != 0)
+        {
+          i = (i + 1) & (capacity - 1);
+        }
+      slots[i] = e + 1;
+    }
+  free (journal->slots);
+  journal->slots = slots;
+  journal->slot_capacity = capacity;
+  return 0;
+}
+
+/**
+ * Add a URL to the journal, without recording it.
+ * @return New entry, NULL if out of memory
+ */
+static JournalEntry *
+add_entry (JobJournal *journal, const char *url, JournalState state)
+{
+  if (journal->count == journal->capacity)
+    {
+      size_t capacity = journal->capacity > 0 ? journal->capacity * 2
+                                              : JOURNAL_INITIAL_ENTRIES;
+      JournalEntry *entries
+          = realloc (journal->entries, capacity * sizeof (JournalEntry));
+      size_t *dirty = realloc (journal->dirty, capacity * sizeof (size_t));
+      if (entries != NULL)
+        {
+          journal->entries = entries;
+        }
+      if (dirty != NULL)
+        {
+          journal->dirty = dirty;
+        }
+      if (entries == NULL || dirty == NULL)
+        {
+          return NULL;
+        }
+      journal->capacity = capacity;
+    }
+  if ((journal->count + 1) * 2 > journal->slot_capacity
+      && grow_slots (journal) != 0)
+    {
+      return NULL;
+    }
+
+  char *copy = strdup (url);
+  if (copy == NULL)
+    {
+      return NULL;
+    }
+  JournalEntry *entry = &journal->entries[journal->count];
+  memset (entry, 0, sizeof (JournalEntry));
+  entry->url = copy;
+  entry->bytes = -1;
+  entry->state = state;
+
+  size_t mask = journal->slot_capacity - 1;
+  size_t i = fnv1a_hash (url) & mask;
+  while (journal->slots[i] != 0)
+    {
+      i = (i + 1) & mask;
+    }
+  journal->slots[i] = ++journal->count;
+  return entry;
+}
+
+/**
+ * Replace the path of an entry.
+ * @return 1 if it changed, 0 otherwise
+ */
+static int
+set_entry_path (JournalEntry *entry, const char *path)
+{
+  if (path == NULL
+      || (entry->path != NULL && strcmp (entry->path, path) == 0))
+    {
+      return 0;
+    }
+  char *copy = strdup (path);
+  if (copy == NULL)
+    {
+      return 0;
+    }
+  free (entry->path);
+  entry->path = copy;
+  return 1;
+}
+
+/**
+ * Apply one record read back from the file.
+ * @return 0 if applied (or the header), -1 if the record is damaged
+ */
+static int
+replay_record (JobJournal *journal, const char *line, size_t length)
+{
+  json_t *record = json_loadb (line, length, 0, NULL);
+  if (!json_is_object (record))
+    {
+      json_decref (record);
+      return -1;
+    }
+  json_t *version = json_object_get (record, JOURNAL_HEADER_KEY);
+  if (version != NULL)
+    {
+      int known = json_is_integer (version)
+                  && json_integer_value (version) == JOURNAL_VERSION;
+      json_decref (record);
+      return known ? 0 : -1;
+    }
+
+  const char *state_name
+      = json_string_value (json_object_get (record, "state"));
+  const char *url = json_string_value (json_object_get (record, "url"));
+  int state = -1;
+  for (size_t s = 0; state_name != NULL
+                     && s < sizeof (state_names) / sizeof (state_names[0]);
+       s++)
+    {
+      if (strcmp (state_name, state_names[s]) == 0)
+        {
+          state = (int)s;
+        }
+    }
+  if (url == NULL || state == -1)
+    {
+      json_decref (record);
+      return -1;
+    }
+
+  JournalEntry *entry = find_entry (journal, url);
+  if (entry == NULL)
+    {
+      entry = add_entry (journal, url, (JournalState)state);
+    }
+  if (entry != NULL)
+    {
+      entry->state = (JournalState)state;
+      json_t *bytes = json_object_get (record, "bytes");
+      if (json_is_integer (bytes))
+        {
+          entry->bytes = json_integer_value (bytes);
+        }
+      set_entry_path (entry,
+                      json_string_value (json_object_get (record, "path")));
+    }
+  json_decref (record);
+  return 0;
+}
+
+/**
+ * Read the journal and apply its records in order. Only complete lines
+ * count: a crash in the middle of an append leaves a partial last line.
+ * @return 0 on success, -1 if the file cannot be read or is not a journal
+ */
+static int
+replay_journal (JobJournal *journal)
+{
+  struct stat st;
+  if (fstat (journal->fd, &st) != 0)
+    {
+      fprintf (stderr, "Error: Cannot read journal %s: %s\n", journal->path,
+               strerror (errno));
+      return -1;
+    }
+  if (st.st_size == 0)
+    {
+      return 0;
+    }
+
+  char *text = malloc ((size_t)st.st_size);
+  if (text == NULL)
+    {
+      fprintf (stderr, "Error: Cannot read journal %s: out of memory\n",
+               journal->path);
+      return -1;
+    }
+  size_t length = 0;
+  while (length < (size_t)st.st_size)
+    {
+      ssize_t bytes_read = pread (journal->fd, text + length,
+                                  (size_t)st.st_size - length, (off_t)length);
+      if (bytes_read < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (bytes_read <= 0)
+        {
+          break;
+        }
+      length += (size_t)bytes_read;
+    }
+
+  // Never take over a file that is not a journal: it would be rewritten
+  char *newline = memchr (text, '\n', length);
+  json_t *header = newline != NULL
+                       ? json_loadb (text, (size_t)(newline - text), 0, NULL)
+                       : NULL;
+  int is_journal = json_integer_value (
+                       json_object_get (header, JOURNAL_HEADER_KEY))
+                   == JOURNAL_VERSION;
+  json_decref (header);
+  if (!is_journal)
+    {
+      fprintf (stderr, "Error: %s is not a ytdl journal\n", journal->path);
+      free (text);
+      return -1;
+    }
+
+  size_t damaged = 0;
+  size_t start = 0;
+  while ((newline = memchr (text + start, '\n', length - start)) != NULL)
+    {
+      size_t end = (size_t)(newline - text);
+      if (end > start
+          && replay_record (journal, text + start, end - start) != 0)
+        {
+          damaged++;
+        }
+      journal->records++;
+      start = end + 1;
+    }
+  if (damaged > 0)
+    {
+      fprintf (stderr, "Warning: Skipped %zu damaged records of journal %s\n",
+               damaged, journal->path);
+    }
+  free (text);
+  return 0;
+}
+
+/**
+ * Write a whole buffer to a descriptor.
+ * @return 0 on success, -1 on error (errno set)
+ */
+static int
+write_all (int fd, const char *data, size_t length)
+{
+  while (length > 0)
+    {
+      ssize_t written = write (fd, data, length);
+      if (written < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (written <= 0)
+        {
+          return -1;
+        }
+      data += written;
+      length -= (size_t)written;
+    }
+  return 0;
+}
+
+/**
+ * Make a rename in the journal's directory durable.
+ */
+static void
+sync_directory (const char *path)
+{
+  char copy[MAX_PATH_LENGTH];
+  snprintf (copy, sizeof (copy), "%s", path);
+  int fd = open (dirname (copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd != -1)
+    {
+      fsync (fd);
+      close (fd);
+    }
+}
+
+/**
+ * Rewrite the journal as one record per URL. The new file is written and
+ * synced under a temporary name, locked, then renamed over the journal,
+ * so a crash at any point leaves either the old journal or the new one.
+ * Records queued while it is written are appended to the new file later.
+ * @param journal Journal
+ * @return 0 on success, -1 on error (the old file is kept)
+ */
+static int
+compact_journal (JobJournal *journal)
+{
+  JournalBuffer snapshot = { NULL, 0, 0 };
+  char header[64];
+  int header_length = snprintf (header, sizeof (header), "{\"%s\":%d}\n",
+                                JOURNAL_HEADER_KEY, JOURNAL_VERSION);
+
+  pthread_mutex_lock (&journal->lock);
+  int status = buffer_append (&snapshot, header, (size_t)header_length);
+  size_t snapshot_records = 1;
+  for (size_t e = 0; e < journal->count && status == 0; e++)
+    {
+      journal->entries[e].stale = 0;
+      journal->entries[e].dirty = 0;
+      if (encode_entry (&journal->entries[e], &snapshot) == 0)
+        {
+          snapshot_records++;
+        }
+    }
+  journal->dirty_count = 0;
+  // The snapshot covers what is pending so far
+  size_t covered = journal->pending.length;
+  size_t covered_records = journal->pending_records;
+  pthread_mutex_unlock (&journal->lock);
+
+  char temporary[MAX_PATH_LENGTH];
+  int fd = -1;
+  if (status == 0
+      && snprintf (temporary, sizeof (temporary), "%s" JOURNAL_TEMPLATE,
+                   journal->path)
+             < (int)sizeof (temporary))
+    {
+      fd = mkostemp (temporary, O_APPEND | O_CLOEXEC);
+    }
+  if (fd == -1 || write_all (fd, snapshot.data, snapshot.length) != 0
+      || fdatasync (fd) != 0 || flock (fd, LOCK_EX | LOCK_NB) != 0
+      || rename (temporary, journal->path) != 0)
+    {
+      fprintf (stderr, "Error: Cannot compact journal %s: %s\n",
+               journal->path, strerror (errno));
+      if (fd != -1)
+        {
+          close (fd);
+          unlink (temporary);
+        }
+      free (snapshot.data);
+      return -1;
+    }
+  free (snapshot.data);
+  sync_directory (journal->path);
+
+  pthread_mutex_lock (&journal->lock);
+  if (journal->fd != -1)
+    {
+      close (journal->fd);
+    }
+  journal->fd = fd;
+  if (covered > 0)
+    {
+      memmove (journal->pending.data, journal->pending.data + covered,
+               journal->pending.length - covered);
+      journal->pending.length -= covered;
+    }
+  journal->pending_records -= covered_records;
+  journal->records = snapshot_records + journal->pending_records;
+  pthread_mutex_unlock (&journal->lock);
+  return 0;
+}
+
+/**
+ * Open a journal, creating it if needed, and replay it. The file is locked
+ * against other ytdl processes and compacted right away, which also drops
+ * a record torn by a crash.
+ * @param path Journal file
+ * @param totals Receives the counts of what it held (can be NULL)
+ * @return Journal, NULL on error
+ */
+JobJournal *
+journal_open (const char *path, JournalTotals *totals)
+{
+  JobJournal *journal = calloc (1, sizeof (JobJournal));
+  if (journal == NULL)
+    {
+      perror ("calloc");
+      return NULL;
+    }
+  pthread_mutex_init (&journal->lock, NULL);
+  journal->path = strdup (path);
+  journal->fd = open (path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  if (journal->path == NULL || journal->fd == -1)
+    {
+      fprintf (stderr, "Error: Cannot open journal %s: %s\n", path,
+               strerror (errno));
+      journal_close (journal);
+      return NULL;
+    }
+  if (flock (journal->fd, LOCK_EX | LOCK_NB) != 0)
+    {
+      fprintf (stderr, "Error: Journal %s is in use by another ytdl\n", path);
+      close (journal->fd);
+      journal->fd = -1;
+      journal_close (journal);
+      return NULL;
+    }
+  if (replay_journal (journal) != 0 || compact_journal (journal) != 0)
+    {
+      close (journal->fd);
+      journal->fd = -1;
+      journal_close (journal);
+      return NULL;
+    }
+  journal->synced_ms = monotonic_ms ();
+
+  if (totals != NULL)
+    {
+      memset (totals, 0, sizeof (JournalTotals));
+      for (size_t e = 0; e < journal->count; e++)
+        {
+          switch (journal->entries[e].state)
+            {
+            case JOURNAL_DONE:
+              totals->done++;
+              break;
+            case JOURNAL_FAILED:
+              totals->failed++;
+              break;
+            case JOURNAL_LISTED:
+              totals->listed++;
+              break;
+            default:
+              totals->unfinished++;
+              break;
+            }
+        }
+    }
+  return journal;
+}
+
+/**
+ * Write and sync what is pending, then close the journal.
+ * @param journal Journal (can be NULL)
+ */
+void
+journal_close (JobJournal *journal)
+{
+  if (journal == NULL)
+    {
+      return;
+    }
+  if (journal->fd != -1)
+    {
+      journal_sync (journal, 1);
+      close (journal->fd);
+    }
+  for (size_t e = 0; e < journal->count; e++)
+    {
+      free (journal->entries[e].url);
+      free (journal->entries[e].path);
+    }
+  free (journal->entries);
+  free (journal->slots);
+  free (journal->dirty);
+  free (journal->pending.data);
+  free (journal->writing.data);
+  free (journal->path);
+  pthread_mutex_destroy (&journal->lock);
+  free (journal);
+}
+
+/**
+ * URLs an earlier run did not finish: queued, fetching or downloading when
+ * it stopped.
+ * @param journal Journal
+ * @param count Receives the number of URLs
+ * @return Allocated array of allocated URLs (free each, then the array),
+ *         NULL if there are none or on error
+ */
+char **
+journal_unfinished (JobJournal *journal, size_t *count)
+{
+  *count = 0;
+  pthread_mutex_lock (&journal->lock);
+  char **urls = journal->count > 0
+                    ? malloc (journal->count * sizeof (char *))
+                    : NULL;
+  for (size_t e = 0; urls != NULL && e < journal->count; e++)
+    {
+      const JournalEntry *entry = &journal->entries[e];
+      if (entry->state < JOURNAL_DONE && !entry->claimed
+          && (urls[*count] = strdup (entry->url)) != NULL)
+        {
+          (*count)++;
+        }
+    }
+  pthread_mutex_unlock (&journal->lock);
+  if (urls != NULL && *count == 0)
+    {
+      free (urls);
+      urls = NULL;
+    }
+  return urls;
+}
+
+/**
+ * Claim a URL for this run's downloads. A URL new to the journal is
+ * recorded as queued; one that is finished (done, failed, or a listed
+ * playlist) or already claimed is not downloaded again.
+ * @param journal Journal
+ * @param url URL about to be queued
+ * @return 1 to queue it, 0 to skip it
+ */
+int
+journal_claim (JobJournal *journal, const char *url)
+{
+  int claimed = 1;
+  pthread_mutex_lock (&journal->lock);
+  JournalEntry *entry = find_entry (journal, url);
+  if (entry == NULL)
+    {
+      entry = add_entry (journal, url, JOURNAL_QUEUED);
+      if (entry != NULL)
+        {
+          record_entry (journal, entry);
+        }
+    }
+  else if (entry->claimed || entry->state >= JOURNAL_DONE)
+    {
+      claimed = 0;
+    }
+  if (entry != NULL)
+    {
+      entry->claimed = 1;
+    }
+  pthread_mutex_unlock (&journal->lock);
+  return claimed;
+}
+
+/**
+ * Record the progress of a URL. A new state or path is recorded right
+ * away; a new byte count only at the next sync, however often it changes
+ * in between.
+ * @param journal Journal
+ * @param url URL
+ * @param state New state
+ * @param bytes Bytes of the file, -1 to keep the previous count
+ * @param path File being written, NULL to keep the previous one
+ */
+void
+journal_update (JobJournal *journal, const char *url, JournalState state,
+                long long bytes, const char *path)
+{
+  pthread_mutex_lock (&journal->lock);
+  JournalEntry *entry = find_entry (journal, url);
+  int changed = entry == NULL;
+  if (entry == NULL)
+    {
+      entry = add_entry (journal, url, state);
+    }
+  if (entry == NULL)
+    {
+      pthread_mutex_unlock (&journal->lock);
+      return;
+    }
+
+  changed |= entry->state != state;
+  entry->state = state;
+  changed |= set_entry_path (entry, path);
+  int counted = bytes >= 0 && bytes != entry->bytes;
+  if (bytes >= 0)
+    {
+      entry->bytes = bytes;
+    }
+  if (changed)
+    {
+      record_entry (journal, entry);
+    }
+  else if (counted)
+    {
+      entry->stale = 1;
+      if (!entry->dirty)
+        {
+          entry->dirty = 1;
+          journal->dirty[journal->dirty_count++]
+              = (size_t)(entry - journal->entries);
+        }
+    }
+  pthread_mutex_unlock (&journal->lock);
+}
+
+/**
+ * Look a URL up.
+ * @param journal Journal
+ * @param url URL
+ * @param bytes Receives its byte count, -1 if unknown (can be NULL)
+ * @param path Receives its file, "" if unknown (can be NULL)
+ * @param path_size Size of path
+ * @return Its JournalState, -1 if the URL is not in the journal
+ */
+int
+journal_lookup (JobJournal *journal, const char *url, long long *bytes,
+                char *path, size_t path_size)
+{
+  pthread_mutex_lock (&journal->lock);
+  const JournalEntry *entry = find_entry (journal, url);
+  int state = entry != NULL ? (int)entry->state : -1;
+  if (bytes != NULL)
+    {
+      *bytes = entry != NULL ? entry->bytes : -1;
+    }
+  if (path != NULL)
+    {
+      snprintf (path, path_size, "%s",
+                entry != NULL && entry->path != NULL ? entry->path : "");
+    }
+  pthread_mutex_unlock (&journal->lock);
+  return state;
+}
+
+/**
+ * Write the pending records and sync them to disk, at most once every
+ * JOURNAL_SYNC_MS unless forced: a crash loses at most that much progress,
+ * and one fdatasync() covers every record of the interval. The journal is
+ * compacted instead once it has grown JOURNAL_COMPACT_RATIO times larger
+ * than its URLs need. If compaction fails, the records are appended to
+ * the old file as usual and it is retried after JOURNAL_COMPACT_RETRY_MS.
+ * @param journal Journal
+ * @param force Sync now
+ * @return 0 on success, -1 on error
+ */
+int
+journal_sync (JobJournal *journal, int force)
+{
+  double now = monotonic_ms ();
+  if (!force && now - journal->synced_ms < JOURNAL_SYNC_MS)
+    {
+      return 0;
+    }
+  journal->synced_ms = now;
+
+  pthread_mutex_lock (&journal->lock);
+  for (size_t d = 0; d < journal->dirty_count; d++)
+    {
+      JournalEntry *entry = &journal->entries[journal->dirty[d]];
+      if (entry->stale)
+        {
+          record_entry (journal, entry);
+        }
+      entry->dirty = 0;
+    }
+  journal->dirty_count = 0;
+  int compact = journal->records
+                    > JOURNAL_COMPACT_RATIO * journal->count
+                          + JOURNAL_COMPACT_SLACK
+                && now >= journal->compact_retry_ms;
+  pthread_mutex_unlock (&journal->lock);
+
+  if (compact)
+    {
+      if (compact_journal (journal) == 0)
+        {
+          return 0;
+        }
+      // Stay durable on the old file; compaction may work again later
+      journal->compact_retry_ms = now + JOURNAL_COMPACT_RETRY_MS;
+    }
+
+  pthread_mutex_lock (&journal->lock);
+  JournalBuffer swap = journal->writing;
+  journal->writing = journal->pending;
+  journal->pending = swap;
+  journal->pending.length = 0;
+  journal->pending_records = 0;
+  pthread_mutex_unlock (&journal->lock);
+
+  if (journal->writing.length == 0)
+    {
+      return 0;
+    }
+  if (write_all (journal->fd, journal->writing.data, journal->writing.length)
+          != 0
+      || fdatasync (journal->fd) != 0)
+    {
+      if (!journal->write_failed)
+        {
+          fprintf (stderr, "Error: Cannot write journal %s: %s\n",
+                   journal->path, strerror (errno));
+        }
+      journal->write_failed = 1;
+      journal->writing.length = 0;
+      return -1;
+    }
+  journal->writing.length = 0;
+  return 0;
+}
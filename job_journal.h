@@ -0,0 +1,48 @@
+#ifndef JOB_JOURNAL_H
+#define JOB_JOURNAL_H
+
+#include <stddef.h>
+
+// Most time records wait in memory before they are written and synced
+#define JOURNAL_SYNC_MS 1000
+// Rewrite the journal once it holds this many records per job...
+#define JOURNAL_COMPACT_RATIO 4
+// ...plus this many, so small journals are not rewritten over and over
+#define JOURNAL_COMPACT_SLACK 4096
+// After a failed compaction, records are appended again for this long
+#define JOURNAL_COMPACT_RETRY_MS 60000
+
+// Where a URL of the journal stands
+typedef enum
+{
+  JOURNAL_QUEUED,      // handed to the downloads
+  JOURNAL_FETCHING,    // yt-dlp started, nothing downloaded yet
+  JOURNAL_DOWNLOADING, // a file is being written
+  JOURNAL_DONE,
+  JOURNAL_FAILED,
+  JOURNAL_LISTED // a playlist whose entries were all queued
+} JournalState;
+
+// What a journal held when it was opened
+typedef struct
+{
+  size_t done;
+  size_t failed;
+  size_t unfinished; // queued, fetching or downloading: resumed
+  size_t listed;
+} JournalTotals;
+
+// Append-only record of the jobs of a run, replayed on the next run
+typedef struct JobJournal JobJournal;
+
+// clang-format off
+JobJournal *journal_open(const char *path, JournalTotals *totals);
+void journal_close(JobJournal *journal);
+char **journal_unfinished(JobJournal *journal, size_t *count);
+int journal_claim(JobJournal *journal, const char *url);
+void journal_update(JobJournal *journal, const char *url, JournalState state, long long bytes, const char *path);
+int journal_lookup(JobJournal *journal, const char *url, long long *bytes, char *path, size_t path_size);
+int journal_sync(JobJournal *journal, int force);
+// clang-format on
+
+#endif
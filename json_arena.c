@@ -0,0 +1,222 @@
+#include "json_arena.h"
+
+#include <jansson.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// First block of an arena; later ones double, so a document of any size
+// takes a handful of mallocs
+#define JSON_ARENA_FIRST_BLOCK (64 * 1024)
+#define JSON_ARENA_MAX_BLOCK (8 * 1024 * 1024)
+
+struct JsonArenaBlock
+{
+  JsonArenaBlock *next;
+  size_t size; // usable bytes in data
+  size_t used;
+  max_align_t data[];
+};
+
+// Arena of the calling thread, NULL outside json_arena_begin/end
+static _Thread_local JsonArena *current_arena = NULL;
+
+static atomic_flag hooks_installed = ATOMIC_FLAG_INIT;
+
+static atomic_ulong total_documents;
+static atomic_ulong total_arena_allocations;
+static atomic_ulong total_heap_allocations;
+static atomic_ulong total_blocks;
+static atomic_size_t peak_reserved;
+
+/**
+ * Add a block large enough for a request.
+ * @param arena Arena
+ * @param size Bytes requested
+ * @return New block, NULL if malloc failed
+ */
+static JsonArenaBlock *
+add_block (JsonArena *arena, size_t size)
+{
+  size_t block_size = arena->blocks ? arena->blocks->size * 2
+                                    : JSON_ARENA_FIRST_BLOCK;
+  if (block_size > JSON_ARENA_MAX_BLOCK)
+    {
+      block_size = JSON_ARENA_MAX_BLOCK;
+    }
+  if (block_size < size)
+    {
+      block_size = size;
+    }
+
+  JsonArenaBlock *block = malloc (sizeof (JsonArenaBlock) + block_size);
+  if (block == NULL)
+    {
+      return NULL;
+    }
+  block->next = arena->blocks;
+  block->size = block_size;
+  block->used = 0;
+  arena->blocks = block;
+  arena->block_count++;
+  arena->reserved += block_size;
+  atomic_fetch_add (&total_blocks, 1);
+  return block;
+}
+
+/**
+ * jansson allocation hook: bump-allocate from the thread's arena.
+ */
+static void *
+arena_malloc (size_t size)
+{
+  JsonArena *arena = current_arena;
+  if (arena == NULL)
+    {
+      atomic_fetch_add (&total_heap_allocations, 1);
+      return malloc (size);
+    }
+
+  const size_t align = _Alignof (max_align_t);
+  size = (size + align - 1) & ~(align - 1);
+  if (size == 0)
+    {
+      size = align;
+    }
+
+  JsonArenaBlock *block = arena->blocks;
+  if (block == NULL || block->size - block->used < size)
+    {
+      block = add_block (arena, size);
+      if (block == NULL)
+        {
+          return NULL;
+        }
+    }
+
+  void *pointer = (char *)block->data + block->used;
+  block->used += size;
+  arena->allocations++;
+  return pointer;
+}
+
+/**
+ * Whether a pointer lies in one of the arena's blocks.
+ */
+static int
+arena_owns (const JsonArena *arena, const void *pointer)
+{
+  uintptr_t address = (uintptr_t)pointer;
+  for (const JsonArenaBlock *block = arena->blocks; block != NULL;
+       block = block->next)
+    {
+      uintptr_t start = (uintptr_t)block->data;
+      if (address >= start && address < start + block->size)
+        {
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/**
+ * jansson free hook: arena memory is released with the arena; anything
+ * else (values created before the arena began) goes back to malloc.
+ */
+static void
+arena_free (void *pointer)
+{
+  JsonArena *arena = current_arena;
+  if (pointer == NULL || (arena != NULL && arena_owns (arena, pointer)))
+    {
+      return;
+    }
+  free (pointer);
+}
+
+/**
+ * Route the calling thread's jansson allocations to an arena. The hooks
+ * are installed on first use and stay installed; outside an arena they
+ * fall through to malloc and free.
+ * @param arena Arena, initialized with JSON_ARENA_INIT
+ */
+void
+json_arena_begin (JsonArena *arena)
+{
+  if (!atomic_flag_test_and_set (&hooks_installed))
+    {
+      json_set_alloc_funcs (arena_malloc, arena_free);
+    }
+  current_arena = arena;
+}
+
+/**
+ * Release every document in the arena at once, keeping the newest (and
+ * largest) block for the next document.
+ * @param arena Arena
+ */
+void
+json_arena_reset (JsonArena *arena)
+{
+  size_t peak = atomic_load (&peak_reserved);
+  while (arena->reserved > peak
+         && !atomic_compare_exchange_weak (&peak_reserved, &peak,
+                                           arena->reserved))
+    {
+    }
+  if (arena->allocations > 0)
+    {
+      atomic_fetch_add (&total_documents, 1);
+      atomic_fetch_add (&total_arena_allocations, arena->allocations);
+    }
+  arena->allocations = 0;
+
+  JsonArenaBlock *kept = arena->blocks;
+  if (kept == NULL)
+    {
+      return;
+    }
+  JsonArenaBlock *block = kept->next;
+  while (block != NULL)
+    {
+      JsonArenaBlock *next = block->next;
+      free (block);
+      block = next;
+    }
+  kept->next = NULL;
+  kept->used = 0;
+  arena->block_count = 1;
+  arena->reserved = kept->size;
+}
+
+/**
+ * Stop using an arena and release all its memory.
+ * @param arena Arena
+ */
+void
+json_arena_end (JsonArena *arena)
+{
+  json_arena_reset (arena);
+  free (arena->blocks);
+  arena->blocks = NULL;
+  arena->block_count = 0;
+  arena->reserved = 0;
+  if (current_arena == arena)
+    {
+      current_arena = NULL;
+    }
+}
+
+/**
+ * Read the process-wide jansson allocation counters.
+ * @param stats Receives the counters
+ */
+void
+json_arena_get_stats (JsonArenaStats *stats)
+{
+  stats->documents = atomic_load (&total_documents);
+  stats->arena_allocations = atomic_load (&total_arena_allocations);
+  stats->heap_allocations = atomic_load (&total_heap_allocations);
+  stats->blocks = atomic_load (&total_blocks);
+  stats->peak_reserved = atomic_load (&peak_reserved);
+}
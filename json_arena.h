@@ -0,0 +1,40 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <stddef.h>
+
+typedef struct JsonArenaBlock JsonArenaBlock;
+
+// Bump allocator behind jansson for one document at a time. Between
+// json_arena_begin() and json_arena_end() every json_t node and string the
+// calling thread creates comes out of a few large blocks, json_decref()
+// frees nothing, and the whole document goes away in one reset. Values
+// created inside must not be used (or decref'd) after the arena ends.
+typedef struct
+{
+  JsonArenaBlock *blocks; // newest first
+  size_t allocations;     // jansson requests served
+  size_t block_count;     // blocks taken from malloc
+  size_t reserved;        // bytes in all blocks
+} JsonArena;
+
+#define JSON_ARENA_INIT { NULL, 0, 0, 0 }
+
+// Process-wide jansson allocation counters
+typedef struct
+{
+  unsigned long documents;         // arenas ended
+  unsigned long arena_allocations; // served from arenas
+  unsigned long heap_allocations;  // served by malloc, outside any arena
+  unsigned long blocks;            // arena blocks taken from malloc
+  size_t peak_reserved;            // largest arena footprint in bytes
+} JsonArenaStats;
+
+// clang-format off
+void json_arena_begin(JsonArena *arena);
+void json_arena_reset(JsonArena *arena);
+void json_arena_end(JsonArena *arena);
+void json_arena_get_stats(JsonArenaStats *stats);
+// clang-format on
+
+#endif
@@ -0,0 +1,841 @@
+#include "json_scan.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_SCAN_X86 1
+#else
+#define JSON_SCAN_X86 0
+#endif
+
+// Longest number literal accepted (digits, sign, fraction and exponent)
+#define JSON_SCAN_NUMBER_MAX 63
+
+// Bytes classified per step of the vector container skip
+#define JSON_SCAN_BLOCK 64
+
+// Character classes of one block, one bit per byte (bit 0 = first byte)
+typedef struct
+{
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t open;  // { or [
+  uint64_t close; // } or ]
+} BlockMasks;
+
+typedef void (*BlockClassifier) (const char *block, BlockMasks *masks);
+
+// Set by json_scan_set_isa(), before any scanning starts
+static JsonScanIsa requested_isa = JSON_SCAN_ISA_AUTO;
+
+static const char *const isa_names[]
+    = { "auto", "scalar", "sse2", "avx2" };
+
+/**
+ * Record a scan error at the current position.
+ * @param scanner Scanner
+ * @return -1, for use in return statements
+ */
+static int
+scan_fail (JsonScanner *scanner)
+{
+  if (scanner->error == NULL)
+    {
+      scanner->error = scanner->position;
+    }
+  return -1;
+}
+
+/**
+ * Skip JSON whitespace.
+ * @param scanner Scanner
+ */
+static void
+skip_whitespace (JsonScanner *scanner)
+{
+  const char *p = scanner->position;
+  while (p < scanner->end
+         && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+    {
+      p++;
+    }
+  scanner->position = p;
+}
+
+/**
+ * Find the closing quote of a string whose opening quote is at p[-1].
+ * @param p First byte of the string contents
+ * @param end End of input
+ * @param escaped Set when a backslash escape is seen (can be NULL)
+ * @return Pointer to the closing quote, NULL if the string is unterminated
+ */
+static const char *
+find_string_end (const char *p, const char *end, int *escaped)
+{
+  for (;;)
+    {
+      const char *quote = memchr (p, '"', (size_t)(end - p));
+      if (quote == NULL)
+        {
+          return NULL;
+        }
+
+      // The quote is escaped only by an odd run of backslashes before it
+      const char *backslash = quote;
+      while (backslash > p && backslash[-1] == '\\')
+        {
+          backslash--;
+        }
+      if (escaped != NULL && memchr (p, '\\', (size_t)(quote - p)) != NULL)
+        {
+          *escaped = 1;
+        }
+      if (((quote - backslash) & 1) == 0)
+        {
+          return quote;
+        }
+      p = quote + 1;
+    }
+}
+
+#if JSON_SCAN_X86
+/*
+ * '[' and '{' differ only in bit 0x20, as do ']' and '}', so OR-ing that
+ * bit in turns both bracket pairs into a single compare each.
+ */
+
+__attribute__ ((target ("sse2"))) static void
+classify_block_sse2 (const char *block, BlockMasks *masks)
+{
+  const __m128i quote = _mm_set1_epi8 ('"');
+  const __m128i backslash = _mm_set1_epi8 ('\\');
+  const __m128i fold = _mm_set1_epi8 (0x20);
+  const __m128i open = _mm_set1_epi8 ('{');
+  const __m128i close = _mm_set1_epi8 ('}');
+
+  memset (masks, 0, sizeof (BlockMasks));
+  for (int i = 0; i < JSON_SCAN_BLOCK; i += 16)
+    {
+      __m128i bytes = _mm_loadu_si128 ((const __m128i *)(block + i));
+      __m128i folded = _mm_or_si128 (bytes, fold);
+      masks->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8 (
+                          _mm_cmpeq_epi8 (bytes, quote))
+                      << i;
+      masks->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8 (
+                              _mm_cmpeq_epi8 (bytes, backslash))
+                          << i;
+      masks->open |= (uint64_t)(uint16_t)_mm_movemask_epi8 (
+                         _mm_cmpeq_epi8 (folded, open))
+                     << i;
+      masks->close |= (uint64_t)(uint16_t)_mm_movemask_epi8 (
+                          _mm_cmpeq_epi8 (folded, close))
+                      << i;
+    }
+}
+
+__attribute__ ((target ("avx2"))) static void
+classify_block_avx2 (const char *block, BlockMasks *masks)
+{
+  const __m256i quote = _mm256_set1_epi8 ('"');
+  const __m256i backslash = _mm256_set1_epi8 ('\\');
+  const __m256i fold = _mm256_set1_epi8 (0x20);
+  const __m256i open = _mm256_set1_epi8 ('{');
+  const __m256i close = _mm256_set1_epi8 ('}');
+
+  memset (masks, 0, sizeof (BlockMasks));
+  for (int i = 0; i < JSON_SCAN_BLOCK; i += 32)
+    {
+      __m256i bytes = _mm256_loadu_si256 ((const __m256i *)(block + i));
+      __m256i folded = _mm256_or_si256 (bytes, fold);
+      masks->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8 (
+                          _mm256_cmpeq_epi8 (bytes, quote))
+                      << i;
+      masks->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8 (
+                              _mm256_cmpeq_epi8 (bytes, backslash))
+                          << i;
+      masks->open |= (uint64_t)(uint32_t)_mm256_movemask_epi8 (
+                         _mm256_cmpeq_epi8 (folded, open))
+                     << i;
+      masks->close |= (uint64_t)(uint32_t)_mm256_movemask_epi8 (
+                          _mm256_cmpeq_epi8 (folded, close))
+                      << i;
+    }
+}
+#endif
+
+/**
+ * Whether this CPU can run an instruction set.
+ * @param isa Instruction set
+ * @return Non-zero if supported
+ */
+static int
+isa_supported (JsonScanIsa isa)
+{
+  switch (isa)
+    {
+    case JSON_SCAN_ISA_AUTO:
+    case JSON_SCAN_ISA_SCALAR:
+      return 1;
+#if JSON_SCAN_X86
+    case JSON_SCAN_ISA_SSE2:
+      return __builtin_cpu_supports ("sse2");
+    case JSON_SCAN_ISA_AVX2:
+      return __builtin_cpu_supports ("avx2");
+#endif
+    default:
+      return 0;
+    }
+}
+
+/**
+ * Force the instruction set used to skip containers, e.g. to compare them
+ * in a benchmark. Must be called before scanning starts on any thread.
+ * @param isa Instruction set, JSON_SCAN_ISA_AUTO for run-time detection
+ * @return 0 on success, -1 if this CPU does not support it
+ */
+int
+json_scan_set_isa (JsonScanIsa isa)
+{
+  if (!isa_supported (isa))
+    {
+      return -1;
+    }
+  requested_isa = isa;
+  return 0;
+}
+
+/**
+ * Instruction set in use: the forced one, else the best this CPU has.
+ * @return Instruction set (never JSON_SCAN_ISA_AUTO)
+ */
+JsonScanIsa
+json_scan_active_isa (void)
+{
+  if (requested_isa != JSON_SCAN_ISA_AUTO)
+    {
+      return requested_isa;
+    }
+  if (isa_supported (JSON_SCAN_ISA_AVX2))
+    {
+      return JSON_SCAN_ISA_AVX2;
+    }
+  if (isa_supported (JSON_SCAN_ISA_SSE2))
+    {
+      return JSON_SCAN_ISA_SSE2;
+    }
+  return JSON_SCAN_ISA_SCALAR;
+}
+
+/**
+ * Name of an instruction set, for reports.
+ * @param isa Instruction set
+ * @return Static string
+ */
+const char *
+json_scan_isa_name (JsonScanIsa isa)
+{
+  return (size_t)isa < sizeof (isa_names) / sizeof (isa_names[0])
+             ? isa_names[isa]
+             : "unknown";
+}
+
+/**
+ * Positions escaped by a backslash, given the backslashes of a block.
+ * Odd-length runs escape the byte after them; the carry says whether the
+ * previous block ended in the middle of one.
+ * @param backslash Backslash mask
+ * @param carry In: first byte is escaped; out: same for the next block
+ * @return Mask of escaped bytes
+ */
+static uint64_t
+escaped_positions (uint64_t backslash, uint64_t *carry)
+{
+  const uint64_t even = 0x5555555555555555ULL;
+  backslash &= ~*carry;
+  uint64_t follows_escape = backslash << 1 | *carry;
+
+  // Adding the odd-position run starts propagates a carry through each
+  // run; which runs flip the even/odd pattern falls out of the sum
+  uint64_t odd_starts = backslash & ~even & ~follows_escape;
+  uint64_t even_runs;
+  *carry = __builtin_add_overflow (odd_starts, backslash, &even_runs);
+  return (even ^ (even_runs << 1)) & follows_escape;
+}
+
+/**
+ * Bits between each pair of quotes: bit i is the parity of the quotes at
+ * or before position i.
+ */
+static uint64_t
+prefix_xor (uint64_t bits)
+{
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+/**
+ * Vector container skip in the style of a simdjson structural index: each
+ * block is classified into quote, backslash and bracket bitmaps, escaped
+ * quotes and in-string brackets are masked out with bit arithmetic, and
+ * the brackets left only need counting. Blocks that cannot close the
+ * container are counted with popcount alone.
+ * @param p Opening bracket
+ * @param end End of input
+ * @param classify Block classifier for the instruction set in use
+ * @return Pointer past the matching bracket, NULL if unterminated
+ */
+static const char *
+skip_container_blocks (const char *p, const char *end,
+                       BlockClassifier classify)
+{
+  uint64_t escape_carry = 0;
+  uint64_t string_carry = 0; // all ones while inside a string
+  size_t depth = 0;
+  char tail[JSON_SCAN_BLOCK];
+
+  for (; p < end; p += JSON_SCAN_BLOCK)
+    {
+      const char *block = p;
+      size_t available = (size_t)(end - p);
+      if (available < JSON_SCAN_BLOCK)
+        {
+          // Pad the last block with whitespace rather than read past end
+          memset (tail, ' ', sizeof (tail));
+          memcpy (tail, p, available);
+          block = tail;
+        }
+
+      BlockMasks masks;
+      classify (block, &masks);
+      uint64_t quotes
+          = masks.quote & ~escaped_positions (masks.backslash, &escape_carry);
+      uint64_t in_string = prefix_xor (quotes) ^ string_carry;
+      string_carry = (uint64_t)0 - (in_string >> 63);
+
+      uint64_t open = masks.open & ~in_string;
+      uint64_t close = masks.close & ~in_string;
+      size_t closes = (size_t)__builtin_popcountll (close);
+      if (depth > closes)
+        {
+          depth = depth + (size_t)__builtin_popcountll (open) - closes;
+          continue;
+        }
+
+      for (uint64_t brackets = open | close; brackets != 0;
+           brackets &= brackets - 1)
+        {
+          int bit = __builtin_ctzll (brackets);
+          if (open >> bit & 1)
+            {
+              depth++;
+            }
+          else if (--depth == 0)
+            {
+              return p + bit + 1;
+            }
+        }
+    }
+  return NULL;
+}
+
+/**
+ * Byte-at-a-time container skip, for CPUs without vector support.
+ * @param p Opening bracket
+ * @param end End of input
+ * @return Pointer past the matching bracket, NULL if unterminated
+ */
+static const char *
+skip_container_scalar (const char *p, const char *end)
+{
+  size_t depth = 0;
+  while (p < end)
+    {
+      char c = *p++;
+      if (c == '"')
+        {
+          p = find_string_end (p, end, NULL);
+          if (p == NULL)
+            {
+              return NULL;
+            }
+          p++;
+        }
+      else if (c == '{' || c == '[')
+        {
+          depth++;
+        }
+      else if ((c == '}' || c == ']') && --depth == 0)
+        {
+          return p;
+        }
+    }
+  return NULL;
+}
+
+/**
+ * Skip an object or array with the instruction set in use.
+ * @param p Opening bracket
+ * @param end End of input
+ * @return Pointer past the matching bracket, NULL if unterminated
+ */
+static const char *
+skip_container (const char *p, const char *end)
+{
+  switch (json_scan_active_isa ())
+    {
+#if JSON_SCAN_X86
+    case JSON_SCAN_ISA_AVX2:
+      return skip_container_blocks (p, end, classify_block_avx2);
+    case JSON_SCAN_ISA_SSE2:
+      return skip_container_blocks (p, end, classify_block_sse2);
+#endif
+    default:
+      return skip_container_scalar (p, end);
+    }
+}
+
+/**
+ * Start scanning a JSON text.
+ * @param scanner Scanner to initialize
+ * @param text JSON text (need not be NUL-terminated)
+ * @param length Length of the text
+ */
+void
+json_scan_init (JsonScanner *scanner, const char *text, size_t length)
+{
+  scanner->position = text;
+  scanner->end = text + length;
+  scanner->error = NULL;
+}
+
+/**
+ * Classify the next value without consuming it.
+ * @param scanner Scanner
+ * @return Type of the next value, JSON_SCAN_INVALID at end or on error
+ */
+JsonScanType
+json_scan_peek (JsonScanner *scanner)
+{
+  skip_whitespace (scanner);
+  if (scanner->error != NULL || scanner->position >= scanner->end)
+    {
+      return JSON_SCAN_INVALID;
+    }
+
+  switch (*scanner->position)
+    {
+    case '{':
+      return JSON_SCAN_OBJECT;
+    case '[':
+      return JSON_SCAN_ARRAY;
+    case '"':
+      return JSON_SCAN_STRING;
+    case 't':
+    case 'f':
+    case 'n':
+      return JSON_SCAN_LITERAL;
+    default:
+      if (*scanner->position == '-'
+          || (*scanner->position >= '0' && *scanner->position <= '9'))
+        {
+          return JSON_SCAN_NUMBER;
+        }
+      return JSON_SCAN_INVALID;
+    }
+}
+
+/**
+ * Skip the next value. Containers are skipped by matching brackets, with
+ * strings inside them jumped over, so nothing inside them is parsed or
+ * validated. Large subtrees (fragment lists, captions) are skipped 64
+ * bytes at a time where the CPU has SSE2 or AVX2.
+ * @param scanner Scanner
+ * @return 0 on success, -1 on error
+ */
+int
+json_scan_skip (JsonScanner *scanner)
+{
+  JsonScanType type = json_scan_peek (scanner);
+  const char *p = scanner->position;
+  const char *end = scanner->end;
+
+  switch (type)
+    {
+    case JSON_SCAN_STRING:
+      p = find_string_end (p + 1, end, NULL);
+      if (p == NULL)
+        {
+          return scan_fail (scanner);
+        }
+      scanner->position = p + 1;
+      return 0;
+
+    case JSON_SCAN_NUMBER:
+    case JSON_SCAN_LITERAL:
+      while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' '
+             && *p != '\n' && *p != '\r' && *p != '\t')
+        {
+          p++;
+        }
+      scanner->position = p;
+      return 0;
+
+    case JSON_SCAN_OBJECT:
+    case JSON_SCAN_ARRAY:
+      p = skip_container (p, end);
+      if (p == NULL)
+        {
+          scanner->position = end;
+          return scan_fail (scanner);
+        }
+      scanner->position = p;
+      return 0;
+
+    default:
+      return scan_fail (scanner);
+    }
+}
+
+/**
+ * Step into an object or array.
+ * @param scanner Scanner
+ * @param type JSON_SCAN_OBJECT or JSON_SCAN_ARRAY
+ * @return 0 on success, -1 if the next value is of another type
+ */
+int
+json_scan_enter (JsonScanner *scanner, JsonScanType type)
+{
+  if (json_scan_peek (scanner) != type)
+    {
+      return scan_fail (scanner);
+    }
+  scanner->position++;
+  return 0;
+}
+
+/**
+ * Advance to the next member of the object being scanned. On success the
+ * scanner is positioned at the member's value, which the caller must
+ * consume (read or skip) before asking for the next member.
+ * @param scanner Scanner inside an object
+ * @param first Set to 1 before the first call; maintained by the scanner
+ * @param key Receives the member name
+ * @return 1 for a member, 0 at the end of the object, -1 on error
+ */
+int
+json_scan_next_member (JsonScanner *scanner, int *first, JsonSpan *key)
+{
+  skip_whitespace (scanner);
+  if (scanner->position >= scanner->end)
+    {
+      return scan_fail (scanner);
+    }
+  if (*scanner->position == '}')
+    {
+      scanner->position++;
+      return 0;
+    }
+  if (!*first)
+    {
+      if (*scanner->position != ',')
+        {
+          return scan_fail (scanner);
+        }
+      scanner->position++;
+    }
+  *first = 0;
+
+  if (json_scan_string (scanner, key) != 0)
+    {
+      return -1;
+    }
+  skip_whitespace (scanner);
+  if (scanner->position >= scanner->end || *scanner->position != ':')
+    {
+      return scan_fail (scanner);
+    }
+  scanner->position++;
+  return 1;
+}
+
+/**
+ * Advance to the next element of the array being scanned. On success the
+ * scanner is positioned at the element, which the caller must consume.
+ * @param scanner Scanner inside an array
+ * @param first Set to 1 before the first call; maintained by the scanner
+ * @return 1 for an element, 0 at the end of the array, -1 on error
+ */
+int
+json_scan_next_element (JsonScanner *scanner, int *first)
+{
+  skip_whitespace (scanner);
+  if (scanner->position >= scanner->end)
+    {
+      return scan_fail (scanner);
+    }
+  if (*scanner->position == ']')
+    {
+      scanner->position++;
+      return 0;
+    }
+  if (!*first)
+    {
+      if (*scanner->position != ',')
+        {
+          return scan_fail (scanner);
+        }
+      scanner->position++;
+    }
+  *first = 0;
+  return 1;
+}
+
+/**
+ * Read a string value as a span of the input.
+ * @param scanner Scanner
+ * @param span Receives the raw contents
+ * @return 0 on success, -1 if the next value is not a string
+ */
+int
+json_scan_string (JsonScanner *scanner, JsonSpan *span)
+{
+  if (json_scan_peek (scanner) != JSON_SCAN_STRING)
+    {
+      return scan_fail (scanner);
+    }
+
+  const char *start = scanner->position + 1;
+  int escaped = 0;
+  const char *quote = find_string_end (start, scanner->end, &escaped);
+  if (quote == NULL)
+    {
+      return scan_fail (scanner);
+    }
+
+  span->start = start;
+  span->length = (size_t)(quote - start);
+  span->escaped = escaped;
+  scanner->position = quote + 1;
+  return 0;
+}
+
+/**
+ * Read a number value.
+ * @param scanner Scanner
+ * @param value Receives the value
+ * @param integral Set to 1 if the literal has no fraction or exponent
+ * @return 0 on success, -1 if the next value is not a valid number
+ */
+int
+json_scan_number (JsonScanner *scanner, double *value, int *integral)
+{
+  if (json_scan_peek (scanner) != JSON_SCAN_NUMBER)
+    {
+      return scan_fail (scanner);
+    }
+
+  // Copy the literal out: the input is not NUL-terminated
+  char literal[JSON_SCAN_NUMBER_MAX + 1];
+  size_t length = 0;
+  int is_integral = 1;
+  const char *p = scanner->position;
+  while (p < scanner->end && length < JSON_SCAN_NUMBER_MAX
+         && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.'
+             || *p == 'e' || *p == 'E'))
+    {
+      if (*p == '.' || *p == 'e' || *p == 'E')
+        {
+          is_integral = 0;
+        }
+      literal[length++] = *p++;
+    }
+  literal[length] = '\0';
+
+  char *parsed_end;
+  double parsed = strtod (literal, &parsed_end);
+  if (length == 0 || parsed_end != literal + length)
+    {
+      return scan_fail (scanner);
+    }
+
+  *value = parsed;
+  *integral = is_integral;
+  scanner->position = p;
+  return 0;
+}
+
+/**
+ * Compare a span with a plain string (escaped spans never match: none of
+ * the names looked up need escapes).
+ * @param span Span to compare
+ * @param text NUL-terminated string
+ * @return Non-zero if equal
+ */
+int
+json_span_equals (const JsonSpan *span, const char *text)
+{
+  return !span->escaped && strncmp (span->start, text, span->length) == 0
+         && text[span->length] == '\0';
+}
+
+/**
+ * Parse four hex digits of a \u escape.
+ * @return Code unit, -1 if invalid
+ */
+static long
+parse_hex4 (const char *p, const char *end)
+{
+  if (end - p < 4)
+    {
+      return -1;
+    }
+  long value = 0;
+  for (int i = 0; i < 4; i++)
+    {
+      char c = p[i];
+      int digit = (c >= '0' && c <= '9')   ? c - '0'
+                  : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                  : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+                                           : -1;
+      if (digit < 0)
+        {
+          return -1;
+        }
+      value = value * 16 + digit;
+    }
+  return value;
+}
+
+/**
+ * Encode a code point as UTF-8.
+ * @return Bytes written
+ */
+static size_t
+encode_utf8 (unsigned long code_point, char *out)
+{
+  if (code_point < 0x80)
+    {
+      out[0] = (char)code_point;
+      return 1;
+    }
+  if (code_point < 0x800)
+    {
+      out[0] = (char)(0xC0 | (code_point >> 6));
+      out[1] = (char)(0x80 | (code_point & 0x3F));
+      return 2;
+    }
+  if (code_point < 0x10000)
+    {
+      out[0] = (char)(0xE0 | (code_point >> 12));
+      out[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+      out[2] = (char)(0x80 | (code_point & 0x3F));
+      return 3;
+    }
+  out[0] = (char)(0xF0 | (code_point >> 18));
+  out[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+  out[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+  out[3] = (char)(0x80 | (code_point & 0x3F));
+  return 4;
+}
+
+/**
+ * Decode a string span into a NUL-terminated buffer. The decoded text is
+ * never longer than the raw span, so span->length + 1 bytes always
+ * suffice. Lone surrogates become U+FFFD, malformed \u escapes '?'.
+ * @param span String span
+ * @param buffer Output buffer of at least span->length + 1 bytes
+ * @return Decoded length, excluding the terminator
+ */
+size_t
+json_span_decode (const JsonSpan *span, char *buffer)
+{
+  if (!span->escaped)
+    {
+      memcpy (buffer, span->start, span->length);
+      buffer[span->length] = '\0';
+      return span->length;
+    }
+
+  const char *p = span->start;
+  const char *end = span->start + span->length;
+  char *out = buffer;
+  while (p < end)
+    {
+      if (*p != '\\' || p + 1 >= end)
+        {
+          *out++ = *p++;
+          continue;
+        }
+
+      char escape = p[1];
+      p += 2;
+      switch (escape)
+        {
+        case 'b':
+          *out++ = '\b';
+          break;
+        case 'f':
+          *out++ = '\f';
+          break;
+        case 'n':
+          *out++ = '\n';
+          break;
+        case 'r':
+          *out++ = '\r';
+          break;
+        case 't':
+          *out++ = '\t';
+          break;
+        case 'u':
+          {
+            long unit = parse_hex4 (p, end);
+            if (unit < 0)
+              {
+                // Too short to hold U+FFFD's three bytes
+                *out++ = '?';
+                break;
+              }
+            p += 4;
+            unsigned long code_point = (unsigned long)unit;
+            if (unit >= 0xD800 && unit <= 0xDBFF)
+              {
+                // A high surrogate needs its low half (12 raw bytes become
+                // at most 4 decoded ones)
+                long low = (end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                               ? parse_hex4 (p + 2, end)
+                               : -1;
+                if (low >= 0xDC00 && low <= 0xDFFF)
+                  {
+                    code_point
+                        = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                  }
+                else
+                  {
+                    code_point = 0xFFFD;
+                  }
+              }
+            else if (unit >= 0xDC00 && unit <= 0xDFFF)
+              {
+                code_point = 0xFFFD;
+              }
+            out += encode_utf8 (code_point, out);
+            break;
+          }
+        default:
+          // \" \\ \/ and anything unknown stand for themselves
+          *out++ = escape;
+          break;
+        }
+    }
+  *out = '\0';
+  return (size_t)(out - buffer);
+}
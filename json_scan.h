@@ -0,0 +1,60 @@
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <stddef.h>
+
+// Read-only cursor over a JSON text. Nothing is allocated: values the
+// caller is not interested in are skipped by bracket matching, and strings
+// are returned as spans of the input.
+typedef struct
+{
+  const char *position;
+  const char *end;
+  const char *error; // where scanning failed, NULL while the text is valid
+} JsonScanner;
+
+// Raw string contents between the quotes, escapes not yet decoded
+typedef struct
+{
+  const char *start;
+  size_t length;
+  int escaped; // contains backslash escapes
+} JsonSpan;
+
+// Kind of the next value
+typedef enum
+{
+  JSON_SCAN_INVALID,
+  JSON_SCAN_OBJECT,
+  JSON_SCAN_ARRAY,
+  JSON_SCAN_STRING,
+  JSON_SCAN_NUMBER,
+  JSON_SCAN_LITERAL // true, false or null
+} JsonScanType;
+
+// Instruction set used to skip containers (see json_scan_set_isa)
+typedef enum
+{
+  JSON_SCAN_ISA_AUTO, // best the CPU supports, chosen at run time
+  JSON_SCAN_ISA_SCALAR,
+  JSON_SCAN_ISA_SSE2,
+  JSON_SCAN_ISA_AVX2
+} JsonScanIsa;
+
+// clang-format off
+int json_scan_set_isa(JsonScanIsa isa);
+JsonScanIsa json_scan_active_isa(void);
+const char *json_scan_isa_name(JsonScanIsa isa);
+void json_scan_init(JsonScanner *scanner, const char *text, size_t length);
+JsonScanType json_scan_peek(JsonScanner *scanner);
+int json_scan_skip(JsonScanner *scanner);
+int json_scan_enter(JsonScanner *scanner, JsonScanType type);
+int json_scan_next_member(JsonScanner *scanner, int *first, JsonSpan *key);
+int json_scan_next_element(JsonScanner *scanner, int *first);
+int json_scan_string(JsonScanner *scanner, JsonSpan *span);
+int json_scan_number(JsonScanner *scanner, double *value, int *integral);
+int json_span_equals(const JsonSpan *span, const char *text);
+size_t json_span_decode(const JsonSpan *span, char *buffer);
+// clang-format on
+
+#endif
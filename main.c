@@ -23,12 +23,49 @@
  *   - Download the selected video format to a specified or current directory.
  *
  * Usage:
- *   ./ytdl [OPTIONS] URL
+ *   ./ytdl [OPTIONS] URL...
  *
  *   Options:
  *     -h, --help            Display this help message and exit.
  *     -o, --output PATH     Specify the output directory for downloaded
  * videos. Defaults to the current working directory if not provided.
+ *     -t, --timeout SECONDS Stop any yt-dlp run that takes longer.
+ *         --max-memory MB   Cap the address space of each yt-dlp run.
+ *         --max-cpu SECONDS Cap the CPU time of each yt-dlp run.
+ *         --zygote          Import yt_dlp once in a helper (python3, or
+ *                           $YTDL_PYTHON) and fork each yt-dlp run from it.
+ *     -f, --format FORMAT   Download FORMAT immediately, skipping the metadata
+ *                           fetch and the format prompt.
+ *         --stats           Print how long each phase took.
+ *         --lean            Ask yt-dlp for only the fields ytdl displays
+ *                           instead of the full JSON document.
+ *         --archive PATH    Append each fetched info JSON to a zstd archive
+ *                           (with an index and a trained dictionary).
+ *         --playlist        Treat every URL as a playlist or channel. Their
+ *                           entries are downloaded (in FORMAT, or the best
+ *                           quality) while the listing is still running.
+ *         --list-shards N   List playlists as ranges of 500 entries with N
+ *                           concurrent yt-dlp runs, queued in playlist
+ *                           order.
+ *     -j, --jobs N          Download every URL as a job of its own, N at
+ *                           once, and sum up the run at the end. Exits
+ *                           with 2 if only some of the jobs succeeded.
+ *     -a, --batch-file FILE Also download the URLs in FILE, one per line
+ *                           ('-' reads them from stdin).
+ *     -r, --limit-rate RATE Cap the combined rate of all downloads (50M,
+ *                           800Mbit), or give HH:MM=RATE,... profiles by
+ *                           time of day. Running jobs share the budget and
+ *                           the share of slow ones goes to faster ones.
+ *         --journal FILE    Record every job's state in FILE. Run again
+ *                           with the same FILE (and URLs, or none) after
+ *                           an interruption to resume only the unfinished
+ *                           jobs, continuing their partial files.
+ *         --connections K   Download single videos (chosen at the prompt
+ *                           or with -f) with K parallel range requests
+ *                           instead of yt-dlp, when the format is one plain
+ *                           HTTP file (not HLS or DASH fragments, not
+ *                           merged). Not for -j, -a, --journal or
+ *                           playlists.
  *
  *   Examples:
  *     - Display help message:
@@ -40,6 +77,23 @@
  *     - Download a video to a specified directory:
  *         ./ytdl -o /path/to/download https://www.youtube.com/watch?v=example
  *
+ *     - Download a known format from a script:
+ *         ./ytdl -f 22 https://www.youtube.com/watch?v=example
+ *
+ *     - Download a whole playlist:
+ *         ./ytdl https://www.youtube.com/playlist?list=example
+ *
+ *     - Download a list of URLs, eight at a time:
+ *         ./ytdl -j 8 -a urls.txt
+ *
+ *     - The same within 800 Mbit/s, or 200 Mbit/s during office hours:
+ *         ./ytdl -j 8 -r 800Mbit -a urls.txt
+ *         ./ytdl -j 8 -r 09:00=200Mbit,18:00=800Mbit -a urls.txt
+ *
+ *     - A batch that survives a reboot; the second command resumes it:
+ *         ./ytdl -j 8 --journal urls.journal -a urls.txt
+ *         ./ytdl -j 8 --journal urls.journal
+ *
  * Dependencies:
  *   - yt-dlp: Ensure that yt-dlp is installed
  * https://github.com/yt-dlp/yt-dlp.
@@ -52,20 +106,44 @@
  *
  * Compilation:
  *   To compile the program: make all
+ *   To extract metadata in-process through libpython instead of running
+ *   `yt-dlp -j`: make USE_EMBEDDED_PYTHON=1 (needs python3-embed and an
+ *   importable yt_dlp module; falls back to the subprocess otherwise)
+ *   The info JSON archive (--archive) needs libzstd; it is enabled when
+ *   pkg-config finds it, or with make USE_ZSTD=1
+ *   The native range downloader (--connections) needs libcurl; likewise
+ *   enabled when pkg-config finds it, or with make USE_CURL=1
  *
  * https://www.x.com/tetsuoai
  * ---------------------------------------------------------------------------
  */
 
+#define _GNU_SOURCE
 #include "argument_parsing.h"
 #include "command_execution.h"
 #include "directory_management.h"
 #include "download_helpers.h"
+#include "download_jobs.h"
+#include "download_queue.h"
 #include "format_parsing.h"
 #include "help_display.h"
 #include "user_interaction.h"
+#include "json_arena.h"
+#include "metadata_cache.h"
+#include "playlist.h"
+#include "url_feeder.h"
+#include "util.h"
 #include "video_info.h"
 #include "ytdl.h"
+#include "zygote.h"
+
+#if USE_EMBEDDED_PYTHON
+#include "python_backend.h"
+#endif
+
+#if USE_ZSTD
+#include "info_archive.h"
+#endif
 
 #if USE_NCURSES
 #include "terminal_ui.h"
@@ -74,12 +152,74 @@ UIState *g_current_ui_state = NULL;
 DownloadProgress *g_current_progress = NULL;
 #endif
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <time.h>
 #include <unistd.h>
 
+// Wall-clock time spent in each phase, reported by --stats (summed over
+// the videos of a batch)
+typedef struct
+{
+  double start_ms;
+  double metadata_ms;  // yt-dlp -j and parsing; 0 when skipped
+  double selection_ms; // format display and prompt, including user time
+  double download_ms;
+} PhaseTimings;
+
+// State shared by the videos of one run
+typedef struct
+{
+  PhaseTimings timings;
+#if USE_NCURSES
+  UIState ui_state;
+  bool use_ui;
+#endif
+} Session;
+
+// How the handling of one video ended
+typedef enum
+{
+  VIDEO_DONE,
+  VIDEO_FAILED,
+  VIDEO_CANCELLED // no format was chosen
+} VideoOutcome;
+
+/**
+ * Print the per-phase timings to stderr.
+ * @param timings Timings collected so far
+ */
+static void
+print_phase_timings (const PhaseTimings *timings)
+{
+  fprintf (stderr,
+           "Timing: metadata %.1f ms, selection %.1f ms, download %.1f ms, "
+           "total %.1f ms\n",
+           timings->metadata_ms, timings->selection_ms, timings->download_ms,
+           monotonic_ms () - timings->start_ms);
+}
+
+/**
+ * Print jansson allocation counts and the peak resident set to stderr.
+ */
+static void
+print_memory_stats (void)
+{
+  JsonArenaStats arena;
+  json_arena_get_stats (&arena);
+  struct rusage usage;
+  long peak_rss_kb = getrusage (RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss
+                                                          : 0;
+  fprintf (stderr,
+           "Memory: peak RSS %.1f MB, json %lu allocations in %lu arena "
+           "blocks (%.1f KB peak) + %lu from the heap\n",
+           peak_rss_kb / 1024.0, arena.arena_allocations, arena.blocks,
+           arena.peak_reserved / 1024.0, arena.heap_allocations);
+}
+
 /**
  * Validate configuration structure for required fields.
  * @param config Configuration structure to validate
@@ -94,7 +234,9 @@ validate_config (const Config *config)
       return -1;
     }
 
-  if (config->url == NULL)
+  // A batch file or a journal can be the only source of URLs
+  if (config->url == NULL && config->batch_file == NULL
+      && config->journal_path == NULL)
     {
       fprintf (stderr, "Error: URL is not set\n");
       return -1;
@@ -106,8 +248,18 @@ validate_config (const Config *config)
       return -1;
     }
 
+  // The job queue and playlists run yt-dlp for each download themselves
+  if (config->connections > 0
+      && (config->jobs > 0 || config->batch_file != NULL
+          || config->journal_path != NULL || config->force_playlist))
+    {
+      fprintf (stderr, "Error: --connections applies to single videos, not "
+                       "to -j, -a, --journal or --playlist\n");
+      return -1;
+    }
+
   // Validate URL length
-  size_t url_len = strlen (config->url);
+  size_t url_len = config->url != NULL ? strlen (config->url) : 1;
   if (url_len == 0 || url_len >= MAX_URL_LENGTH)
     {
       fprintf (stderr, "Error: Invalid URL length (%zu)\n", url_len);
@@ -133,9 +285,38 @@ validate_config (const Config *config)
 static int
 display_config_info (const Config *config)
 {
-  if (printf ("URL: %s\n", config->url) < 0)
+  for (size_t i = 0; i < config->url_count; i++)
+    {
+      if (printf ("URL: %s\n", config->urls[i]) < 0)
+        {
+          fprintf (stderr, "Error: Failed to display URL\n");
+          return -1;
+        }
+    }
+
+  if (config->batch_file != NULL
+      && printf ("Batch file: %s\n", strcmp (config->batch_file,
+                                              BATCH_FILE_STDIN)
+                                              == 0
+                                          ? "(stdin)"
+                                          : config->batch_file)
+             < 0)
+    {
+      fprintf (stderr, "Error: Failed to display batch file\n");
+      return -1;
+    }
+
+  if (config->rate_limit != NULL
+      && printf ("Rate limit: %s\n", config->rate_limit) < 0)
+    {
+      fprintf (stderr, "Error: Failed to display rate limit\n");
+      return -1;
+    }
+
+  if (config->journal_path != NULL
+      && printf ("Journal: %s\n", config->journal_path) < 0)
     {
-      fprintf (stderr, "Error: Failed to display URL\n");
+      fprintf (stderr, "Error: Failed to display journal\n");
       return -1;
     }
 
@@ -149,149 +330,277 @@ display_config_info (const Config *config)
 }
 
 /**
- * Main application entry point with comprehensive error handling.
- * @param argc Argument count
- * @param argv Argument vector
+ * Download a format given on the command line without fetching metadata
+ * first. Title, path and size come from yt-dlp's report of the download.
+ * @param config Configuration with format_selector set
+ * @param timings Receives the download time
  * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
  */
-int
-main (int argc, char *argv[])
+static int
+download_direct (const Config *config, PhaseTimings *timings)
 {
-  // Initialize configuration structure explicitly
-  Config config = { .url = NULL, .output_path = NULL };
-
-  int result = EXIT_FAILURE; // Default to failure
+  DownloadReport report;
+  double start = monotonic_ms ();
+  int status = download_video (config, config->format_selector, &report);
+  timings->download_ms += monotonic_ms () - start;
 
-  // Parse command line arguments
-  if (parse_arguments (argc, argv, &config) != EXIT_SUCCESS)
+  if (status != EXIT_SUCCESS)
     {
-      goto cleanup;
+      fprintf (stderr, "Error: Video download failed\n");
+      return EXIT_FAILURE;
     }
 
-  // Initialize output path
-  if (initialize_output_path (&config) != EXIT_SUCCESS)
+  if (report.title != NULL)
     {
-      goto cleanup;
+      printf ("Title: %s\n", report.title);
     }
-
-  // Validate configuration
-  if (validate_config (&config) != 0)
+  if (report.filepath != NULL)
     {
-      goto cleanup;
+      printf ("File: %s\n", report.filepath);
     }
-
-  // Display configuration information
-  if (display_config_info (&config) != 0)
+  if (report.size >= 0)
     {
-      goto cleanup;
+      printf ("Size: %lld bytes\n", report.size);
     }
+  free_download_report (&report);
+  return EXIT_SUCCESS;
+}
 
-#if USE_NCURSES
-  // Initialize terminal UI if available
-  UIState ui_state;
-  bool use_ui = false;
-
-  if (ui_init (&ui_state) == 0)
+/**
+ * Download every entry of a playlist or channel while it is being listed:
+ * entry 1 downloads as soon as yt-dlp has printed it, and the listing waits
+ * whenever DOWNLOAD_QUEUE_CAPACITY entries are ahead of the downloads. A
+ * failed entry does not stop the others; Ctrl-C stops both sides.
+ * @param config Configuration with url set to the playlist
+ * @param timings Receives the download time
+ * @return EXIT_SUCCESS if the playlist was listed and every entry
+ *         downloaded, EXIT_FAILURE otherwise
+ */
+static int
+download_playlist (Config *config, PhaseTimings *timings)
+{
+  const char *playlist_url = config->url;
+  if (config->connections > 0)
     {
-      use_ui = true;
-      // Display initial status
-      ui_show_status (&ui_state, "Fetching video information...");
+      fprintf (stderr, "Warning: --connections does not apply to playlist "
+                       "entries; yt-dlp downloads them\n");
+    }
+  DownloadQueue *queue = download_queue_create (DOWNLOAD_QUEUE_CAPACITY);
+  if (queue == NULL)
+    {
+      return EXIT_FAILURE;
+    }
+  PlaylistReader reader;
+  if (playlist_open (&reader, playlist_url, (int)config->list_shards, queue)
+      != 0)
+    {
+      fprintf (stderr, "Error: Failed to list playlist %s\n", playlist_url);
+      download_queue_destroy (queue);
+      return EXIT_FAILURE;
     }
-#endif
 
-  // Get video information
-  char *json_str = get_video_info (config.url);
-  if (json_str == NULL)
+  int result = EXIT_SUCCESS;
+  size_t downloaded = 0;
+  QueuedVideo video;
+  while (download_queue_pop (queue, &video) == 1)
     {
-      fprintf (stderr, "Error: Failed to retrieve video information\n");
-#if USE_NCURSES
-      if (use_ui)
+      printf ("Playlist entry %zu: %s\n", video.index, video.url);
+      config->url = video.url;
+      if (download_direct (config, timings) == EXIT_SUCCESS)
         {
-          ui_show_error (&ui_state, "Failed to retrieve video information");
-          sleep (2);
-          ui_cleanup (&ui_state);
+          downloaded++;
+        }
+      else
+        {
+          result = EXIT_FAILURE;
+        }
+      if (command_cancel_requested ())
+        {
+          download_queue_abandon (queue);
+          break;
         }
-#endif
-      goto cleanup;
     }
+  config->url = playlist_url;
 
-  // Parse video formats
-  json_t *formats = parse_formats (json_str);
+  if (playlist_close (&reader) != 0)
+    {
+      fprintf (stderr, "Error: Listing of %s did not complete\n",
+               playlist_url);
+      result = EXIT_FAILURE;
+    }
+  printf ("Playlist: %zu of %zu entries downloaded\n", downloaded,
+          reader.entries);
+  download_queue_destroy (queue);
+  return result;
+}
 
-  // Extract video info for UI display
-#if USE_NCURSES
-  VideoDisplayInfo video_info = { 0 };
-  bool video_info_allocated = false;
-  if (use_ui && formats != NULL)
-    {
-      // Parse video title and other info from JSON
-      json_error_t error;
-      json_t *root = json_loads (json_str, 0, &error);
-      if (root)
+/**
+ * Whether the run includes a playlist or channel.
+ * @param config Configuration
+ */
+static bool
+has_playlist (const Config *config)
+{
+  for (size_t i = 0; i < config->url_count; i++)
+    {
+      if (config->force_playlist || is_playlist_url (config->urls[i]))
         {
-          json_t *title_obj = json_object_get (root, "title");
-          json_t *channel_obj = json_object_get (root, "channel");
-          json_t *duration_obj = json_object_get (root, "duration");
-
-          if (title_obj && json_is_string (title_obj))
-            {
-              video_info.title = strdup (json_string_value (title_obj));
-              video_info_allocated = true;
-            }
-          if (channel_obj && json_is_string (channel_obj))
-            {
-              video_info.channel = strdup (json_string_value (channel_obj));
-              video_info_allocated = true;
-            }
-          if (duration_obj && json_is_integer (duration_obj))
-            {
-              int duration_seconds = json_integer_value (duration_obj);
-              video_info.duration = malloc (32);
-              if (video_info.duration)
-                {
-                  ui_format_time (duration_seconds, video_info.duration, 32);
-                  video_info_allocated = true;
-                }
-            }
-
-          json_decref (root);
+          return true;
         }
     }
-#endif
-
-  free (json_str); // Free immediately after parsing
-  json_str = NULL;
+  return false;
+}
 
-  if (formats == NULL)
+/**
+ * Download every URL of the run as a job of its own, up to -j at once: the
+ * command-line URLs, the entries of any playlist among them and the lines
+ * of the batch file, fed by a thread while the first jobs already run.
+ * With --journal, the jobs an earlier run left unfinished come first and
+ * those it finished are skipped.
+ * @param config Configuration
+ * @param timings Receives the download time
+ * @return EXIT_SUCCESS if every job completed, EXIT_PARTIAL if only some
+ *         did, EXIT_FAILURE if none did or a source could not be read
+ *         without anything downloading
+ */
+static int
+download_concurrently (const Config *config, PhaseTimings *timings)
+{
+  JobJournal *journal = NULL;
+  if (config->journal_path != NULL)
     {
-      fprintf (stderr, "Error: Failed to parse video formats\n");
-#if USE_NCURSES
-      if (use_ui)
+      JournalTotals totals;
+      journal = journal_open (config->journal_path, &totals);
+      if (journal == NULL)
         {
-          ui_show_error (&ui_state, "Failed to parse video formats");
-          sleep (2);
-          ui_cleanup (&ui_state);
+          return EXIT_FAILURE;
         }
+      printf ("Journal: %zu done, %zu failed, %zu to resume\n", totals.done,
+              totals.failed, totals.unfinished);
+    }
+  DownloadQueue *queue = download_queue_create (DOWNLOAD_QUEUE_CAPACITY);
+  if (queue == NULL)
+    {
+      journal_close (journal);
+      return EXIT_FAILURE;
+    }
+  UrlFeeder feeder;
+  if (url_feeder_start (&feeder, config, queue, journal) != 0)
+    {
+      download_queue_destroy (queue);
+      journal_close (journal);
+      return EXIT_FAILURE;
+    }
+
+  DownloadSummary summary;
+  int max_jobs = config->jobs > 0 ? (int)config->jobs : 1;
+  int status = run_download_jobs (config, queue, max_jobs, journal, &summary);
+  int fed = url_feeder_finish (&feeder);
+  download_queue_destroy (queue);
+  journal_close (journal);
+  timings->download_ms += summary.elapsed_ms;
+
+  print_download_summary (&summary);
+  int result = download_summary_exit_status (&summary);
+  if ((status != 0 || fed != 0) && result == EXIT_SUCCESS)
+    {
+      result = summary.done > 0 ? EXIT_PARTIAL : EXIT_FAILURE;
+    }
+  free_download_summary (&summary);
+  return result;
+}
+
+/**
+ * Append the video's info JSON to the archive, if one was requested.
+ * @param config Configuration with url and info_json_fd set for the video
+ */
+static void
+archive_video_info (const Config *config)
+{
+#if USE_ZSTD
+  // Keep the full document for auditing (lean and cached runs have none)
+  if (config->archive_path != NULL && config->info_json_fd >= 0
+      && archive_info_json (config->archive_path, config->url,
+                            config->info_json_fd)
+             != 0)
+    {
+      fprintf (stderr, "Warning: Failed to archive video info\n");
+    }
+#else
+  (void)config;
 #endif
-      goto cleanup;
+}
+
+/**
+ * Report a video whose information could not be retrieved.
+ * @param session Run state
+ */
+static void
+report_fetch_failure (Session *session)
+{
+  fprintf (stderr, "Error: Failed to retrieve video information\n");
+#if USE_NCURSES
+  if (session->use_ui)
+    {
+      ui_show_error (&session->ui_state,
+                     "Failed to retrieve video information");
+      sleep (2);
     }
+#else
+  (void)session;
+#endif
+}
 
+/**
+ * Show a video's formats, let the user choose one and download it.
+ * @param session Run state; selection and download times are added
+ * @param config Configuration with url and info_json_fd set for the video
+ * @param table Format table of the video (freed here)
+ * @return How handling the video ended
+ */
+static VideoOutcome
+select_and_download (Session *session, Config *config, FormatTable *table)
+{
+  archive_video_info (config);
+
+  double phase_start = monotonic_ms ();
   char *format_code = NULL;
 
 #if USE_NCURSES
-  if (use_ui)
+  if (session->use_ui)
     {
       // Display video info
-      ui_display_video_info (&ui_state, &video_info);
+      VideoDisplayInfo video_info = { 0 };
+      if (table->title != NULL)
+        {
+          video_info.title = strdup (table->title);
+        }
+      if (table->channel != NULL)
+        {
+          video_info.channel = strdup (table->channel);
+        }
+      if (table->duration >= 0)
+        {
+          video_info.duration = malloc (32);
+          if (video_info.duration)
+            {
+              ui_format_time ((int)table->duration, video_info.duration, 32);
+            }
+        }
+      ui_display_video_info (&session->ui_state, &video_info);
+      free (video_info.title);
+      free (video_info.channel);
+      free (video_info.duration);
 
       // Interactive format selection
       FormatListState list_state = { 0 };
-      ui_display_formats (&ui_state, formats, &list_state);
-      format_code = ui_select_format_interactive (&ui_state, &list_state);
+      ui_display_formats (&session->ui_state, table, &list_state);
+      format_code
+          = ui_select_format_interactive (&session->ui_state, &list_state);
 
       if (format_code == NULL)
         {
-          ui_show_status (&ui_state, "Download cancelled");
+          ui_show_status (&session->ui_state, "Download cancelled");
           sleep (1);
         }
     }
@@ -299,9 +608,7 @@ main (int argc, char *argv[])
     {
 #endif
       // Fallback to text-based display
-      display_formats (formats);
-      json_decref (formats);
-      formats = NULL;
+      display_formats (table);
 
       // Prompt user for format selection
       format_code = prompt_for_format ();
@@ -309,82 +616,295 @@ main (int argc, char *argv[])
     }
 #endif
 
+  free_format_table (table);
+
   if (format_code == NULL)
     {
       fprintf (stderr, "Error: Failed to get format selection from user\n");
-#if USE_NCURSES
-      if (use_ui)
-        {
-          ui_cleanup (&ui_state);
-        }
-#endif
-      goto cleanup;
+      return VIDEO_CANCELLED;
     }
 
-#if USE_NCURSES
-  // Cleanup formats if using UI (already cleaned up in text mode)
-  if (use_ui && formats != NULL)
-    {
-      json_decref (formats);
-      formats = NULL;
-    }
-#endif
+  session->timings.selection_ms += monotonic_ms () - phase_start;
 
-    // Download the video
+  // Download the video
 #if USE_NCURSES
-  if (use_ui)
+  DownloadProgress progress = { 0 };
+  if (session->use_ui)
     {
       // Show download progress UI
-      DownloadProgress progress = { 0 };
       progress.start_time = time (NULL);
       strcpy (progress.current_stage, "Starting download...");
-      ui_show_progress (&ui_state, &progress);
+      ui_show_progress (&session->ui_state, &progress);
 
       // Set global pointers for progress tracking
-      g_current_ui_state = &ui_state;
+      g_current_ui_state = &session->ui_state;
       g_current_progress = &progress;
     }
 #endif
 
-  if (download_video (&config, format_code) != EXIT_SUCCESS)
+  phase_start = monotonic_ms ();
+  int download_status = download_video (config, format_code, NULL);
+  session->timings.download_ms += monotonic_ms () - phase_start;
+  free (format_code);
+#if USE_NCURSES
+  // progress goes out of scope with this video
+  g_current_progress = NULL;
+#endif
+  if (download_status != EXIT_SUCCESS)
     {
       fprintf (stderr, "Error: Video download failed\n");
 #if USE_NCURSES
-      if (use_ui)
+      if (session->use_ui)
         {
-          ui_show_error (&ui_state, "Video download failed");
+          ui_show_error (&session->ui_state, "Video download failed");
           sleep (2);
         }
 #endif
-      free (format_code);
-      goto cleanup;
+      return VIDEO_FAILED;
     }
 
 #if USE_NCURSES
-  if (use_ui)
+  if (session->use_ui)
     {
-      ui_show_status (&ui_state, "Download complete!");
+      ui_show_status (&session->ui_state, "Download complete!");
       sleep (1);
     }
 #endif
+  return VIDEO_DONE;
+}
 
-  // Success path
-  free (format_code);
-  result = EXIT_SUCCESS;
+/**
+ * Fetch, offer and download the one URL given.
+ * @param session Run state
+ * @param config Configuration
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int
+process_single_video (Session *session, Config *config)
+{
+  // Get video information, straight into typed columns
+  double phase_start = monotonic_ms ();
+  FormatTable *table = get_video_info (config->url, config->lean_metadata,
+                                       &config->info_json_fd);
+  session->timings.metadata_ms = monotonic_ms () - phase_start;
+  if (table == NULL)
+    {
+      report_fetch_failure (session);
+      return EXIT_FAILURE;
+    }
+  return select_and_download (session, config, table) == VIDEO_DONE
+             ? EXIT_SUCCESS
+             : EXIT_FAILURE;
+}
 
-cleanup:
+/**
+ * Fetch the info of every URL given with one yt-dlp run, then offer and
+ * download the videos in turn. A video that fails does not stop the
+ * others; cancelling a selection (or Ctrl-C) does.
+ * @param session Run state
+ * @param config Configuration
+ * @return EXIT_SUCCESS if every video was downloaded, EXIT_FAILURE otherwise
+ */
+static int
+process_batch (Session *session, Config *config)
+{
+  size_t count = config->url_count;
+  VideoInfoEntry *entries = calloc (count, sizeof (VideoInfoEntry));
+  if (entries == NULL)
+    {
+      fprintf (stderr, "Error: Memory allocation failed\n");
+      return EXIT_FAILURE;
+    }
+  for (size_t i = 0; i < count; i++)
+    {
+      entries[i].url = config->urls[i];
+      entries[i].info_json_fd = -1;
+    }
+
+  double phase_start = monotonic_ms ();
+  get_video_info_batch (entries, count, config->lean_metadata);
+  session->timings.metadata_ms = monotonic_ms () - phase_start;
+
+  int result = EXIT_SUCCESS;
+  size_t i;
+  for (i = 0; i < count; i++)
+    {
+      config->url = entries[i].url;
 #if USE_NCURSES
-  if (use_ui)
+      if (!session->use_ui)
+#endif
+        printf ("Video %zu of %zu: %s\n", i + 1, count, config->url);
+      if (entries[i].table == NULL)
+        {
+          report_fetch_failure (session);
+          result = EXIT_FAILURE;
+          continue;
+        }
+
+      // The download loads this video's info JSON; cleanup closes the last
+      if (config->info_json_fd >= 0)
+        {
+          close (config->info_json_fd);
+        }
+      config->info_json_fd = entries[i].info_json_fd;
+      entries[i].info_json_fd = -1;
+      VideoOutcome outcome
+          = select_and_download (session, config, entries[i].table);
+      entries[i].table = NULL;
+      if (outcome != VIDEO_DONE)
+        {
+          result = EXIT_FAILURE;
+        }
+      if (outcome == VIDEO_CANCELLED || command_cancel_requested ())
+        {
+          break;
+        }
+    }
+
+  // Videos not reached
+  for (; i < count; i++)
     {
-      ui_cleanup (&ui_state);
-      // Free video info only if allocated
-      if (video_info_allocated)
+      free_format_table (entries[i].table);
+      if (entries[i].info_json_fd >= 0)
         {
-          free (video_info.title);
-          free (video_info.channel);
-          free (video_info.duration);
+          close (entries[i].info_json_fd);
         }
     }
+  free (entries);
+  return result;
+}
+
+/**
+ * Main application entry point with comprehensive error handling.
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int
+main (int argc, char *argv[])
+{
+  // Initialize configuration structure explicitly
+  Config config = { .url = NULL,
+                    .output_path = NULL,
+                    .info_json_fd = -1,
+                    .list_shards = 1,
+                    .cache_ttl_seconds = DEFAULT_CACHE_TTL_SECONDS };
+
+  int result = EXIT_FAILURE; // Default to failure
+  // Declared up front so every goto cleanup sees it initialized
+  Session session = { .timings = { .start_ms = monotonic_ms () } };
+
+  // Parse command line arguments
+  if (parse_arguments (argc, argv, &config) != EXIT_SUCCESS)
+    {
+      goto cleanup;
+    }
+
+  // Initialize output path
+  if (initialize_output_path (&config) != EXIT_SUCCESS)
+    {
+      goto cleanup;
+    }
+
+  // Validate configuration
+  if (validate_config (&config) != 0)
+    {
+      goto cleanup;
+    }
+
+  // Display configuration information
+  if (display_config_info (&config) != 0)
+    {
+      goto cleanup;
+    }
+
+  // Every yt-dlp run gets the same deadline and resource caps
+  CommandLimits limits = { .timeout_ms = config.timeout_seconds * 1000,
+                           .memory_mb = config.max_memory_mb,
+                           .cpu_seconds = config.max_cpu_seconds };
+  set_command_limits (&limits);
+
+  // Re-runs on the same video skip extraction while the entry is fresh
+  MetadataCacheSettings cache = { .ttl_seconds = config.cache_ttl_seconds,
+                                  .memory_entries
+                                  = DEFAULT_CACHE_MEMORY_ENTRIES };
+  configure_metadata_cache (&cache);
+
+  // Pay for interpreter startup and the yt_dlp import once, not per run
+  if (config.use_zygote && zygote_start (NULL) != 0)
+    {
+      fprintf (stderr, "Warning: Continuing without the yt-dlp zygote\n");
+    }
+
+  // -j, a batch file or a journal: a queue of concurrent download jobs
+  // (several URLs alone go through process_batch below)
+  if (config.jobs > 0 || config.batch_file != NULL
+      || config.journal_path != NULL)
+    {
+      install_cancel_handler ();
+      result = download_concurrently (&config, &session.timings);
+      goto cleanup;
+    }
+
+  // A format known up front needs neither metadata nor a prompt (and no
+  // UI: this is the scripted path). Playlists take it too, in the best
+  // quality unless -f says otherwise: nobody picks formats for 5000 videos
+  if (config.format_selector != NULL || has_playlist (&config))
+    {
+      install_cancel_handler ();
+      result = EXIT_SUCCESS;
+      for (size_t i = 0; i < config.url_count && !command_cancel_requested ();
+           i++)
+        {
+          config.url = config.urls[i];
+          bool playlist
+              = config.force_playlist || is_playlist_url (config.url);
+          if ((playlist ? download_playlist (&config, &session.timings)
+                        : download_direct (&config, &session.timings))
+              != EXIT_SUCCESS)
+            {
+              result = EXIT_FAILURE;
+            }
+        }
+      goto cleanup;
+    }
+
+#if USE_NCURSES
+  // Initialize terminal UI if available
+  if (ui_init (&session.ui_state) == 0)
+    {
+      session.use_ui = true;
+      // Display initial status
+      ui_show_status (&session.ui_state, "Fetching video information...");
+    }
+  else
+    {
+      install_cancel_handler ();
+    }
+#else
+  // Ctrl-C stops the running yt-dlp (and its process group) cleanly
+  install_cancel_handler ();
+#endif
+
+  result = config.url_count > 1 ? process_batch (&session, &config)
+                                : process_single_video (&session, &config);
+
+cleanup:
+#if USE_NCURSES
+  if (session.use_ui)
+    {
+      ui_cleanup (&session.ui_state);
+    }
+#endif
+  if (config.show_stats)
+    {
+      print_phase_timings (&session.timings);
+      print_memory_stats ();
+    }
+  zygote_stop ();
+  metadata_cache_shutdown ();
+#if USE_EMBEDDED_PYTHON
+  python_backend_shutdown ();
 #endif
   cleanup (&config);
   return result;
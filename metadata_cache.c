@@ -0,0 +1,747 @@
+#define _GNU_SOURCE
+#include "metadata_cache.h"
+#include "util.h"
+#include "ytdl.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Identifies a cache file and its layout version
+#define CACHE_MAGIC "YTDLMC1\n"
+#define CACHE_FILE_SUFFIX ".meta"
+// Name of a cache file being written, before it is renamed into place
+#define CACHE_TEMPLATE ".tmp-XXXXXX"
+// Pool offset standing for a missing string
+#define CACHE_NO_STRING UINT32_MAX
+// Length of a YouTube video ID
+#define YOUTUBE_ID_LENGTH 11
+// Longest cache key (canonical ID or URL)
+#define CACHE_KEY_LENGTH MAX_URL_LENGTH
+
+/*
+ * On-disk layout, native byte order (the cache is per machine). Every
+ * column starts on an 8-byte boundary or follows only narrower ones, so
+ * the numeric columns are read in place from the mapping:
+ *
+ *   CacheHeader
+ *   int64_t  filesize[count]
+ *   double   fps[count], tbr[count]
+ *   int32_t  width[count], height[count]
+ *   uint32_t format_id[count], resolution[count], ext[count]  (pool offsets)
+ *   uint8_t  quality[count]
+ *   char     key[key_length]
+ *   char     pool[pool_size]  (NUL-terminated strings)
+ */
+typedef struct
+{
+  char magic[8];
+  uint32_t header_size; // sizeof (CacheHeader) when written
+  uint32_t count;
+  int64_t created; // time() when stored
+  int64_t duration;
+  uint32_t key_length;
+  uint32_t title; // pool offsets
+  uint32_t channel;
+  uint32_t pool_size;
+} CacheHeader;
+
+// One table in the in-memory tier
+typedef struct
+{
+  char *key;
+  FormatTable *table;
+  int64_t created;
+} MemoryEntry;
+
+static long cache_ttl_seconds = 0;
+static char cache_directory[MAX_PATH_LENGTH];
+static MemoryEntry *memory_entries = NULL; // most recently used first
+static size_t memory_capacity = 0;
+static size_t memory_count = 0;
+
+/**
+ * Bytes taken by the columns and strings that follow the header.
+ */
+static size_t
+cache_body_size (size_t count, size_t key_length, size_t pool_size)
+{
+  return count
+             * (sizeof (int64_t) + 2 * sizeof (double) + 2 * sizeof (int32_t)
+                + 3 * sizeof (uint32_t) + 1)
+         + key_length + pool_size;
+}
+
+/**
+ * Whether a character can appear in a YouTube video ID.
+ */
+static int
+is_video_id_char (char c)
+{
+  return isalnum ((unsigned char)c) || c == '-' || c == '_';
+}
+
+/**
+ * Copy a YouTube video ID if exactly one starts at text.
+ * @return 0 if an ID was found, -1 otherwise
+ */
+static int
+copy_video_id (const char *text, char *key, size_t size)
+{
+  size_t length = 0;
+  while (is_video_id_char (text[length]))
+    {
+      length++;
+    }
+  if (length != YOUTUBE_ID_LENGTH)
+    {
+      return -1;
+    }
+  snprintf (key, size, "youtube:%.*s", (int)length, text);
+  return 0;
+}
+
+/**
+ * Canonical key of a URL, for the cache and the info archive: "youtube:ID"
+ * for the many spellings of a YouTube video URL (watch, youtu.be, shorts,
+ * embed, live, with or without www./m./music.), otherwise the URL itself
+ * without its fragment.
+ * @param url Validated URL
+ * @param key Receives the key
+ * @param size Size of key
+ * @return 0 on success, -1 if the URL is too long to key
+ */
+int
+canonical_video_key (const char *url, char *key, size_t size)
+{
+  const char *host = strstr (url, "://");
+  host = host ? host + 3 : url;
+  size_t host_length = strcspn (host, "/?#");
+  const char *rest = host + host_length;
+
+  static const char *const prefixes[] = { "www.", "m.", "music." };
+  for (size_t i = 0; i < sizeof (prefixes) / sizeof (prefixes[0]); i++)
+    {
+      size_t prefix_length = strlen (prefixes[i]);
+      if (host_length > prefix_length
+          && strncmp (host, prefixes[i], prefix_length) == 0)
+        {
+          host += prefix_length;
+          host_length -= prefix_length;
+          break;
+        }
+    }
+
+  if (host_length == 8 && strncmp (host, "youtu.be", 8) == 0 && *rest == '/'
+      && copy_video_id (rest + 1, key, size) == 0)
+    {
+      return 0;
+    }
+  if ((host_length == 11 && strncmp (host, "youtube.com", 11) == 0)
+      || (host_length == 20 && strncmp (host, "youtube-nocookie.com", 20) == 0))
+    {
+      static const char *const paths[]
+          = { "/shorts/", "/embed/", "/live/", "/v/" };
+      for (size_t i = 0; i < sizeof (paths) / sizeof (paths[0]); i++)
+        {
+          size_t path_length = strlen (paths[i]);
+          if (strncmp (rest, paths[i], path_length) == 0
+              && copy_video_id (rest + path_length, key, size) == 0)
+            {
+              return 0;
+            }
+        }
+
+      const char *query = strchr (rest, '?');
+      for (const char *p = query; p != NULL && *p != '\0' && *p != '#';
+           p = strpbrk (p + 1, "&#"))
+        {
+          if (p[0] != '#' && strncmp (p + 1, "v=", 2) == 0
+              && copy_video_id (p + 3, key, size) == 0)
+            {
+              return 0;
+            }
+        }
+    }
+
+  size_t length = strcspn (url, "#");
+  if (length >= size)
+    {
+      return -1;
+    }
+  memcpy (key, url, length);
+  key[length] = '\0';
+  return 0;
+}
+
+/**
+ * Path of the cache file for a key: a 64-bit FNV-1a hash of the key (the
+ * key itself is stored inside and checked on load).
+ * @return 0 on success, -1 if the path does not fit
+ */
+static int
+cache_file_path (const char *key, char *path, size_t size)
+{
+  int written = snprintf (path, size, "%s/%016llx" CACHE_FILE_SUFFIX,
+                          cache_directory,
+                          (unsigned long long)fnv1a_hash (key));
+  return written > 0 && (size_t)written < size ? 0 : -1;
+}
+
+/**
+ * Create the cache directory and any missing parents.
+ * @return 0 on success, -1 on error
+ */
+static int
+create_cache_directory (void)
+{
+  char path[MAX_PATH_LENGTH];
+  snprintf (path, sizeof (path), "%s", cache_directory);
+  for (char *p = path + 1;; p++)
+    {
+      if (*p == '/' || *p == '\0')
+        {
+          char saved = *p;
+          *p = '\0';
+          if (mkdir (path, DIRECTORY_PERMISSIONS) == -1 && errno != EEXIST)
+            {
+              return -1;
+            }
+          *p = saved;
+          if (saved == '\0')
+            {
+              return 0;
+            }
+        }
+    }
+}
+
+/**
+ * Drop the least recently used entries beyond a capacity.
+ */
+static void
+trim_memory_entries (size_t capacity)
+{
+  while (memory_count > capacity)
+    {
+      memory_count--;
+      free (memory_entries[memory_count].key);
+      free_format_table (memory_entries[memory_count].table);
+    }
+}
+
+/**
+ * Put a copy of a table at the front of the in-memory tier.
+ */
+static void
+remember_table (const char *key, const FormatTable *table, int64_t created)
+{
+  if (memory_capacity == 0)
+    {
+      return;
+    }
+
+  MemoryEntry entry = { strdup (key), copy_format_table (table), created };
+  if (entry.key == NULL || entry.table == NULL)
+    {
+      free (entry.key);
+      free_format_table (entry.table);
+      return;
+    }
+
+  // Replace an older copy of the same key, else evict the oldest
+  size_t slot = memory_count;
+  for (size_t i = 0; i < memory_count; i++)
+    {
+      if (strcmp (memory_entries[i].key, key) == 0)
+        {
+          slot = i;
+          break;
+        }
+    }
+  if (slot < memory_count)
+    {
+      free (memory_entries[slot].key);
+      free_format_table (memory_entries[slot].table);
+    }
+  else
+    {
+      trim_memory_entries (memory_capacity - 1);
+      slot = memory_count++;
+    }
+  memmove (&memory_entries[1], &memory_entries[0],
+           slot * sizeof (MemoryEntry));
+  memory_entries[0] = entry;
+}
+
+/**
+ * Look a key up in the in-memory tier.
+ * @return Copy of the table, NULL on a miss
+ */
+static FormatTable *
+recall_table (const char *key, int64_t now)
+{
+  for (size_t i = 0; i < memory_count; i++)
+    {
+      if (strcmp (memory_entries[i].key, key) != 0)
+        {
+          continue;
+        }
+      MemoryEntry entry = memory_entries[i];
+      if (now - entry.created >= cache_ttl_seconds)
+        {
+          return NULL;
+        }
+      memmove (&memory_entries[1], &memory_entries[0],
+               i * sizeof (MemoryEntry));
+      memory_entries[0] = entry;
+      return copy_format_table (entry.table);
+    }
+  return NULL;
+}
+
+/**
+ * Rebuild a table from a mapped cache file, validating every offset.
+ * @param data Mapping
+ * @param size Size of the mapping
+ * @param key Expected key
+ * @param now Current time
+ * @param created Receives when the table was stored
+ * @return Table (free with free_format_table), NULL if the file is stale,
+ *         for another key, or malformed
+ */
+static FormatTable *
+decode_cache_file (const char *data, size_t size, const char *key,
+                   int64_t now, int64_t *created)
+{
+  const CacheHeader *header = (const CacheHeader *)data;
+  if (size < sizeof (CacheHeader)
+      || memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) != 0
+      || header->header_size != sizeof (CacheHeader) || header->count == 0
+      || header->pool_size == 0
+      || size != sizeof (CacheHeader)
+                     + cache_body_size (header->count, header->key_length,
+                                        header->pool_size)
+      || now - header->created >= cache_ttl_seconds
+      || now < header->created)
+    {
+      return NULL;
+    }
+  *created = header->created;
+
+  size_t count = header->count;
+  const char *p = data + sizeof (CacheHeader);
+  FormatTable view = { .count = count, .duration = (long)header->duration };
+  view.filesize = (long long *)p;
+  p += count * sizeof (int64_t);
+  view.fps = (double *)p;
+  p += count * sizeof (double);
+  view.tbr = (double *)p;
+  p += count * sizeof (double);
+  view.width = (int *)p;
+  p += count * sizeof (int32_t);
+  view.height = (int *)p;
+  p += count * sizeof (int32_t);
+  const uint32_t *offsets = (const uint32_t *)p;
+  p += 3 * count * sizeof (uint32_t);
+  view.quality = (unsigned char *)p;
+  p += count;
+  const char *stored_key = p;
+  p += header->key_length;
+  const char *pool = p;
+
+  if (header->key_length != strlen (key)
+      || memcmp (stored_key, key, header->key_length) != 0
+      || pool[header->pool_size - 1] != '\0')
+    {
+      return NULL;
+    }
+
+  // Offsets inside the pool always reach its final NUL
+  const char **strings = malloc (3 * count * sizeof (const char *));
+  if (strings == NULL)
+    {
+      return NULL;
+    }
+  int valid = header->title == CACHE_NO_STRING
+              || header->title < header->pool_size;
+  valid = valid
+          && (header->channel == CACHE_NO_STRING
+              || header->channel < header->pool_size);
+  for (size_t i = 0; valid && i < 3 * count; i++)
+    {
+      valid = offsets[i] == CACHE_NO_STRING || offsets[i] < header->pool_size;
+      strings[i] = offsets[i] == CACHE_NO_STRING ? NULL : pool + offsets[i];
+    }
+
+  FormatTable *table = NULL;
+  if (valid)
+    {
+      view.format_id = strings;
+      view.resolution = strings + count;
+      view.ext = strings + 2 * count;
+      view.title = header->title == CACHE_NO_STRING ? NULL
+                                                    : pool + header->title;
+      view.channel = header->channel == CACHE_NO_STRING
+                         ? NULL
+                         : pool + header->channel;
+      table = copy_format_table (&view);
+    }
+  free (strings);
+  return table;
+}
+
+/**
+ * Read a table from the disk tier.
+ * @param created Receives when the table was stored, so the memory tier
+ *                expires it with the file
+ * @return Table, NULL on a miss
+ */
+static FormatTable *
+load_cache_file (const char *key, int64_t now, int64_t *created)
+{
+  char path[MAX_PATH_LENGTH];
+  if (cache_file_path (key, path, sizeof (path)) != 0)
+    {
+      return NULL;
+    }
+
+  int fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      return NULL;
+    }
+  struct stat st;
+  if (fstat (fd, &st) == -1 || st.st_size <= 0)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  // Files are only ever replaced by rename, so a mapping never changes
+  size_t size = (size_t)st.st_size;
+  void *data = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      return NULL;
+    }
+  FormatTable *table = decode_cache_file (data, size, key, now, created);
+  munmap (data, size);
+  return table;
+}
+
+/**
+ * Pool offset of a string, appending it unless the same interned string
+ * was already written.
+ */
+static uint32_t
+pool_offset (const char *text, const char **written, uint32_t *offsets,
+             size_t *written_count, char *pool, size_t *pool_used)
+{
+  if (text == NULL)
+    {
+      return CACHE_NO_STRING;
+    }
+  for (size_t i = 0; i < *written_count; i++)
+    {
+      if (written[i] == text)
+        {
+          return offsets[i];
+        }
+    }
+  size_t length = strlen (text) + 1;
+  uint32_t offset = (uint32_t)*pool_used;
+  memcpy (pool + *pool_used, text, length);
+  *pool_used += length;
+  written[*written_count] = text;
+  offsets[(*written_count)++] = offset;
+  return offset;
+}
+
+/**
+ * Serialize a table in the cache file layout.
+ * @param size Receives the size
+ * @return Buffer (caller must free), NULL on error
+ */
+static char *
+encode_cache_file (const char *key, const FormatTable *table, int64_t now,
+                   size_t *size)
+{
+  size_t count = table->count;
+  size_t key_length = strlen (key);
+  size_t pool_size = (table->title ? strlen (table->title) + 1 : 0)
+                     + (table->channel ? strlen (table->channel) + 1 : 0);
+  for (size_t i = 0; i < count; i++)
+    {
+      const char *strings[]
+          = { table->format_id[i], table->resolution[i], table->ext[i] };
+      for (size_t k = 0; k < 3; k++)
+        {
+          pool_size += strings[k] ? strlen (strings[k]) + 1 : 0;
+        }
+    }
+  if (count == 0 || count > UINT32_MAX / 4 || pool_size >= UINT32_MAX)
+    {
+      return NULL;
+    }
+
+  *size = sizeof (CacheHeader) + cache_body_size (count, key_length,
+                                                  pool_size + 1);
+  char *buffer = calloc (1, *size);
+  const char **written = malloc ((2 + 3 * count) * sizeof (const char *));
+  uint32_t *written_offsets = malloc ((2 + 3 * count) * sizeof (uint32_t));
+  if (buffer == NULL || written == NULL || written_offsets == NULL)
+    {
+      free (buffer);
+      free (written);
+      free (written_offsets);
+      return NULL;
+    }
+
+  char *p = buffer + sizeof (CacheHeader);
+  int64_t *filesize = (int64_t *)p;
+  p += count * sizeof (int64_t);
+  double *fps = (double *)p;
+  p += count * sizeof (double);
+  double *tbr = (double *)p;
+  p += count * sizeof (double);
+  int32_t *width = (int32_t *)p;
+  p += count * sizeof (int32_t);
+  int32_t *height = (int32_t *)p;
+  p += count * sizeof (int32_t);
+  uint32_t *offsets = (uint32_t *)p;
+  p += 3 * count * sizeof (uint32_t);
+  uint8_t *quality = (uint8_t *)p;
+  p += count;
+  memcpy (p, key, key_length);
+  char *pool = p + key_length;
+
+  // The pool always ends in a NUL, even when every string is missing
+  size_t pool_used = 0, written_count = 0;
+  CacheHeader *header = (CacheHeader *)buffer;
+  memcpy (header->magic, CACHE_MAGIC, sizeof (header->magic));
+  header->header_size = sizeof (CacheHeader);
+  header->count = (uint32_t)count;
+  header->created = now;
+  header->duration = table->duration;
+  header->key_length = (uint32_t)key_length;
+  header->title = pool_offset (table->title, written, written_offsets,
+                               &written_count, pool, &pool_used);
+  header->channel = pool_offset (table->channel, written, written_offsets,
+                                 &written_count, pool, &pool_used);
+  for (size_t i = 0; i < count; i++)
+    {
+      filesize[i] = table->filesize[i];
+      fps[i] = table->fps[i];
+      tbr[i] = table->tbr[i];
+      width[i] = table->width[i];
+      height[i] = table->height[i];
+      quality[i] = table->quality[i];
+      offsets[i] = pool_offset (table->format_id[i], written, written_offsets,
+                                &written_count, pool, &pool_used);
+      offsets[count + i]
+          = pool_offset (table->resolution[i], written, written_offsets,
+                         &written_count, pool, &pool_used);
+      offsets[2 * count + i]
+          = pool_offset (table->ext[i], written, written_offsets,
+                         &written_count, pool, &pool_used);
+    }
+  pool[pool_used++] = '\0';
+  header->pool_size = (uint32_t)pool_used;
+  *size = sizeof (CacheHeader) + cache_body_size (count, key_length,
+                                                  pool_used);
+
+  free (written);
+  free (written_offsets);
+  return buffer;
+}
+
+/**
+ * Write a table to the disk tier. The file is written under a temporary
+ * name and renamed into place, so concurrent ytdl processes only ever see
+ * complete files.
+ */
+static void
+save_cache_file (const char *key, const FormatTable *table, int64_t now)
+{
+  char path[MAX_PATH_LENGTH];
+  char temporary[MAX_PATH_LENGTH];
+  if (cache_file_path (key, path, sizeof (path)) != 0
+      || snprintf (temporary, sizeof (temporary), "%s/" CACHE_TEMPLATE,
+                   cache_directory)
+             >= (int)sizeof (temporary))
+    {
+      return;
+    }
+
+  size_t size;
+  char *buffer = encode_cache_file (key, table, now, &size);
+  if (buffer == NULL)
+    {
+      return;
+    }
+
+  int fd = mkstemp (temporary);
+  if (fd == -1 && errno == ENOENT && create_cache_directory () == 0)
+    {
+      // A failed mkstemp() leaves the template unusable
+      if (snprintf (temporary, sizeof (temporary), "%s/" CACHE_TEMPLATE,
+                    cache_directory)
+          < (int)sizeof (temporary))
+        {
+          fd = mkstemp (temporary);
+        }
+    }
+  if (fd == -1)
+    {
+      free (buffer);
+      return;
+    }
+
+  const char *p = buffer;
+  size_t remaining = size;
+  while (remaining > 0)
+    {
+      ssize_t written = write (fd, p, remaining);
+      if (written < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (written <= 0)
+        {
+          break;
+        }
+      p += written;
+      remaining -= (size_t)written;
+    }
+  free (buffer);
+
+  if (close (fd) != 0 || remaining > 0 || rename (temporary, path) != 0)
+    {
+      unlink (temporary);
+    }
+}
+
+/**
+ * Set the cache lifetime, location and in-memory tier size. Until this is
+ * called (or with a TTL of 0) lookups miss and stores do nothing.
+ * @param settings Settings, NULL to disable the cache
+ */
+void
+configure_metadata_cache (const MetadataCacheSettings *settings)
+{
+  metadata_cache_shutdown ();
+  if (settings == NULL || settings->ttl_seconds <= 0)
+    {
+      return;
+    }
+
+  int written;
+  const char *xdg = getenv ("XDG_CACHE_HOME");
+  const char *home = getenv ("HOME");
+  if (settings->directory != NULL)
+    {
+      written = snprintf (cache_directory, sizeof (cache_directory), "%s",
+                          settings->directory);
+    }
+  else if (xdg != NULL && xdg[0] == '/')
+    {
+      written = snprintf (cache_directory, sizeof (cache_directory),
+                          "%s/ytdl", xdg);
+    }
+  else if (home != NULL && home[0] == '/')
+    {
+      written = snprintf (cache_directory, sizeof (cache_directory),
+                          "%s/.cache/ytdl", home);
+    }
+  else
+    {
+      return;
+    }
+  if (written <= 0 || (size_t)written >= sizeof (cache_directory))
+    {
+      cache_directory[0] = '\0';
+      return;
+    }
+
+  if (settings->memory_entries > 0)
+    {
+      memory_entries = calloc (settings->memory_entries, sizeof (MemoryEntry));
+      memory_capacity = memory_entries ? settings->memory_entries : 0;
+    }
+  cache_ttl_seconds = settings->ttl_seconds;
+}
+
+/**
+ * Look up the format table of a URL, first in memory, then on disk.
+ * @param url Validated video URL
+ * @return Table (free with free_format_table), NULL on a miss
+ */
+FormatTable *
+metadata_cache_lookup (const char *url)
+{
+  char key[CACHE_KEY_LENGTH];
+  if (cache_ttl_seconds <= 0
+      || canonical_video_key (url, key, sizeof (key)) != 0)
+    {
+      return NULL;
+    }
+
+  int64_t now = (int64_t)time (NULL);
+  FormatTable *table = recall_table (key, now);
+  if (table != NULL)
+    {
+      return table;
+    }
+
+  int64_t created;
+  table = load_cache_file (key, now, &created);
+  if (table != NULL)
+    {
+      remember_table (key, table, created);
+    }
+  return table;
+}
+
+/**
+ * Store the format table of a URL in both tiers. Failures only cost a
+ * later cache miss, so they are not reported.
+ * @param url Validated video URL
+ * @param table Table to store
+ */
+void
+metadata_cache_store (const char *url, const FormatTable *table)
+{
+  char key[CACHE_KEY_LENGTH];
+  if (cache_ttl_seconds <= 0 || table == NULL
+      || canonical_video_key (url, key, sizeof (key)) != 0)
+    {
+      return;
+    }
+
+  int64_t now = (int64_t)time (NULL);
+  save_cache_file (key, table, now);
+  remember_table (key, table, now);
+}
+
+/**
+ * Release the in-memory tier and disable the cache.
+ */
+void
+metadata_cache_shutdown (void)
+{
+  trim_memory_entries (0);
+  free (memory_entries);
+  memory_entries = NULL;
+  memory_capacity = 0;
+  cache_ttl_seconds = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef METADATA_CACHE_H
+#define METADATA_CACHE_H
+
+#include "format_parsing.h"
+
+// Default lifetime of a cached format table, in seconds
+#define DEFAULT_CACHE_TTL_SECONDS 3600
+// Format tables kept in memory in front of the disk cache
+#define DEFAULT_CACHE_MEMORY_ENTRIES 16
+
+// Settings applied by configure_metadata_cache()
+typedef struct
+{
+  long ttl_seconds;         // entries older than this are ignored; 0 disables
+  const char *directory;    // NULL for $XDG_CACHE_HOME/ytdl or ~/.cache/ytdl
+  size_t memory_entries;    // in-memory LRU tier size, 0 for disk only
+} MetadataCacheSettings;
+
+// clang-format off
+int canonical_video_key(const char *url, char *key, size_t size);
+void configure_metadata_cache(const MetadataCacheSettings *settings);
+FormatTable *metadata_cache_lookup(const char *url);
+void metadata_cache_store(const char *url, const FormatTable *table);
+void metadata_cache_shutdown(void);
+// clang-format on
+
+#endif
@@ -0,0 +1,721 @@
+#define _GNU_SOURCE
+#include "playlist.h"
+#include "command_executor.h"
+#include "json_scan.h"
+#include "util.h"
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Command constants for yt-dlp
+#define YT_DLP_COMMAND "yt-dlp"
+#define YT_DLP_JSON_FLAG "-j"
+// List entries without extracting them
+#define YT_DLP_FLAT_FLAG "--flat-playlist"
+// Print entries as pages are fetched instead of after the last one
+#define YT_DLP_LAZY_FLAG "--lazy-playlist"
+// List only a range of entries ("FIRST-LAST", from 1)
+#define YT_DLP_ITEMS_FLAG "--playlist-items"
+
+// Fields of a flat entry naming the video, in order of preference
+#define JSON_FIELD_URL "url"
+#define JSON_FIELD_WEBPAGE_URL "webpage_url"
+
+// Longest entry line kept; flat entries are a few KB, longer lines are
+// skipped rather than buffered
+#define PLAYLIST_LINE_LIMIT (256 * 1024)
+
+// Runs a shard gets before its entries are given up on
+#define PLAYLIST_SHARD_ATTEMPTS 3
+// Shards listed ahead of the one being queued, per concurrent run
+#define PLAYLIST_SHARD_WINDOW 2
+
+// State of one --playlist-items range of a sharded listing
+typedef enum
+{
+  SHARD_LISTING, // queued or running in the executor
+  SHARD_LISTED,
+  SHARD_FAILED
+} ShardState;
+
+typedef struct ShardScheduler ShardScheduler;
+
+typedef struct
+{
+  ShardScheduler *scheduler;
+  size_t number; // lists entries number * PLAYLIST_SHARD_SIZE + 1 onwards
+  ShardState state;
+  int attempts;
+  char *output; // the run's stdout once listed
+  size_t length;
+} PlaylistShard;
+
+// Shards between the one being queued and the next to start, in a ring
+struct ShardScheduler
+{
+  PlaylistReader *reader;
+  CommandExecutor *executor;
+  PlaylistShard *window; // shard n is window[n % window_size]
+  size_t window_size;
+  size_t queued;  // next shard whose entries go to the download queue
+  size_t started; // next shard to start
+  size_t end;     // first shard past the playlist, SIZE_MAX until known
+  size_t failed;  // shards given up on in a row, in queue order
+};
+
+// URL paths that name a playlist or channel rather than a video
+static const char *const playlist_paths[]
+    = { "/playlist", "/@", "/channel/", "/c/", "/user/" };
+
+/**
+ * Whether a query string has a parameter of the given name.
+ * @param query Text after '?'
+ * @param name Parameter name followed by '='
+ */
+static int
+has_query_parameter (const char *query, const char *name)
+{
+  size_t name_len = strlen (name);
+  for (const char *p = query; p != NULL && *p != '\0' && *p != '#';)
+    {
+      if (strncmp (p, name, name_len) == 0)
+        {
+          return 1;
+        }
+      p = strchr (p, '&');
+      p = p ? p + 1 : NULL;
+    }
+  return 0;
+}
+
+/**
+ * Whether a URL names a playlist or channel: a playlist, channel or user
+ * page, or a list= link that does not point at one video of the list.
+ * @param url URL given on the command line
+ * @return 1 for a playlist, 0 otherwise
+ */
+int
+is_playlist_url (const char *url)
+{
+  const char *host = strstr (url, "://");
+  if (host == NULL)
+    {
+      return 0;
+    }
+  host += 3;
+
+  const char *path = host + strcspn (host, "/?#");
+  for (size_t i = 0; i < sizeof (playlist_paths) / sizeof (*playlist_paths);
+       i++)
+    {
+      if (strncmp (path, playlist_paths[i], strlen (playlist_paths[i])) == 0)
+        {
+          return 1;
+        }
+    }
+
+  const char *query = strchr (path, '?');
+  return query != NULL && has_query_parameter (query + 1, "list=")
+         && !has_query_parameter (query + 1, "v=");
+}
+
+/**
+ * Find the video URL of one flat entry: its url, else its webpage_url.
+ * @param text Entry line
+ * @param length Length of text
+ * @param url Receives the URL
+ * @return 0 if a http(s) URL was found, -1 otherwise
+ */
+static int
+scan_entry_url (const char *text, size_t length, char url[MAX_URL_LENGTH])
+{
+  JsonScanner scanner;
+  json_scan_init (&scanner, text, length);
+  if (json_scan_enter (&scanner, JSON_SCAN_OBJECT) != 0)
+    {
+      return -1;
+    }
+
+  url[0] = '\0';
+  int first = 1;
+  JsonSpan name, value;
+  while (json_scan_next_member (&scanner, &first, &name) == 1)
+    {
+      int preferred = json_span_equals (&name, JSON_FIELD_URL);
+      if ((!preferred && !json_span_equals (&name, JSON_FIELD_WEBPAGE_URL))
+          || json_scan_peek (&scanner) != JSON_SCAN_STRING)
+        {
+          if (json_scan_skip (&scanner) != 0)
+            {
+              break;
+            }
+          continue;
+        }
+      if (json_scan_string (&scanner, &value) != 0)
+        {
+          break;
+        }
+      if (value.length < MAX_URL_LENGTH && (preferred || url[0] == '\0'))
+        {
+          json_span_decode (&value, url);
+          if (preferred)
+            {
+              break;
+            }
+        }
+    }
+
+  return strncmp (url, "http://", 7) == 0 || strncmp (url, "https://", 8) == 0
+             ? 0
+             : -1;
+}
+
+/**
+ * FNV-1a hash of a URL, never 0 (the empty slot of the seen set).
+ */
+static uint64_t
+hash_url (const char *url)
+{
+  uint64_t hash = fnv1a_hash (url);
+  return hash != 0 ? hash : 1;
+}
+
+/**
+ * Record a URL as queued. Only hashes are kept, 8 bytes per entry.
+ * @param reader Playlist reader
+ * @param url Entry URL
+ * @return 1 if the URL is new, 0 if it was queued before
+ */
+static int
+remember_url (PlaylistReader *reader, const char *url)
+{
+  if (reader->seen_count * 2 >= reader->seen_capacity)
+    {
+      size_t capacity = reader->seen_capacity ? reader->seen_capacity * 2
+                                              : 1024;
+      uint64_t *grown = calloc (capacity, sizeof (uint64_t));
+      if (grown == NULL)
+        {
+          // Without room to remember, queue rather than drop
+          return 1;
+        }
+      for (size_t i = 0; i < reader->seen_capacity; i++)
+        {
+          uint64_t hash = reader->seen[i];
+          if (hash != 0)
+            {
+              size_t slot = hash & (capacity - 1);
+              while (grown[slot] != 0)
+                {
+                  slot = (slot + 1) & (capacity - 1);
+                }
+              grown[slot] = hash;
+            }
+        }
+      free (reader->seen);
+      reader->seen = grown;
+      reader->seen_capacity = capacity;
+    }
+
+  uint64_t hash = hash_url (url);
+  size_t slot = hash & (reader->seen_capacity - 1);
+  while (reader->seen[slot] != 0)
+    {
+      if (reader->seen[slot] == hash)
+        {
+          return 0;
+        }
+      slot = (slot + 1) & (reader->seen_capacity - 1);
+    }
+  reader->seen[slot] = hash;
+  reader->seen_count++;
+  return 1;
+}
+
+/**
+ * Queue the video of one entry line, unless it was queued already.
+ * @param reader Playlist reader
+ * @param text Entry line without its newline
+ * @param length Length of text
+ * @param index Position of the entry in the playlist
+ * @return 0 to keep reading, -1 once the downloads have stopped
+ */
+static int
+queue_entry (PlaylistReader *reader, const char *text, size_t length,
+             size_t index)
+{
+  char url[MAX_URL_LENGTH];
+  if (scan_entry_url (text, length, url) != 0)
+    {
+      reader->skipped++;
+      return 0;
+    }
+  if (!remember_url (reader, url))
+    {
+      reader->duplicates++;
+      return 0;
+    }
+
+  if (download_queue_push (reader->queue, url, index) != 0)
+    {
+      return -1;
+    }
+  reader->entries++;
+  return 0;
+}
+
+/**
+ * Single run: split yt-dlp's output into entry lines in one fixed buffer
+ * and queue each entry as soon as its line is complete. Waiting for room
+ * in the queue stops the reads, and a full pipe then stops yt-dlp, so a
+ * playlist of any length is held in bounded memory.
+ * @param reader Playlist reader with its stream open
+ */
+static void
+list_stream (PlaylistReader *reader)
+{
+  char *line = malloc (PLAYLIST_LINE_LIMIT);
+  size_t length = 0, scanned = 0, index = 0;
+  int skipping = 0; // inside a line longer than the buffer
+  int stopped = 0;  // the downloads no longer want entries
+  if (line == NULL)
+    {
+      fprintf (stderr, "Error: Memory allocation failed\n");
+      reader->status = -1;
+      return;
+    }
+
+  while (!stopped)
+    {
+      ssize_t bytes_read = command_stream_read (
+          &reader->stream, line + length, PLAYLIST_LINE_LIMIT - length);
+      if (bytes_read <= 0)
+        {
+          reader->status = bytes_read == 0 ? 0 : -1;
+          break;
+        }
+      length += (size_t)bytes_read;
+
+      size_t start = 0;
+      char *newline;
+      while (!stopped
+             && (newline = memchr (line + scanned, '\n', length - scanned))
+                    != NULL)
+        {
+          size_t end = (size_t)(newline - line);
+          if (!skipping && end > start)
+            {
+              stopped = queue_entry (reader, line + start, end - start,
+                                     ++index)
+                        != 0;
+            }
+          skipping = 0;
+          start = scanned = end + 1;
+        }
+
+      memmove (line, line + start, length - start);
+      length -= start;
+      scanned = length;
+      if (length == PLAYLIST_LINE_LIMIT)
+        {
+          if (!skipping)
+            {
+              fprintf (stderr,
+                       "Warning: Skipping a playlist entry over %d KB\n",
+                       PLAYLIST_LINE_LIMIT / 1024);
+              reader->skipped++;
+              index++;
+            }
+          skipping = 1;
+          length = scanned = 0;
+        }
+    }
+
+  // An entry cut short by a killed run is not trusted
+  free (line);
+}
+
+/**
+ * Number of entry lines in a shard's output.
+ */
+static size_t
+count_lines (const char *text, size_t length)
+{
+  size_t lines = 0;
+  const char *end = text + length;
+  while (text < end)
+    {
+      const char *newline = memchr (text, '\n', (size_t)(end - text));
+      const char *line_end = newline ? newline : end;
+      lines += line_end > text;
+      text = line_end + 1;
+    }
+  return lines;
+}
+
+static void shard_finished (CommandResult *result, void *data);
+
+/**
+ * Submit (or resubmit) the yt-dlp run listing one shard.
+ * @param scheduler Sharded listing
+ * @param shard Shard to list
+ */
+static void
+start_shard (ShardScheduler *scheduler, PlaylistShard *shard)
+{
+  char items[64];
+  size_t first = shard->number * PLAYLIST_SHARD_SIZE + 1;
+  snprintf (items, sizeof (items), "%zu-%zu", first,
+            first + PLAYLIST_SHARD_SIZE - 1);
+  char *const argv[] = { YT_DLP_COMMAND,    YT_DLP_FLAT_FLAG,
+                         YT_DLP_JSON_FLAG,  YT_DLP_ITEMS_FLAG,
+                         items,             (char *)scheduler->reader->url,
+                         NULL };
+
+  shard->state = SHARD_LISTING;
+  shard->attempts++;
+  if (executor_submit (scheduler->executor, YT_DLP_COMMAND, argv,
+                       shard_finished, shard)
+      != 0)
+    {
+      shard->state = SHARD_FAILED;
+    }
+}
+
+/**
+ * Completion of a shard's run. Only an empty shard marks the end of the
+ * playlist: a short one may be a range with unavailable entries. A failed
+ * one is listed again on its own, and once out of attempts its entries
+ * are reported and skipped while the shards after it carry on.
+ * @param result Finished run
+ * @param data PlaylistShard
+ */
+static void
+shard_finished (CommandResult *result, void *data)
+{
+  PlaylistShard *shard = data;
+  ShardScheduler *scheduler = shard->scheduler;
+  size_t first = shard->number * PLAYLIST_SHARD_SIZE + 1;
+  size_t last = first + PLAYLIST_SHARD_SIZE - 1;
+
+  if (result->exit_status == 0
+      && result->termination == COMMAND_TERMINATION_NONE)
+    {
+      shard->output = result->output;
+      shard->length = result->output_length;
+      result->output = NULL;
+      shard->state = SHARD_LISTED;
+      if (count_lines (shard->output, shard->length) == 0
+          && scheduler->end > shard->number)
+        {
+          scheduler->end = shard->number;
+        }
+      return;
+    }
+
+  if (command_cancel_requested ())
+    {
+      shard->state = SHARD_FAILED;
+      return;
+    }
+
+  const char *reason
+      = result->termination != COMMAND_TERMINATION_NONE
+            ? command_termination_description (result->termination)
+            : command_error_description (
+                  classify_command_error (&result->error_tail));
+  if (shard->attempts < PLAYLIST_SHARD_ATTEMPTS)
+    {
+      fprintf (stderr,
+               "Warning: Listing entries %zu-%zu failed (%s), retrying\n",
+               first, last, reason);
+      start_shard (scheduler, shard);
+      return;
+    }
+
+  fprintf (stderr,
+           "Error: Entries %zu-%zu of %s could not be listed (%s), "
+           "skipping them\n",
+           first, last, scheduler->reader->url, reason);
+  shard->state = SHARD_FAILED;
+}
+
+/**
+ * Queue the entries of a listed shard in playlist order.
+ * @return 0 to keep going, -1 once the downloads have stopped
+ */
+static int
+queue_shard (PlaylistReader *reader, const PlaylistShard *shard)
+{
+  size_t index = shard->number * PLAYLIST_SHARD_SIZE;
+  const char *text = shard->output;
+  const char *end = text + shard->length;
+  while (text < end)
+    {
+      const char *newline = memchr (text, '\n', (size_t)(end - text));
+      const char *line_end = newline ? newline : end;
+      if (line_end > text
+          && queue_entry (reader, text, (size_t)(line_end - text), ++index)
+                 != 0)
+        {
+          return -1;
+        }
+      text = line_end + 1;
+    }
+  return 0;
+}
+
+/**
+ * Sharded listing: keep up to reader->shards yt-dlp runs listing
+ * consecutive PLAYLIST_SHARD_SIZE ranges, and queue each shard's entries
+ * once every shard before it has been queued, so the order is the
+ * playlist's whatever order the runs finish in. Listing stays at most
+ * PLAYLIST_SHARD_WINDOW shards per run ahead of the queue. A shard that
+ * cannot be listed is skipped; a whole window of them in a row means the
+ * playlist itself is failing, and ends the listing.
+ * @param reader Playlist reader
+ */
+static void
+list_sharded (PlaylistReader *reader)
+{
+  ShardScheduler scheduler = { .reader = reader, .end = SIZE_MAX };
+  scheduler.window_size = (size_t)reader->shards * PLAYLIST_SHARD_WINDOW;
+  scheduler.window = calloc (scheduler.window_size, sizeof (PlaylistShard));
+  scheduler.executor = executor_create (reader->shards);
+  if (scheduler.window == NULL || scheduler.executor == NULL)
+    {
+      fprintf (stderr, "Error: Cannot start playlist listing\n");
+      free (scheduler.window);
+      executor_destroy (scheduler.executor);
+      reader->status = -1;
+      return;
+    }
+
+  int stopped = 0;
+  while (!stopped && scheduler.queued < scheduler.end)
+    {
+      while (scheduler.started < scheduler.end
+             && scheduler.started - scheduler.queued < scheduler.window_size
+             && executor_active_count (scheduler.executor)
+                        + executor_pending_count (scheduler.executor)
+                    < (size_t)reader->shards)
+        {
+          PlaylistShard *shard
+              = &scheduler.window[scheduler.started % scheduler.window_size];
+          memset (shard, 0, sizeof (PlaylistShard));
+          shard->scheduler = &scheduler;
+          shard->number = scheduler.started++;
+          start_shard (&scheduler, shard);
+        }
+
+      if (executor_run_once (scheduler.executor, -1) == -1)
+        {
+          reader->status = -1;
+          break;
+        }
+
+      while (scheduler.queued < scheduler.started
+             && scheduler.queued < scheduler.end)
+        {
+          PlaylistShard *shard
+              = &scheduler.window[scheduler.queued % scheduler.window_size];
+          if (shard->state == SHARD_LISTING)
+            {
+              break;
+            }
+          if (shard->state == SHARD_LISTED)
+            {
+              stopped = queue_shard (reader, shard) != 0;
+              scheduler.failed = 0;
+            }
+          else
+            {
+              reader->status = -1;
+              scheduler.failed++;
+            }
+          free (shard->output);
+          shard->output = NULL;
+          scheduler.queued++;
+          if (scheduler.failed == scheduler.window_size
+              && scheduler.end == SIZE_MAX)
+            {
+              fprintf (stderr, "Error: Giving up listing %s\n", reader->url);
+              scheduler.end = scheduler.queued;
+            }
+          if (stopped)
+            {
+              break;
+            }
+        }
+
+      if (command_cancel_requested ())
+        {
+          reader->status = -1;
+          break;
+        }
+    }
+
+  // Runs past the end (or abandoned) are killed without their callbacks
+  executor_destroy (scheduler.executor);
+  for (size_t i = 0; i < scheduler.window_size; i++)
+    {
+      free (scheduler.window[i].output);
+    }
+  free (scheduler.window);
+}
+
+/**
+ * Run the listing described by reader's url, shards and queue.
+ * @param reader Playlist reader
+ * @return 0 if the whole playlist was listed, -1 otherwise
+ */
+static int
+run_listing (PlaylistReader *reader)
+{
+  if (reader->shards > 1)
+    {
+      list_sharded (reader);
+    }
+  else
+    {
+      char *const argv[] = { YT_DLP_COMMAND,   YT_DLP_FLAT_FLAG,
+                             YT_DLP_LAZY_FLAG, YT_DLP_JSON_FLAG,
+                             (char *)reader->url, NULL };
+      if (command_stream_open (&reader->stream, YT_DLP_COMMAND, argv) != 0)
+        {
+          reader->status = -1;
+        }
+      else
+        {
+          list_stream (reader);
+          if (command_stream_close (&reader->stream) != 0)
+            {
+              reader->status = -1;
+            }
+        }
+    }
+
+  if (reader->skipped > 0)
+    {
+      fprintf (stderr, "Warning: %zu playlist entries had no video URL\n",
+               reader->skipped);
+    }
+  if (reader->duplicates > 0)
+    {
+      fprintf (stderr, "Warning: Skipped %zu duplicate playlist entries\n",
+               reader->duplicates);
+    }
+  free (reader->seen);
+  reader->seen = NULL;
+  return reader->status;
+}
+
+/**
+ * Set a reader up for one listing.
+ * @return 0 on success, -1 if the parameters are invalid
+ */
+static int
+init_reader (PlaylistReader *reader, const char *url, int shards,
+             DownloadQueue *queue)
+{
+  if (reader == NULL || url == NULL || queue == NULL || shards < 1
+      || shards > PLAYLIST_MAX_SHARDS)
+    {
+      fprintf (stderr, "Error: Invalid playlist listing parameters\n");
+      return -1;
+    }
+
+  memset (reader, 0, sizeof (PlaylistReader));
+  reader->url = url;
+  reader->shards = shards;
+  reader->queue = queue;
+  return 0;
+}
+
+/**
+ * List a playlist into a download queue on the calling thread. The queue
+ * is left open, so that other sources can feed it before or after.
+ * @param reader Reader to use
+ * @param url Playlist or channel URL
+ * @param shards Concurrent yt-dlp runs; 1 streams a single run, more
+ *               split the listing into PLAYLIST_SHARD_SIZE ranges
+ * @param queue Queue receiving the entries
+ * @return 0 if the whole playlist was listed, -1 otherwise
+ */
+int
+playlist_list (PlaylistReader *reader, const char *url, int shards,
+               DownloadQueue *queue)
+{
+  if (init_reader (reader, url, shards, queue) != 0)
+    {
+      return -1;
+    }
+  return run_listing (reader);
+}
+
+/**
+ * Reader thread: list the playlist, then close the queue.
+ * @param data PlaylistReader
+ * @return NULL
+ */
+static void *
+playlist_reader_thread (void *data)
+{
+  PlaylistReader *reader = data;
+  run_listing (reader);
+  download_queue_close (reader->queue);
+  return NULL;
+}
+
+/**
+ * Start listing a playlist into a download queue on a reader thread. The
+ * queue is closed when the listing ends, however it ends.
+ * @param reader Reader to start
+ * @param url Playlist or channel URL (must outlive the reader)
+ * @param shards Concurrent yt-dlp runs (see playlist_list())
+ * @param queue Queue receiving the entries
+ * @return 0 on success, -1 on error (the queue is left open)
+ */
+int
+playlist_open (PlaylistReader *reader, const char *url, int shards,
+               DownloadQueue *queue)
+{
+  if (init_reader (reader, url, shards, queue) != 0)
+    {
+      return -1;
+    }
+
+  // Interrupts are left to the main thread, whose waits they cut short;
+  // the reader notices cancellation through its child watches
+  sigset_t blocked, previous;
+  sigemptyset (&blocked);
+  sigaddset (&blocked, SIGINT);
+  sigaddset (&blocked, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, &blocked, &previous);
+  int err = pthread_create (&reader->thread, NULL, playlist_reader_thread,
+                            reader);
+  pthread_sigmask (SIG_SETMASK, &previous, NULL);
+  if (err != 0)
+    {
+      fprintf (stderr, "Error: Cannot start playlist reader: %s\n",
+               strerror (err));
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * Wait for a listing started with playlist_open() to end. Once the
+ * downloads have abandoned the queue, the rest of the listing is dropped.
+ * @param reader Started reader
+ * @return 0 if the whole playlist was listed, -1 otherwise
+ */
+int
+playlist_close (PlaylistReader *reader)
+{
+  pthread_join (reader->thread, NULL);
+  return reader->status;
+}
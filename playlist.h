@@ -0,0 +1,43 @@
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include "command_execution.h"
+#include "download_queue.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+// Entries listed by each yt-dlp run of a sharded listing
+#define PLAYLIST_SHARD_SIZE 500
+// Most yt-dlp runs listing one playlist at once
+#define PLAYLIST_MAX_SHARDS 32
+
+// Flat enumeration of a playlist or channel. yt-dlp lists the entries as
+// one small JSON object per line without extracting them; a reader thread
+// queues each entry for download as soon as it is known. With shards > 1
+// the listing is split into --playlist-items ranges listed concurrently
+// and merged back in playlist order.
+typedef struct
+{
+  const char *url;
+  int shards;           // concurrent yt-dlp runs, 1 streams a single run
+  CommandStream stream; // the single run
+  DownloadQueue *queue;
+  pthread_t thread;
+  size_t entries;    // videos queued
+  size_t skipped;    // lines without a usable URL
+  size_t duplicates; // entries already queued under the same URL
+  uint64_t *seen;    // open-addressing set of queued URL hashes
+  size_t seen_count;
+  size_t seen_capacity;
+  int status; // reader outcome: 0, or -1 if part of the listing failed
+} PlaylistReader;
+
+// clang-format off
+int is_playlist_url(const char *url);
+int playlist_list(PlaylistReader *reader, const char *url, int shards, DownloadQueue *queue);
+int playlist_open(PlaylistReader *reader, const char *url, int shards, DownloadQueue *queue);
+int playlist_close(PlaylistReader *reader);
+// clang-format on
+
+#endif
@@ -0,0 +1,196 @@
+#include "progress_parser.h"
+
+#include <string.h>
+
+/**
+ * Prepare a line reader for a new child.
+ * @param reader Reader to reset
+ */
+void
+progress_line_reader_init (ProgressLineReader *reader)
+{
+  reader->length = 0;
+  reader->overflow = 0;
+}
+
+/**
+ * Split a chunk of output into lines and pass each complete one on.
+ * @param reader Line reader
+ * @param data Chunk just read
+ * @param length Bytes in data
+ * @param on_line Called for each complete line (valid during the call only)
+ * @param user_data Passed through to on_line
+ */
+void
+progress_line_reader_feed (ProgressLineReader *reader, const char *data,
+                           size_t length, ProgressLineCallback on_line,
+                           void *user_data)
+{
+  while (length > 0)
+    {
+      const char *newline = memchr (data, '\n', length);
+      size_t chunk = newline != NULL ? (size_t)(newline - data) : length;
+      if (!reader->overflow)
+        {
+          if (reader->length == 0 && newline != NULL)
+            {
+              on_line (data, chunk, user_data);
+            }
+          else if (reader->length + chunk <= PROGRESS_LINE_MAX)
+            {
+              memcpy (reader->line + reader->length, data, chunk);
+              reader->length += chunk;
+              if (newline != NULL)
+                {
+                  on_line (reader->line, reader->length, user_data);
+                }
+            }
+          else
+            {
+              reader->overflow = 1;
+            }
+        }
+      if (newline == NULL)
+        {
+          break;
+        }
+
+      reader->length = 0;
+      reader->overflow = 0;
+      data += chunk + 1;
+      length -= chunk + 1;
+    }
+}
+
+/**
+ * Pass on a last line that ended without a newline.
+ * @param reader Line reader
+ * @param on_line Called if a line is pending
+ * @param user_data Passed through to on_line
+ */
+void
+progress_line_reader_finish (ProgressLineReader *reader,
+                             ProgressLineCallback on_line, void *user_data)
+{
+  if (!reader->overflow && reader->length > 0)
+    {
+      on_line (reader->line, reader->length, user_data);
+    }
+  progress_line_reader_init (reader);
+}
+
+/**
+ * Take the next space-separated field.
+ * @param cursor Position in the line, advanced past the field
+ * @param end End of the line
+ * @param length Receives the length of the field
+ * @return Start of the field (length 0 once the line is used up)
+ */
+static const char *
+next_field (const char **cursor, const char *end, size_t *length)
+{
+  const char *p = *cursor;
+  while (p < end && *p == ' ')
+    {
+      p++;
+    }
+  const char *start = p;
+  while (p < end && *p != ' ')
+    {
+      p++;
+    }
+  *length = (size_t)(p - start);
+  *cursor = p;
+  return start;
+}
+
+/**
+ * Parse a decimal field such as "1048576" or "524288.75". Done by hand
+ * rather than with strtod(): the curses UI switches LC_NUMERIC to the
+ * user's locale, which may expect a decimal comma.
+ * @param field Field text
+ * @param length Length of field
+ * @return Value, -1 for "NA" or anything unexpected
+ */
+static double
+parse_number (const char *field, size_t length)
+{
+  double value = 0.0;
+  size_t i = 0;
+  while (i < length && field[i] >= '0' && field[i] <= '9')
+    {
+      value = value * 10.0 + (field[i++] - '0');
+    }
+  if (i == 0)
+    {
+      return -1.0;
+    }
+  if (i < length && field[i] == '.')
+    {
+      double scale = 0.1;
+      for (i++; i < length && field[i] >= '0' && field[i] <= '9'; i++)
+        {
+          value += (field[i] - '0') * scale;
+          scale /= 10.0;
+        }
+    }
+  return i == length ? value : -1.0;
+}
+
+/**
+ * Parse a line printed through PROGRESS_TEMPLATE.
+ * @param line Line without its newline (not NUL-terminated)
+ * @param length Length of line
+ * @param update Receives the update
+ * @return 1 if this was a progress line, 0 for any other output
+ */
+int
+parse_progress_line (const char *line, size_t length, ProgressUpdate *update)
+{
+  size_t prefix_length = sizeof (PROGRESS_LINE_PREFIX) - 1;
+  if (length < prefix_length
+      || memcmp (line, PROGRESS_LINE_PREFIX, prefix_length) != 0)
+    {
+      return 0;
+    }
+  while (length > 0 && line[length - 1] == '\r')
+    {
+      length--;
+    }
+
+  const char *cursor = line + prefix_length;
+  const char *end = line + length;
+  size_t field_length;
+  const char *field = next_field (&cursor, end, &field_length);
+  if (field_length == 0)
+    {
+      return 0;
+    }
+
+  update->status = PROGRESS_UNKNOWN;
+  if (field_length == 11 && memcmp (field, "downloading", 11) == 0)
+    {
+      update->status = PROGRESS_DOWNLOADING;
+    }
+  else if (field_length == 8 && memcmp (field, "finished", 8) == 0)
+    {
+      update->status = PROGRESS_FINISHED;
+    }
+  else if (field_length == 5 && memcmp (field, "error", 5) == 0)
+    {
+      update->status = PROGRESS_ERROR;
+    }
+
+  double numbers[5]; // downloaded, total, estimate, speed, eta
+  for (int i = 0; i < 5; i++)
+    {
+      field = next_field (&cursor, end, &field_length);
+      numbers[i] = parse_number (field, field_length);
+    }
+
+  update->downloaded = (long long)numbers[0];
+  update->total = (long long)(numbers[1] >= 0 ? numbers[1] : numbers[2]);
+  update->speed = numbers[3];
+  update->eta = (long)numbers[4];
+  return 1;
+}
@@ -0,0 +1,58 @@
+#ifndef PROGRESS_PARSER_H
+#define PROGRESS_PARSER_H
+
+#include <stddef.h>
+
+// Marker opening every line printed through PROGRESS_TEMPLATE
+#define PROGRESS_LINE_PREFIX "[ytdl-progress]"
+// yt-dlp --progress-template printing one machine-readable line per update
+// (with --newline): status, downloaded bytes, total bytes, estimated total,
+// speed in bytes/s and ETA in seconds, "NA" for whatever is unknown
+#define PROGRESS_TEMPLATE                                                     \
+  "download:" PROGRESS_LINE_PREFIX " %(progress.status)s "                    \
+  "%(progress.downloaded_bytes)s %(progress.total_bytes)s "                   \
+  "%(progress.total_bytes_estimate)s %(progress.speed)s %(progress.eta)s"
+// Longest stdout line kept whole; the rest of a longer one is dropped
+#define PROGRESS_LINE_MAX 512
+
+// State of the stream a progress line is about
+typedef enum
+{
+  PROGRESS_DOWNLOADING,
+  PROGRESS_FINISHED,
+  PROGRESS_ERROR,
+  PROGRESS_UNKNOWN
+} ProgressStatus;
+
+// One progress update; numbers are -1 where yt-dlp did not know them
+typedef struct
+{
+  ProgressStatus status;
+  long long downloaded;
+  long long total; // exact size, else yt-dlp's estimate
+  double speed;    // bytes per second
+  long eta;        // seconds
+} ProgressUpdate;
+
+// Splits a child's stdout into lines without allocating: lines that arrive
+// whole are passed straight from the read buffer, only a line cut by a
+// read boundary is assembled in the fixed buffer
+typedef struct
+{
+  char line[PROGRESS_LINE_MAX];
+  size_t length;
+  int overflow; // dropping the rest of an overlong line
+} ProgressLineReader;
+
+// Called for each complete line, without its newline
+typedef void (*ProgressLineCallback) (const char *line, size_t length,
+                                      void *user_data);
+
+// clang-format off
+void progress_line_reader_init(ProgressLineReader *reader);
+void progress_line_reader_feed(ProgressLineReader *reader, const char *data, size_t length, ProgressLineCallback on_line, void *user_data);
+void progress_line_reader_finish(ProgressLineReader *reader, ProgressLineCallback on_line, void *user_data);
+int parse_progress_line(const char *line, size_t length, ProgressUpdate *update);
+// clang-format on
+
+#endif
@@ -0,0 +1,403 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h> // must precede system headers
+
+#include "python_backend.h"
+#include "command_execution.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Nesting deeper than this in an info dict is treated as corrupt
+#define PYTHON_MAX_DEPTH 64
+
+/*
+ * Glue evaluated once at startup. A single YoutubeDL instance is kept for
+ * the life of the process; errors are collected by a logger instead of
+ * being printed, so they can be classified like a subprocess' stderr.
+ */
+static const char backend_script[]
+    = "import yt_dlp\n"
+      "class _Logger:\n"
+      "    def __init__(self):\n"
+      "        self.errors = []\n"
+      "    def debug(self, msg):\n"
+      "        pass\n"
+      "    def info(self, msg):\n"
+      "        pass\n"
+      "    def warning(self, msg):\n"
+      "        pass\n"
+      "    def error(self, msg):\n"
+      "        self.errors.append(msg)\n"
+      "_logger = _Logger()\n"
+      "_params = {'quiet': True, 'no_warnings': True, 'logger': _logger}\n"
+      "if _socket_timeout > 0:\n"
+      "    _params['socket_timeout'] = _socket_timeout\n"
+      "_ydl = yt_dlp.YoutubeDL(_params)\n"
+      "def extract(url):\n"
+      "    del _logger.errors[:]\n"
+      "    try:\n"
+      "        info = _ydl.extract_info(url, download=False)\n"
+      "        return _ydl.sanitize_info(info), None\n"
+      "    except BaseException as e:\n"
+      "        return None, '\\n'.join(_logger.errors) or str(e)\n";
+
+static int backend_state = 0; // 0 untried, 1 ready, -1 unavailable
+static PyObject *extract_function = NULL;
+
+/**
+ * Print and clear the pending Python exception on one line.
+ * @param context What was being attempted
+ */
+static void
+report_python_exception (const char *context)
+{
+  PyObject *type, *value, *traceback;
+  PyErr_Fetch (&type, &value, &traceback);
+
+  PyObject *text = value ? PyObject_Str (value) : NULL;
+  const char *message = text ? PyUnicode_AsUTF8 (text) : NULL;
+  const char *name = type && PyType_Check (type)
+                         ? ((PyTypeObject *)type)->tp_name
+                         : "exception";
+  fprintf (stderr, "Error: %s: %s: %s\n", context, name,
+           message ? message : "(no details)");
+
+  PyErr_Clear ();
+  Py_XDECREF (text);
+  Py_XDECREF (type);
+  Py_XDECREF (value);
+  Py_XDECREF (traceback);
+}
+
+/**
+ * Start the interpreter and import yt_dlp, once per process.
+ * @return 0 on success, -1 if the backend cannot be used
+ */
+static int
+initialize_backend (void)
+{
+  if (backend_state != 0)
+    {
+      return backend_state == 1 ? 0 : -1;
+    }
+  backend_state = -1;
+
+  // Behave like the python3 executable (UTF-8 mode under a C locale,
+  // PYTHONPATH honoured), minus signal handlers: SIGINT stays with ytdl
+  PyPreConfig preconfig;
+  PyPreConfig_InitPythonConfig (&preconfig);
+  PyStatus status = Py_PreInitialize (&preconfig);
+  if (!PyStatus_Exception (status))
+    {
+      PyConfig config;
+      PyConfig_InitPythonConfig (&config);
+      config.install_signal_handlers = 0;
+      config.parse_argv = 0;
+      status = Py_InitializeFromConfig (&config);
+      PyConfig_Clear (&config);
+    }
+  if (PyStatus_Exception (status) || !Py_IsInitialized ())
+    {
+      fprintf (stderr, "Error: Failed to initialize embedded Python: %s\n",
+               status.err_msg ? status.err_msg : "unknown error");
+      return -1;
+    }
+
+  PyObject *globals = PyDict_New ();
+  if (globals == NULL)
+    {
+      report_python_exception ("Embedded Python setup failed");
+      return -1;
+    }
+  PyDict_SetItemString (globals, "__builtins__", PyEval_GetBuiltins ());
+
+  const CommandLimits *limits = get_command_limits ();
+  PyObject *timeout = PyFloat_FromDouble (limits->timeout_ms / 1000.0);
+  if (timeout != NULL)
+    {
+      PyDict_SetItemString (globals, "_socket_timeout", timeout);
+      Py_DECREF (timeout);
+    }
+
+  PyObject *result
+      = PyRun_String (backend_script, Py_file_input, globals, globals);
+  if (result == NULL)
+    {
+      report_python_exception ("Embedded yt_dlp unavailable");
+      Py_DECREF (globals);
+      return -1;
+    }
+  Py_DECREF (result);
+
+  extract_function = PyDict_GetItemString (globals, "extract");
+  Py_XINCREF (extract_function);
+  Py_DECREF (globals);
+  if (extract_function == NULL)
+    {
+      fprintf (stderr, "Error: Embedded yt_dlp glue is incomplete\n");
+      return -1;
+    }
+
+  backend_state = 1;
+  return 0;
+}
+
+/**
+ * Copy a Python string into a jansson string. Lone surrogates (which
+ * UTF-8 cannot carry) are replaced.
+ * @param object str object
+ * @return New json string, NULL on error
+ */
+static json_t *
+string_to_json (PyObject *object)
+{
+  Py_ssize_t length;
+  const char *text = PyUnicode_AsUTF8AndSize (object, &length);
+  if (text != NULL)
+    {
+      return json_stringn (text, (size_t)length);
+    }
+
+  PyErr_Clear ();
+  PyObject *bytes = PyUnicode_AsEncodedString (object, "utf-8", "replace");
+  if (bytes == NULL)
+    {
+      PyErr_Clear ();
+      return NULL;
+    }
+  json_t *string = json_stringn (PyBytes_AS_STRING (bytes),
+                                 (size_t)PyBytes_GET_SIZE (bytes));
+  Py_DECREF (bytes);
+  return string;
+}
+
+/**
+ * Convert a sanitized info dict (or any value inside it) straight into a
+ * jansson tree, with the same mapping json.dumps() would apply.
+ * @param object Python value
+ * @param depth Current nesting depth
+ * @return New json value, NULL on error
+ */
+static json_t *
+python_to_json (PyObject *object, int depth)
+{
+  if (depth > PYTHON_MAX_DEPTH)
+    {
+      fprintf (stderr, "Error: Info dict nested too deeply\n");
+      return NULL;
+    }
+
+  if (object == Py_None)
+    {
+      return json_null ();
+    }
+  // bool is a subclass of int, so it must be tested first
+  if (PyBool_Check (object))
+    {
+      return object == Py_True ? json_true () : json_false ();
+    }
+  if (PyLong_Check (object))
+    {
+      int overflow = 0;
+      long long value = PyLong_AsLongLongAndOverflow (object, &overflow);
+      if (overflow == 0 && !(value == -1 && PyErr_Occurred ()))
+        {
+          return json_integer ((json_int_t)value);
+        }
+      // Beyond 64 bits a real is the closest jansson offers
+      PyErr_Clear ();
+      double approximate = PyLong_AsDouble (object);
+      if (approximate == -1.0 && PyErr_Occurred ())
+        {
+          PyErr_Clear ();
+          return json_null ();
+        }
+      return json_real (approximate);
+    }
+  if (PyFloat_Check (object))
+    {
+      double value = PyFloat_AS_DOUBLE (object);
+      // jansson has no NaN/Infinity (json.dumps writes them anyway)
+      return isfinite (value) ? json_real (value) : json_null ();
+    }
+  if (PyUnicode_Check (object))
+    {
+      return string_to_json (object);
+    }
+
+  if (PyDict_Check (object))
+    {
+      json_t *dict = json_object ();
+      if (dict == NULL)
+        {
+          return NULL;
+        }
+
+      PyObject *key, *value;
+      Py_ssize_t position = 0;
+      while (PyDict_Next (object, &position, &key, &value))
+        {
+          // Non-string keys are stringified, as json.dumps does
+          PyObject *key_string = PyUnicode_Check (key) ? key
+                                                       : PyObject_Str (key);
+          if (key_string == NULL)
+            {
+              PyErr_Clear ();
+              continue;
+            }
+          if (key_string == key)
+            {
+              Py_INCREF (key_string);
+            }
+
+          const char *key_text = PyUnicode_AsUTF8 (key_string);
+          json_t *child = key_text ? python_to_json (value, depth + 1) : NULL;
+          // json_object_set_new() consumes child even when it fails
+          int failed = child == NULL
+                       || json_object_set_new (dict, key_text, child) != 0;
+          Py_DECREF (key_string);
+          if (failed)
+            {
+              PyErr_Clear ();
+              json_decref (dict);
+              return NULL;
+            }
+        }
+      return dict;
+    }
+
+  if (PyList_Check (object) || PyTuple_Check (object))
+    {
+      json_t *array = json_array ();
+      if (array == NULL)
+        {
+          return NULL;
+        }
+
+      Py_ssize_t count = PySequence_Fast_GET_SIZE (object);
+      PyObject **items = PySequence_Fast_ITEMS (object);
+      for (Py_ssize_t i = 0; i < count; i++)
+        {
+          json_t *child = python_to_json (items[i], depth + 1);
+          if (child == NULL || json_array_append_new (array, child) != 0)
+            {
+              json_decref (array);
+              return NULL;
+            }
+        }
+      return array;
+    }
+
+  // sanitize_info() leaves only JSON types; anything else becomes its repr
+  PyObject *repr = PyObject_Repr (object);
+  if (repr == NULL)
+    {
+      PyErr_Clear ();
+      return json_null ();
+    }
+  json_t *string = string_to_json (repr);
+  Py_DECREF (repr);
+  return string;
+}
+
+/**
+ * Report a failed extraction, classified like a failed yt-dlp process.
+ * @param message Collected error text
+ */
+static void
+report_extract_error (PyObject *message)
+{
+  const char *text
+      = message && PyUnicode_Check (message) ? PyUnicode_AsUTF8 (message)
+                                             : NULL;
+  if (text == NULL)
+    {
+      PyErr_Clear ();
+      text = "";
+    }
+
+  StderrTail tail = { 0 };
+  stderr_tail_append (&tail, text, strlen (text));
+  fprintf (stderr, "Error: yt_dlp extraction failed (%s)\n",
+           command_error_description (classify_command_error (&tail)));
+
+  // Show the last line, which is where yt-dlp puts the reason
+  const char *line = strrchr (text, '\n');
+  line = line ? line + 1 : text;
+  if (*line != '\0')
+    {
+      fprintf (stderr, "  %s\n", line);
+    }
+}
+
+/**
+ * Whether the embedded interpreter can import yt_dlp. The first call pays
+ * for interpreter startup and the import.
+ * @return Non-zero if python_extract_info() can be used
+ */
+int
+python_backend_available (void)
+{
+  return initialize_backend () == 0;
+}
+
+/**
+ * Extract video metadata in-process through YoutubeDL.extract_info(),
+ * converting the sanitized info dict directly into a jansson tree.
+ * @param url Video URL
+ * @return Info document (caller must json_decref), NULL on error
+ */
+json_t *
+python_extract_info (const char *url)
+{
+  if (url == NULL || initialize_backend () != 0)
+    {
+      return NULL;
+    }
+
+  PyObject *result = PyObject_CallFunction (extract_function, "s", url);
+  if (result == NULL || !PyTuple_Check (result)
+      || PyTuple_GET_SIZE (result) != 2)
+    {
+      report_python_exception ("Embedded yt_dlp call failed");
+      Py_XDECREF (result);
+      return NULL;
+    }
+
+  PyObject *info = PyTuple_GET_ITEM (result, 0);
+  if (info == Py_None)
+    {
+      report_extract_error (PyTuple_GET_ITEM (result, 1));
+      Py_DECREF (result);
+      return NULL;
+    }
+
+  json_t *root = python_to_json (info, 0);
+  Py_DECREF (result);
+  if (root == NULL || !json_is_object (root))
+    {
+      fprintf (stderr, "Error: Failed to convert yt_dlp info dict\n");
+      json_decref (root);
+      return NULL;
+    }
+  return root;
+}
+
+/**
+ * Release the YoutubeDL instance and shut the interpreter down.
+ */
+void
+python_backend_shutdown (void)
+{
+  if (backend_state == 1)
+    {
+      Py_CLEAR (extract_function);
+    }
+  if (Py_IsInitialized ())
+    {
+      Py_FinalizeEx ();
+    }
+  backend_state = 0;
+}
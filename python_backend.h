@@ -0,0 +1,12 @@
+#ifndef PYTHON_BACKEND_H
+#define PYTHON_BACKEND_H
+
+#include "ytdl.h"
+
+// clang-format off
+int python_backend_available(void);
+json_t *python_extract_info(const char *url);
+void python_backend_shutdown(void);
+// clang-format on
+
+#endif
@@ -0,0 +1,626 @@
+#define _GNU_SOURCE
+#include "range_download.h"
+#include "command_execution.h"
+#include "util.h"
+
+#include <curl/curl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PARTIAL_SUFFIX ".part"
+// Split points are rounded down to this many bytes
+#define RANGE_ALIGN (64 * 1024)
+// A transfer that fails mid-range is retried from where it stopped
+#define RANGE_MAX_RETRIES 3
+// A connection is slow below this share of the median speed...
+#define RANGE_SLOW_RATIO 0.25
+// ...once it has run this long, and is then replaced at most this often
+#define RANGE_SLOW_GRACE_MS 500
+#define RANGE_MAX_RESTARTS 3
+// Replacing a connection is worth it if it would otherwise take this long
+#define RANGE_RESTART_WORTH_MS 1000
+#define RANGE_CONNECT_TIMEOUT 30L
+
+typedef struct RangeDownload RangeDownload;
+
+// One connection and the range it is filling
+typedef struct
+{
+  RangeDownload *download;
+  CURL *easy;
+  long long next;     // next byte to write
+  long long end;      // one past the last byte wanted; shrinks when split
+  int active;         // in the multi handle
+  int checked;        // response status verified
+  int fresh;          // next request must not reuse a connection
+  int retries;        // failures of the current range
+  int restarts;       // times replaced for being slow
+  double started_ms;  // when the current request was made
+  long long window;   // bytes written since the last tick
+  double speed;       // bytes per second, smoothed over ticks
+  const char *failed; // why the range cannot be finished, or NULL
+  char range[64];
+  char error[CURL_ERROR_SIZE];
+} RangeSlot;
+
+struct RangeDownload
+{
+  const RangeRequest *request;
+  int fd;
+  CURLM *multi;
+  struct curl_slist *headers;
+  RangeSlot slots[RANGE_MAX_CONNECTIONS];
+  int count;
+  long long written;
+  RangeStats *stats;
+  char failure[256];
+};
+
+/**
+ * Check each response before its body: 206 for the range asked for, or
+ * 200 if the whole file was asked for anyway.
+ * @return 0 if the body can be written, -1 if not
+ */
+static int
+check_response (RangeSlot *slot)
+{
+  long status = 0;
+  curl_easy_getinfo (slot->easy, CURLINFO_RESPONSE_CODE, &status);
+  if (status == 206
+      || (status == 200 && slot->next == 0
+          && slot->end == slot->download->request->size))
+    {
+      slot->checked = 1;
+      return 0;
+    }
+  slot->failed = status == 200 ? "server ignores range requests"
+                               : "unexpected HTTP status";
+  return -1;
+}
+
+/**
+ * Header callback: the total of each Content-Range must be the size the
+ * info JSON gave, and the range must start where it was asked to.
+ */
+static size_t
+read_header (char *data, size_t size, size_t count, void *user_data)
+{
+  RangeSlot *slot = user_data;
+  size_t length = size * count;
+  static const char name[] = "content-range:";
+  if (length <= sizeof (name) - 1
+      || strncasecmp (data, name, sizeof (name) - 1) != 0)
+    {
+      return length;
+    }
+
+  char line[128];
+  size_t n = length < sizeof (line) - 1 ? length : sizeof (line) - 1;
+  memcpy (line, data, n);
+  line[n] = '\0';
+  long long first = 0, last = 0, total = 0;
+  if (sscanf (line + sizeof (name) - 1, " bytes %lld-%lld/%lld", &first,
+              &last, &total)
+      != 3)
+    {
+      return length; // "bytes */N" or a total of "*": nothing to check
+    }
+  if (total != slot->download->request->size)
+    {
+      slot->failed = "server reports a different size";
+      return 0;
+    }
+  if (first != slot->next)
+    {
+      slot->failed = "server sent a different range";
+      return 0;
+    }
+  return length;
+}
+
+/**
+ * Write callback: body bytes go to their offset in the file. Once a split
+ * has cut the range short, the bytes past its new end are refused, which
+ * ends the transfer there.
+ * @return Bytes taken
+ */
+static size_t
+write_range (char *data, size_t size, size_t count, void *user_data)
+{
+  RangeSlot *slot = user_data;
+  RangeDownload *download = slot->download;
+  size_t length = size * count;
+  if (!slot->checked && check_response (slot) != 0)
+    {
+      return 0;
+    }
+
+  long long room = slot->end - slot->next;
+  size_t take = (long long)length < room ? length : (size_t)room;
+  size_t done = 0;
+  while (done < take)
+    {
+      ssize_t n = pwrite (download->fd, data + done, take - done,
+                          slot->next + (long long)done);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            {
+              continue;
+            }
+          slot->failed = strerror (errno);
+          return 0;
+        }
+      done += (size_t)n;
+    }
+  slot->next += (long long)take;
+  slot->window += (long long)take;
+  download->written += (long long)take;
+  return take;
+}
+
+/**
+ * Set up the handle of a slot: everything but the range itself.
+ * @return 0 on success, -1 on error
+ */
+static int
+init_slot (RangeDownload *download, RangeSlot *slot)
+{
+  const RangeRequest *request = download->request;
+  slot->download = download;
+  slot->easy = curl_easy_init ();
+  if (slot->easy == NULL)
+    {
+      return -1;
+    }
+  CURL *easy = slot->easy;
+  curl_easy_setopt (easy, CURLOPT_URL, request->url);
+  curl_easy_setopt (easy, CURLOPT_HTTPHEADER, download->headers);
+  curl_easy_setopt (easy, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt (easy, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt (easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt (easy, CURLOPT_CONNECTTIMEOUT, RANGE_CONNECT_TIMEOUT);
+  curl_easy_setopt (easy, CURLOPT_ERRORBUFFER, slot->error);
+  curl_easy_setopt (easy, CURLOPT_HEADERFUNCTION, read_header);
+  curl_easy_setopt (easy, CURLOPT_HEADERDATA, slot);
+  curl_easy_setopt (easy, CURLOPT_WRITEFUNCTION, write_range);
+  curl_easy_setopt (easy, CURLOPT_WRITEDATA, slot);
+  if (request->rate_limit > 0)
+    {
+      curl_off_t share = request->rate_limit / download->count;
+      curl_easy_setopt (easy, CURLOPT_MAX_RECV_SPEED_LARGE,
+                        share > 0 ? share : (curl_off_t)1);
+    }
+  return 0;
+}
+
+/**
+ * Request the rest of a slot's range.
+ * @return 0 on success, -1 on error
+ */
+static int
+start_slot (RangeSlot *slot)
+{
+  snprintf (slot->range, sizeof (slot->range), "%lld-%lld", slot->next,
+            slot->end - 1);
+  curl_easy_setopt (slot->easy, CURLOPT_RANGE, slot->range);
+  curl_easy_setopt (slot->easy, CURLOPT_FRESH_CONNECT, (long)slot->fresh);
+  curl_easy_setopt (slot->easy, CURLOPT_FORBID_REUSE, (long)slot->fresh);
+  slot->fresh = 0;
+  slot->checked = 0;
+  slot->error[0] = '\0';
+  slot->started_ms = monotonic_ms ();
+  slot->window = 0;
+  if (curl_multi_add_handle (slot->download->multi, slot->easy) != CURLM_OK)
+    {
+      return -1;
+    }
+  slot->active = 1;
+  slot->download->stats->requests++;
+  return 0;
+}
+
+static void
+stop_slot (RangeSlot *slot)
+{
+  if (slot->active)
+    {
+      curl_multi_remove_handle (slot->download->multi, slot->easy);
+      slot->active = 0;
+    }
+}
+
+/**
+ * Give an idle slot the tail of the range expected to finish last, cut
+ * where both halves should finish together at their current speeds.
+ * @return 1 if the slot got work, 0 if there was none worth splitting
+ */
+static int
+split_range (RangeDownload *download, RangeSlot *idle)
+{
+  RangeSlot *victim = NULL;
+  double longest = 0;
+  for (int i = 0; i < download->count; i++)
+    {
+      RangeSlot *slot = &download->slots[i];
+      long long remaining = slot->end - slot->next;
+      if (!slot->active || remaining < 2 * RANGE_MIN_SPLIT)
+        {
+          continue;
+        }
+      double eta = (double)remaining / (slot->speed > 1 ? slot->speed : 1);
+      if (eta > longest)
+        {
+          longest = eta;
+          victim = slot;
+        }
+    }
+  if (victim == NULL)
+    {
+      return 0;
+    }
+
+  double keep_speed = victim->speed > 1 ? victim->speed : 1;
+  double take_speed = idle->speed > 1 ? idle->speed : keep_speed;
+  long long remaining = victim->end - victim->next;
+  long long keep
+      = (long long)((double)remaining * keep_speed / (keep_speed + take_speed));
+  if (keep < RANGE_MIN_SPLIT)
+    {
+      keep = RANGE_MIN_SPLIT;
+    }
+  if (keep > remaining - RANGE_MIN_SPLIT)
+    {
+      keep = remaining - RANGE_MIN_SPLIT;
+    }
+  long long cut = (victim->next + keep) / RANGE_ALIGN * RANGE_ALIGN;
+  if (cut <= victim->next)
+    {
+      return 0;
+    }
+
+  idle->next = cut;
+  idle->end = victim->end;
+  idle->retries = 0;
+  victim->end = cut;
+  download->stats->splits++;
+  return start_slot (idle) == 0 ? 1 : 0;
+}
+
+/**
+ * Handle a finished transfer: a completed range frees its slot for a
+ * split, a broken one is retried from where it stopped.
+ * @return 0 to go on, -1 if the download failed
+ */
+static int
+finish_slot (RangeDownload *download, RangeSlot *slot, CURLcode result)
+{
+  stop_slot (slot);
+  if (slot->next >= slot->end)
+    {
+      // Cut short by a split, or complete
+      split_range (download, slot);
+      return 0;
+    }
+  if (slot->failed != NULL)
+    {
+      snprintf (download->failure, sizeof (download->failure), "%s",
+                slot->failed);
+      return -1;
+    }
+  if (result == CURLE_HTTP_RETURNED_ERROR
+      || ++slot->retries > RANGE_MAX_RETRIES)
+    {
+      snprintf (download->failure, sizeof (download->failure), "%s",
+                slot->error[0] != '\0' ? slot->error
+                                       : curl_easy_strerror (result));
+      return -1;
+    }
+  slot->fresh = 1;
+  return start_slot (slot);
+}
+
+/**
+ * Measure the speed of each connection over the last tick, and replace
+ * connections far slower than the median by fresh ones: servers that
+ * throttle per connection often do so only to some of them. Idle slots
+ * keep the speed their last range ended with, so the slow ranges left
+ * at the end are still measured against the fast ones.
+ */
+static void
+tick (RangeDownload *download, double elapsed_ms, double now)
+{
+  double speeds[RANGE_MAX_CONNECTIONS];
+  int measured = 0;
+  for (int i = 0; i < download->count; i++)
+    {
+      RangeSlot *slot = &download->slots[i];
+      if (slot->active)
+        {
+          double current = (double)slot->window * 1e3 / elapsed_ms;
+          slot->speed
+              = slot->speed > 0 ? (slot->speed + current) / 2 : current;
+          slot->window = 0;
+        }
+      if (slot->speed <= 0)
+        {
+          continue;
+        }
+      // Insertion sort: at most RANGE_MAX_CONNECTIONS speeds
+      int j = measured++;
+      for (; j > 0 && speeds[j - 1] > slot->speed; j--)
+        {
+          speeds[j] = speeds[j - 1];
+        }
+      speeds[j] = slot->speed;
+    }
+  double median = measured >= 2 ? speeds[measured / 2] : 0;
+  for (int i = 0; i < download->count; i++)
+    {
+      RangeSlot *slot = &download->slots[i];
+      double remaining = (double)(slot->end - slot->next);
+      if (slot->active && slot->restarts < RANGE_MAX_RESTARTS
+          && now - slot->started_ms >= RANGE_SLOW_GRACE_MS
+          && slot->speed < median * RANGE_SLOW_RATIO
+          && remaining * 1e3 / (slot->speed > 1 ? slot->speed : 1)
+                 >= RANGE_RESTART_WORTH_MS)
+        {
+          stop_slot (slot);
+          slot->restarts++;
+          slot->fresh = 1;
+          slot->speed = 0;
+          download->stats->restarts++;
+          start_slot (slot);
+        }
+    }
+
+  // Ranges may have become worth splitting since a slot went idle
+  for (int i = 0; i < download->count; i++)
+    {
+      if (!download->slots[i].active)
+        {
+          split_range (download, &download->slots[i]);
+        }
+    }
+}
+
+/**
+ * Run the transfers until every range is written.
+ * @return 0 on success, -1 on error
+ */
+static int
+run_transfers (RangeDownload *download, RangeProgressCallback progress,
+               void *user_data)
+{
+  double last_tick = monotonic_ms ();
+  for (;;)
+    {
+      int running = 0;
+      curl_multi_perform (download->multi, &running);
+
+      CURLMsg *message;
+      int left;
+      while ((message = curl_multi_info_read (download->multi, &left)))
+        {
+          if (message->msg != CURLMSG_DONE)
+            {
+              continue;
+            }
+          for (int i = 0; i < download->count; i++)
+            {
+              RangeSlot *slot = &download->slots[i];
+              if (slot->easy == message->easy_handle
+                  && finish_slot (download, slot, message->data.result) != 0)
+                {
+                  return -1;
+                }
+            }
+        }
+
+      int active = 0;
+      for (int i = 0; i < download->count; i++)
+        {
+          active += download->slots[i].active;
+        }
+      if (active == 0)
+        {
+          if (progress != NULL)
+            {
+              progress (download->written, download->request->size,
+                        user_data);
+            }
+          return 0;
+        }
+      if (command_cancel_requested ())
+        {
+          snprintf (download->failure, sizeof (download->failure),
+                    "cancelled");
+          return -1;
+        }
+
+      double now = monotonic_ms ();
+      if (now - last_tick >= RANGE_TICK_MS)
+        {
+          tick (download, now - last_tick, now);
+          last_tick = now;
+          if (progress != NULL)
+            {
+              progress (download->written, download->request->size,
+                        user_data);
+            }
+        }
+      curl_multi_poll (download->multi, NULL, 0, RANGE_TICK_MS / 2, NULL);
+    }
+}
+
+/**
+ * Reserve the whole file up front, so ranges written out of order neither
+ * fragment it nor run out of space halfway.
+ * @return 0 on success, -1 on error
+ */
+static int
+preallocate (int fd, long long size)
+{
+  if (fallocate (fd, 0, 0, size) == 0)
+    {
+      return 0;
+    }
+  if (errno != EOPNOTSUPP && errno != ENOSYS)
+    {
+      return -1;
+    }
+  // No fallocate() on this filesystem: a sparse file of the final size
+  return ftruncate (fd, size);
+}
+
+/**
+ * Download a file with parallel HTTP range requests into PATH.part, and
+ * rename it to PATH once its size is verified.
+ * @param request What to download and where
+ * @param progress Called every RANGE_TICK_MS, or NULL
+ * @param user_data Passed to progress
+ * @param stats Filled with how it went, or NULL
+ * @return 0 on success, -1 on error
+ */
+int
+range_download (const RangeRequest *request, RangeProgressCallback progress,
+                void *user_data, RangeStats *stats)
+{
+  RangeStats own_stats;
+  if (stats == NULL)
+    {
+      stats = &own_stats;
+    }
+  memset (stats, 0, sizeof (*stats));
+  if (request->size <= 0 || request->connections < 1
+      || request->connections > RANGE_MAX_CONNECTIONS)
+    {
+      fprintf (stderr, "Error: Invalid range download request\n");
+      return -1;
+    }
+
+  char partial[4096];
+  if ((size_t)snprintf (partial, sizeof (partial), "%s%s", request->path,
+                        PARTIAL_SUFFIX)
+      >= sizeof (partial))
+    {
+      fprintf (stderr, "Error: Output path too long\n");
+      return -1;
+    }
+  RangeDownload *download = calloc (1, sizeof (*download));
+  if (download == NULL)
+    {
+      fprintf (stderr, "Error: Memory allocation failed\n");
+      return -1;
+    }
+  download->request = request;
+  download->stats = stats;
+  download->fd = open (partial, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                       0644);
+  if (download->fd < 0 || preallocate (download->fd, request->size) != 0)
+    {
+      fprintf (stderr, "Error: Cannot create %s: %s\n", partial,
+               strerror (errno));
+      if (download->fd >= 0)
+        {
+          close (download->fd);
+          unlink (partial);
+        }
+      free (download);
+      return -1;
+    }
+
+  double start = monotonic_ms ();
+  int result = -1;
+  curl_global_init (CURL_GLOBAL_DEFAULT);
+  download->multi = curl_multi_init ();
+  // One connection per range: a multiplexed HTTP/2 connection would share
+  // whatever throttling the server applies to it
+  curl_multi_setopt (download->multi, CURLMOPT_PIPELINING,
+                     (long)CURLPIPE_NOTHING);
+  for (const char *const *header = request->headers;
+       header != NULL && *header != NULL; header++)
+    {
+      download->headers = curl_slist_append (download->headers, *header);
+    }
+
+  // Never more connections than ranges worth splitting
+  long long most = (request->size + RANGE_MIN_SPLIT - 1) / RANGE_MIN_SPLIT;
+  download->count = request->connections < most ? request->connections
+                                                 : (int)most;
+  int ready = download->multi != NULL;
+  for (int i = 0; ready && i < download->count; i++)
+    {
+      RangeSlot *slot = &download->slots[i];
+      ready = init_slot (download, slot) == 0;
+      slot->next = request->size * i / download->count;
+      slot->end = request->size * (i + 1) / download->count;
+      ready = ready && start_slot (slot) == 0;
+    }
+  if (!ready)
+    {
+      snprintf (download->failure, sizeof (download->failure),
+                "cannot set up transfers");
+    }
+  else if (run_transfers (download, progress, user_data) == 0)
+    {
+      struct stat st;
+      if (download->written != request->size)
+        {
+          snprintf (download->failure, sizeof (download->failure),
+                    "wrote %lld of %lld bytes", download->written,
+                    request->size);
+        }
+      else if (fstat (download->fd, &st) != 0 || st.st_size != request->size)
+        {
+          snprintf (download->failure, sizeof (download->failure),
+                    "file is not %lld bytes", request->size);
+        }
+      else
+        {
+          result = 0;
+        }
+    }
+
+  for (int i = 0; i < download->count; i++)
+    {
+      stop_slot (&download->slots[i]);
+      if (download->slots[i].easy != NULL)
+        {
+          curl_easy_cleanup (download->slots[i].easy);
+        }
+    }
+  curl_multi_cleanup (download->multi);
+  curl_slist_free_all (download->headers);
+  curl_global_cleanup ();
+
+  stats->bytes = download->written;
+  stats->elapsed_ms = monotonic_ms () - start;
+  if (close (download->fd) != 0 && result == 0)
+    {
+      snprintf (download->failure, sizeof (download->failure), "%s",
+                strerror (errno));
+      result = -1;
+    }
+  if (result == 0 && rename (partial, request->path) != 0)
+    {
+      snprintf (download->failure, sizeof (download->failure), "%s",
+                strerror (errno));
+      result = -1;
+    }
+  if (result != 0)
+    {
+      // A preallocated partial file would look complete to yt-dlp's resume
+      unlink (partial);
+      fprintf (stderr, "Error: Range download of %s failed: %s\n",
+               request->path, download->failure);
+    }
+  free (download);
+  return result;
+}
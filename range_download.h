@@ -0,0 +1,42 @@
+#ifndef RANGE_DOWNLOAD_H
+#define RANGE_DOWNLOAD_H
+
+#include <stddef.h>
+
+// Most range requests of one download at once (--connections)
+#define RANGE_MAX_CONNECTIONS 16
+// Ranges are never split below this many bytes
+#define RANGE_MIN_SPLIT (1024 * 1024)
+// How often speeds are measured and slow connections looked for
+#define RANGE_TICK_MS 250
+
+// One file fetched with parallel HTTP range requests
+typedef struct
+{
+  const char *url;
+  const char *const *headers; // "Name: value" lines, NULL-terminated
+  long long size;             // exact size the file must have
+  const char *path;           // written as PATH.part, then renamed
+  int connections;            // 1 to RANGE_MAX_CONNECTIONS
+  long long rate_limit;       // combined bytes per second, 0 for none
+} RangeRequest;
+
+// How a range download went
+typedef struct
+{
+  long long bytes; // written to the file
+  double elapsed_ms;
+  size_t requests; // HTTP requests made, retries included
+  size_t splits;   // ranges split to keep finished connections busy
+  size_t restarts; // slow connections replaced by fresh ones
+} RangeStats;
+
+// Called every RANGE_TICK_MS with the bytes written so far
+typedef void (*RangeProgressCallback) (long long downloaded, long long total,
+                                       void *user_data);
+
+// clang-format off
+int range_download(const RangeRequest *request, RangeProgressCallback progress, void *user_data, RangeStats *stats);
+// clang-format on
+
+#endif
@@ -1,4 +1,5 @@
 #include "terminal_ui.h"
+#include "command_execution.h"
 #include "format_parsing.h"
 #include <math.h>
 #include <stdlib.h>
@@ -97,6 +98,12 @@ create_windows (UIState *state)
 void
 ui_signal_handler (int sig)
 {
+  // Children sit in their own process groups; pass the interrupt on
+  if (sig == SIGINT || sig == SIGTERM)
+    {
+      command_request_cancel ();
+    }
+
   if (g_ui_state == NULL)
     {
       return;
@@ -1,6 +1,7 @@
 #ifndef TERMINAL_UI_H
 #define TERMINAL_UI_H
 
+#include "format_parsing.h"
 #include "ytdl.h"
 #include <locale.h>
 #include <ncurses.h>
@@ -66,7 +67,7 @@ typedef struct
   int visible_lines;
   int selected_index;
   int total_formats;
-  json_t *formats;
+  const FormatTable *table;
   WINDOW *pad;
   int pad_height;
 } FormatListState;
@@ -86,7 +87,8 @@ typedef struct
     time_t timestamp;
     long long bytes;
   } samples[SPEED_SAMPLE_SIZE];
-  int sample_index;
+  int sample_index; // newest sample
+  int sample_count; // samples held, up to SPEED_SAMPLE_SIZE
   time_t last_update;
 } DownloadProgress;
 
@@ -115,7 +117,7 @@ int ui_init (UIState *state);
 void ui_cleanup (UIState *state);
 void ui_handle_resize (UIState *state);
 void ui_display_video_info (UIState *state, const VideoDisplayInfo *info);
-int ui_display_formats (UIState *state, json_t *formats,
+int ui_display_formats (UIState *state, const FormatTable *table,
                         FormatListState *list_state);
 char *ui_select_format_interactive (UIState *state,
                                     FormatListState *list_state);
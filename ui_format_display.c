@@ -11,86 +11,6 @@
 #define COL_FILESIZE_WIDTH 10
 #define COL_QUALITY_WIDTH 12
 
-/**
- * Get format information from JSON object safely.
- * @param format JSON format object
- * @param format_id Output for format ID
- * @param resolution Output for resolution
- * @param ext Output for extension
- * @param filesize Output for file size
- * @return 0 on success, -1 on error
- */
-static int
-get_format_info (json_t *format, const char **format_id,
-                 const char **resolution, const char **ext,
-                 json_int_t *filesize)
-{
-  if (format == NULL || !json_is_object (format))
-    {
-      return -1;
-    }
-
-  json_t *id_obj = json_object_get (format, "format_id");
-  *format_id = (id_obj && json_is_string (id_obj)) ? json_string_value (id_obj)
-                                                   : "N/A";
-
-  json_t *res_obj = json_object_get (format, "resolution");
-  *resolution = (res_obj && json_is_string (res_obj))
-                    ? json_string_value (res_obj)
-                    : "N/A";
-
-  json_t *ext_obj = json_object_get (format, "ext");
-  *ext = (ext_obj && json_is_string (ext_obj)) ? json_string_value (ext_obj)
-                                               : "N/A";
-
-  json_t *size_obj = json_object_get (format, "filesize");
-  *filesize = (size_obj && json_is_integer (size_obj))
-                  ? json_integer_value (size_obj)
-                  : 0;
-
-  return 0;
-}
-
-/**
- * Determine quality label for format.
- * @param resolution Resolution string
- * @param ext Extension string
- * @return Quality label string
- */
-static const char *
-get_quality_label (const char *resolution, const char *ext)
-{
-  if (resolution == NULL || strcmp (resolution, "N/A") == 0)
-    {
-      if (ext
-          && (strcmp (ext, "m4a") == 0 || strcmp (ext, "webm") == 0
-              || strcmp (ext, "opus") == 0))
-        {
-          return "Audio Only";
-        }
-      return "";
-    }
-
-  // Extract height from resolution (e.g., "1920x1080" -> 1080)
-  const char *x_pos = strchr (resolution, 'x');
-  if (x_pos)
-    {
-      int height = atoi (x_pos + 1);
-      if (height >= 2160)
-        return "4K UHD";
-      if (height >= 1440)
-        return "2K QHD";
-      if (height >= 1080)
-        return "Full HD";
-      if (height >= 720)
-        return "HD";
-      if (height >= 480)
-        return "SD";
-    }
-
-  return "";
-}
-
 /**
  * Draw format table header.
  * @param win Window to draw in
@@ -123,22 +43,19 @@ draw_format_header (WINDOW *win, int y, bool colors_supported)
  * Draw a single format entry.
  * @param win Window to draw in
  * @param y Y position
+ * @param table Format table
  * @param index Format index
- * @param format JSON format object
  * @param selected Whether this format is selected
  * @param colors_supported Whether colors are supported
  */
 static void
-draw_format_entry (WINDOW *win, int y, int index, json_t *format,
+draw_format_entry (WINDOW *win, int y, const FormatTable *table, int index,
                    bool selected, bool colors_supported)
 {
-  const char *format_id, *resolution, *ext;
-  json_int_t filesize;
-
-  if (get_format_info (format, &format_id, &resolution, &ext, &filesize) != 0)
-    {
-      return;
-    }
+  const char *format_id = table->format_id[index];
+  const char *resolution = table->resolution[index];
+  const char *ext = table->ext[index];
+  long long filesize = table->filesize[index];
 
   // Format file size
   char size_str[32];
@@ -151,8 +68,10 @@ draw_format_entry (WINDOW *win, int y, int index, json_t *format,
       strcpy (size_str, "N/A");
     }
 
-  // Get quality label
-  const char *quality = get_quality_label (resolution, ext);
+  FormatQuality tier = (FormatQuality)table->quality[index];
+  const char *quality = format_quality_label (tier);
+  bool highlight = tier == FORMAT_QUALITY_UHD || tier == FORMAT_QUALITY_FULL_HD;
+  bool audio = tier == FORMAT_QUALITY_AUDIO;
 
   // Apply selection highlighting
   if (selected && colors_supported)
@@ -165,17 +84,19 @@ draw_format_entry (WINDOW *win, int y, int index, json_t *format,
 
   // Draw format entry
   mvwprintw (win, y, 1, "%-*d %-*s %-*s %-*s %-*s", COL_INDEX_WIDTH, index + 1,
-             COL_FORMAT_ID_WIDTH, format_id, COL_RESOLUTION_WIDTH, resolution,
-             COL_EXTENSION_WIDTH, ext, COL_FILESIZE_WIDTH, size_str);
+             COL_FORMAT_ID_WIDTH, format_id ? format_id : "N/A",
+             COL_RESOLUTION_WIDTH, resolution ? resolution : "N/A",
+             COL_EXTENSION_WIDTH, ext ? ext : "N/A", COL_FILESIZE_WIDTH,
+             size_str);
 
   // Draw quality label with special color if not selected
-  if (!selected && colors_supported && strlen (quality) > 0)
+  if (!selected && colors_supported)
     {
-      if (strstr (quality, "4K") || strstr (quality, "Full HD"))
+      if (highlight)
         {
           wattron (win, COLOR_PAIR (COLOR_PAIR_SUCCESS));
         }
-      else if (strstr (quality, "Audio"))
+      else if (audio)
         {
           wattron (win, COLOR_PAIR (COLOR_PAIR_WARNING));
         }
@@ -191,13 +112,13 @@ draw_format_entry (WINDOW *win, int y, int index, json_t *format,
     {
       wattroff (win, COLOR_PAIR (COLOR_PAIR_SELECTED) | A_BOLD);
     }
-  else if (!selected && colors_supported && strlen (quality) > 0)
+  else if (!selected && colors_supported)
     {
-      if (strstr (quality, "4K") || strstr (quality, "Full HD"))
+      if (highlight)
         {
           wattroff (win, COLOR_PAIR (COLOR_PAIR_SUCCESS));
         }
-      else if (strstr (quality, "Audio"))
+      else if (audio)
         {
           wattroff (win, COLOR_PAIR (COLOR_PAIR_WARNING));
         }
@@ -207,15 +128,15 @@ draw_format_entry (WINDOW *win, int y, int index, json_t *format,
 /**
  * Display formats in the content window.
  * @param state UI state structure
- * @param formats JSON array of formats
+ * @param table Format table
  * @param list_state Format list state for scrolling
  * @return 0 on success, -1 on error
  */
 int
-ui_display_formats (UIState *state, json_t *formats,
+ui_display_formats (UIState *state, const FormatTable *table,
                     FormatListState *list_state)
 {
-  if (state == NULL || formats == NULL || list_state == NULL
+  if (state == NULL || table == NULL || list_state == NULL
       || !state->ncurses_available)
     {
       return -1;
@@ -227,10 +148,10 @@ ui_display_formats (UIState *state, json_t *formats,
   werase (win);
 
   // Initialize list state only if not already initialized
-  if (list_state->formats == NULL)
+  if (list_state->table == NULL)
     {
-      list_state->formats = formats;
-      list_state->total_formats = json_array_size (formats);
+      list_state->table = table;
+      list_state->total_formats = (int)table->count;
       list_state->selected_index = 0;
       list_state->visible_start = 0;
     }
@@ -265,10 +186,8 @@ ui_display_formats (UIState *state, json_t *formats,
        i++)
     {
       int format_index = list_state->visible_start + i;
-      json_t *format = json_array_get (formats, format_index);
-
       bool selected = (format_index == list_state->selected_index);
-      draw_format_entry (win, y + i, format_index, format, selected,
+      draw_format_entry (win, y + i, table, format_index, selected,
                          state->colors_supported);
     }
 
@@ -312,7 +231,7 @@ update_format_display (UIState *state, FormatListState *list_state)
     }
 
   // Redraw the format list
-  ui_display_formats (state, list_state->formats, list_state);
+  ui_display_formats (state, list_state->table, list_state);
 }
 
 /**
@@ -343,13 +262,7 @@ handle_format_shortcut (int ch, FormatListState *list_state)
       // Select first audio-only format
       for (int i = 0; i < list_state->total_formats; i++)
         {
-          json_t *format = json_array_get (list_state->formats, i);
-          json_t *res_obj = json_object_get (format, "resolution");
-          const char *resolution = (res_obj && json_is_string (res_obj))
-                                       ? json_string_value (res_obj)
-                                       : "N/A";
-
-          if (strcmp (resolution, "N/A") == 0 || strstr (resolution, "audio"))
+          if (list_state->table->quality[i] == FORMAT_QUALITY_AUDIO)
             {
               list_state->selected_index = i;
               return 1;
@@ -465,20 +378,20 @@ ui_select_format_interactive (UIState *state, FormatListState *list_state)
         case '\r':
         case KEY_ENTER:
           // Get selected format code
-          {
-            json_t *format = json_array_get (list_state->formats,
-                                             list_state->selected_index);
-            json_t *id_obj = json_object_get (format, "format_id");
-            if (id_obj && json_is_string (id_obj))
-              {
-                const char *format_id = json_string_value (id_obj);
-                selected_format = malloc (strlen (format_id) + 1);
-                if (selected_format)
-                  {
-                    strcpy (selected_format, format_id);
-                  }
-              }
-          }
+          if (list_state->selected_index >= 0
+              && list_state->selected_index < list_state->total_formats)
+            {
+              const char *format_id
+                  = list_state->table->format_id[list_state->selected_index];
+              if (format_id != NULL)
+                {
+                  selected_format = malloc (strlen (format_id) + 1);
+                  if (selected_format)
+                    {
+                      strcpy (selected_format, format_id);
+                    }
+                }
+            }
           selecting = false;
           break;
 
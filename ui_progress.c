@@ -64,23 +64,18 @@ draw_progress_bar (WINDOW *win, int y, int x, int width, double percent,
 double
 ui_calculate_speed (DownloadProgress *progress)
 {
-  if (progress == NULL || progress->sample_index == 0)
-    {
-      return 0.0;
-    }
-
-  // Find oldest and newest samples
-  int oldest_idx = 0;
-  int newest_idx
-      = (progress->sample_index - 1 + SPEED_SAMPLE_SIZE) % SPEED_SAMPLE_SIZE;
-
   // Need at least 2 samples
-  if (progress->samples[oldest_idx].timestamp == 0
-      || progress->samples[newest_idx].timestamp == 0)
+  if (progress == NULL || progress->sample_count < 2)
     {
       return 0.0;
     }
 
+  // Oldest and newest samples still in the ring
+  int newest_idx = progress->sample_index;
+  int oldest_idx
+      = (newest_idx - (progress->sample_count - 1) + SPEED_SAMPLE_SIZE)
+        % SPEED_SAMPLE_SIZE;
+
   // Calculate time difference
   double time_diff = difftime (progress->samples[newest_idx].timestamp,
                                progress->samples[oldest_idx].timestamp);
@@ -118,12 +113,20 @@ ui_update_progress (DownloadProgress *progress, long long downloaded,
   progress->downloaded_bytes = downloaded;
   progress->total_bytes = total;
 
-  // Update speed calculation ring buffer
+  // Update speed calculation ring buffer, one sample per second
   time_t now = time (NULL);
-  if (now != progress->samples[progress->sample_index].timestamp)
+  if (progress->sample_count == 0
+      || now != progress->samples[progress->sample_index].timestamp)
     {
-      progress->sample_index
-          = (progress->sample_index + 1) % SPEED_SAMPLE_SIZE;
+      if (progress->sample_count > 0)
+        {
+          progress->sample_index
+              = (progress->sample_index + 1) % SPEED_SAMPLE_SIZE;
+        }
+      if (progress->sample_count < SPEED_SAMPLE_SIZE)
+        {
+          progress->sample_count++;
+        }
       progress->samples[progress->sample_index].timestamp = now;
       progress->samples[progress->sample_index].bytes = downloaded;
     }
@@ -0,0 +1,286 @@
+#define _GNU_SOURCE
+#include "url_feeder.h"
+#include "command_execution.h"
+#include "playlist.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Queue one URL, listing it first if it names a playlist.
+ * @param feeder Feeder
+ * @param url URL from the command line or the batch file
+ * @return 0 to go on, -1 once the downloads have stopped
+ */
+static int
+feed_url (UrlFeeder *feeder, const char *url)
+{
+  feeder->sources++;
+  if (feeder->config->force_playlist || is_playlist_url (url))
+    {
+      // Its entries are all in the journal already
+      if (feeder->journal != NULL
+          && journal_lookup (feeder->journal, url, NULL, NULL, 0)
+                 == JOURNAL_LISTED)
+        {
+          return 0;
+        }
+
+      PlaylistReader reader;
+      if (playlist_list (&reader, url, (int)feeder->config->list_shards,
+                         feeder->queue)
+          != 0)
+        {
+          fprintf (stderr, "Error: Listing of %s did not complete\n", url);
+          feeder->status = -1;
+        }
+      else if (feeder->journal != NULL && !command_cancel_requested ())
+        {
+          journal_update (feeder->journal, url, JOURNAL_LISTED, -1, NULL);
+        }
+      return command_cancel_requested () ? -1 : 0;
+    }
+  return download_queue_push (feeder->queue, url, feeder->sources);
+}
+
+/**
+ * Queue the URL on one batch file line. Blank lines and comments
+ * (starting with '#', ';' or ']', as in yt-dlp's batch files) are
+ * skipped, as is anything yt-dlp would take for an option.
+ * @param feeder Feeder
+ * @param line Line without its newline (modified)
+ * @param length Length of line
+ * @return 0 to go on, -1 once the downloads have stopped
+ */
+static int
+feed_line (UrlFeeder *feeder, char *line, size_t length)
+{
+  while (length > 0 && isspace ((unsigned char)line[length - 1]))
+    {
+      length--;
+    }
+  line[length] = '\0';
+  while (isspace ((unsigned char)*line))
+    {
+      line++;
+    }
+  if (*line == '\0' || strchr ("#;]", *line) != NULL)
+    {
+      return 0;
+    }
+  if (*line == '-')
+    {
+      fprintf (stderr, "Warning: Skipping batch line starting with '-': %s\n",
+               line);
+      return 0;
+    }
+  return feed_url (feeder, line);
+}
+
+/**
+ * Feed the lines of the batch file. Reads wait in short polls, so that a
+ * cancelled run is noticed even while stdin is idle.
+ * @param feeder Feeder
+ * @param path Batch file, or BATCH_FILE_STDIN
+ * @return 0 to go on, -1 once the downloads have stopped
+ */
+static int
+feed_batch_file (UrlFeeder *feeder, const char *path)
+{
+  int from_stdin = strcmp (path, BATCH_FILE_STDIN) == 0;
+  int fd = from_stdin ? STDIN_FILENO : open (path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      fprintf (stderr, "Error: Cannot open batch file %s: %s\n", path,
+               strerror (errno));
+      feeder->status = -1;
+      return 0;
+    }
+
+  char line[MAX_URL_LENGTH + 1];
+  size_t length = 0;
+  int skipping = 0; // inside a line too long to be a URL
+  int stopped = 0;
+  while (!stopped && !command_cancel_requested ())
+    {
+      struct pollfd pfd = { .fd = fd, .events = POLLIN };
+      if (poll (&pfd, 1, COMMAND_WATCH_INTERVAL_MS) == 0)
+        {
+          continue;
+        }
+
+      ssize_t bytes_read = read (fd, line + length, sizeof (line) - length);
+      if (bytes_read == -1 && errno == EINTR)
+        {
+          continue;
+        }
+      if (bytes_read <= 0)
+        {
+          if (bytes_read == -1)
+            {
+              fprintf (stderr, "Error: Cannot read batch file %s: %s\n",
+                       path, strerror (errno));
+              feeder->status = -1;
+            }
+          else if (length > 0 && !skipping)
+            {
+              stopped = feed_line (feeder, line, length) != 0;
+            }
+          break;
+        }
+      length += (size_t)bytes_read;
+
+      size_t start = 0;
+      char *newline;
+      while (!stopped
+             && (newline = memchr (line + start, '\n', length - start))
+                    != NULL)
+        {
+          size_t end = (size_t)(newline - line);
+          if (!skipping)
+            {
+              stopped = feed_line (feeder, line + start, end - start) != 0;
+            }
+          skipping = 0;
+          start = end + 1;
+        }
+      memmove (line, line + start, length - start);
+      length -= start;
+      if (length == sizeof (line))
+        {
+          if (!skipping)
+            {
+              fprintf (stderr, "Warning: Skipping batch line over %d "
+                               "characters\n",
+                       MAX_URL_LENGTH - 1);
+            }
+          skipping = 1;
+          length = 0;
+        }
+    }
+
+  if (!from_stdin)
+    {
+      close (fd);
+    }
+  return stopped ? -1 : 0;
+}
+
+/**
+ * Queue what an earlier run left unfinished, ahead of everything else.
+ * @param feeder Feeder with a journal
+ * @return 0 to go on, -1 once the downloads have stopped
+ */
+static int
+feed_unfinished (UrlFeeder *feeder)
+{
+  size_t count;
+  char **urls = journal_unfinished (feeder->journal, &count);
+  int stopped = 0;
+  for (size_t i = 0; i < count; i++)
+    {
+      if (!stopped)
+        {
+          stopped = download_queue_push (feeder->queue, urls[i], i + 1) != 0;
+        }
+      free (urls[i]);
+    }
+  free (urls);
+  return stopped ? -1 : 0;
+}
+
+/**
+ * Journal filter of the queue: every URL pushed, whatever its source, is
+ * claimed in the journal first.
+ * @param url URL being pushed
+ * @param user_data JobJournal
+ * @return 1 to queue it, 0 if it is finished or queued already
+ */
+static int
+claim_url (const char *url, void *user_data)
+{
+  return journal_claim (user_data, url);
+}
+
+/**
+ * Feeder thread: unfinished journal URLs, command-line URLs, then the
+ * batch file, then close.
+ * @param data UrlFeeder
+ * @return NULL
+ */
+static void *
+url_feeder_thread (void *data)
+{
+  UrlFeeder *feeder = data;
+  const Config *config = feeder->config;
+  int stopped = feeder->journal != NULL && feed_unfinished (feeder) != 0;
+  for (size_t i = 0; i < config->url_count && !stopped; i++)
+    {
+      stopped = feed_url (feeder, config->urls[i]) != 0;
+    }
+  if (!stopped && config->batch_file != NULL)
+    {
+      feed_batch_file (feeder, config->batch_file);
+    }
+  download_queue_close (feeder->queue);
+  return NULL;
+}
+
+/**
+ * Start feeding a run's URLs into a download queue.
+ * @param feeder Feeder to start
+ * @param config Configuration with the URLs and batch file (must outlive
+ *               the feeder)
+ * @param queue Queue receiving the URLs (its filter is set with a journal)
+ * @param journal Journal of the run, or NULL
+ * @return 0 on success, -1 on error (the queue is left open)
+ */
+int
+url_feeder_start (UrlFeeder *feeder, const Config *config,
+                  DownloadQueue *queue, JobJournal *journal)
+{
+  memset (feeder, 0, sizeof (UrlFeeder));
+  feeder->config = config;
+  feeder->queue = queue;
+  feeder->journal = journal;
+  if (journal != NULL)
+    {
+      download_queue_set_filter (queue, claim_url, journal);
+    }
+
+  // As for the playlist reader: interrupts belong to the main thread
+  sigset_t blocked, previous;
+  sigemptyset (&blocked);
+  sigaddset (&blocked, SIGINT);
+  sigaddset (&blocked, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, &blocked, &previous);
+  int err = pthread_create (&feeder->thread, NULL, url_feeder_thread, feeder);
+  pthread_sigmask (SIG_SETMASK, &previous, NULL);
+  if (err != 0)
+    {
+      fprintf (stderr, "Error: Cannot start URL feeder: %s\n",
+               strerror (err));
+      return -1;
+    }
+  return 0;
+}
+
+/**
+ * Wait for the feeder to finish. Abandon the queue first when the
+ * downloads stop early, or this waits for room that never comes.
+ * @param feeder Started feeder
+ * @return 0 if every source was read completely, -1 otherwise
+ */
+int
+url_feeder_finish (UrlFeeder *feeder)
+{
+  pthread_join (feeder->thread, NULL);
+  return feeder->status;
+}
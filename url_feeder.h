@@ -0,0 +1,32 @@
+#ifndef URL_FEEDER_H
+#define URL_FEEDER_H
+
+#include "download_queue.h"
+#include "job_journal.h"
+
+#include <pthread.h>
+
+// Stdin as the batch file
+#define BATCH_FILE_STDIN "-"
+
+// Thread feeding every URL of a run into a download queue: the URLs of
+// the command line, then the lines of the batch file. Playlists among
+// them are listed into the queue entry by entry. The queue is closed
+// once everything has been fed. With a journal, the URLs an earlier run
+// left unfinished come first, and those it finished are skipped.
+typedef struct
+{
+  const Config *config;
+  DownloadQueue *queue;
+  JobJournal *journal; // NULL without --journal
+  pthread_t thread;
+  size_t sources; // URLs read from the command line and the batch file
+  int status;     // 0, or -1 if a source could not be read completely
+} UrlFeeder;
+
+// clang-format off
+int url_feeder_start(UrlFeeder *feeder, const Config *config, DownloadQueue *queue, JobJournal *journal);
+int url_feeder_finish(UrlFeeder *feeder);
+// clang-format on
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Small helpers shared by several modules, defined here so that every
+// caller gets them inlined without another object to link
+
+/**
+ * Monotonic clock in milliseconds.
+ * @return Milliseconds since an arbitrary point
+ */
+static inline double
+monotonic_ms (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/**
+ * 64-bit FNV-1a hash of a string.
+ * @param text NUL-terminated string
+ * @return Hash of its bytes
+ */
+static inline uint64_t
+fnv1a_hash (const char *text)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const unsigned char *p = (const unsigned char *)text; *p != '\0'; p++)
+    {
+      hash = (hash ^ *p) * 0x100000001b3ULL;
+    }
+  return hash;
+}
+
+#endif
@@ -1,14 +1,74 @@
+#define _GNU_SOURCE
 #include "video_info.h"
 #include "command_execution.h"
+#include "format_parsing.h"
+#include "json_arena.h"
+#include "json_scan.h"
+#include "metadata_cache.h"
+
+#if USE_EMBEDDED_PYTHON
+#include "python_backend.h"
+#endif
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 // Command constants for yt-dlp
 #define YT_DLP_COMMAND "yt-dlp"
 #define YT_DLP_JSON_FLAG "-j"
+#define YT_DLP_PRINT_FLAG "-O"
+#define YT_DLP_FORMAT_FLAG "-f"
+#define YT_DLP_ALL_FORMATS "all"
+
+// Name of the in-memory file holding the info JSON for the download step
+#define INFO_JSON_MEMFD_NAME "ytdl-info-json"
+// Where the info JSON copies of a batch go when TMPDIR is not set: on
+// disk, since a batch keeps one per URL until all are downloaded
+#define INFO_JSON_BATCH_DIRECTORY "/var/tmp"
+
+// Top-level fields naming the URL a `yt-dlp -j` document was extracted
+// for, in order of preference
+#define JSON_FIELD_ORIGINAL_URL "original_url"
+#define JSON_FIELD_WEBPAGE_URL "webpage_url"
+
+// Parse threads of a batch, at most
+#define BATCH_MAX_WORKERS 8
+// Documents read ahead of the parse threads, per thread, before reading
+// pauses (each can be megabytes)
+#define BATCH_QUEUE_PER_WORKER 2
+// Free space ensured in the line buffer before each read
+#define BATCH_READ_CHUNK (256 * 1024)
+
+// One line of batch output and what a parse thread made of it
+typedef struct
+{
+  char *text; // the document, freed once parsed
+  size_t length;
+  FormatTable *table;       // NULL if the line did not parse
+  int info_json_fd;         // copy of the document for the download, or -1
+  char key[MAX_URL_LENGTH]; // canonical key of its URL, "" if unknown
+} BatchDocument;
+
+// Documents of a batch in output order, handed to the parse threads
+typedef struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t queued; // a document was added, or reading finished
+  pthread_cond_t taken;  // a parse thread took a document
+  BatchDocument **documents;
+  size_t count;
+  size_t capacity;
+  size_t next;       // first document no thread has taken
+  size_t read_ahead; // most documents waiting for a thread
+  int finished;      // no more documents will be added
+} BatchQueue;
 
 /**
  * Validate URL for basic security and format requirements.
@@ -65,32 +125,644 @@ validate_url (const char *url)
 }
 
 /**
- * Retrieve video information from yt-dlp with comprehensive validation.
- * @param url Video URL to fetch information for
- * @return Allocated JSON string containing video info, NULL on error
+ * Subprocess backend: run `yt-dlp -j` with its stdout in an in-memory
+ * file, then scan the mapped text for the displayed fields only. No JSON
+ * tree is built, and the same file is handed to the download so it can
+ * load the document instead of extracting again.
+ * @param url Validated video URL
+ * @param info_json_fd Receives the in-memory file, or -1 on error
+ * @return Format table (free with free_format_table), NULL on error
  */
-char *
-get_video_info (const char *url)
+static FormatTable *
+fetch_info_subprocess (const char *url, int *info_json_fd)
 {
-  if (validate_url (url) != 0)
+  // Build command arguments securely
+  char *const argv[]
+      = { YT_DLP_COMMAND, YT_DLP_JSON_FLAG,
+          (char *)url, // Cast is safe since we validated the URL
+          NULL };
+
+  CapturedOutput captured;
+  if (execute_command_to_memfd (YT_DLP_COMMAND, argv, &captured, NULL) != 0)
     {
+      fprintf (stderr, "Error: Failed to execute yt-dlp command\n");
       return NULL;
     }
 
-  printf ("Fetching video info...\n");
+  FormatTable *table = scan_format_table (captured.data, captured.length);
+  if (table != NULL)
+    {
+      *info_json_fd = captured.fd;
+      captured.fd = -1; // kept open for the download
+    }
+  release_captured_output (&captured);
+  return table;
+}
 
-  // Build command arguments securely
+/**
+ * Lean backend: have yt-dlp print only the fields ytdl displays, one
+ * record per format, instead of the full -j document with its thumbnails,
+ * captions, headers and fragment lists. The result has the same shape as
+ * the full document, restricted to those fields.
+ * @param url Validated video URL
+ * @return Format table (free with free_format_table), NULL on error
+ */
+static FormatTable *
+fetch_info_lean (const char *url)
+{
   char *const argv[]
-      = { YT_DLP_COMMAND, YT_DLP_JSON_FLAG,
+      = { YT_DLP_COMMAND,
+          YT_DLP_FORMAT_FLAG,
+          YT_DLP_ALL_FORMATS, // one "video" print per format
+          YT_DLP_PRINT_FLAG,
+          LEAN_INFO_TEMPLATE,
+          YT_DLP_PRINT_FLAG,
+          LEAN_FORMAT_TEMPLATE,
           (char *)url, // Cast is safe since we validated the URL
           NULL };
 
-  char *result = execute_command_with_output (YT_DLP_COMMAND, argv);
-  if (result == NULL)
+  CommandResult result;
+  if (execute_command_capture (YT_DLP_COMMAND, argv, &result) != 0)
     {
       fprintf (stderr, "Error: Failed to execute yt-dlp command\n");
       return NULL;
     }
 
-  return result;
-}
\ No newline at end of file
+  // The records only live until the table is built
+  JsonArena arena = JSON_ARENA_INIT;
+  json_arena_begin (&arena);
+  json_t *root = parse_lean_metadata (result.output, result.output_length);
+  FormatTable *table = root ? build_format_table (root) : NULL;
+  json_decref (root);
+  json_arena_end (&arena);
+
+  free (result.output);
+  return table;
+}
+
+#if USE_EMBEDDED_PYTHON
+/**
+ * Serialize an info document extracted in-process into an in-memory file
+ * for the download step.
+ * @param root Info document
+ * @return File descriptor, -1 on error
+ */
+static int
+save_info_json (const json_t *root)
+{
+  int fd = memfd_create (INFO_JSON_MEMFD_NAME, MFD_CLOEXEC);
+  if (fd == -1)
+    {
+      fprintf (stderr, "Warning: Cannot keep info JSON for download: %s\n",
+               strerror (errno));
+      return -1;
+    }
+  if (json_dumpfd (root, fd, JSON_COMPACT) != 0)
+    {
+      close (fd);
+      fd = -1;
+    }
+  return fd;
+}
+#endif
+
+/**
+ * Extract the format table with the configured backend.
+ * @param url Validated video URL
+ * @param lean Fetch only the displayed fields
+ * @param info_json_fd Receives the info JSON file, if the backend keeps one
+ * @return Format table (free with free_format_table), NULL on error
+ */
+static FormatTable *
+fetch_info (const char *url, int lean, int *info_json_fd)
+{
+  // The lean records cannot be loaded back, so the download re-extracts
+  if (lean)
+    {
+      return fetch_info_lean (url);
+    }
+
+#if USE_EMBEDDED_PYTHON
+  // In-process extraction skips both the spawn and the JSON text round
+  // trip; without an importable yt_dlp the subprocess backend is used
+  if (python_backend_available ())
+    {
+      // The converted info dict is dropped as a whole once it has been
+      // tabulated and saved
+      JsonArena arena = JSON_ARENA_INIT;
+      json_arena_begin (&arena);
+      json_t *root = python_extract_info (url);
+      FormatTable *table = root ? build_format_table (root) : NULL;
+      if (table != NULL)
+        {
+          *info_json_fd = save_info_json (root);
+        }
+      json_decref (root);
+      json_arena_end (&arena);
+      return table;
+    }
+#endif
+
+  return fetch_info_subprocess (url, info_json_fd);
+}
+
+/**
+ * Retrieve video information from yt-dlp with comprehensive validation.
+ * A table cached by an earlier run is returned without running yt-dlp.
+ * @param url Video URL to fetch information for
+ * @param lean Fetch only the displayed fields (no info JSON is kept)
+ * @param info_json_fd Receives an in-memory file holding the info JSON for
+ *                     `yt-dlp --load-info-json` (caller must close), or -1
+ *                     (always for cached tables: the stream URLs in an info
+ *                     JSON expire, so only the table is cached)
+ * @return Format table (free with free_format_table), NULL on error
+ */
+FormatTable *
+get_video_info (const char *url, int lean, int *info_json_fd)
+{
+  *info_json_fd = -1;
+  if (validate_url (url) != 0)
+    {
+      return NULL;
+    }
+
+  FormatTable *table = metadata_cache_lookup (url);
+  if (table != NULL)
+    {
+      printf ("Using cached video info\n");
+      return table;
+    }
+
+  printf ("Fetching video info...\n");
+  table = fetch_info (url, lean, info_json_fd);
+  metadata_cache_store (url, table);
+  return table;
+}
+
+/**
+ * Copy a document into an unnamed file for the download step. The copies
+ * of a batch all stay open until it is downloaded, so they go to an
+ * O_TMPFILE on disk and only fall back to memory where the file system
+ * cannot hold one.
+ * @param text Document
+ * @param length Length of text
+ * @return File descriptor, -1 on error
+ */
+static int
+save_info_text (const char *text, size_t length)
+{
+  const char *directory = getenv ("TMPDIR");
+  if (directory == NULL || directory[0] == '\0')
+    {
+      directory = INFO_JSON_BATCH_DIRECTORY;
+    }
+  int fd = open (directory, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd == -1)
+    {
+      fd = memfd_create (INFO_JSON_MEMFD_NAME, MFD_CLOEXEC);
+    }
+  if (fd == -1)
+    {
+      fprintf (stderr, "Warning: Cannot keep info JSON for download: %s\n",
+               strerror (errno));
+      return -1;
+    }
+  while (length > 0)
+    {
+      ssize_t written = write (fd, text, length);
+      if (written == -1 && errno == EINTR)
+        {
+          continue;
+        }
+      if (written <= 0)
+        {
+          close (fd);
+          return -1;
+        }
+      text += written;
+      length -= (size_t)written;
+    }
+  return fd;
+}
+
+/**
+ * Canonical key of the URL a document was extracted for: the URL yt-dlp
+ * was given (original_url), else the video's page.
+ * @param text Document
+ * @param length Length of text
+ * @param key Receives the key, "" if the document names no usable URL
+ * @param size Size of key
+ */
+static void
+scan_document_key (const char *text, size_t length, char *key, size_t size)
+{
+  key[0] = '\0';
+  JsonScanner scanner;
+  json_scan_init (&scanner, text, length);
+  if (json_scan_enter (&scanner, JSON_SCAN_OBJECT) != 0)
+    {
+      return;
+    }
+
+  char url[MAX_URL_LENGTH];
+  int first = 1;
+  JsonSpan name, value;
+  while (json_scan_next_member (&scanner, &first, &name) == 1)
+    {
+      int original = json_span_equals (&name, JSON_FIELD_ORIGINAL_URL);
+      if ((!original && !json_span_equals (&name, JSON_FIELD_WEBPAGE_URL))
+          || json_scan_peek (&scanner) != JSON_SCAN_STRING)
+        {
+          if (json_scan_skip (&scanner) != 0)
+            {
+              return;
+            }
+          continue;
+        }
+      if (json_scan_string (&scanner, &value) != 0)
+        {
+          return;
+        }
+      if (value.length < sizeof (url) && (original || key[0] == '\0'))
+        {
+          json_span_decode (&value, url);
+          if (canonical_video_key (url, key, size) != 0)
+            {
+              key[0] = '\0';
+            }
+          if (original && key[0] != '\0')
+            {
+              return;
+            }
+        }
+    }
+}
+
+/**
+ * Parse one batch document into its format table, key and info JSON file.
+ * Runs on a parse thread; touches nothing but the document.
+ * @param document Document, its text is released
+ */
+static void
+parse_batch_document (BatchDocument *document)
+{
+  document->table = scan_format_table (document->text, document->length);
+  if (document->table != NULL)
+    {
+      scan_document_key (document->text, document->length, document->key,
+                         sizeof (document->key));
+      document->info_json_fd
+          = save_info_text (document->text, document->length);
+    }
+  free (document->text);
+  document->text = NULL;
+}
+
+/**
+ * Parse thread: take documents in output order until reading is finished
+ * and none are left.
+ * @param data BatchQueue
+ * @return NULL
+ */
+static void *
+batch_worker (void *data)
+{
+  BatchQueue *queue = data;
+  for (;;)
+    {
+      pthread_mutex_lock (&queue->lock);
+      while (queue->next == queue->count && !queue->finished)
+        {
+          pthread_cond_wait (&queue->queued, &queue->lock);
+        }
+      if (queue->next == queue->count)
+        {
+          pthread_mutex_unlock (&queue->lock);
+          return NULL;
+        }
+      BatchDocument *document = queue->documents[queue->next++];
+      pthread_cond_signal (&queue->taken);
+      pthread_mutex_unlock (&queue->lock);
+
+      parse_batch_document (document);
+    }
+}
+
+/**
+ * Add a complete line of output to the batch. Blocks while read_ahead
+ * documents are already waiting, so a slow parse holds yt-dlp back through
+ * the pipe instead of piling up documents in memory.
+ * @param queue Batch queue
+ * @param text Line without its newline, ownership taken
+ * @param length Length of text
+ * @param parse_here Parse on the calling thread (no parse threads)
+ * @return 0 on success, -1 on error
+ */
+static int
+queue_document (BatchQueue *queue, char *text, size_t length, int parse_here)
+{
+  BatchDocument *document = malloc (sizeof (BatchDocument));
+  if (document == NULL)
+    {
+      fprintf (stderr, "Error: Memory allocation failed\n");
+      free (text);
+      return -1;
+    }
+  document->text = text;
+  document->length = length;
+  document->table = NULL;
+  document->info_json_fd = -1;
+  document->key[0] = '\0';
+  if (parse_here)
+    {
+      parse_batch_document (document);
+    }
+
+  pthread_mutex_lock (&queue->lock);
+  while (!parse_here && queue->count - queue->next >= queue->read_ahead)
+    {
+      pthread_cond_wait (&queue->taken, &queue->lock);
+    }
+  if (queue->count == queue->capacity)
+    {
+      size_t capacity = queue->capacity ? queue->capacity * 2 : 16;
+      BatchDocument **grown = realloc (queue->documents,
+                                       capacity * sizeof (BatchDocument *));
+      if (grown == NULL)
+        {
+          pthread_mutex_unlock (&queue->lock);
+          fprintf (stderr, "Error: Memory allocation failed\n");
+          free (document->text);
+          free_format_table (document->table);
+          free (document);
+          return -1;
+        }
+      queue->documents = grown;
+      queue->capacity = capacity;
+    }
+  queue->documents[queue->count++] = document;
+  if (parse_here)
+    {
+      queue->next = queue->count;
+    }
+  pthread_cond_signal (&queue->queued);
+  pthread_mutex_unlock (&queue->lock);
+  return 0;
+}
+
+/**
+ * Split the output of `yt-dlp -j URL...` into documents as it arrives,
+ * one per line. Output is read straight into the line being assembled;
+ * only the bytes past a newline are copied, to start the next line.
+ * @param stream Running yt-dlp
+ * @param queue Batch queue receiving the lines
+ * @param parse_here Parse on this thread (no parse threads)
+ * @return 0 on success, -1 on error
+ */
+static int
+read_batch_output (CommandStream *stream, BatchQueue *queue, int parse_here)
+{
+  char *line = NULL;
+  size_t length = 0, capacity = 0, scanned = 0;
+  int status = 0;
+  for (;;)
+    {
+      if (capacity - length < BATCH_READ_CHUNK)
+        {
+          size_t grown_capacity = capacity ? capacity * 2 : BATCH_READ_CHUNK;
+          char *grown = realloc (line, grown_capacity);
+          if (grown == NULL)
+            {
+              fprintf (stderr, "Error: Memory allocation failed\n");
+              status = -1;
+              break;
+            }
+          line = grown;
+          capacity = grown_capacity;
+        }
+
+      ssize_t bytes_read
+          = command_stream_read (stream, line + length, capacity - length);
+      if (bytes_read <= 0)
+        {
+          status = bytes_read == 0 ? 0 : -1;
+          break;
+        }
+      length += (size_t)bytes_read;
+
+      char *newline;
+      while (status == 0
+             && (newline = memchr (line + scanned, '\n', length - scanned))
+                    != NULL)
+        {
+          size_t line_length = (size_t)(newline - line);
+          size_t rest = length - line_length - 1;
+          char *next = malloc (rest + BATCH_READ_CHUNK);
+          if (next == NULL)
+            {
+              fprintf (stderr, "Error: Memory allocation failed\n");
+              status = -1;
+              break;
+            }
+          memcpy (next, newline + 1, rest);
+          if (line_length > 0)
+            {
+              status = queue_document (queue, line, line_length, parse_here);
+            }
+          else
+            {
+              free (line);
+            }
+          line = next;
+          length = rest;
+          capacity = rest + BATCH_READ_CHUNK;
+          scanned = 0;
+        }
+      if (status != 0)
+        {
+          break;
+        }
+      scanned = length;
+    }
+
+  // yt-dlp ends every document with a newline, but a killed run may not
+  if (status == 0 && length > 0)
+    {
+      return queue_document (queue, line, length, parse_here);
+    }
+  free (line);
+  return status;
+}
+
+/**
+ * Hand a parsed document to the entry it was requested by: the entry with
+ * the same canonical key, or for a document naming no URL, the first
+ * entry still waiting (yt-dlp prints documents in argument order).
+ * @return 1 if the document was taken, 0 if nothing requested it
+ */
+static int
+assign_document (VideoInfoEntry *entries, char (*keys)[MAX_URL_LENGTH],
+                 const int *requested, size_t count, BatchDocument *document)
+{
+  for (size_t i = 0; i < count; i++)
+    {
+      if (requested[i] && entries[i].table == NULL
+          && (document->key[0] == '\0'
+              || strcmp (keys[i], document->key) == 0))
+        {
+          entries[i].table = document->table;
+          entries[i].info_json_fd = document->info_json_fd;
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Retrieve video information for several URLs with a single yt-dlp run, so
+ * interpreter startup and extractor setup are paid once per batch instead
+ * of once per video. `yt-dlp -j` prints one document per line; lines are
+ * split off as they arrive and parsed into format tables on a pool of
+ * threads while yt-dlp works on the next video. Cached tables are used as
+ * by get_video_info(). Lean records (which carry no URL to match them by)
+ * and the in-process backend (which has no startup to amortize) fetch one
+ * URL at a time.
+ * @param entries URLs to fetch; table and info_json_fd are filled in
+ *                (table NULL and info_json_fd -1 where fetching failed)
+ * @param count Number of entries
+ * @param lean Fetch only the displayed fields
+ * @return Number of entries that received a table
+ */
+size_t
+get_video_info_batch (VideoInfoEntry *entries, size_t count, int lean)
+{
+  size_t found = 0;
+  int in_process = 0;
+#if USE_EMBEDDED_PYTHON
+  in_process = python_backend_available ();
+#endif
+  if (lean || in_process)
+    {
+      for (size_t i = 0; i < count; i++)
+        {
+          entries[i].table = get_video_info (entries[i].url, lean,
+                                             &entries[i].info_json_fd);
+          found += entries[i].table != NULL;
+        }
+      return found;
+    }
+
+  char **argv = calloc (count + 3, sizeof (char *));
+  char (*keys)[MAX_URL_LENGTH] = calloc (count, MAX_URL_LENGTH);
+  int *requested = calloc (count, sizeof (int));
+  if (argv == NULL || keys == NULL || requested == NULL)
+    {
+      fprintf (stderr, "Error: Memory allocation failed\n");
+      free (argv);
+      free (keys);
+      free (requested);
+      return 0;
+    }
+
+  size_t argc = 0;
+  argv[argc++] = YT_DLP_COMMAND;
+  argv[argc++] = YT_DLP_JSON_FLAG;
+  for (size_t i = 0; i < count; i++)
+    {
+      entries[i].table = NULL;
+      entries[i].info_json_fd = -1;
+      if (validate_url (entries[i].url) != 0)
+        {
+          continue;
+        }
+      entries[i].table = metadata_cache_lookup (entries[i].url);
+      if (entries[i].table != NULL)
+        {
+          found++;
+          continue;
+        }
+      canonical_video_key (entries[i].url, keys[i], MAX_URL_LENGTH);
+      requested[i] = 1;
+      argv[argc++] = (char *)entries[i].url; // validated above
+    }
+  size_t pending = argc - 2;
+  if (pending == 0)
+    {
+      goto done;
+    }
+
+  printf ("Fetching video info for %zu videos...\n", pending);
+  CommandStream stream;
+  if (command_stream_open (&stream, YT_DLP_COMMAND, argv) != 0)
+    {
+      fprintf (stderr, "Error: Failed to execute yt-dlp command\n");
+      goto done;
+    }
+
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  size_t wanted = cpus > 0 ? (size_t)cpus : 1;
+  wanted = wanted < BATCH_MAX_WORKERS ? wanted : BATCH_MAX_WORKERS;
+  wanted = wanted < pending ? wanted : pending;
+
+  BatchQueue queue = { .read_ahead = wanted * BATCH_QUEUE_PER_WORKER };
+  pthread_mutex_init (&queue.lock, NULL);
+  pthread_cond_init (&queue.queued, NULL);
+  pthread_cond_init (&queue.taken, NULL);
+  pthread_t workers[BATCH_MAX_WORKERS];
+  size_t worker_count = 0;
+  while (worker_count < wanted
+         && pthread_create (&workers[worker_count], NULL, batch_worker, &queue)
+                == 0)
+    {
+      worker_count++;
+    }
+
+  read_batch_output (&stream, &queue, worker_count == 0);
+  pthread_mutex_lock (&queue.lock);
+  queue.finished = 1;
+  pthread_cond_broadcast (&queue.queued);
+  pthread_mutex_unlock (&queue.lock);
+  for (size_t i = 0; i < worker_count; i++)
+    {
+      pthread_join (workers[i], NULL);
+    }
+  // A video that failed is reported here; the others are still used
+  command_stream_close (&stream);
+
+  for (size_t i = 0; i < queue.count; i++)
+    {
+      BatchDocument *document = queue.documents[i];
+      if (document->table != NULL
+          && assign_document (entries, keys, requested, count, document))
+        {
+          found++;
+        }
+      else if (document->table != NULL)
+        {
+          free_format_table (document->table);
+          if (document->info_json_fd >= 0)
+            {
+              close (document->info_json_fd);
+            }
+        }
+      free (document);
+    }
+  for (size_t i = 0; i < count; i++)
+    {
+      if (requested[i])
+        {
+          metadata_cache_store (entries[i].url, entries[i].table);
+        }
+    }
+
+  free (queue.documents);
+  pthread_cond_destroy (&queue.taken);
+  pthread_cond_destroy (&queue.queued);
+  pthread_mutex_destroy (&queue.lock);
+
+done:
+  free (argv);
+  free (keys);
+  free (requested);
+  return found;
+}
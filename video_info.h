@@ -1,10 +1,20 @@
 #ifndef VIDEO_INFO_H
 #define VIDEO_INFO_H
 
+#include "format_parsing.h"
 #include "ytdl.h"
 
+// One URL of a batch and what was fetched for it
+typedef struct
+{
+  const char *url;
+  FormatTable *table; // NULL if the video could not be fetched
+  int info_json_fd;   // info JSON for the download (caller closes), or -1
+} VideoInfoEntry;
+
 // clang-format off
-char *get_video_info(const char *url);
+FormatTable *get_video_info(const char *url, int lean, int *info_json_fd);
+size_t get_video_info_batch(VideoInfoEntry *entries, size_t count, int lean);
 // clang-format on
 
 #endif
\ No newline at end of file
@@ -16,6 +16,7 @@
 #define MAX_PATH_LENGTH 4096
 #define BUFFER_SIZE 1024
 #define FORMAT_CODE_LENGTH 20
+#define FORMAT_SELECTOR_LENGTH 256
 #define DIRECTORY_PERMISSIONS (S_IRWXU)
 
 enum
@@ -26,8 +27,27 @@ enum
 
 typedef struct
 {
-  const char *url;
+  const char *url;               // video being processed
+  char *const *urls;             // every URL given, url_count of them
+  size_t url_count;
   char *output_path;
+  long timeout_seconds;          // per-command wall-clock limit, 0 for none
+  unsigned long max_memory_mb;   // per-command address space cap, 0 for none
+  unsigned long max_cpu_seconds; // per-command CPU time cap, 0 for none
+  int use_zygote;                // fork yt-dlp from a pre-warmed helper
+  int info_json_fd;              // memfd holding the fetched info JSON, or -1
+  char *format_selector;         // download this without fetching metadata
+  int force_playlist;            // treat every URL as a playlist or channel
+  unsigned long list_shards;     // concurrent yt-dlp runs listing a playlist
+  unsigned long jobs;            // concurrent downloads (-j), 0 if not given
+  char *batch_file;              // file of URLs ("-" for stdin), or NULL
+  char *rate_limit;              // combined rate or schedule, or NULL
+  char *journal_path;            // job journal to resume from, or NULL
+  int show_stats;                // print per-phase timings at exit
+  int lean_metadata;             // fetch only the displayed fields
+  long cache_ttl_seconds;        // metadata cache lifetime, 0 disables it
+  char *archive_path;            // zstd archive for fetched info JSON, or NULL
+  unsigned long connections;     // range requests per download, 0 for yt-dlp
 } Config;
 
 #endif
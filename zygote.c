@@ -0,0 +1,555 @@
+#define _GNU_SOURCE
+#include "zygote.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// Descriptor the helper finds its control socket on
+#define ZYGOTE_CONTROL_FD 3
+// Largest request (argv strings plus separators) the helper accepts
+#define ZYGOTE_MAX_REQUEST (64 * 1024)
+// How long the helper may take to import yt_dlp and report ready
+#define ZYGOTE_START_TIMEOUT_MS 30000
+// How long the helper may take to fork a runner and report its pid
+#define ZYGOTE_SPAWN_TIMEOUT_MS 10000
+// Interpreter used when YTDL_PYTHON is unset
+#define ZYGOTE_DEFAULT_PYTHON "python3"
+
+/*
+ * The helper imports yt_dlp once, then waits on its control socket. Each
+ * request carries argv (NUL-separated) plus three descriptors: a status
+ * socket, stdout and stderr. The helper forks a runner that becomes its own
+ * process group leader and calls yt_dlp.main() with those descriptors as
+ * its standard streams. The runner's pid goes back over the status socket
+ * at once; its wait status and CPU times follow when it is reaped.
+ * Runners inherit the environment the helper was started with.
+ */
+static const char zygote_script[]
+    = "import array, os, select, signal, socket, sys, traceback\n"
+      "import yt_dlp\n"
+      "ctl = socket.socket(fileno=3)\n"
+      "rd, wr = os.pipe()\n"
+      "os.set_blocking(rd, False)\n"
+      "os.set_blocking(wr, False)\n"
+      "signal.signal(signal.SIGCHLD, lambda *a: None)\n"
+      "signal.signal(signal.SIGINT, signal.SIG_IGN)\n"
+      "signal.set_wakeup_fd(wr)\n"
+      "def run(argv, out, err):\n"
+      "    code = 1\n"
+      "    try:\n"
+      "        os.setpgid(0, 0)\n"
+      "        signal.set_wakeup_fd(-1)\n"
+      "        signal.signal(signal.SIGCHLD, signal.SIG_DFL)\n"
+      "        signal.signal(signal.SIGINT, signal.default_int_handler)\n"
+      "        os.dup2(os.open(os.devnull, os.O_RDONLY), 0)\n"
+      "        os.dup2(out, 1)\n"
+      "        os.dup2(err, 2)\n"
+      "        os.closerange(3, 65536)\n"
+      "        sys.stdout = open(1, 'w', 1 if os.isatty(1) else -1, 'utf-8',"
+      " 'replace', closefd=False)\n"
+      "        sys.stderr = open(2, 'w', 1, 'utf-8', 'backslashreplace',"
+      " closefd=False)\n"
+      "        sys.__stdout__, sys.__stderr__ = sys.stdout, sys.stderr\n"
+      "        sys.argv = ['yt-dlp'] + argv\n"
+      "        code = 0\n"
+      "        yt_dlp.main(argv)\n"
+      "    except SystemExit as e:\n"
+      "        if isinstance(e.code, int):\n"
+      "            code = e.code\n"
+      "        elif e.code is not None:\n"
+      "            sys.stderr.write('%s\\n' % e.code)\n"
+      "            code = 1\n"
+      "    except BaseException:\n"
+      "        traceback.print_exc()\n"
+      "        code = 1\n"
+      "    try:\n"
+      "        sys.stdout.flush()\n"
+      "        sys.stderr.flush()\n"
+      "    finally:\n"
+      "        os._exit(code & 0xff)\n"
+      "conns = {}\n"
+      "ctl.send(b'ready')\n"
+      "while True:\n"
+      "    ready = select.select([ctl, rd], [], [])[0]\n"
+      "    if rd in ready:\n"
+      "        try:\n"
+      "            os.read(rd, 512)\n"
+      "        except BlockingIOError:\n"
+      "            pass\n"
+      "        while conns:\n"
+      "            try:\n"
+      "                pid, status, ru = os.wait4(-1, os.WNOHANG)\n"
+      "            except ChildProcessError:\n"
+      "                break\n"
+      "            if pid == 0:\n"
+      "                break\n"
+      "            c = conns.pop(pid, None)\n"
+      "            if c is not None:\n"
+      "                try:\n"
+      "                    c.send(b'%d %d %d' % (status,"
+      " int(ru.ru_utime * 1e6), int(ru.ru_stime * 1e6)))\n"
+      "                except OSError:\n"
+      "                    pass\n"
+      "                c.close()\n"
+      "    if ctl in ready:\n"
+      "        msg, anc, _, _ = ctl.recvmsg(65536, socket.CMSG_SPACE(12))\n"
+      "        if not msg:\n"
+      "            break\n"
+      "        fds = array.array('i')\n"
+      "        for level, kind, data in anc:\n"
+      "            if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:\n"
+      "                fds.frombytes(data[:len(data) - len(data) % 4])\n"
+      "        if len(fds) != 3:\n"
+      "            for fd in fds:\n"
+      "                os.close(fd)\n"
+      "            continue\n"
+      "        argv = [os.fsdecode(a) for a in msg.split(b'\\0')[1:-1]]\n"
+      "        pid = os.fork()\n"
+      "        if pid == 0:\n"
+      "            run(argv, fds[1], fds[2])\n"
+      "        try:\n"
+      "            os.setpgid(pid, pid)\n"
+      "        except OSError:\n"
+      "            pass\n"
+      "        os.close(fds[1])\n"
+      "        os.close(fds[2])\n"
+      "        c = socket.socket(fileno=fds[0])\n"
+      "        try:\n"
+      "            c.send(b'%d' % pid)\n"
+      "        except OSError:\n"
+      "            pass\n"
+      "        conns[pid] = c\n";
+
+// Runner started through the zygote and not yet reaped
+typedef struct
+{
+  pid_t pid;
+  int status_fd; // receives "<wait status> <utime us> <stime us>"
+} ZygoteChild;
+
+static pid_t zygote_pid = -1;
+static int zygote_fd = -1;
+static ZygoteChild *zygote_children = NULL;
+static size_t zygote_child_count = 0;
+static size_t zygote_child_capacity = 0;
+
+/**
+ * Wait until a socket is readable and receive one message from it.
+ * @param fd Socket
+ * @param buffer Destination (NUL-terminated on success)
+ * @param size Size of destination
+ * @param timeout_ms Maximum wait
+ * @return Bytes received, 0 if the peer closed, -1 on error or timeout
+ */
+static ssize_t
+receive_message (int fd, char *buffer, size_t size, int timeout_ms)
+{
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  int ready;
+  do
+    {
+      ready = poll (&pfd, 1, timeout_ms);
+    }
+  while (ready == -1 && errno == EINTR);
+  if (ready <= 0)
+    {
+      return -1;
+    }
+
+  ssize_t received;
+  do
+    {
+      received = recv (fd, buffer, size - 1, 0);
+    }
+  while (received == -1 && errno == EINTR);
+  if (received >= 0)
+    {
+      buffer[received] = '\0';
+    }
+  return received;
+}
+
+/**
+ * Find the registry entry of a zygote runner.
+ * @param pid Runner pid
+ * @return Entry, NULL if the pid was not started through the zygote
+ */
+static ZygoteChild *
+find_child (pid_t pid)
+{
+  for (size_t i = 0; i < zygote_child_count; i++)
+    {
+      if (zygote_children[i].pid == pid)
+        {
+          return &zygote_children[i];
+        }
+    }
+  return NULL;
+}
+
+/**
+ * Start the fork-server helper. It costs one interpreter startup and one
+ * yt_dlp import; every later yt-dlp launch is a fork of the warm helper.
+ * @param python Interpreter to run (NULL for $YTDL_PYTHON or python3)
+ * @return 0 on success, -1 on error (yt-dlp is then launched normally)
+ */
+int
+zygote_start (const char *python)
+{
+  if (zygote_fd >= 0)
+    {
+      return 0;
+    }
+  if (python == NULL)
+    {
+      python = getenv ("YTDL_PYTHON");
+    }
+  if (python == NULL || *python == '\0')
+    {
+      python = ZYGOTE_DEFAULT_PYTHON;
+    }
+
+  int pair[2];
+  if (socketpair (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) == -1)
+    {
+      perror ("socketpair");
+      return -1;
+    }
+  // dup2 onto itself would leave close-on-exec set
+  if (pair[1] == ZYGOTE_CONTROL_FD)
+    {
+      int moved = fcntl (pair[1], F_DUPFD_CLOEXEC, ZYGOTE_CONTROL_FD + 1);
+      close (pair[1]);
+      pair[1] = moved;
+    }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_init (&actions);
+  posix_spawnattr_init (&attr);
+
+  // The helper is silent; failures show up as a missing ready message
+  posix_spawn_file_actions_addopen (&actions, STDIN_FILENO, "/dev/null",
+                                    O_RDONLY, 0);
+  posix_spawn_file_actions_addopen (&actions, STDOUT_FILENO, "/dev/null",
+                                    O_WRONLY, 0);
+  posix_spawn_file_actions_addopen (&actions, STDERR_FILENO, "/dev/null",
+                                    O_WRONLY, 0);
+  posix_spawn_file_actions_adddup2 (&actions, pair[1], ZYGOTE_CONTROL_FD);
+
+  // Its own process group keeps terminal signals away from it
+  sigset_t empty;
+  sigemptyset (&empty);
+  posix_spawnattr_setpgroup (&attr, 0);
+  posix_spawnattr_setsigmask (&attr, &empty);
+  posix_spawnattr_setflags (&attr,
+                            POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+
+  char *const argv[]
+      = { (char *)python, "-c", (char *)zygote_script, NULL };
+  pid_t pid = -1;
+  int err = pair[1] >= 0 ? posix_spawnp (&pid, python, &actions, &attr,
+                                         argv, environ)
+                         : errno;
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+  if (pair[1] >= 0)
+    {
+      close (pair[1]);
+    }
+
+  if (err != 0)
+    {
+      fprintf (stderr, "Error: Failed to launch %s for the yt-dlp zygote: %s\n",
+               python, strerror (err));
+      close (pair[0]);
+      return -1;
+    }
+
+  char ready[16];
+  if (receive_message (pair[0], ready, sizeof (ready),
+                       ZYGOTE_START_TIMEOUT_MS)
+          <= 0
+      || strcmp (ready, "ready") != 0)
+    {
+      fprintf (stderr,
+               "Error: yt-dlp zygote failed to start (can %s import "
+               "yt_dlp?)\n",
+               python);
+      kill (pid, SIGKILL);
+      waitpid (pid, NULL, 0);
+      close (pair[0]);
+      return -1;
+    }
+
+  zygote_pid = pid;
+  zygote_fd = pair[0];
+  return 0;
+}
+
+/**
+ * Shut the helper down. Runners already started keep running and are
+ * reported as killed if reaped afterwards.
+ */
+void
+zygote_stop (void)
+{
+  if (zygote_fd < 0)
+    {
+      return;
+    }
+
+  // The helper exits when its control socket reaches end-of-file
+  close (zygote_fd);
+  zygote_fd = -1;
+  kill (zygote_pid, SIGTERM);
+  while (waitpid (zygote_pid, NULL, 0) == -1 && errno == EINTR)
+    ;
+  zygote_pid = -1;
+}
+
+/**
+ * Whether the helper is up.
+ * @return Non-zero if zygote_start() succeeded and the helper is usable
+ */
+int
+zygote_running (void)
+{
+  return zygote_fd >= 0;
+}
+
+/**
+ * Whether launches of a command should go through the zygote.
+ * @param command Command name
+ * @return Non-zero if the zygote is running and serves this command
+ */
+int
+zygote_handles (const char *command)
+{
+  return zygote_fd >= 0 && command != NULL
+         && strcmp (command, ZYGOTE_COMMAND) == 0;
+}
+
+/**
+ * Start yt-dlp as a fork of the warm helper.
+ * @param argv Argument vector (argv[0] is ignored)
+ * @param stdout_fd Descriptor for the runner's stdout, -1 to use ours
+ * @param stderr_fd Descriptor for the runner's stderr, -1 to use ours
+ * @return Runner pid (its own process group leader), -1 on error. On error
+ *         the helper is shut down so callers fall back to a normal launch.
+ */
+pid_t
+zygote_spawn (char *const argv[], int stdout_fd, int stderr_fd)
+{
+  if (zygote_fd < 0 || argv == NULL || argv[0] == NULL)
+    {
+      return -1;
+    }
+
+  size_t length = 0;
+  for (size_t i = 0; argv[i] != NULL; i++)
+    {
+      length += strlen (argv[i]) + 1;
+    }
+  if (length > ZYGOTE_MAX_REQUEST)
+    {
+      fprintf (stderr, "Error: Arguments too long for the yt-dlp zygote\n");
+      return -1;
+    }
+
+  if (zygote_child_count == zygote_child_capacity)
+    {
+      size_t capacity = zygote_child_capacity ? zygote_child_capacity * 2 : 8;
+      ZygoteChild *children
+          = realloc (zygote_children, capacity * sizeof (ZygoteChild));
+      if (children == NULL)
+        {
+          perror ("realloc");
+          return -1;
+        }
+      zygote_children = children;
+      zygote_child_capacity = capacity;
+    }
+
+  char *payload = malloc (length);
+  if (payload == NULL)
+    {
+      perror ("malloc");
+      return -1;
+    }
+  char *cursor = payload;
+  for (size_t i = 0; argv[i] != NULL; i++)
+    {
+      size_t len = strlen (argv[i]) + 1;
+      memcpy (cursor, argv[i], len);
+      cursor += len;
+    }
+
+  int status_pair[2];
+  if (socketpair (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, status_pair)
+      == -1)
+    {
+      perror ("socketpair");
+      free (payload);
+      return -1;
+    }
+
+  int fds[3] = { status_pair[1], stdout_fd >= 0 ? stdout_fd : STDOUT_FILENO,
+                 stderr_fd >= 0 ? stderr_fd : STDERR_FILENO };
+  union
+  {
+    char buffer[CMSG_SPACE (sizeof (fds))];
+    struct cmsghdr align;
+  } control;
+  memset (&control, 0, sizeof (control));
+
+  struct iovec iov = { .iov_base = payload, .iov_len = length };
+  struct msghdr msg = { 0 };
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof (control.buffer);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (fds));
+  memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+
+  ssize_t sent;
+  do
+    {
+      sent = sendmsg (zygote_fd, &msg, MSG_NOSIGNAL);
+    }
+  while (sent == -1 && errno == EINTR);
+  free (payload);
+  close (status_pair[1]);
+
+  char reply[32];
+  char *end = NULL;
+  long pid = -1;
+  if (sent == (ssize_t)length
+      && receive_message (status_pair[0], reply, sizeof (reply),
+                          ZYGOTE_SPAWN_TIMEOUT_MS)
+             > 0)
+    {
+      pid = strtol (reply, &end, 10);
+    }
+
+  if (pid <= 0 || end == NULL || *end != '\0')
+    {
+      fprintf (stderr, "Warning: yt-dlp zygote stopped responding; "
+                       "launching yt-dlp directly\n");
+      close (status_pair[0]);
+      zygote_stop ();
+      return -1;
+    }
+
+  zygote_children[zygote_child_count].pid = (pid_t)pid;
+  zygote_children[zygote_child_count].status_fd = status_pair[0];
+  zygote_child_count++;
+  return (pid_t)pid;
+}
+
+/**
+ * Whether a pid belongs to a runner started through the zygote.
+ * @param pid Process id
+ * @return Non-zero for unreaped zygote runners
+ */
+int
+zygote_owns (pid_t pid)
+{
+  return find_child (pid) != NULL;
+}
+
+/**
+ * Descriptor that becomes readable once a runner has exited (the zygote's
+ * counterpart of a pidfd). It stays owned by the registry.
+ * @param pid Runner pid
+ * @return Descriptor, -1 if the pid is not a zygote runner
+ */
+int
+zygote_exit_fd (pid_t pid)
+{
+  ZygoteChild *child = find_child (pid);
+  return child ? child->status_fd : -1;
+}
+
+/**
+ * Collect a runner's exit status without blocking, like
+ * wait4(pid, ..., WNOHANG, ...).
+ * @param pid Runner pid
+ * @param status Receives the wait status
+ * @param usage Receives user/system CPU time (can be NULL)
+ * @return pid once collected, 0 while still running, -1 on error
+ */
+pid_t
+zygote_reap (pid_t pid, int *status, struct rusage *usage)
+{
+  ZygoteChild *child = find_child (pid);
+  if (child == NULL)
+    {
+      errno = ECHILD;
+      return -1;
+    }
+
+  char reply[64];
+  ssize_t received;
+  do
+    {
+      received = recv (child->status_fd, reply, sizeof (reply) - 1,
+                       MSG_DONTWAIT);
+    }
+  while (received == -1 && errno == EINTR);
+  if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      return 0;
+    }
+
+  long long wait_status = SIGKILL, utime = 0, stime = 0;
+  if (received > 0)
+    {
+      reply[received] = '\0';
+      if (sscanf (reply, "%lld %lld %lld", &wait_status, &utime, &stime)
+          != 3)
+        {
+          wait_status = SIGKILL;
+        }
+    }
+  else
+    {
+      // The helper went away before reporting; treat the runner as killed
+      fprintf (stderr, "Warning: yt-dlp zygote exited before reporting "
+                       "process %ld\n",
+               (long)pid);
+    }
+
+  if (status != NULL)
+    {
+      *status = (int)wait_status;
+    }
+  if (usage != NULL)
+    {
+      memset (usage, 0, sizeof (struct rusage));
+      usage->ru_utime.tv_sec = utime / 1000000;
+      usage->ru_utime.tv_usec = utime % 1000000;
+      usage->ru_stime.tv_sec = stime / 1000000;
+      usage->ru_stime.tv_usec = stime % 1000000;
+    }
+
+  close (child->status_fd);
+  *child = zygote_children[--zygote_child_count];
+  return pid;
+}
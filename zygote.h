@@ -0,0 +1,22 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include "ytdl.h"
+
+#include <sys/resource.h>
+
+// Command name whose launches the zygote takes over
+#define ZYGOTE_COMMAND "yt-dlp"
+
+// clang-format off
+int zygote_start(const char *python);
+void zygote_stop(void);
+int zygote_running(void);
+int zygote_handles(const char *command);
+pid_t zygote_spawn(char *const argv[], int stdout_fd, int stderr_fd);
+int zygote_owns(pid_t pid);
+int zygote_exit_fd(pid_t pid);
+pid_t zygote_reap(pid_t pid, int *status, struct rusage *usage);
+// clang-format on
+
+#endif